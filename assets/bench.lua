@@ -0,0 +1,449 @@
+-- Runs the benchmark suites of bench/ and reports their results.
+--
+-- A suite is a module returning a list of {name, fn [, setup]}, where
+-- fn(n) performs n operations and setup, if given, is called once before
+-- the benchmark; a suite that cannot run here returns {skip = reason}
+-- instead. Each benchmark is calibrated so that a trial lasts at least
+-- `mintime' seconds, warmed up, then timed over `trials' trials. Results
+-- give the median and 99th percentile time per operation, the bytes
+-- allocated per operation and the collections run. Runs of the corpus
+-- made apart, as in separate processes, can be merged into one result.
+--
+-- On the host (see bench/run.lua):
+--   build/host/lua bench/run.lua -f csv
+-- In the app, over the REPL:
+--   > bench = require 'bench'
+--   > print(bench.report(bench.run{suites = {'tables'}}, 'text'))
+
+local bench = {}
+
+bench.suites = {
+  'tables', 'strings', 'patterns', 'closures', 'coroutines',
+  'format', 'sort', 'gc', 'bridge',
+}
+
+-- os.clock is processor time; in the app the whole process shares it,
+-- so the monotonic clock of the JVM is preferred there
+local clock, clockname = os.clock, 'os.clock'
+if luajava then
+  local System = luajava.bindClass 'java.lang.System'
+  clock = function() return System:nanoTime() * 1e-9 end
+  clockname = 'System.nanoTime'
+end
+bench.clock = clock
+
+local function trial(fn, n)
+  local a0, c0 = collectgarbage 'allocated', collectgarbage 'cycles'
+  local t0 = clock()
+  fn(n)
+  local t = clock() - t0
+  return t, (collectgarbage 'allocated' - a0) * 1024, collectgarbage 'cycles' - c0
+end
+
+local function calibrate(fn, mintime)
+  local n = 1
+  while true do
+    local t = trial(fn, n)
+    if t >= mintime or n >= 2^30 then return n end
+    if t <= 0 then
+      n = n * 10
+    else
+      -- aim a bit over mintime, growing at most tenfold per try
+      n = math.ceil(n * math.min(10, 1.2 * mintime / t))
+    end
+  end
+end
+
+-- nearest-rank percentile of a sorted list
+local function percentile(sorted, p)
+  return sorted[math.max(1, math.ceil(#sorted * p / 100))]
+end
+
+bench.percentile = percentile
+
+-- sets the median, 99th percentile and minimum of the trial times of a
+-- result, and its run medians if there are none yet
+local function summarize(r)
+  local sorted = {}
+  for i, t in ipairs(r.times) do sorted[i] = t end
+  table.sort(sorted)
+  r.median, r.p99, r.min = percentile(sorted, 50), percentile(sorted, 99), sorted[1]
+  r.runs = r.runs or {r.median}
+  return r
+end
+
+-- Measures one benchmark; times are in seconds per operation. The
+-- operations per trial are calibrated, unless opts.ops gives them by
+-- benchmark name; calibration still runs then, so that the state of the
+-- heap and of the string table is the same as in a calibrated run.
+function bench.measure(name, fn, opts)
+  opts = opts or {}
+  local trials = opts.trials or 11
+  collectgarbage()
+  local n = calibrate(fn, opts.mintime or 0.02)
+  n = opts.ops and opts.ops[name] or n
+  for i = 1, opts.warmup or 2 do trial(fn, n) end
+  collectgarbage()
+  local times, cycles = {}, 0
+  for i = 1, trials do
+    local t, a, c = trial(fn, n)
+    times[i] = t / n
+    cycles = cycles + c
+  end
+  -- what is allocated during a trial depends on where the collector is
+  -- (interned strings are freed and made again, the string table shrinks
+  -- and grows), so allocations are measured apart, each trial starting
+  -- from a full collection with the collector stopped
+  local allocs, alloc = {}, 0
+  for i = 1, opts.alloctrials or 3 do
+    collectgarbage()
+    collectgarbage 'stop'
+    local t, a = trial(fn, n)
+    collectgarbage 'restart'
+    allocs[i] = a / n
+    alloc = alloc + a
+  end
+  collectgarbage()
+  local r = {
+    name = name, ops = n, trials = trials, times = times, allocs = allocs,
+    alloc = alloc / (n * #allocs), cycles = cycles,
+  }
+  return summarize(r)
+end
+
+-- Runs the selected benchmarks. Options: suites (names, all by default),
+-- filter (a pattern the benchmark names must match), trials, warmup,
+-- mintime, ops (see measure) and progress (a function called with each
+-- result).
+function bench.run(opts)
+  opts = opts or {}
+  local results = {}
+  for _, suite in ipairs(opts.suites or bench.suites) do
+    local list = require('bench.' .. suite)
+    if list.skip then
+      results[#results + 1] = {name = suite, skip = list.skip}
+    end
+    for _, b in ipairs(list) do
+      local name = suite .. '.' .. b[1]
+      if not opts.filter or name:find(opts.filter) then
+        if b[3] then b[3]() end
+        local r = bench.measure(name, b[2], opts)
+        results[#results + 1] = r
+        if opts.progress then opts.progress(r) end
+      end
+    end
+  end
+  results.lua = _VERSION
+  results.clock = clockname
+  return results
+end
+
+-- Merges the results of several runs of the same benchmarks into one,
+-- with the trials of all runs and the median of each run in `runs'. The
+-- operation counts are those of the first run.
+function bench.merge(list)
+  local merged, byname = {lua = list[1].lua, clock = list[1].clock}, {}
+  for _, results in ipairs(list) do
+    for _, r in ipairs(results) do
+      local m = byname[r.name]
+      if r.skip then
+        if not m then
+          byname[r.name] = r
+          merged[#merged + 1] = r
+        end
+      elseif not m then
+        m = {name = r.name, ops = r.ops, trials = 0, cycles = 0, times = {}, allocs = {}, runs = {}}
+        byname[r.name] = m
+        merged[#merged + 1] = m
+      end
+      if m and not r.skip then
+        m.trials, m.cycles = m.trials + r.trials, m.cycles + r.cycles
+        for _, t in ipairs(r.times) do m.times[#m.times + 1] = t end
+        for _, a in ipairs(r.allocs) do m.allocs[#m.allocs + 1] = a end
+        for _, t in ipairs(r.runs) do m.runs[#m.runs + 1] = t end
+      end
+    end
+  end
+  for _, m in ipairs(merged) do
+    if not m.skip then
+      local alloc = 0
+      for _, a in ipairs(m.allocs) do alloc = alloc + a end
+      m.alloc = alloc / #m.allocs
+      summarize(m)
+    end
+  end
+  return merged
+end
+
+local columns = {'name', 'ops', 'trials', 'median_ns', 'p99_ns', 'min_ns', 'alloc_bytes', 'gc_cycles'}
+
+local function row(r)
+  return {
+    r.name, r.ops, r.trials,
+    string.format('%.1f', r.median * 1e9), string.format('%.1f', r.p99 * 1e9),
+    string.format('%.1f', r.min * 1e9), string.format('%.1f', r.alloc), r.cycles,
+  }
+end
+
+local function jsonstring(s)
+  return '"' .. s:gsub('[%c"\\]', function(c)
+    return string.format('\\u%04x', c:byte())
+  end) .. '"'
+end
+
+-- Formats results as 'csv', 'json' or 'text' (the default).
+function bench.report(results, format)
+  local out = {}
+  if format == 'csv' then
+    out[1] = table.concat(columns, ',')
+    for _, r in ipairs(results) do
+      if not r.skip then out[#out + 1] = table.concat(row(r), ',') end
+    end
+  elseif format == 'json' then
+    local items = {}
+    for _, r in ipairs(results) do
+      if r.skip then
+        items[#items + 1] = string.format('{"name":%s,"skip":%s}',
+          jsonstring(r.name), jsonstring(r.skip))
+      else
+        local fields, values = {}, row(r)
+        for i, c in ipairs(columns) do
+          local v = values[i]
+          fields[i] = jsonstring(c) .. ':' .. (i == 1 and jsonstring(v) or v)
+        end
+        local times = {}
+        for i, t in ipairs(r.times) do times[i] = string.format('%.1f', t * 1e9) end
+        fields[#fields + 1] = '"times_ns":[' .. table.concat(times, ',') .. ']'
+        items[#items + 1] = '{' .. table.concat(fields, ',') .. '}'
+      end
+    end
+    out[1] = string.format('{"lua":%s,"clock":%s,"results":[\n%s\n]}',
+      jsonstring(results.lua or _VERSION), jsonstring(results.clock or clockname),
+      table.concat(items, ',\n'))
+  else
+    out[1] = string.format('%-32s %10s %10s %12s %6s', 'benchmark', 'median ns', 'p99 ns', 'alloc B/op', 'gc')
+    for _, r in ipairs(results) do
+      if r.skip then
+        out[#out + 1] = string.format('%-32s skipped: %s', r.name, r.skip)
+      else
+        out[#out + 1] = string.format('%-32s %10.1f %10.1f %12.1f %6d',
+          r.name, r.median * 1e9, r.p99 * 1e9, r.alloc, r.cycles)
+      end
+    end
+  end
+  return table.concat(out, '\n') .. '\n'
+end
+
+--
+-- Baselines
+--
+-- A baseline is a Lua file holding the results of previous runs (trial
+-- times and run medians in ns per operation, allocations in bytes per
+-- operation), tagged with a format version; load() gives them back as
+-- run() returns them. compare() tests each benchmark against it on the
+-- medians of the runs, since the trials of one run vary much less than
+-- runs do (the heap, the string table and the processor clock differ
+-- between processes): a change counts only if the 99% confidence interval
+-- of the ratio, by Welch's t-test on the logarithms of the run medians,
+-- lies wholly beyond the threshold, and if every run is beyond every run
+-- of the other side. This needs at least two runs on each side; see
+-- merge() and the -n option of bench/run.lua.
+--
+-- Bytes per operation depend on the number of operations (tables grow
+-- by doubling, strings are interned once), so allocations are only
+-- compared when the run used the operation counts of the baseline (see
+-- ops()), and with the same test on the trial allocations.
+
+bench.BASELINE_VERSION = 3
+
+local function nslist(values)
+  local out = {}
+  for i, t in ipairs(values) do out[i] = string.format('%.1f', t * 1e9) end
+  return table.concat(out, ', ')
+end
+
+function bench.save(results, file)
+  local out = {
+    '-- benchmark baseline, written by bench.save',
+    'return {',
+    string.format('  version = %d, lua = %q, clock = %q, date = %q,',
+      bench.BASELINE_VERSION, results.lua or _VERSION,
+      results.clock or clockname, os.date('!%Y-%m-%dT%H:%M:%SZ')),
+    '  results = {',
+  }
+  for _, r in ipairs(results) do
+    if r.skip then
+      out[#out + 1] = string.format('    {name = %q, skip = %q},', r.name, r.skip)
+    else
+      local allocs = {}
+      for i, a in ipairs(r.allocs) do allocs[i] = string.format('%.1f', a) end
+      out[#out + 1] = string.format('    {name = %q, ops = %d, trials = %d, cycles = %d, alloc = %.1f,',
+        r.name, r.ops, r.trials, r.cycles, r.alloc)
+      out[#out + 1] = string.format('     allocs = {%s}, runs = {%s},',
+        table.concat(allocs, ', '), nslist(r.runs))
+      out[#out + 1] = string.format('     times = {%s}},', nslist(r.times))
+    end
+  end
+  out[#out + 1] = '  },'
+  out[#out + 1] = '}'
+  local f, err = io.open(file, 'w')
+  if not f then return nil, err end
+  f:write(table.concat(out, '\n'), '\n')
+  f:close()
+  return true
+end
+
+function bench.load(file)
+  local chunk, err = loadfile(file)
+  if not chunk then return nil, err end
+  local base = setfenv(chunk, {})()
+  if type(base) ~= 'table' or base.version ~= bench.BASELINE_VERSION then
+    return nil, file .. ': not a version ' .. bench.BASELINE_VERSION .. ' baseline'
+  end
+  local results = {lua = base.lua, clock = base.clock, date = base.date}
+  for i, r in ipairs(base.results) do
+    if not r.skip then
+      for k, t in ipairs(r.times) do r.times[k] = t * 1e-9 end
+      for k, t in ipairs(r.runs) do r.runs[k] = t * 1e-9 end
+      summarize(r)
+    end
+    results[i] = r
+  end
+  return results
+end
+
+-- Returns the operations per trial of a baseline by benchmark name, to be
+-- passed as the ops option of run(), so that allocations can be compared.
+function bench.ops(base)
+  local ops = {}
+  for _, r in ipairs(base) do ops[r.name] = r.ops end
+  return ops
+end
+
+-- two-sided 99% quantiles of Student's t, by degrees of freedom
+local T99 = {
+  63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+  3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+  2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750,
+}
+
+local function stats(values, f)
+  local n, sum, sq = #values, 0, 0
+  for _, v in ipairs(values) do sum = sum + f(v) end
+  local mean = sum / n
+  for _, v in ipairs(values) do sq = sq + (f(v) - mean) ^ 2 end
+  return mean, n > 1 and sq / (n - 1) or 0, n
+end
+
+local function logstats(times)
+  return stats(times, math.log)
+end
+
+local function identity(v) return v end
+
+-- Welch's t-test: the difference of the means of two samples and the
+-- half width of its 99% confidence interval, unbounded unless both have
+-- two values at least
+local function welch(m1, v1, n1, m2, v2, n2)
+  if n1 < 2 or n2 < 2 then return m2 - m1, math.huge end
+  local a, c = v1 / n1, v2 / n2
+  local se = math.sqrt(a + c)
+  local df = (a + c) ^ 2 / ((n1 > 1 and a * a / (n1 - 1) or 0) + (n2 > 1 and c * c / (n2 - 1) or 0))
+  if df ~= df or df < 1 then df = 1 end  -- no variance at all
+  local t = T99[math.floor(df)] or 2.576
+  return m2 - m1, t * se
+end
+
+-- Compares results with a baseline. Returns the list of differences,
+-- each with the geometric means of the run medians in ns (base and new),
+-- their ratio and its confidence interval (low, high), a verdict
+-- ('slower', 'faster', 'same', 'new' or 'missing'), and the number of
+-- regressions. A benchmark run with the operation counts of the
+-- baseline also regresses when its trial allocations are, with 99%
+-- confidence, more than `threshold' (and a byte) above the baseline's.
+function bench.compare(base, results, threshold)
+  threshold = threshold or 0.05
+  local limit = math.log(1 + threshold)
+  local diffs, regressions, seen, byname = {}, 0, {}, {}
+  for _, b in ipairs(base) do
+    if not b.skip then byname[b.name] = b end
+  end
+  for _, r in ipairs(results) do
+    if not r.skip then
+      local b = byname[r.name]
+      local d = {name = r.name, alloc = r.alloc}
+      seen[r.name], seen[r.name:match('^[^.]*')] = true, true
+      if not b then
+        d.verdict = 'new'
+      else
+        local m1, v1, n1 = logstats(b.runs)
+        local m2, v2, n2 = logstats(r.runs)
+        d.base, d.new, d.basealloc = math.exp(m1) * 1e9, math.exp(m2) * 1e9, b.alloc
+        local diff, width = welch(m1, v1, n1, m2, v2, n2)
+        d.ratio = math.exp(diff)
+        d.low, d.high = math.exp(diff - width), math.exp(diff + width)
+        local bmin, bmax = math.min(unpack(b.runs)), math.max(unpack(b.runs))
+        local rmin, rmax = math.min(unpack(r.runs)), math.max(unpack(r.runs))
+        if diff - width > limit and rmin > bmax then
+          d.verdict = 'slower'
+        elseif diff + width < -limit and rmax < bmin then
+          d.verdict = 'faster'
+        else
+          d.verdict = 'same'
+        end
+        if b.ops == r.ops then
+          local a1, w1, k1 = stats(b.allocs, identity)
+          local adiff, awidth = welch(a1, w1, k1, stats(r.allocs, identity))
+          if adiff - awidth > a1 * threshold + 1 then
+            d.allocregressed = true
+          end
+        end
+        if d.verdict == 'slower' or d.allocregressed then
+          regressions = regressions + 1
+        end
+      end
+      diffs[#diffs + 1] = d
+    end
+  end
+  -- benchmarks of the suites run that are gone
+  local missing = {}
+  for name in pairs(byname) do
+    if not seen[name] and seen[name:match('^[^.]*')] then
+      missing[#missing + 1] = name
+    end
+  end
+  table.sort(missing)
+  for _, name in ipairs(missing) do
+    diffs[#diffs + 1] = {name = name, verdict = 'missing'}
+  end
+  return diffs, regressions
+end
+
+-- Formats the differences found by compare(); unless `all' is true, only
+-- the benchmarks that changed are listed.
+function bench.diffreport(diffs, all)
+  local out, counts = {}, {}
+  for _, d in ipairs(diffs) do
+    counts[d.verdict] = (counts[d.verdict] or 0) + 1
+    local flag = d.allocregressed and ' alloc ' .. string.format('%.1f->%.1f B', d.basealloc, d.alloc) or ''
+    if d.ratio and (all or d.verdict ~= 'same' or flag ~= '') then
+      out[#out + 1] = string.format('%-32s %10.1f %10.1f %+7.1f%% [%+.1f%%, %+.1f%%] %s%s',
+        d.name, d.base, d.new, (d.ratio - 1) * 100,
+        (d.low - 1) * 100, (d.high - 1) * 100, d.verdict, flag)
+    elseif not d.ratio then
+      out[#out + 1] = string.format('%-32s %s', d.name, d.verdict)
+    end
+  end
+  local summary = {}
+  for _, v in ipairs{'slower', 'faster', 'same', 'new', 'missing'} do
+    if counts[v] then summary[#summary + 1] = counts[v] .. ' ' .. v end
+  end
+  if #out > 0 then
+    table.insert(out, 1, string.format('%-32s %10s %10s %8s %s',
+      'benchmark', 'base ns', 'new ns', 'change', '99% interval'))
+  end
+  out[#out + 1] = table.concat(summary, ', ')
+  return table.concat(out, '\n') .. '\n'
+end
+
+return bench
@@ -0,0 +1,54 @@
+-- Calls between Lua and Java through luajava and import.lua. Only runs
+-- in the app, or wherever luajava is loaded.
+
+if not luajava then
+  return {skip = 'needs luajava'}
+end
+
+require 'import'
+
+-- resolved by import.lua from java.lang and java.util
+local Math, StringBuilder, ArrayList, Integer = Math, StringBuilder, ArrayList, Integer
+
+return {
+  {'static_call', function(n)
+    local s = 0
+    for i = 1, n do s = s + Math:abs(-i) end
+    return s
+  end},
+
+  {'method_call', function(n)
+    local sb = luajava.new(StringBuilder)
+    for i = 1, n do
+      sb:append('x')
+      if i % 1000 == 0 then sb:setLength(0) end
+    end
+  end},
+
+  {'field_read', function(n)
+    local m
+    for i = 1, n do m = Integer.MAX_VALUE end
+    return m
+  end},
+
+  {'new_object', function(n)
+    for i = 1, n do luajava.new(StringBuilder) end
+  end},
+
+  {'import_call', function(n)
+    -- constructors called through import.lua's __call
+    local list
+    for i = 1, n do list = ArrayList() end
+    return list
+  end},
+
+  -- each operation iterates a list of 100 elements
+  {'collection', function(n)
+    local list, s = luajava.new(ArrayList), 0
+    for i = 1, 100 do list:add(i) end
+    for k = 1, n do
+      for v in enum(list) do s = s + v end
+    end
+    return s
+  end},
+}
@@ -0,0 +1,64 @@
+-- Functions: closures, upvalues, method calls and varargs.
+
+local Point = {}
+Point.__index = Point
+
+function Point.new(x, y)
+  return setmetatable({x = x, y = y}, Point)
+end
+
+function Point:add(o)
+  return Point.new(self.x + o.x, self.y + o.y)
+end
+
+function Point:len2()
+  return self.x * self.x + self.y * self.y
+end
+
+return {
+  {'call', function(n)
+    local function f(a, b) return a + b end
+    local s = 0
+    for i = 1, n do s = f(s, i) end
+    return s
+  end},
+
+  {'closure_create', function(n)
+    local f
+    for i = 1, n do f = function() return i end end
+    return f
+  end},
+
+  {'upvalue_counter', function(n)
+    local count = 0
+    local function inc() count = count + 1 end
+    for i = 1, n do inc() end
+    return count
+  end},
+
+  {'method_call', function(n)
+    local p, s = Point.new(3, 4), 0
+    for i = 1, n do s = s + p:len2() end
+    return s
+  end},
+
+  {'objects', function(n)
+    local p, d = Point.new(0, 0), Point.new(1, 1)
+    for i = 1, n do p = p:add(d) end
+    return p
+  end},
+
+  {'varargs', function(n)
+    local function count(...) return select('#', ...) end
+    local s = 0
+    for i = 1, n do s = s + count(i, i, i) end
+    return s
+  end},
+
+  {'recursion', function(n)
+    local function fib(k) if k < 2 then return k end return fib(k - 1) + fib(k - 2) end
+    local s = 0
+    for i = 1, n do s = s + fib(10) end
+    return s
+  end},
+}
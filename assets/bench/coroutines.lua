@@ -0,0 +1,40 @@
+-- Coroutine creation and switching.
+
+return {
+  {'resume_yield', function(n)
+    local co = coroutine.create(function()
+      while true do coroutine.yield() end
+    end)
+    for i = 1, n do coroutine.resume(co) end
+  end},
+
+  {'wrap_generator', function(n)
+    local gen = coroutine.wrap(function()
+      local i = 0
+      while true do i = i + 1; coroutine.yield(i) end
+    end)
+    local s = 0
+    for i = 1, n do s = s + gen() end
+    return s
+  end},
+
+  {'create', function(n)
+    local f = function(x) return x end
+    for i = 1, n do coroutine.resume(coroutine.create(f), i) end
+  end},
+
+  -- producer/consumer pipeline passing values through a filter
+  {'pipeline', function(n)
+    local producer = coroutine.wrap(function()
+      for i = 1, n do coroutine.yield(i) end
+      coroutine.yield(nil)
+    end)
+    local filter = coroutine.wrap(function()
+      for v in producer do coroutine.yield(v * 2) end
+      coroutine.yield(nil)
+    end)
+    local s = 0
+    for v in filter do s = s + v end
+    return s
+  end},
+}
@@ -0,0 +1,35 @@
+-- string.format conversions.
+
+local format = string.format
+
+return {
+  {'integer', function(n)
+    local s
+    for i = 1, n do s = format('%d', i) end
+    return s
+  end},
+
+  {'float', function(n)
+    local s
+    for i = 1, n do s = format('%8.3f', i / 7) end
+    return s
+  end},
+
+  {'string', function(n)
+    local s
+    for i = 1, n do s = format('%s: %s', 'name', 'value') end
+    return s
+  end},
+
+  {'quoted', function(n)
+    local s
+    for i = 1, n do s = format('%q', 'a "quoted"\nline') end
+    return s
+  end},
+
+  {'mixed', function(n)
+    local s
+    for i = 1, n do s = format('[%5d] %-10s %6.2f%% %x', i, 'item', i / 3, i) end
+    return s
+  end},
+}
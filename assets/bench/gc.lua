@@ -0,0 +1,41 @@
+-- Garbage collector load: short lived garbage, with and without a large
+-- live heap, and finalizers.
+
+local live
+
+-- setup keeping `size' objects alive
+local function keep(size)
+  return function()
+    live = {}
+    for i = 1, size do live[i] = {i, tostring(i)} end
+  end
+end
+
+return {
+  {'churn_tables', function(n)
+    for i = 1, n do local t = {i, i, i} end
+  end, keep(0)},
+
+  {'churn_strings', function(n)
+    for i = 1, n do local s = 'garbage ' .. i end
+  end},
+
+  -- the same garbage while 100000 objects stay alive, so each cycle
+  -- traverses a large heap
+  {'churn_live_heap', function(n)
+    for i = 1, n do local t = {i, i, i} end
+  end, keep(100000)},
+
+  -- each operation is a collection with 10000 live objects
+  {'full_collect', function(n)
+    for k = 1, n do collectgarbage() end
+  end, keep(10000)},
+
+  -- proxies with finalizers
+  {'userdata_gc', function(n)
+    for i = 1, n do
+      local u = newproxy(true)
+      getmetatable(u).__gc = function() end
+    end
+  end, keep(0)},
+}
@@ -0,0 +1,47 @@
+-- Pattern matching with the string library.
+
+local text = string.rep('The quick brown fox jumps over the lazy dog 42 times. ', 20)
+
+return {
+  {'find_plain', function(n)
+    local c = 0
+    for i = 1, n do
+      if text:find('lazy dog', 1, true) then c = c + 1 end
+    end
+    return c
+  end},
+
+  {'find_pattern', function(n)
+    local c = 0
+    for i = 1, n do
+      if text:find('%d+ times') then c = c + 1 end
+    end
+    return c
+  end},
+
+  {'match_captures', function(n)
+    local a, b
+    for i = 1, n do a, b = ('key' .. i .. '=value'):match('^(%w+)=(%w+)$') end
+    return a, b
+  end},
+
+  {'gmatch_words', function(n)
+    local c = 0
+    for i = 1, n do
+      for w in ('one two three four five six'):gmatch('%a+') do c = c + 1 end
+    end
+    return c
+  end},
+
+  {'gsub_replace', function(n)
+    local s
+    for i = 1, n do s = ('a-b-c-d-e-f'):gsub('-', '+') end
+    return s
+  end},
+
+  {'gsub_function', function(n)
+    local s
+    for i = 1, n do s = ('$a and $b'):gsub('%$(%w+)', {a = 'x', b = 'y'}) end
+    return s
+  end},
+}
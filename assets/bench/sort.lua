@@ -0,0 +1,37 @@
+-- table.sort on numbers and strings, with and without a comparator.
+
+local function numbers(n)
+  math.randomseed(42)
+  local t = {}
+  for i = 1, n do t[i] = math.random(1, 1000000) end
+  return t
+end
+
+local function greater(a, b) return a > b end
+
+-- each operation sorts an array of 1000 elements
+return {
+  {'numbers', function(n)
+    for k = 1, n do table.sort(numbers(1000)) end
+  end},
+
+  {'comparator', function(n)
+    for k = 1, n do table.sort(numbers(1000), greater) end
+  end},
+
+  {'strings', function(n)
+    for k = 1, n do
+      local t = numbers(1000)
+      for i = 1, #t do t[i] = tostring(t[i]) end
+      table.sort(t)
+    end
+  end},
+
+  {'records', function(n)
+    for k = 1, n do
+      local t = numbers(1000)
+      for i = 1, #t do t[i] = {key = t[i]} end
+      table.sort(t, function(a, b) return a.key < b.key end)
+    end
+  end},
+}
@@ -0,0 +1,53 @@
+-- String building and manipulation.
+
+return {
+  {'concat_op', function(n)
+    local s
+    for i = 1, n do s = 'item ' .. i .. ' of ' .. n end
+    return s
+  end},
+
+  {'buffer', function(n)
+    local buf = {}
+    for i = 1, n do buf[#buf + 1] = tostring(i) end
+    return table.concat(buf, ',')
+  end},
+
+  {'append_small', function(n)
+    -- repeated s = s .. x, restarted to stay linear
+    local s = ''
+    for i = 1, n do
+      s = s .. 'x'
+      if #s > 64 then s = '' end
+    end
+    return s
+  end},
+
+  {'sub_byte', function(n)
+    local s, c = string.rep('abcdefghij', 10), 0
+    for i = 1, n do
+      local k = i % 100 + 1
+      c = c + s:sub(k, k):byte()
+    end
+    return c
+  end},
+
+  {'upper_rep', function(n)
+    local s
+    for i = 1, n do s = string.upper(string.rep('ab', 8)) end
+    return s
+  end},
+
+  {'tostring_number', function(n)
+    local s
+    for i = 1, n do s = tostring(i + 0.5) end
+    return s
+  end},
+
+  {'interning', function(n)
+    -- hashes and interns new strings
+    local t = {}
+    for i = 1, n do t[1] = 'key' .. i end
+    return t
+  end},
+}
@@ -0,0 +1,69 @@
+-- Table heavy code: construction, access and traversal of arrays and
+-- hashes.
+
+return {
+  {'array_fill', function(n)
+    local t = {}
+    for i = 1, n do t[i] = i end
+  end},
+
+  {'array_read', function(n)
+    local t, s = {}, 0
+    for i = 1, 1000 do t[i] = i end
+    for i = 1, n do s = s + t[i % 1000 + 1] end
+    return s
+  end},
+
+  {'hash_fill', function(n)
+    local t = {}
+    for i = 1, n do t['k' .. (i % 5000)] = i end
+  end},
+
+  {'field_access', function(n)
+    local p = {x = 1, y = 2, z = 3}
+    for i = 1, n do p.x = p.y + p.z end
+  end},
+
+  {'constructor', function(n)
+    local t
+    for i = 1, n do t = {x = i, y = i, z = i} end
+    return t
+  end},
+
+  {'ipairs', function(n)
+    local t, s = {}, 0
+    for i = 1, n do t[i] = i end
+    for _, v in ipairs(t) do s = s + v end
+    return s
+  end},
+
+  {'pairs', function(n)
+    local t, s = {}, 0
+    for i = 1, n do t[i * 7 + 0.5] = i end
+    for _, v in pairs(t) do s = s + v end
+    return s
+  end},
+
+  {'insert_remove', function(n)
+    local t = {}
+    for i = 1, n do
+      table.insert(t, i)
+      if i % 3 == 0 then table.remove(t) end
+    end
+  end},
+
+  -- a records workload: build, group and aggregate
+  {'records', function(n)
+    local rows, groups = {}, {}
+    for i = 1, n do
+      rows[i] = {id = i, group = 'g' .. (i % 16), value = i % 97}
+    end
+    for _, r in ipairs(rows) do
+      local g = groups[r.group]
+      if not g then g = {count = 0, sum = 0}; groups[r.group] = g end
+      g.count = g.count + 1
+      g.sum = g.sum + r.value
+    end
+    return groups
+  end},
+}
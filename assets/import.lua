@@ -84,13 +84,10 @@ function proxy (classname,obj)
 end
 
 
-function enum(e)
-   --local e = o:GetEnumerator()
-   return function()
-      if e:hasMoreElements() then
-        return e:nextElement()
-     end
-   end
+-- iterates over an Enumeration, Iterator, Iterable or array; the elements
+-- are fetched from Java in chunks (see luajava.iter)
+function enum(e,chunk)
+   return luajava.iter(e,chunk)
 end
 
 function dump (t)
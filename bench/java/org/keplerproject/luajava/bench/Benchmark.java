@@ -0,0 +1,59 @@
+package org.keplerproject.luajava.bench;
+
+/**
+ * A benchmark run by {@link Harness}. The harness calls {@link #run(int)}
+ * with an operation count chosen so that one iteration lasts about the
+ * requested time, and reports the average time per operation.
+ */
+public abstract class Benchmark
+{
+	/**
+	 * Keeps results alive, so the JIT cannot drop the work producing them.
+	 */
+	private static volatile Object sink;
+
+	private final String name;
+
+	protected Benchmark(String name)
+	{
+		this.name = name;
+	}
+
+	public String getName()
+	{
+		return name;
+	}
+
+	/**
+	 * Prepares the benchmark, typically opening a LuaState. Not measured.
+	 */
+	public void setUp() throws Exception
+	{
+	}
+
+	/**
+	 * Releases what {@link #setUp()} acquired. Not measured.
+	 */
+	public void tearDown() throws Exception
+	{
+	}
+
+	/**
+	 * Performs <code>ops</code> operations.
+	 */
+	public abstract void run(int ops) throws Exception;
+
+	/**
+	 * Consumes a result of the measured code.
+	 */
+	protected static void consume(Object value)
+	{
+		sink = value;
+	}
+
+	protected static void consume(double value)
+	{
+		if (value == Double.MIN_VALUE)
+			sink = null;
+	}
+}
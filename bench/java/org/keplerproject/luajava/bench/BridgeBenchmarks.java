@@ -0,0 +1,181 @@
+package org.keplerproject.luajava.bench;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import org.keplerproject.luajava.JavaFunction;
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaObject;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+
+/**
+ * Benchmarks of the crossings between Java and Lua: LuaState natives,
+ * {@link LuaObject#call}, {@link JavaFunction} callbacks and the
+ * reflective dispatch of methods, fields and constructors.
+ */
+public class BridgeBenchmarks
+{
+	/**
+	 * Object used by the reflective benchmarks.
+	 */
+	public static class Target
+	{
+		public int count;
+
+		public int add(int x)
+		{
+			count += x;
+			return count;
+		}
+	}
+
+	/**
+	 * Base of the benchmarks needing a state, opened with the standard
+	 * libraries and running <code>script</code>.
+	 */
+	static abstract class StateBenchmark extends Benchmark
+	{
+		protected LuaState L;
+		private final String script;
+
+		StateBenchmark(String name, String script)
+		{
+			super(name);
+			this.script = script;
+		}
+
+		public void setUp() throws Exception
+		{
+			L = LuaStateFactory.newLuaState();
+			L.openLibs();
+			prepare();
+			if (script != null && L.LdoString(script) != 0)
+				throw new LuaException(L.toString(-1));
+		}
+
+		/**
+		 * Sets globals needed by the script.
+		 */
+		protected void prepare() throws LuaException
+		{
+		}
+
+		public void tearDown()
+		{
+			L.close();
+		}
+	}
+
+	/**
+	 * Runs the Lua function <code>loop(n)</code> of its script once per
+	 * iteration, so the crossings measured are those made from Lua.
+	 */
+	static class LoopBenchmark extends StateBenchmark
+	{
+		private LuaObject loop;
+
+		LoopBenchmark(String name, String body)
+		{
+			super(name, "function loop(n) " + body + " end");
+		}
+
+		public void setUp() throws Exception
+		{
+			super.setUp();
+			loop = L.getLuaObject("loop");
+		}
+
+		public void run(int ops) throws LuaException
+		{
+			loop.call(new Object[] { new Integer(ops) });
+		}
+	}
+
+	public static List<Benchmark> all()
+	{
+		List<Benchmark> list = new ArrayList<Benchmark>();
+
+		list.add(new StateBenchmark("LuaState.pushPop", null)
+		{
+			public void run(int ops)
+			{
+				for (int i = 0; i < ops; i++)
+				{
+					L.pushNumber(i);
+					L.pop(1);
+				}
+			}
+		});
+
+		list.add(new StateBenchmark("LuaState.getGlobal", "x = 42")
+		{
+			public void run(int ops)
+			{
+				for (int i = 0; i < ops; i++)
+				{
+					L.getGlobal("x");
+					consume(L.toNumber(-1));
+					L.pop(1);
+				}
+			}
+		});
+
+		list.add(new StateBenchmark("LuaObject.call", "function inc(x) return x + 1 end")
+		{
+			private LuaObject inc;
+
+			public void setUp() throws Exception
+			{
+				super.setUp();
+				inc = L.getLuaObject("inc");
+			}
+
+			public void run(int ops) throws LuaException
+			{
+				Object[] args = { new Double(1) };
+				for (int i = 0; i < ops; i++)
+					consume(inc.call(args));
+			}
+		});
+
+		list.add(new LoopBenchmark("JavaFunction.call", "for i = 1, n do jf(i) end")
+		{
+			protected void prepare() throws LuaException
+			{
+				new JavaFunction(L)
+				{
+					public int execute()
+					{
+						L.pushNumber(L.toNumber(2) + 1);
+						return 1;
+					}
+				}.register("jf");
+			}
+		});
+
+		list.add(new LoopBenchmark("Reflect.method", "local t = target for i = 1, n do t:add(1) end")
+		{
+			protected void prepare()
+			{
+				L.pushJavaObject(new Target());
+				L.setGlobal("target");
+			}
+		});
+
+		list.add(new LoopBenchmark("Reflect.field", "local t, c = target for i = 1, n do c = t.count end")
+		{
+			protected void prepare()
+			{
+				L.pushJavaObject(new Target());
+				L.setGlobal("target");
+			}
+		});
+
+		list.add(new LoopBenchmark("Reflect.new",
+				"local cls = luajava.bindClass('java.lang.Object') "
+				+ "for i = 1, n do luajava.new(cls) end"));
+
+		return list;
+	}
+}
@@ -0,0 +1,159 @@
+package org.keplerproject.luajava.bench;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * A small JMH-like harness for the benchmarks of the bridge, run on a
+ * desktop JVM against the host build of libluajava (see the Makefile at
+ * the top of the repository).
+ * <p>
+ * Each benchmark is calibrated, warmed up, then measured over several
+ * iterations; the score is the mean time per operation, with the error
+ * of a 99.9% confidence interval as JMH reports it.
+ * <pre>
+ * Harness [-wi warmups] [-i iterations] [-r millis] [-l] [name...]
+ * </pre>
+ * Names select benchmarks containing them; all run by default.
+ */
+public class Harness
+{
+	private int warmups = 5;
+	private int iterations = 10;
+	private long millis = 200;
+
+	/* two-sided 99.9% quantiles of Student's t, by degrees of freedom */
+	private static final double[] T999 = {
+		636.62, 31.60, 12.92, 8.61, 6.87, 5.96, 5.41, 5.04, 4.78, 4.59,
+		4.44, 4.32, 4.22, 4.14, 4.07, 4.01, 3.97, 3.92, 3.88, 3.85,
+		3.82, 3.79, 3.77, 3.75, 3.73, 3.71, 3.69, 3.67, 3.66, 3.65
+	};
+
+	public static void main(String[] args) throws Exception
+	{
+		Harness harness = new Harness();
+		List<String> filters = new ArrayList<String>();
+		boolean list = false;
+
+		for (int i = 0; i < args.length; i++)
+		{
+			if (args[i].equals("-wi") && i + 1 < args.length)
+				harness.warmups = Integer.parseInt(args[++i]);
+			else if (args[i].equals("-i") && i + 1 < args.length)
+				harness.iterations = Integer.parseInt(args[++i]);
+			else if (args[i].equals("-r") && i + 1 < args.length)
+				harness.millis = Long.parseLong(args[++i]);
+			else if (args[i].equals("-l"))
+				list = true;
+			else if (args[i].startsWith("-"))
+			{
+				System.err.println("usage: Harness [-wi warmups] [-i iterations] [-r millis] [-l] [name...]");
+				System.exit(1);
+			}
+			else
+				filters.add(args[i]);
+		}
+
+		List<Benchmark> selected = new ArrayList<Benchmark>();
+		for (Benchmark b : BridgeBenchmarks.all())
+		{
+			if (matches(b.getName(), filters))
+				selected.add(b);
+		}
+
+		if (list)
+		{
+			for (Benchmark b : selected)
+				System.out.println(b.getName());
+			return;
+		}
+
+		System.out.println(String.format("%-32s %5s %12s %10s  %s",
+				"Benchmark", "Cnt", "Score", "Error", "Units"));
+		for (Benchmark b : selected)
+			harness.measure(b);
+	}
+
+	private static boolean matches(String name, List<String> filters)
+	{
+		if (filters.isEmpty())
+			return true;
+		for (String f : filters)
+		{
+			if (name.indexOf(f) >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Runs one benchmark and prints its score.
+	 */
+	public void measure(Benchmark b) throws Exception
+	{
+		b.setUp();
+		try
+		{
+			int ops = calibrate(b);
+			for (int i = 0; i < warmups; i++)
+				b.run(ops);
+
+			double[] scores = new double[iterations];
+			for (int i = 0; i < iterations; i++)
+			{
+				long start = System.nanoTime();
+				b.run(ops);
+				scores[i] = (double) (System.nanoTime() - start) / ops;
+			}
+			report(b.getName(), scores);
+		}
+		finally
+		{
+			b.tearDown();
+		}
+	}
+
+	/**
+	 * Finds how many operations last about <code>millis</code>.
+	 */
+	private int calibrate(Benchmark b) throws Exception
+	{
+		long target = millis * 1000000L;
+		int ops = 1;
+		for (;;)
+		{
+			long start = System.nanoTime();
+			b.run(ops);
+			long elapsed = System.nanoTime() - start;
+			if (elapsed >= target / 10 || ops >= Integer.MAX_VALUE / 2)
+			{
+				double perOp = (double) Math.max(elapsed, 1) / ops;
+				return (int) Math.max(1, Math.min(Integer.MAX_VALUE, target / perOp));
+			}
+			ops *= 2;
+		}
+	}
+
+	private static void report(String name, double[] scores)
+	{
+		int n = scores.length;
+		double mean = 0;
+		for (int i = 0; i < n; i++)
+			mean += scores[i];
+		mean /= n;
+
+		double error = Double.NaN;
+		if (n > 1)
+		{
+			double var = 0;
+			for (int i = 0; i < n; i++)
+				var += (scores[i] - mean) * (scores[i] - mean);
+			var /= n - 1;
+			double t = n - 1 <= T999.length ? T999[n - 2] : 3.29;
+			error = t * Math.sqrt(var / n);
+		}
+
+		System.out.println(String.format("%-32s %5d %12.3f %10s  ns/op",
+				name, n, mean, Double.isNaN(error) ? "" : String.format("\u00b1 %.3f", error)));
+	}
+}
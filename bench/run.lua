@@ -0,0 +1,166 @@
+-- Runs the benchmark corpus (assets/bench) with the standalone interpreter
+-- of the host build:
+--
+--   build/host/lua bench/run.lua [options] [pattern]
+--
+--   -s suite    runs only this suite (may be repeated)
+--   -t trials   timed trials per benchmark (11)
+--   -m seconds  minimum duration of a trial (0.02)
+--   -n runs     runs the corpus in this many processes and merges their
+--               results (1, or 5 with -w, -c or -b)
+--   -f format   text, csv or json (text)
+--   -o file     writes the report to file instead of stdout
+--   -w file     saves the results as a baseline
+--   -c file     compares the results with a baseline, printing the
+--               changes; exits with status 1 on any regression. The
+--               benchmarks run with the operation counts of the
+--               baseline, so that allocations per operation compare
+--   -b lua      compares with the corpus run by another interpreter, as
+--               the build of the tree before a change, in processes
+--               alternating with those of this one; exits as -c does
+--   -p file     runs the benchmarks with the operation counts of a
+--               baseline
+--   -r percent  smallest change counted by -c or -b (5)
+--   -a          lists all benchmarks in the comparison, not just changes
+--
+-- A pattern selects the benchmarks whose name (suite.name) matches it.
+--
+-- A change only counts when it holds across runs, so -w, -c and -b run
+-- the corpus in several processes: the trials of one process vary much
+-- less than processes do. With more than one run, the first one
+-- calibrates the operation counts and the others reuse them. A baseline
+-- file cannot tell a change from the machine running slower than when it
+-- was recorded; -b can, since both sides run in turns.
+
+local dir = arg[0]:match('^(.-)[^/]*$')
+package.path = dir .. '../assets/?.lua;' .. package.path
+
+local bench = require 'bench'
+
+local opts, format, output = {}, 'text', nil
+local save, check, against, opsfile, threshold, all, runs
+-- the options given again to the processes of each run
+local passed = {}
+local i = 1
+while arg[i] do
+  local a, v = arg[i], arg[i + 1]
+  if a == '-s' and v then
+    opts.suites = opts.suites or {}
+    table.insert(opts.suites, v)
+    passed[#passed + 1], passed[#passed + 2] = a, v
+    i = i + 1
+  elseif a == '-t' and v then
+    opts.trials = tonumber(v)
+    passed[#passed + 1], passed[#passed + 2] = a, v
+    i = i + 1
+  elseif a == '-m' and v then
+    opts.mintime = tonumber(v)
+    passed[#passed + 1], passed[#passed + 2] = a, v
+    i = i + 1
+  elseif a == '-n' and v then runs = tonumber(v); i = i + 1
+  elseif a == '-f' and v then format = v; i = i + 1
+  elseif a == '-o' and v then output = v; i = i + 1
+  elseif a == '-w' and v then save = v; i = i + 1
+  elseif a == '-c' and v then check = v; i = i + 1
+  elseif a == '-b' and v then against = v; i = i + 1
+  elseif a == '-p' and v then opsfile = v; i = i + 1
+  elseif a == '-r' and v then threshold = tonumber(v) / 100; i = i + 1
+  elseif a == '-a' then all = true
+  elseif a:sub(1, 1) == '-' then
+    io.stderr:write('usage: lua bench/run.lua [-s suite] [-t trials] [-m seconds] [-n runs] [-f text|csv|json]\n',
+      '                         [-o file] [-w baseline] [-c baseline | -b lua [-r percent] [-a]]\n',
+      '                         [-p baseline] [pattern]\n')
+    os.exit(1)
+  else
+    opts.filter = a
+    passed[#passed + 1] = a
+  end
+  i = i + 1
+end
+if check and against then
+  io.stderr:write('-c and -b cannot be used together\n')
+  os.exit(1)
+end
+runs = runs or ((save or check or against) and 5 or 1)
+
+local base
+if check then
+  base = assert(bench.load(check))
+  opsfile = opsfile or check
+end
+if opsfile then
+  opts.ops = bench.ops(assert(bench.load(opsfile)))
+end
+
+local function quote(s)
+  return "'" .. s:gsub("'", "'\\''") .. "'"
+end
+
+-- runs the corpus in a new process of this interpreter, or of another
+-- one, returning its results and the baseline file holding them
+local function runapart(n, opsfrom, interpreter)
+  if not interpreter then
+    local first = 0
+    while arg[first - 1] do first = first - 1 end
+    interpreter = arg[first]
+  end
+  local file = os.tmpname()
+  local cmd = {quote(interpreter), quote(arg[0]), '-n 1 -w', quote(file)}
+  if opsfrom then cmd[#cmd + 1] = '-p ' .. quote(opsfrom) end
+  for _, a in ipairs(passed) do cmd[#cmd + 1] = quote(a) end
+  io.stderr:write('run ', n, ' of ', runs, interpreter == against and ' (' .. against .. ')' or '', '\n')
+  local status = os.execute(table.concat(cmd, ' ') .. ' > /dev/null')
+  local results, err = bench.load(file)
+  if status ~= 0 or not results then
+    os.remove(file)
+    error('run ' .. n .. ' failed' .. (err and ': ' .. err or ''))
+  end
+  return results, file
+end
+
+local results
+if against then
+  local list, baselist, files = {}, {}, {}
+  for n = 1, runs do
+    baselist[n], files[#files + 1] = runapart(n, opsfile or files[1], against)
+    list[n], files[#files + 1] = runapart(n, opsfile or files[1])
+  end
+  for _, file in ipairs(files) do os.remove(file) end
+  base, results = bench.merge(baselist), bench.merge(list)
+elseif runs > 1 then
+  local list, files = {}, {}
+  for n = 1, runs do
+    list[n], files[n] = runapart(n, opsfile or files[1])
+  end
+  for _, file in ipairs(files) do os.remove(file) end
+  results = bench.merge(list)
+else
+  if output or check then
+    opts.progress = function(r) io.stderr:write(r.name, '\n') end
+  end
+  results = bench.run(opts)
+end
+
+local report = bench.report(results, format)
+if output then
+  local f = assert(io.open(output, 'w'))
+  f:write(report)
+  f:close()
+elseif not (check or against) then
+  io.write(report)
+end
+
+if save then
+  assert(bench.save(results, save))
+end
+
+if check or against then
+  if base.clock ~= results.clock then
+    io.stderr:write('warning: baseline measured with ', base.clock, ', not ', results.clock, '\n')
+  end
+  local diffs, regressions = bench.compare(base, results, threshold)
+  io.write(bench.diffreport(diffs, all))
+  if regressions > 0 then
+    os.exit(1)
+  end
+end
@@ -28,7 +28,12 @@ local line = io.read()
 while line do
   log:write(line,'\n')
   local cmd,file = line:match '^%.(.)%s+(.+)$'
-  if file then
+  local out
+  if cmd == 'p' then
+    -- .p start [time|count] [interval], .p stop [file]
+    out = file:match '^stop%s+(%S+)'
+    line = '--profile:'..file
+  elseif file then
     local mod
     if cmd == 'm' then
       mod = file
@@ -47,6 +52,12 @@ while line do
   if line then
     local res = eval(line)
     log:write(res,'\n')
+    if out then
+      local f = io.open(out,'w')
+      f:write(res)
+      f:close()
+      res = 'wrote '..out..'\n'
+    end
     io.write(res)
   else
     print(err)
@@ -775,11 +775,15 @@ LUA_API int lua_setfenv (lua_State *L, int idx) {
 
 LUA_API void lua_call (lua_State *L, int nargs, int nresults) {
   StkId func;
+  lua_State *running;
   lua_lock(L);
   api_checknelems(L, nargs+1);
   checkresults(L, nargs, nresults);
   func = L->top - (nargs+1);
+  running = G(L)->running;
+  luaD_setrunning(L, L);
   luaD_call(L, func, nresults);
+  luaD_setrunning(L, running);
   adjustresults(L, nresults);
   lua_unlock(L);
 }
@@ -923,6 +927,30 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = cast_int(g->totalbytes & 0x3ff);
       break;
     }
+    case LUA_GCALLOC: {
+      res = cast_int(g->totalalloc / 1024);
+      break;
+    }
+    case LUA_GCALLOCB: {
+      res = cast_int(g->totalalloc - 1024.0 * cast_int(g->totalalloc / 1024));
+      break;
+    }
+    case LUA_GCCYCLES: {
+      res = cast_int(g->gccycles);
+      break;
+    }
+    case LUA_GCTIMING: {
+      res = g->gctiming;
+      g->gctiming = cast_byte(data != 0);
+      break;
+    }
+    case LUA_GCRESETSTATS: {
+      memset(&g->gcstats, 0, sizeof(g->gcstats));
+      g->gcstatsalloc = g->totalalloc;
+      g->gcstatsfreed = g->totalfreed;
+      g->gcstatscycles = g->gccycles;
+      break;
+    }
     case LUA_GCSTEP: {
       lu_mem a = (cast(lu_mem, data) << 10);
       if (a <= g->totalbytes)
@@ -955,6 +983,24 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+/*
+** Statistics of the collector since the state opened or since
+** LUA_GCRESETSTATS. Steps and phases are always counted; their times
+** only while LUA_GCTIMING is on, which reads the clock a few times per
+** step.
+*/
+LUA_API void lua_gcstats (lua_State *L, lua_GCStats *s) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  *s = g->gcstats;
+  s->cycles = g->gccycles - g->gcstatscycles;
+  s->allocated = g->totalalloc - g->gcstatsalloc;
+  s->freed = g->totalfreed - g->gcstatsfreed;
+  lua_unlock(L);
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1022,6 +1068,96 @@ LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
 }
 
 
+/*
+** The tracer is told when the collector steps and when modules load, with
+** a LUA_TRACEBEGIN event before and a LUA_TRACEEND event after. Errors
+** raised in between skip the LUA_TRACEEND event. As it may be called
+** from the collector, the tracer must not allocate memory of the state.
+*/
+LUA_API void lua_settracer (lua_State *L, lua_Tracer f, void *ud) {
+  lua_lock(L);
+  G(L)->tracerud = ud;
+  G(L)->tracer = f;
+  lua_unlock(L);
+}
+
+
+LUA_API lua_Tracer lua_gettracer (lua_State *L, void **ud) {
+  lua_Tracer f;
+  lua_lock(L);
+  if (ud) *ud = G(L)->tracerud;
+  f = G(L)->tracer;
+  lua_unlock(L);
+  return f;
+}
+
+
+/*
+** The heap hook is told of new objects sampled about every `interval'
+** bytes allocated, with a LUA_HEAPALLOC event, and of their freeing,
+** with a LUA_HEAPFREE event; it must not allocate memory of the state.
+** With an interval of 0 it is only told of the objects sampled before.
+*/
+LUA_API void lua_setheaphook (lua_State *L, lua_HeapHook f, void *ud,
+                              size_t interval) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  g->heaphookud = ud;
+  g->heaphook = f;
+  g->heapinterval = interval;
+  luaC_setheapnext(L);
+  lua_unlock(L);
+}
+
+
+LUA_API lua_HeapHook lua_getheaphook (lua_State *L, void **ud) {
+  lua_HeapHook f;
+  lua_lock(L);
+  if (ud) *ud = G(L)->heaphookud;
+  f = G(L)->heaphook;
+  lua_unlock(L);
+  return f;
+}
+
+
+LUA_API void lua_heapwalk (lua_State *L, lua_HeapWalker f, void *ud) {
+  lua_lock(L);
+  luaC_heapwalk(L, f, ud);
+  lua_unlock(L);
+}
+
+
+/*
+** Pushes the instructions counted since the state opened or was last
+** reset, with the `top' functions that ran the most, and returns 1.
+** Without LUA_USE_VMSTATS nothing is counted: returns 0, pushing nothing.
+*/
+LUA_API int lua_vmstats (lua_State *L, int top) {
+#if defined(LUA_USE_VMSTATS)
+  lua_lock(L);
+  luaC_checkGC(L);
+  luaG_vmstats(L, top);
+  lua_unlock(L);
+  return 1;
+#else
+  UNUSED(L); UNUSED(top);
+  return 0;
+#endif
+}
+
+
+LUA_API void lua_resetvmstats (lua_State *L) {
+#if defined(LUA_USE_VMSTATS)
+  lua_lock(L);
+  luaG_resetvmstats(L);
+  lua_unlock(L);
+#else
+  UNUSED(L);
+#endif
+}
+
+
 LUA_API void *lua_newuserdata (lua_State *L, size_t size) {
   Udata *u;
   lua_lock(L);
@@ -190,24 +190,83 @@ static int luaB_gcinfo (lua_State *L) {
 }
 
 
+static void setgcfield (lua_State *L, const char *k, lua_Number v) {
+  lua_pushnumber(L, v);
+  lua_setfield(L, -2, k);
+}
+
+
+static int gcstats (lua_State *L) {
+  static const char *const phases[LUA_GCPHASES] = {"propagate", "atomic",
+    "sweepstring", "sweep", "finalize"};
+  lua_GCStats s;
+  int i;
+  lua_gcstats(L, &s);
+  lua_createtable(L, 0, 11);
+  setgcfield(L, "cycles", (lua_Number)s.cycles);
+  setgcfield(L, "steps", (lua_Number)s.steps);
+  setgcfield(L, "finalized", (lua_Number)s.finalized);
+  setgcfield(L, "allocated", s.allocated);
+  setgcfield(L, "freed", s.freed);
+  setgcfield(L, "debtmax", s.debtmax);
+  setgcfield(L, "steptime", s.steptime);
+  setgcfield(L, "stepmax", s.stepmax);
+  setgcfield(L, "atomicmax", s.atomicmax);
+  lua_createtable(L, 0, LUA_GCPHASES);
+  for (i = 0; i < LUA_GCPHASES; i++) {
+    lua_createtable(L, 0, 2);
+    setgcfield(L, "steps", (lua_Number)s.phasesteps[i]);
+    setgcfield(L, "time", s.phasetime[i]);
+    lua_setfield(L, -2, phases[i]);
+  }
+  lua_setfield(L, -2, "phases");
+  /* pauses[i]: atomic phases shorter than 0.125 * 2^(i-1) ms */
+  lua_createtable(L, LUA_GCPAUSEBINS, 0);
+  for (i = 0; i < LUA_GCPAUSEBINS; i++) {
+    lua_pushnumber(L, (lua_Number)s.pauses[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "pauses");
+  return 1;
+}
+
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
-    "count", "step", "setpause", "setstepmul", NULL};
+    "count", "step", "setpause", "setstepmul", "allocated", "cycles",
+    "timing", "resetstats", "stats", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
-    LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL};
+    LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
+    LUA_GCALLOC, LUA_GCCYCLES, LUA_GCTIMING, LUA_GCRESETSTATS, -1};
   int o = luaL_checkoption(L, 1, "collect", opts);
-  int ex = luaL_optint(L, 2, 0);
-  int res = lua_gc(L, optsnum[o], ex);
+  int ex;
+  int res;
+  if (optsnum[o] < 0)
+    return gcstats(L);
+  if (optsnum[o] == LUA_GCTIMING)
+    ex = lua_toboolean(L, 2);
+  else
+    ex = luaL_optint(L, 2, 0);
+  res = lua_gc(L, optsnum[o], ex);
   switch (optsnum[o]) {
     case LUA_GCCOUNT: {
       int b = lua_gc(L, LUA_GCCOUNTB, 0);
       lua_pushnumber(L, res + ((lua_Number)b/1024));
       return 1;
     }
-    case LUA_GCSTEP: {
+    case LUA_GCALLOC: {
+      int b = lua_gc(L, LUA_GCALLOCB, 0);
+      lua_pushnumber(L, res + ((lua_Number)b/1024));
+      return 1;
+    }
+    case LUA_GCSTEP:
+    case LUA_GCTIMING: {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCRESETSTATS: {
+      return 0;
+    }
     default: {
       lua_pushnumber(L, res);
       return 1;
@@ -372,6 +372,26 @@ static int db_errorfb (lua_State *L) {
 }
 
 
+/*
+** debug.vmstats([top]) returns the instructions run by the interpreter:
+** { total = n, ops = { [opname] = n }, pairs = { ["op1 op2"] = n },
+** protos = { { source =, linedefined =, lastlinedefined =, count = n,
+** lines = { [line] = n } }, ... } }, with the `top' functions (20 by
+** default) that ran the most. debug.vmstats("reset") zeroes the counts.
+*/
+static int db_vmstats (lua_State *L) {
+  static const char *const opts[] = {"reset", NULL};
+  if (!lua_isnoneornil(L, 1) && !lua_isnumber(L, 1)) {
+    luaL_checkoption(L, 1, NULL, opts);
+    lua_resetvmstats(L);
+    return 0;
+  }
+  if (!lua_vmstats(L, luaL_optint(L, 1, 20)))
+    return luaL_error(L, "Lua built without LUA_USE_VMSTATS");
+  return 1;
+}
+
+
 static const luaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getfenv", db_getfenv},
@@ -387,6 +407,7 @@ static const luaL_Reg dblib[] = {
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
   {"traceback", db_errorfb},
+  {"vmstats", db_vmstats},
   {NULL, NULL}
 };
 
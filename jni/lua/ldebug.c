@@ -7,6 +7,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -50,6 +51,24 @@ static int currentline (lua_State *L, CallInfo *ci) {
 }
 
 
+static void sethookstep (lua_State *L);
+
+
+/*
+** sets the hook bits of the mask, keeping the internal ones: they may be
+** set meanwhile by other threads (see `lua_requestsample'), so the mask
+** is only ever updated atomically. A lock would not do here, since
+** `lua_sethook' may run in a signal handler.
+*/
+static void sethookmask (lua_State *L, int mask) {
+  lu_byte old;
+  do {
+    old = L->hookmask;
+  } while (!luai_hookmaskcas(L, old,
+               cast_byte(mask | (old & (LUA_MASKQUOTA | LUA_MASKSAMPLE)))));
+}
+
+
 /*
 ** this function can be called asynchronous (e.g. during a signal)
 */
@@ -61,7 +80,12 @@ LUA_API int lua_sethook (lua_State *L, lua_Hook func, int mask, int count) {
   L->hook = func;
   L->basehookcount = count;
   resethookcount(L);
-  L->hookmask = cast_byte(mask);
+  sethookmask(L, mask);
+  if (G(L)->quotaarmed)  /* keep counting for quotas */
+    luaG_armquota(L);
+  if (G(L)->sampler != NULL)  /* and for the sampler */
+    luaG_armsample(L);
+  sethookstep(L);  /* internal bits kept from before */
   return 1;
 }
 
@@ -72,11 +96,14 @@ LUA_API lua_Hook lua_gethook (lua_State *L) {
 
 
 LUA_API int lua_gethookmask (lua_State *L) {
-  return L->hookmask;
+  return L->hookmask & ~(LUA_MASKQUOTA | LUA_MASKSAMPLE);
 }
 
 
 LUA_API int lua_gethookcount (lua_State *L) {
+  if ((L->hookmask & (LUA_MASKQUOTA | LUA_MASKSAMPLE)) &&
+      !(L->hookmask & LUA_MASKCOUNT))
+    return 0;  /* count only used by quotas or the sampler */
   return L->basehookcount;
 }
 
@@ -636,3 +663,377 @@ void luaG_runerror (lua_State *L, const char *fmt, ...) {
   luaG_errormsg(L);
 }
 
+
+/*
+** {======================================================
+** CPU quotas
+** =======================================================
+*/
+
+/* starts a new slice of the quotas */
+static void resetquota (global_State *g) {
+  g->quotaused = 0;
+  if (g->quotamillis != 0) {
+    luai_quotaclock(g->quotadeadline);
+    g->quotadeadline += g->quotamillis;
+  }
+}
+
+
+LUA_API void lua_setquota (lua_State *L, unsigned long instructions,
+                           unsigned long millis, int mode) {
+  global_State *g = G(L);
+  lua_lock(L);
+  g->quotainstr = instructions;
+  g->quotamillis = millis;
+  g->quotamode = cast_byte(mode);
+  resetquota(g);
+  g->interrupted = 0;
+  /* once armed, every thread counts instructions: the main thread now,
+     others when they are created or resumed */
+  g->quotaarmed = 1;
+  luaG_armquota(L);
+  luaG_armquota(g->mainthread);
+  lua_unlock(L);
+}
+
+
+LUA_API unsigned long lua_quotaused (lua_State *L) {
+  return G(L)->quotaused;
+}
+
+
+/*
+** May be called from any thread, like a signal handler would: only flags
+** the state, which then raises an error at the next check of its quotas.
+** A state that never had a quota set starts checking in its main thread
+** (best effort, as `lua.c' does from its signal handler); coroutines
+** created before that are only checked once resumed again.
+*/
+LUA_API void lua_interrupt (lua_State *L) {
+  global_State *g = G(L);
+  g->interrupted = 1;
+  if (!g->quotaarmed) {
+    lua_State *m = g->mainthread;
+    g->quotaarmed = 1;
+    if (!(m->hookmask & LUA_MASKCOUNT)) m->basehookcount = LUAI_QUOTASTEP;
+    /* check at the next instruction; the mask is updated atomically, as
+       by `lua_requestsample', after the count (the counts themselves are
+       not synchronized with the VM, so the check may come a step later) */
+    m->hookcount = 1;
+    luai_hookmaskset(m, LUA_MASKQUOTA);
+  }
+}
+
+
+/*
+** a thread without a count hook checks its quotas and calls the sampler
+** every `basehookcount' instructions: the smaller of their steps
+*/
+static void sethookstep (lua_State *L) {
+  if (!(L->hookmask & LUA_MASKCOUNT)) {
+    int step = LUAI_QUOTASTEP;
+    if ((L->hookmask & LUA_MASKSAMPLE) && G(L)->samplestep > 0 &&
+        (!(L->hookmask & LUA_MASKQUOTA) || G(L)->samplestep < step))
+      step = G(L)->samplestep;
+    if (L->basehookcount != step) {
+      L->basehookcount = step;
+      resethookcount(L);
+    }
+  }
+}
+
+
+void luaG_armquota (lua_State *L) {
+  if (!(L->hookmask & LUA_MASKQUOTA)) {
+    luai_hookmaskset(L, LUA_MASKQUOTA);
+    sethookstep(L);
+  }
+}
+
+
+static void quotaerror (lua_State *L, const char *msg) {
+  msg = luaO_pushfstring(L, "%s", msg);
+  addinfo(L, msg);
+  if (L->errfunc != 0) {  /* is there an error handling function? */
+    StkId errfunc = restorestack(L, L->errfunc);
+    if (!ttisfunction(errfunc)) luaD_throw(L, LUA_ERRERR);
+    setobjs2s(L, L->top, L->top - 1);  /* move argument */
+    setobjs2s(L, L->top - 1, errfunc);  /* push function */
+    incr_top(L);
+    luaD_call(L, L->top - 2, 1);  /* call it */
+  }
+  luaD_throw(L, LUA_ERRQUOTA);
+}
+
+
+/*
+** called by the VM every `basehookcount' instructions of a thread with
+** LUA_MASKQUOTA set. Raises a LUA_ERRQUOTA error or, in LUA_QUOTAYIELD
+** mode, yields the thread (as a count hook may) when possible; quotas
+** are then time slices, renewed at each forced yield.
+*/
+void luaG_checkquota (lua_State *L) {
+  global_State *g = G(L);
+  const char *msg = NULL;
+  g->quotaused += L->basehookcount;
+  if (g->interrupted)
+    msg = "interrupted";
+  else if (g->quotainstr != 0 && g->quotaused > g->quotainstr)
+    msg = "instruction quota exceeded";
+  else if (g->quotamillis != 0) {
+    double now;
+    luai_quotaclock(now);
+    if (now > g->quotadeadline)
+      msg = "time quota exceeded";
+  }
+  if (msg == NULL)
+    return;
+  if (g->quotamode == LUA_QUOTAYIELD && !g->interrupted &&
+      lua_isyieldable(L)) {
+    resetquota(g);
+    L->base = L->top;  /* as lua_yield(L, 0) */
+    L->status = LUA_YIELD;
+    return;
+  }
+  quotaerror(L, msg);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Sampling
+** =======================================================
+*/
+
+
+/*
+** With a positive `step', `f' is called every `step' instructions run by
+** any thread of the state, with the thread and the number of
+** instructions it ran since the last call (`step', or the count of a
+** count hook set on the thread). It is called with LUA_SAMPLEREQUEST
+** after `lua_requestsample', and with LUA_SAMPLEENTRY when Lua is entered
+** from C, so that time spent outside Lua can be told apart.
+** `f' runs within the VM, like a hook: it may inspect the stack with
+** `lua_getstack' and `lua_getinfo' but must not push values, call
+** functions, yield or raise errors. A NULL `f' removes the sampler.
+*/
+LUA_API void lua_setsampler (lua_State *L, lua_Sampler f, void *ud,
+                             int step) {
+  global_State *g = G(L);
+  lua_lock(L);
+  g->sampler = f;
+  g->samplerud = ud;
+  g->samplestep = (step > 0) ? step : 0;
+  g->samplerequested = 0;
+  /* the main thread now, others when they are created or resumed */
+  if (f != NULL) {
+    luaG_armsample(L);
+    luaG_armsample(g->mainthread);
+  }
+  lua_unlock(L);
+}
+
+
+LUA_API lua_Sampler lua_getsampler (lua_State *L, void **ud) {
+  if (ud) *ud = G(L)->samplerud;
+  return G(L)->sampler;
+}
+
+
+/*
+** May be called from any thread, like `lua_interrupt': makes the thread
+** the state is running call the sampler at its next instruction. Costs
+** nothing to the VM until then, unlike a periodic sampler.
+*/
+LUA_API void lua_requestsample (lua_State *L) {
+  global_State *g = G(L);
+  lua_State *r;
+  luai_samplelock(g);
+  r = g->running;
+  g->samplerequested = 1;
+  /* check at the next instruction; the count comes first, so that the
+     VM never counts down from a stale one once it sees the bit. A VM
+     already counting may overwrite it, delaying the sample by at most
+     a count step. */
+  r->hookcount = 1;
+  luai_hookmaskset(r, LUA_MASKSAMPLE);
+  luai_sampleunlock(g);
+}
+
+
+void luaG_armsample (lua_State *L) {
+  if (G(L)->samplestep > 0) {
+    luai_hookmaskset(L, LUA_MASKSAMPLE);
+    sethookstep(L);
+  }
+}
+
+
+static void disarmsample (lua_State *L) {
+  luai_hookmaskclear(L, LUA_MASKSAMPLE);
+  sethookstep(L);
+}
+
+
+void luaG_sample (lua_State *L) {
+  global_State *g = G(L);
+  if (g->sampler == NULL) {  /* removed? stop calling it */
+    disarmsample(L);
+    return;
+  }
+  if (g->samplerequested) {
+    g->samplerequested = 0;
+    if (g->samplestep == 0)  /* only called on request? */
+      disarmsample(L);
+    (*g->sampler)(L, LUA_SAMPLEREQUEST, g->samplerud);
+  }
+  else if (g->samplestep > 0)
+    (*g->sampler)(L, L->basehookcount, g->samplerud);
+  else
+    disarmsample(L);
+}
+
+/* }====================================================== */
+
+
+#if defined(LUA_USE_VMSTATS)
+
+/*
+** {======================================================
+** Interpreter statistics
+** =======================================================
+*/
+
+typedef struct ProtoCount {
+  Proto *p;
+  lu_mem count;
+} ProtoCount;
+
+
+static lu_mem protocount (const Proto *p) {
+  lu_mem n = 0;
+  int pc;
+  for (pc = 0; pc < p->sizecode; pc++) n += p->vmcounts[pc];
+  return n;
+}
+
+
+static int cmpcounts (const void *a, const void *b) {
+  lu_mem x = ((const ProtoCount *)a)->count;
+  lu_mem y = ((const ProtoCount *)b)->count;
+  return (x < y) ? 1 : (x > y) ? -1 : 0;
+}
+
+
+static void setcount (lua_State *L, Table *t, const char *k, lu_mem n) {
+  setnvalue(luaH_setstr(L, t, luaS_new(L, k)), cast_num(n));
+}
+
+
+/* { source = , linedefined = , lastlinedefined = , count = ,
+     lines = { [line] = instructions run } } */
+static Table *protostats (lua_State *L, const ProtoCount *pc) {
+  const Proto *p = pc->p;
+  Table *t = luaH_new(L, 0, 5);
+  Table *lines = luaH_new(L, 0, 0);
+  int i;
+  sethvalue(L, luaH_setstr(L, t, luaS_new(L, "lines")), lines);
+  setsvalue(L, luaH_setstr(L, t, luaS_new(L, "source")), p->source);
+  setcount(L, t, "linedefined", p->linedefined);
+  setcount(L, t, "lastlinedefined", p->lastlinedefined);
+  setcount(L, t, "count", pc->count);
+  for (i = 0; i < p->sizecode; i++) {
+    if (p->vmcounts[i] > 0) {
+      TValue *v = luaH_setnum(L, lines, getline(p, i));
+      lua_Number n = ttisnil(v) ? 0 : nvalue(v);
+      setnvalue(v, n + cast_num(p->vmcounts[i]));
+    }
+  }
+  return t;
+}
+
+
+/*
+** Pushes { total = , ops = { [opname] = }, pairs = { ["op1 op2"] = },
+** protos = { the `top' functions that ran the most instructions } }.
+** The collector does not run meanwhile, so new objects need no anchor.
+*/
+void luaG_vmstats (lua_State *L, int top) {
+  global_State *g = G(L);
+  Table *t = luaH_new(L, 0, 4);
+  Table *ops = luaH_new(L, 0, NUM_OPCODES);
+  Table *pairs = luaH_new(L, 0, 0);
+  Table *protos;
+  ProtoCount *hot = NULL;
+  GCObject *o;
+  lu_mem total = 0;
+  int n = 0;
+  int i, j;
+  sethvalue2s(L, L->top, t);
+  incr_top(L);
+  sethvalue(L, luaH_setstr(L, t, luaS_new(L, "ops")), ops);
+  sethvalue(L, luaH_setstr(L, t, luaS_new(L, "pairs")), pairs);
+  for (i = 0; i < NUM_OPCODES; i++) {
+    if (g->vmops[i] > 0)
+      setcount(L, ops, luaP_opnames[i], g->vmops[i]);
+    total += g->vmops[i];
+    for (j = 0; j < NUM_OPCODES; j++) {
+      if (g->vmpairs[i][j] > 0) {
+        char name[32];
+        strcpy(name, luaP_opnames[i]);
+        strcat(name, " ");
+        strcat(name, luaP_opnames[j]);
+        setcount(L, pairs, name, g->vmpairs[i][j]);
+      }
+    }
+  }
+  setcount(L, t, "total", total);
+  for (o = g->rootgc; o != NULL; o = o->gch.next) {
+    if (o->gch.tt == LUA_TPROTO && gco2p(o)->vmcounts != NULL) n++;
+  }
+  if (top > 0 && n > 0) {  /* sort the functions run by their counts */
+    Udata *u = luaS_newudata(L, n * sizeof(ProtoCount), hvalue(gt(L)));
+    setuvalue(L, L->top, u);  /* anchored while protos are created */
+    incr_top(L);
+    hot = cast(ProtoCount *, u + 1);
+    n = 0;
+    for (o = g->rootgc; o != NULL; o = o->gch.next) {
+      if (o->gch.tt == LUA_TPROTO && gco2p(o)->vmcounts != NULL) {
+        hot[n].p = gco2p(o);
+        hot[n].count = protocount(gco2p(o));
+        if (hot[n].count > 0) n++;
+      }
+    }
+    qsort(hot, n, sizeof(ProtoCount), cmpcounts);
+    if (n > top) n = top;
+  }
+  else
+    n = 0;
+  protos = luaH_new(L, n, 0);
+  sethvalue(L, luaH_setstr(L, t, luaS_new(L, "protos")), protos);
+  for (i = 0; i < n; i++)
+    sethvalue(L, luaH_setnum(L, protos, i + 1), protostats(L, &hot[i]));
+  if (hot != NULL)
+    L->top--;  /* remove the buffer */
+}
+
+
+void luaG_resetvmstats (lua_State *L) {
+  global_State *g = G(L);
+  GCObject *o;
+  memset(g->vmops, 0, sizeof(g->vmops));
+  memset(g->vmpairs, 0, sizeof(g->vmpairs));
+  for (o = g->rootgc; o != NULL; o = o->gch.next) {
+    if (o->gch.tt == LUA_TPROTO && gco2p(o)->vmcounts != NULL) {
+      Proto *p = gco2p(o);
+      memset(p->vmcounts, 0, p->sizecode * sizeof(lu_mem));
+    }
+  }
+}
+
+/* }====================================================== */
+
+#endif
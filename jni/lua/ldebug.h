@@ -17,6 +17,11 @@
 
 #define resethookcount(L)	(L->hookcount = L->basehookcount)
 
+/* internal hook mask bit: the thread counts instructions for quotas */
+#define LUA_MASKQUOTA	(1 << 5)
+/* internal hook mask bit: the thread calls the sampler */
+#define LUA_MASKSAMPLE	(1 << 6)
+
 
 LUAI_FUNC void luaG_typeerror (lua_State *L, const TValue *o,
                                              const char *opname);
@@ -27,6 +32,14 @@ LUAI_FUNC int luaG_ordererror (lua_State *L, const TValue *p1,
                                              const TValue *p2);
 LUAI_FUNC void luaG_runerror (lua_State *L, const char *fmt, ...);
 LUAI_FUNC void luaG_errormsg (lua_State *L);
+LUAI_FUNC void luaG_armquota (lua_State *L);
+LUAI_FUNC void luaG_checkquota (lua_State *L);
+LUAI_FUNC void luaG_armsample (lua_State *L);
+LUAI_FUNC void luaG_sample (lua_State *L);
+#if defined(LUA_USE_VMSTATS)
+LUAI_FUNC void luaG_vmstats (lua_State *L, int top);
+LUAI_FUNC void luaG_resetvmstats (lua_State *L);
+#endif
 LUAI_FUNC int luaG_checkcode (const Proto *pt);
 LUAI_FUNC int luaG_checkopenop (Instruction i);
 
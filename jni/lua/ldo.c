@@ -59,6 +59,7 @@ void luaD_seterrorobj (lua_State *L, int errcode, StkId oldtop) {
       break;
     }
     case LUA_ERRSYNTAX:
+    case LUA_ERRQUOTA:
     case LUA_ERRRUN: {
       setobjs2s(L, oldtop, L->top - 1);  /* error message on current top */
       break;
@@ -374,6 +375,8 @@ void luaD_call (lua_State *L, StkId func, int nResults) {
     else if (L->nCcalls >= (LUAI_MAXCCALLS + (LUAI_MAXCCALLS>>3)))
       luaD_throw(L, LUA_ERRERR);  /* error while handing stack error */
   }
+  if (L->nCcalls == 1 && G(L)->sampler != NULL)  /* entered from C? */
+    (*G(L)->sampler)(L, LUA_SAMPLEENTRY, G(L)->samplerud);
   if (luaD_precall(L, func, nResults) == PCRLUA)  /* is a Lua function? */
     luaV_execute(L, 1);  /* call it */
   L->nCcalls--;
@@ -384,6 +387,10 @@ void luaD_call (lua_State *L, StkId func, int nResults) {
 static void resume (lua_State *L, void *ud) {
   StkId firstArg = cast(StkId, ud);
   CallInfo *ci = L->ci;
+  if (G(L)->quotaarmed)  /* thread may predate `lua_setquota' */
+    luaG_armquota(L);
+  if (G(L)->sampler != NULL)
+    luaG_armsample(L);
   if (L->status == 0) {  /* start coroutine? */
     lua_assert(ci == L->base_ci && firstArg > L->base);
     if (luaD_precall(L, firstArg - 1, LUA_MULTRET) != PCRLUA)
@@ -415,8 +422,29 @@ static int resume_error (lua_State *L, const char *msg) {
 }
 
 
+/*
+** keeps track of the running thread for `lua_requestsample': threads
+** entered with `lua_resume', `lua_call' or `lua_pcall' (the latter two
+** restore it only on a normal return; an error restores it at the
+** protected call or resume catching it)
+*/
+void luaD_setrunning (lua_State *L, lua_State *running) {
+  global_State *g = G(L);
+  if (g->running == running)
+    return;
+  if (g->sampler != NULL) {
+    luai_samplelock(g);
+    g->running = running;
+    luai_sampleunlock(g);
+  }
+  else
+    g->running = running;
+}
+
+
 LUA_API int lua_resume (lua_State *L, int nargs) {
   int status;
+  lua_State *running;
   lua_lock(L);
   if (L->status != LUA_YIELD && (L->status != 0 || L->ci != L->base_ci))
       return resume_error(L, "cannot resume non-suspended coroutine");
@@ -425,7 +453,10 @@ LUA_API int lua_resume (lua_State *L, int nargs) {
   luai_userstateresume(L, nargs);
   lua_assert(L->errfunc == 0);
   L->baseCcalls = ++L->nCcalls;
+  running = G(L)->running;
+  luaD_setrunning(L, L);
   status = luaD_rawrunprotected(L, resume, L->top - nargs);
+  luaD_setrunning(L, running);
   if (status != 0) {  /* error? */
     L->status = cast_byte(status);  /* mark thread as `dead' */
     luaD_seterrorobj(L, status, L->top);
@@ -453,6 +484,15 @@ LUA_API int lua_yield (lua_State *L, int nresults) {
 }
 
 
+/*
+** tells whether lua_yield may be called: inside a coroutine and not
+** across a C call (for hooks wanting to yield at a safe point)
+*/
+LUA_API int lua_isyieldable (lua_State *L) {
+  return L != G(L)->mainthread && L->nCcalls <= L->baseCcalls;
+}
+
+
 int luaD_pcall (lua_State *L, Pfunc func, void *u,
                 ptrdiff_t old_top, ptrdiff_t ef) {
   int status;
@@ -460,8 +500,11 @@ int luaD_pcall (lua_State *L, Pfunc func, void *u,
   ptrdiff_t old_ci = saveci(L, L->ci);
   lu_byte old_allowhooks = L->allowhook;
   ptrdiff_t old_errfunc = L->errfunc;
+  lua_State *running = G(L)->running;
   L->errfunc = ef;
+  luaD_setrunning(L, L);
   status = luaD_rawrunprotected(L, func, u);
+  luaD_setrunning(L, running);
   if (status != 0) {  /* an error occurred? */
     StkId oldtop = restorestack(L, old_top);
     luaF_close(L, oldtop);  /* close eventual pending closures */
@@ -134,6 +134,9 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+#if defined(LUA_USE_VMSTATS)
+  f->vmcounts = NULL;
+#endif
   return f;
 }
 
@@ -145,10 +148,23 @@ void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
   luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
   luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+#if defined(LUA_USE_VMSTATS)
+  if (f->vmcounts)
+    luaM_freearray(L, f->vmcounts, f->sizecode, lu_mem);
+#endif
   luaM_free(L, f);
 }
 
 
+#if defined(LUA_USE_VMSTATS)
+void luaF_newcounts (lua_State *L, Proto *f) {
+  int pc;
+  f->vmcounts = luaM_newvector(L, f->sizecode, lu_mem);
+  for (pc=0; pc<f->sizecode; pc++) f->vmcounts[pc] = 0;
+}
+#endif
+
+
 void luaF_freeclosure (lua_State *L, Closure *c) {
   int size = (c->c.isC) ? sizeCclosure(c->c.nupvalues) :
                           sizeLclosure(c->l.nupvalues);
@@ -375,7 +375,13 @@ static void cleartable (GCObject *l) {
 }
 
 
+static const char *objtype (GCObject *o);
+
+
 static void freeobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  if (testbit(o->gch.marked, SAMPLEDBIT) && g->heaphook)
+    (*g->heaphook)(L, LUA_HEAPFREE, o, objtype(o), g->heaphookud);
   switch (o->gch.tt) {
     case LUA_TPROTO: luaF_freeproto(L, gco2p(o)); break;
     case LUA_TFUNCTION: luaF_freeclosure(L, gco2cl(o)); break;
@@ -459,6 +465,7 @@ static void GCTM (lua_State *L) {
   if (tm != NULL) {
     lu_byte oldah = L->allowhook;
     lu_mem oldt = g->GCthreshold;
+    g->gcstats.finalized++;
     L->allowhook = 0;  /* stop debug hooks during GC tag method */
     g->GCthreshold = 2*g->totalbytes;  /* avoid GC steps */
     setobj2s(L, L->top, tm);
@@ -599,6 +606,7 @@ static l_mem singlestep (lua_State *L) {
       else {
         g->gcstate = GCSpause;  /* end collection */
         g->gcdept = 0;
+        g->gccycles++;
         return 0;
       }
     }
@@ -607,17 +615,106 @@ static l_mem singlestep (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Statistics
+** =======================================================
+*/
+
+/* times the phases of a step, if `phase' is not negative */
+typedef struct GCClock {
+  int phase;  /* phase being timed */
+  double start;  /* of the step */
+  double last;  /* start of the phase being timed */
+} GCClock;
+
+
+static int statphase (global_State *g) {
+  switch (g->gcstate) {
+    case GCSpropagate:  /* no more gray objects: next step is atomic */
+      return g->gray ? LUA_GCPPROPAGATE : LUA_GCPATOMIC;
+    case GCSsweepstring: return LUA_GCPSWEEPSTRING;
+    case GCSsweep: return LUA_GCPSWEEP;
+    case GCSfinalize: return LUA_GCPFINALIZE;
+    default: return LUA_GCPPROPAGATE;  /* GCSpause marks the roots */
+  }
+}
+
+
+static void startclock (global_State *g, GCClock *c) {
+  g->gcstats.steps++;
+  c->phase = -1;
+  if (g->gctiming) {
+    luai_quotaclock(c->start);
+    c->last = c->start;
+    c->phase = statphase(g);
+  }
+}
+
+
+/* charges the time since the last charge to the phase timed */
+static void chargeclock (global_State *g, GCClock *c, int next) {
+  lua_GCStats *s = &g->gcstats;
+  double now, t;
+  luai_quotaclock(now);
+  t = now - c->last;
+  s->phasetime[c->phase] += t;
+  if (c->phase == LUA_GCPATOMIC) {
+    int bin = 0;
+    double limit = 0.125;
+    while (bin < LUA_GCPAUSEBINS - 1 && t >= limit) {
+      bin++;
+      limit *= 2;
+    }
+    s->pauses[bin]++;
+    if (t > s->atomicmax) s->atomicmax = t;
+  }
+  c->phase = next;
+  c->last = now;
+}
+
+
+static void stopclock (global_State *g, GCClock *c) {
+  if (c->phase >= 0) {
+    lua_GCStats *s = &g->gcstats;
+    chargeclock(g, c, -1);
+    s->steptime += c->last - c->start;
+    if (c->last - c->start > s->stepmax) s->stepmax = c->last - c->start;
+  }
+}
+
+
+/* a single step, counted in the statistics of its phase */
+static l_mem countedstep (lua_State *L, GCClock *c) {
+  global_State *g = G(L);
+  int phase = statphase(g);
+  g->gcstats.phasesteps[phase]++;
+  if (c->phase >= 0 && c->phase != phase)
+    chargeclock(g, c, phase);
+  return singlestep(L);
+}
+
+/* }====================================================== */
+
+
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
+  GCClock c;
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
   g->gcdept += g->totalbytes - g->GCthreshold;
+  if (cast_num(g->gcdept) > g->gcstats.debtmax)
+    g->gcstats.debtmax = cast_num(g->gcdept);
+  luaE_trace(L, LUA_TRACEBEGIN, "gc", "step");
+  startclock(g, &c);
   do {
-    lim -= singlestep(L);
+    lim -= countedstep(L, &c);
     if (g->gcstate == GCSpause)
       break;
   } while (lim > 0);
+  stopclock(g, &c);
+  luaE_trace(L, LUA_TRACEEND, "gc", "step");
   if (g->gcstate != GCSpause) {
     if (g->gcdept < GCSTEPSIZE)
       g->GCthreshold = g->totalbytes + GCSTEPSIZE;  /* - lim/g->gcstepmul;*/
@@ -634,6 +731,9 @@ void luaC_step (lua_State *L) {
 
 void luaC_fullgc (lua_State *L) {
   global_State *g = G(L);
+  GCClock c;
+  luaE_trace(L, LUA_TRACEBEGIN, "gc", "full");
+  startclock(g, &c);
   if (g->gcstate <= GCSpropagate) {
     /* reset sweep marks to sweep all elements (returning them to white) */
     g->sweepstrgc = 0;
@@ -648,13 +748,15 @@ void luaC_fullgc (lua_State *L) {
   /* finish any pending sweep phase */
   while (g->gcstate != GCSfinalize) {
     lua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
-    singlestep(L);
+    countedstep(L, &c);
   }
   markroot(L);
   while (g->gcstate != GCSpause) {
-    singlestep(L);
+    countedstep(L, &c);
   }
   setthreshold(g);
+  stopclock(g, &c);
+  luaE_trace(L, LUA_TRACEEND, "gc", "full");
 }
 
 
@@ -688,6 +790,7 @@ void luaC_link (lua_State *L, GCObject *o, lu_byte tt) {
   g->rootgc = o;
   o->gch.marked = luaC_white(g);
   o->gch.tt = tt;
+  luaC_checksample(L, o);
 }
 
 
@@ -708,3 +811,114 @@ void luaC_linkupval (lua_State *L, UpVal *uv) {
   }
 }
 
+
+/*
+** {======================================================
+** Heap profiling
+** =======================================================
+*/
+
+
+static const char *objtype (GCObject *o) {
+  switch (o->gch.tt) {
+    case LUA_TSTRING: return "string";
+    case LUA_TUSERDATA: return "userdata";
+    case LUA_TTABLE: return "table";
+    case LUA_TFUNCTION: return "closure";
+    case LUA_TUPVAL: return "upvalue";
+    case LUA_TPROTO: return "proto";
+    case LUA_TTHREAD: return "thread";
+    default: lua_assert(0); return "?";
+  }
+}
+
+
+static lu_mem objsize (GCObject *o) {
+  switch (o->gch.tt) {
+    case LUA_TSTRING: return sizestring(gco2ts(o));
+    case LUA_TUSERDATA: return sizeudata(gco2u(o));
+    case LUA_TTABLE: return luaH_size(gco2h(o));
+    case LUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      return cl->c.isC ? sizeCclosure(cl->c.nupvalues) :
+                         sizeLclosure(cl->l.nupvalues);
+    }
+    case LUA_TUPVAL: return sizeof(UpVal);
+    case LUA_TPROTO: {
+      Proto *f = gco2p(o);
+      return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+             sizeof(Proto *) * f->sizep + sizeof(TValue) * f->sizek +
+             sizeof(int) * f->sizelineinfo +
+             sizeof(LocVar) * f->sizelocvars +
+             sizeof(TString *) * f->sizeupvalues;
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      return sizeof(lua_State) + sizeof(TValue) * th->stacksize +
+             sizeof(CallInfo) * th->size_ci;
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+
+/*
+** Samples are spread at random between half and one and a half
+** `heapinterval' bytes apart, so that they do not follow the period of
+** allocation patterns.
+*/
+void luaC_setheapnext (lua_State *L) {
+  global_State *g = G(L);
+  if (g->heaphook == NULL || g->heapinterval == 0)
+    g->heapnext = HUGE_VAL;
+  else {
+    g->heapseed = g->heapseed * 1103515245 + 12345;
+    g->heapnext = g->totalalloc + g->heapinterval / 2 +
+                  (g->heapseed >> 8) % g->heapinterval;
+  }
+}
+
+
+/*
+** Called by `luaC_checksample' with a new object, before its fields are
+** set: the hook may only note its address and look at the stack.
+*/
+void luaC_heapsample (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  luaC_setheapnext(L);
+  if (g->heaphook) {
+    l_setbit(o->gch.marked, SAMPLEDBIT);
+    (*g->heaphook)(L, LUA_HEAPALLOC, o, objtype(o), g->heaphookud);
+  }
+}
+
+
+static void walklist (GCObject *o, lua_HeapWalker f, void *ud) {
+  for (; o != NULL; o = o->gch.next) {
+    (*f)(o, objtype(o), objsize(o), ud);
+    if (o->gch.tt == LUA_TTHREAD)  /* open upvalues are in their thread */
+      walklist(gco2th(o)->openupval, f, ud);
+  }
+}
+
+
+/*
+** Calls `f' with every object of the state that was not freed yet,
+** including those unreachable since the last collection.
+*/
+void luaC_heapwalk (lua_State *L, lua_HeapWalker f, void *ud) {
+  global_State *g = G(L);
+  int i;
+  walklist(g->rootgc, f, ud);
+  for (i = 0; i < g->strt.size; i++)
+    walklist(g->strt.hash[i], f, ud);
+  if (g->tmudata) {  /* circular list of userdata to be finalized */
+    GCObject *o = g->tmudata;
+    do {
+      o = o->gch.next;
+      (*f)(o, objtype(o), objsize(o), ud);
+    } while (o != g->tmudata);
+  }
+}
+
+/* }====================================================== */
@@ -48,6 +48,7 @@
 ** bit 4 - for tables: has weak values
 ** bit 5 - object is fixed (should not be collected)
 ** bit 6 - object is "super" fixed (only the main thread)
+** bit 7 - object was sampled by the heap hook (see `lua_setheaphook')
 */
 
 
@@ -59,6 +60,7 @@
 #define VALUEWEAKBIT	4
 #define FIXEDBIT	5
 #define SFIXEDBIT	6
+#define SAMPLEDBIT	7
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
 
 
@@ -83,6 +85,12 @@
 	luaC_step(L); }
 
 
+/* samples new object `o' once enough bytes were allocated */
+#define luaC_checksample(L,o) { \
+  if (G(L)->totalalloc >= G(L)->heapnext) \
+	luaC_heapsample(L, obj2gco(o)); }
+
+
 #define luaC_barrier(L,p,v) { if (valiswhite(v) && isblack(obj2gco(p)))  \
 	luaC_barrierf(L,obj2gco(p),gcvalue(v)); }
 
@@ -105,6 +113,9 @@ LUAI_FUNC void luaC_link (lua_State *L, GCObject *o, lu_byte tt);
 LUAI_FUNC void luaC_linkupval (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v);
 LUAI_FUNC void luaC_barrierback (lua_State *L, Table *t);
+LUAI_FUNC void luaC_setheapnext (lua_State *L);
+LUAI_FUNC void luaC_heapsample (lua_State *L, GCObject *o);
+LUAI_FUNC void luaC_heapwalk (lua_State *L, lua_HeapWalker f, void *ud);
 
 
 #endif
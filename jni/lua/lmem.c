@@ -81,6 +81,10 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
     luaD_throw(L, LUA_ERRMEM);
   lua_assert((nsize == 0) == (block == NULL));
   g->totalbytes = (g->totalbytes - osize) + nsize;
+  if (nsize > osize)
+    g->totalalloc += nsize - osize;
+  else
+    g->totalfreed += osize - nsize;
   return block;
 }
 
@@ -371,6 +371,20 @@ static const char *findfile (lua_State *L, const char *name,
 }
 
 
+/*
+** Tells the tracer of the state, if any, of a module loading: "require"
+** spans hold a "search" span, running the loaders, and an "execute"
+** span, running the main chunk. Loaders of Lua files add "parse" spans.
+*/
+static void trace (lua_State *L, int event, const char *cat,
+                                             const char *name) {
+  void *ud;
+  lua_Tracer f = lua_gettracer(L, &ud);
+  if (f != NULL)
+    (*f)(L, event, cat, name, ud);
+}
+
+
 static void loaderror (lua_State *L, const char *filename) {
   luaL_error(L, "error loading module " LUA_QS " from file " LUA_QS ":\n\t%s",
                 lua_tostring(L, 1), filename, lua_tostring(L, -1));
@@ -382,8 +396,10 @@ static int loader_Lua (lua_State *L) {
   const char *name = luaL_checkstring(L, 1);
   filename = findfile(L, name, "path");
   if (filename == NULL) return 1;  /* library not found in this path */
+  trace(L, LUA_TRACEBEGIN, "parse", filename);
   if (luaL_loadfile(L, filename) != 0)
     loaderror(L, filename);
+  trace(L, LUA_TRACEEND, "parse", filename);
   return 1;  /* library loaded successfully */
 }
 
@@ -460,15 +476,19 @@ static int ll_require (lua_State *L) {
     return 1;  /* package is already loaded */
   }
   /* else must load it; iterate over available loaders */
+  trace(L, LUA_TRACEBEGIN, "require", name);
+  trace(L, LUA_TRACEBEGIN, "search", name);
   lua_getfield(L, LUA_ENVIRONINDEX, "loaders");
   if (!lua_istable(L, -1))
     luaL_error(L, LUA_QL("package.loaders") " must be a table");
   lua_pushliteral(L, "");  /* error message accumulator */
   for (i=1; ; i++) {
     lua_rawgeti(L, -2, i);  /* get a loader */
-    if (lua_isnil(L, -1))
+    if (lua_isnil(L, -1)) {
+      trace(L, LUA_TRACEEND, "require", name);  /* closes "search" too */
       luaL_error(L, "module " LUA_QS " not found:%s",
                     name, lua_tostring(L, -2));
+    }
     lua_pushstring(L, name);
     lua_call(L, 1, 1);  /* call it */
     if (lua_isfunction(L, -1))  /* did it find module? */
@@ -478,10 +498,13 @@ static int ll_require (lua_State *L) {
     else
       lua_pop(L, 1);
   }
+  trace(L, LUA_TRACEEND, "search", name);
   lua_pushlightuserdata(L, sentinel);
   lua_setfield(L, 2, name);  /* _LOADED[name] = sentinel */
   lua_pushstring(L, name);  /* pass name as argument to module */
+  trace(L, LUA_TRACEBEGIN, "execute", name);
   lua_call(L, 1, 1);  /* run loaded module */
+  trace(L, LUA_TRACEEND, "execute", name);
   if (!lua_isnil(L, -1))  /* non-nil return? */
     lua_setfield(L, 2, name);  /* _LOADED[name] = returned value */
   lua_getfield(L, 2, name);
@@ -490,6 +513,7 @@ static int ll_require (lua_State *L) {
     lua_pushvalue(L, -1);  /* extra copy to be returned */
     lua_setfield(L, 2, name);  /* _LOADED[name] = true */
   }
+  trace(L, LUA_TRACEEND, "require", name);
   return 1;
 }
 
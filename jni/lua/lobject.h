@@ -246,6 +246,9 @@ typedef struct Proto {
   int linedefined;
   int lastlinedefined;
   GCObject *gclist;
+#if defined(LUA_USE_VMSTATS)
+  lu_mem *vmcounts;  /* runs of each instruction, allocated on first call */
+#endif
   lu_byte nups;  /* number of upvalues */
   lu_byte numparams;
   lu_byte is_vararg;
@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define lstate_c
 #define LUA_CORE
@@ -178,6 +179,38 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
   g->gcdept = 0;
+  g->totalalloc = sizeof(LG);
+  g->totalfreed = 0;
+  g->gccycles = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+  g->gcstatsalloc = 0;
+  g->gcstatsfreed = 0;
+  g->gcstatscycles = 0;
+  g->gctiming = 0;
+  g->quotaarmed = 0;
+  g->quotamode = LUA_QUOTAERROR;
+  g->interrupted = 0;
+  g->quotainstr = 0;
+  g->quotaused = 0;
+  g->quotamillis = 0;
+  g->quotadeadline = 0;
+  g->sampler = NULL;
+  g->samplerud = NULL;
+  g->samplestep = 0;
+  g->samplerequested = 0;
+  g->samplelock = 0;
+  g->running = L;
+  g->tracer = NULL;
+  g->tracerud = NULL;
+  g->heaphook = NULL;
+  g->heaphookud = NULL;
+  g->heapinterval = 0;
+  g->heapnext = HUGE_VAL;
+  g->heapseed = 1;
+#if defined(LUA_USE_VMSTATS)
+  memset(g->vmops, 0, sizeof(g->vmops));
+  memset(g->vmpairs, 0, sizeof(g->vmpairs));
+#endif
   for (i=0; i<NUM_TAGS; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != 0) {
     /* memory allocation error: free partial state */
@@ -10,6 +10,9 @@
 #include "lua.h"
 
 #include "lobject.h"
+#if defined(LUA_USE_VMSTATS)
+#include "lopcodes.h"
+#endif
 #include "ltm.h"
 #include "lzio.h"
 
@@ -83,6 +86,14 @@ typedef struct global_State {
   lu_mem totalbytes;  /* number of bytes currently allocated */
   lu_mem estimate;  /* an estimate of number of bytes actually in use */
   lu_mem gcdept;  /* how much GC is `behind schedule' */
+  double totalalloc;  /* bytes ever allocated */
+  double totalfreed;  /* bytes ever freed */
+  unsigned long gccycles;  /* number of completed collections */
+  lua_GCStats gcstats;  /* see `lua_gcstats', but for the totals below */
+  double gcstatsalloc;  /* `totalalloc' when the statistics were reset */
+  double gcstatsfreed;  /* `totalfreed' when the statistics were reset */
+  unsigned long gcstatscycles;  /* `gccycles' when they were reset */
+  lu_byte gctiming;  /* time the collector (see LUA_GCTIMING) */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
   lua_CFunction panic;  /* to be called in unprotected errors */
@@ -91,6 +102,30 @@ typedef struct global_State {
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   struct Table *mt[NUM_TAGS];  /* metatables for basic types */
   TString *tmname[TM_N];  /* array with tag-method names */
+  lu_byte quotaarmed;  /* threads check quotas (see `lua_setquota') */
+  lu_byte quotamode;  /* LUA_QUOTAERROR or LUA_QUOTAYIELD */
+  volatile int interrupted;  /* set by `lua_interrupt', from any thread */
+  unsigned long quotainstr;  /* instruction quota; 0 for none */
+  unsigned long quotaused;  /* instructions run in the current slice */
+  unsigned long quotamillis;  /* time quota; 0 for none */
+  double quotadeadline;  /* end of the current slice, if `quotamillis' */
+  lua_Sampler sampler;  /* see `lua_setsampler' */
+  void *samplerud;  /* auxiliary data to `sampler' */
+  int samplestep;  /* instructions between two calls of `sampler' */
+  volatile int samplerequested;  /* set by `lua_requestsample' */
+  volatile int samplelock;  /* guards `running' (see `luai_samplelock') */
+  struct lua_State *running;  /* innermost thread being resumed */
+  lua_Tracer tracer;  /* see `lua_settracer' */
+  void *tracerud;  /* auxiliary data to `tracer' */
+  lua_HeapHook heaphook;  /* see `lua_setheaphook' */
+  void *heaphookud;  /* auxiliary data to `heaphook' */
+  size_t heapinterval;  /* mean bytes allocated between two samples */
+  double heapnext;  /* `totalalloc' at which the next object is sampled */
+  unsigned int heapseed;  /* spreads the samples around `heapinterval' */
+#if defined(LUA_USE_VMSTATS)
+  lu_mem vmops[NUM_OPCODES];  /* runs of each opcode */
+  lu_mem vmpairs[NUM_OPCODES][NUM_OPCODES];  /* of each opcode after another */
+#endif
 } global_State;
 
 
@@ -129,6 +164,10 @@ struct lua_State {
 
 #define G(L)	(L->l_G)
 
+/* calls the tracer of the state, if any, see `lua_settracer' */
+#define luaE_trace(L,e,c,n) \
+	{ if (G(L)->tracer) (*G(L)->tracer)(L, e, c, n, G(L)->tracerud); }
+
 
 /*
 ** Union of all collectable objects
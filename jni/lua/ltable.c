@@ -379,6 +379,17 @@ void luaH_free (lua_State *L, Table *t) {
 }
 
 
+/*
+** bytes allocated for table `t' and its parts
+*/
+lu_mem luaH_size (const Table *t) {
+  lu_mem size = sizeof(Table) + sizeof(TValue) * t->sizearray;
+  if (t->node != dummynode)
+    size += sizeof(Node) * sizenode(t);
+  return size;
+}
+
+
 static Node *getfreepos (Table *t) {
   while (t->lastfree-- > t->node) {
     if (ttisnil(gkey(t->lastfree)))
@@ -45,6 +45,7 @@
 #define LUA_ERRSYNTAX	3
 #define LUA_ERRMEM	4
 #define LUA_ERRERR	5
+#define LUA_ERRQUOTA	6
 
 
 typedef struct lua_State lua_State;
@@ -213,6 +214,65 @@ LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data);
 LUA_API int  (lua_yield) (lua_State *L, int nresults);
 LUA_API int  (lua_resume) (lua_State *L, int narg);
 LUA_API int  (lua_status) (lua_State *L);
+LUA_API int  (lua_isyieldable) (lua_State *L);
+
+/*
+** CPU quotas
+*/
+#define LUA_QUOTAERROR	0
+#define LUA_QUOTAYIELD	1
+
+LUA_API void (lua_setquota) (lua_State *L, unsigned long instructions,
+                             unsigned long millis, int mode);
+LUA_API unsigned long (lua_quotaused) (lua_State *L);
+LUA_API void (lua_interrupt) (lua_State *L);
+
+/*
+** sampling profilers
+*/
+#define LUA_SAMPLEENTRY	0
+#define LUA_SAMPLEREQUEST	(-1)
+
+typedef void (*lua_Sampler) (lua_State *L, int count, void *ud);
+
+LUA_API void (lua_setsampler) (lua_State *L, lua_Sampler f, void *ud,
+                               int step);
+LUA_API lua_Sampler (lua_getsampler) (lua_State *L, void **ud);
+LUA_API void (lua_requestsample) (lua_State *L);
+
+/*
+** tracers
+*/
+#define LUA_TRACEBEGIN	0
+#define LUA_TRACEEND	1
+
+typedef void (*lua_Tracer) (lua_State *L, int event, const char *cat,
+                            const char *name, void *ud);
+
+LUA_API void (lua_settracer) (lua_State *L, lua_Tracer f, void *ud);
+LUA_API lua_Tracer (lua_gettracer) (lua_State *L, void **ud);
+
+/*
+** heap profilers
+*/
+#define LUA_HEAPALLOC	0
+#define LUA_HEAPFREE	1
+
+typedef void (*lua_HeapHook) (lua_State *L, int event, const void *p,
+                              const char *type, void *ud);
+typedef void (*lua_HeapWalker) (const void *p, const char *type,
+                                size_t size, void *ud);
+
+LUA_API void (lua_setheaphook) (lua_State *L, lua_HeapHook f, void *ud,
+                                size_t interval);
+LUA_API lua_HeapHook (lua_getheaphook) (lua_State *L, void **ud);
+LUA_API void (lua_heapwalk) (lua_State *L, lua_HeapWalker f, void *ud);
+
+/*
+** interpreter statistics (with LUA_USE_VMSTATS)
+*/
+LUA_API int (lua_vmstats) (lua_State *L, int top);
+LUA_API void (lua_resetvmstats) (lua_State *L);
 
 /*
 ** garbage-collection function and options
@@ -226,9 +286,45 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCSTEP		5
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
+#define LUA_GCALLOC		8
+#define LUA_GCALLOCB		9
+#define LUA_GCCYCLES		10
+#define LUA_GCTIMING		11
+#define LUA_GCRESETSTATS	12
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
+/*
+** collector statistics
+*/
+#define LUA_GCPPROPAGATE	0
+#define LUA_GCPATOMIC		1
+#define LUA_GCPSWEEPSTRING	2
+#define LUA_GCPSWEEP		3
+#define LUA_GCPFINALIZE		4
+#define LUA_GCPHASES		5
+
+/* atomic phases shorter than 0.125 ms, 0.25 ms, ... 32 ms, and longer */
+#define LUA_GCPAUSEBINS		10
+
+typedef struct lua_GCStats {
+  unsigned long cycles;  /* collections completed */
+  unsigned long steps;  /* incremental steps and full collections */
+  unsigned long phasesteps[LUA_GCPHASES];  /* single steps of each phase */
+  unsigned long finalized;  /* `__gc' metamethods called */
+  double allocated;  /* bytes allocated */
+  double freed;  /* bytes freed */
+  double debtmax;  /* most bytes the collector was behind schedule */
+  /* in milliseconds, with LUA_GCTIMING on */
+  double phasetime[LUA_GCPHASES];  /* time spent in each phase */
+  double steptime;  /* time spent in steps and full collections */
+  double stepmax;  /* longest step or full collection */
+  double atomicmax;  /* longest atomic phase */
+  unsigned long pauses[LUA_GCPAUSEBINS];  /* atomic phases by length */
+} lua_GCStats;
+
+LUA_API void (lua_gcstats) (lua_State *L, lua_GCStats *s);
+
 
 /*
 ** miscellaneous functions
@@ -382,6 +382,16 @@
 #endif
 
 
+/*
+@@ LUA_USE_VMSTATS makes the interpreter count the instructions it runs.
+** CHANGE it (define it) to count how often each opcode, each pair of
+** consecutive opcodes and each instruction of each function runs, as
+** returned by `debug.vmstats'. Counting slows the interpreter down, so
+** leave it undefined in release builds.
+*/
+/* #define LUA_USE_VMSTATS */
+
+
 /*
 @@ LUAI_BITSINT defines the number of bits in an int.
 ** CHANGE here if Lua cannot automatically detect the number of bits of
@@ -525,6 +535,60 @@
 #define lua_str2number(s,p)	strtod((s), (p))
 
 
+/*
+@@ LUAI_QUOTASTEP is the number of instructions between two checks of the
+@* quotas set with lua_setquota.
+@@ luai_quotaclock gets the time in milliseconds for time quotas.
+** CHANGE them if you need finer checks or have a better clock. On POSIX
+** systems (and Linux, including Android) a monotonic clock is used,
+** elsewhere the processor time.
+*/
+#define LUAI_QUOTASTEP		1000
+
+#if defined(LUA_CORE)
+#include <time.h>
+#if defined(LUA_USE_POSIX) || defined(__linux__)
+#define luai_quotaclock(t)	{ struct timespec ts_; \
+	clock_gettime(CLOCK_MONOTONIC, &ts_); \
+	(t) = ts_.tv_sec * 1000.0 + ts_.tv_nsec / 1000000.0; }
+#else
+#define luai_quotaclock(t)	((t) = clock() * 1000.0 / CLOCKS_PER_SEC)
+#endif
+#endif
+
+
+/*
+@@ luai_samplelock/luai_sampleunlock guard the thread a state is running
+@* against lua_requestsample, which may be called from other threads.
+** CHANGE them if your compiler lacks the GCC atomic builtins; without
+** them lua_requestsample must not be called from another thread.
+*/
+#if defined(__GNUC__)
+#define luai_samplelock(g)	{ while (__sync_lock_test_and_set(&(g)->samplelock, 1)) 	{ /* spin */ } }
+#define luai_sampleunlock(g)	__sync_lock_release(&(g)->samplelock)
+#else
+#define luai_samplelock(g)	((void)0)
+#define luai_sampleunlock(g)	((void)0)
+#endif
+
+
+/*
+@@ luai_hookmaskset/luai_hookmaskclear set and clear bits of the hook
+@* mask of a thread, which lua_requestsample and lua_interrupt may update
+@* from other threads; luai_hookmaskcas replaces the mask if it is still `o'.
+** CHANGE them along with luai_samplelock.
+*/
+#if defined(__GNUC__)
+#define luai_hookmaskset(L,m)	((void)__sync_fetch_and_or(&(L)->hookmask, cast_byte(m)))
+#define luai_hookmaskclear(L,m)	((void)__sync_fetch_and_and(&(L)->hookmask, cast_byte(~(m))))
+#define luai_hookmaskcas(L,o,n)	__sync_bool_compare_and_swap(&(L)->hookmask, (o), (n))
+#else
+#define luai_hookmaskset(L,m)	((void)((L)->hookmask |= cast_byte(m)))
+#define luai_hookmaskclear(L,m)	((void)((L)->hookmask &= cast_byte(~(m))))
+#define luai_hookmaskcas(L,o,n)	((L)->hookmask = (n), 1)
+#endif
+
+
 /*
 @@ The luai_num* macros define the primitive operations over numbers.
 */
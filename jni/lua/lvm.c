@@ -61,9 +61,18 @@ static void traceexec (lua_State *L, const Instruction *pc) {
   lu_byte mask = L->hookmask;
   const Instruction *oldpc = L->savedpc;
   L->savedpc = pc;
-  if ((mask & LUA_MASKCOUNT) && L->hookcount == 0) {
+  if ((mask & (LUA_MASKCOUNT | LUA_MASKQUOTA | LUA_MASKSAMPLE)) &&
+      L->hookcount == 0) {
     resethookcount(L);
-    luaD_callhook(L, LUA_HOOKCOUNT, -1);
+    if (mask & LUA_MASKSAMPLE)
+      luaG_sample(L);
+    if (mask & LUA_MASKQUOTA) {
+      luaG_checkquota(L);
+      if (L->status == LUA_YIELD)  /* quota yielded? */
+        return;
+    }
+    if (mask & LUA_MASKCOUNT)
+      luaD_callhook(L, LUA_HOOKCOUNT, -1);
   }
   if (mask & LUA_MASKLINE) {
     Proto *p = ci_func(L->ci)->l.p;
@@ -361,6 +370,20 @@ static void Arith (lua_State *L, StkId ra, const TValue *rb,
 #define Protect(x)	{ L->savedpc = pc; {x;}; base = L->base; }
 
 
+#if defined(LUA_USE_VMSTATS)
+#define countinstr(L,p,pc,i,last) { \
+        global_State *g_ = G(L); \
+        int op_ = GET_OPCODE(i); \
+        g_->vmops[op_]++; \
+        if (last >= 0) g_->vmpairs[last][op_]++; \
+        last = op_; \
+        (p)->vmcounts[(pc) - 1 - (p)->code]++; \
+      }
+#else
+#define countinstr(L,p,pc,i,last)	((void)0)
+#endif
+
+
 #define arith_op(op,tm) { \
         TValue *rb = RKB(i); \
         TValue *rc = RKC(i); \
@@ -379,17 +402,25 @@ void luaV_execute (lua_State *L, int nexeccalls) {
   StkId base;
   TValue *k;
   const Instruction *pc;
+#if defined(LUA_USE_VMSTATS)
+  int lastop = -1;  /* opcode run before, to count pairs */
+#endif
  reentry:  /* entry point */
   lua_assert(isLua(L->ci));
   pc = L->savedpc;
   cl = &clvalue(L->ci->func)->l;
   base = L->base;
   k = cl->p->k;
+#if defined(LUA_USE_VMSTATS)
+  if (cl->p->vmcounts == NULL)
+    luaF_newcounts(L, cl->p);
+#endif
   /* main loop of interpreter */
   for (;;) {
     const Instruction i = *pc++;
     StkId ra;
-    if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) &&
+    if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT | LUA_MASKQUOTA |
+                        LUA_MASKSAMPLE)) &&
         (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) {
       traceexec(L, pc);
       if (L->status == LUA_YIELD) {  /* did hook yield? */
@@ -398,6 +429,7 @@ void luaV_execute (lua_State *L, int nexeccalls) {
       }
       base = L->base;
     }
+    countinstr(L, cl->p, pc, i, lastop);
     /* warning!! several calls may realloc the stack and invalidate `ra' */
     ra = RA(i);
     lua_assert(base == L->base && L->base == L->ci->base);
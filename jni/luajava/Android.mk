@@ -4,7 +4,7 @@ include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../lua
 LOCAL_MODULE     := luajava
-LOCAL_SRC_FILES  := luajava.c
+LOCAL_SRC_FILES  := luajava.c luachannel.c luaserialize.c luascheduler.c luaparallel.c luaframes.c luastats.c luaprofile.c luatrace.c luaheap.c luarefs.c luastartup.c
 LOCAL_STATIC_LIBRARIES := liblua
 
 include $(BUILD_SHARED_LIBRARY)
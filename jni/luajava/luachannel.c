@@ -0,0 +1,1092 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.channel, a bounded lock-free MPMC
+*    ring buffer shared by any number of lua States. Values are encoded
+*    into a flat malloc'ed message on send and decoded on receive, so no
+*    lua object is ever shared between States and the JVM is not involved.
+*
+*    Supported values are nil, booleans, numbers, strings, channels and
+*    tables whose keys and values are any of those except tables.
+*
+*    The queue follows the classic sequence-numbered bounded queue: each
+*    cell carries a sequence number telling producers and consumers whose
+*    turn it is, and positions are claimed with a compare-and-swap.
+*    Blocking operations spin briefly and then back off with short sleeps.
+*
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luachannel.h"
+
+
+/* Encoded value tags */
+#define CHANNEL_TNIL      0
+#define CHANNEL_TFALSE    1
+#define CHANNEL_TTRUE     2
+#define CHANNEL_TNUMBER   3
+#define CHANNEL_TSTRING   4
+#define CHANNEL_TTABLE    5
+#define CHANNEL_TCHANNEL  6
+
+/* Iterations spent spinning before a blocked operation starts sleeping */
+#define CHANNEL_SPINS     64
+/* Longest sleep of a blocked operation, in nanoseconds */
+#define CHANNEL_MAXSLEEP  1000000
+
+#define CHANNEL_LOAD( p )        ( __sync_synchronize() , *( p ) )
+#define CHANNEL_STORE( p , v )   do { __sync_synchronize(); *( p ) = ( v ); } while ( 0 )
+
+typedef struct
+{
+   volatile size_t seq;
+   char * data;
+} ChannelCell;
+
+typedef struct Channel
+{
+   ChannelCell * cells;
+   size_t mask;
+   char pad0[ 64 ];
+   volatile size_t enqueuePos;
+   char pad1[ 64 ];
+   volatile size_t dequeuePos;
+   char pad2[ 64 ];
+   volatile int refs;
+   char * name;
+   struct Channel * next;
+} Channel;
+
+typedef struct
+{
+   char * data;
+   size_t len;
+   size_t size;
+   int failed;
+} ChannelMessage;
+
+/* Named channels live for the whole process; the list owns one reference */
+static Channel * named_channels = NULL;
+static pthread_mutex_t named_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/***************************************************************************
+*
+* $FC channelNew
+*
+* $ED Description
+*    allocates a channel for at least capacity messages, rounded up to a
+*    power of two
+*
+* $EP Function Parameters
+*    $P capacity - minimum number of messages the channel holds
+*
+* $FV Returned Value
+*    Channel * - the new channel with one reference, or NULL
+*
+*$. **********************************************************************/
+
+   static Channel * channelNew( size_t capacity );
+
+
+/***************************************************************************
+*
+* $FC channelRelease
+*
+* $ED Description
+*    drops a reference to the channel, freeing it and any pending
+*    messages when it was the last one
+*
+* $EP Function Parameters
+*    $P ch - channel
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void channelRelease( Channel * ch );
+
+
+/***************************************************************************
+*
+* $FC channelEnqueue
+*
+* $ED Description
+*    tries to append a message without blocking
+*
+* $EP Function Parameters
+*    $P ch - channel
+*    $P data - encoded message
+*
+* $FV Returned Value
+*    int - 1 on success, 0 if the channel is full
+*
+*$. **********************************************************************/
+
+   static int channelEnqueue( Channel * ch , char * data );
+
+
+/***************************************************************************
+*
+* $FC channelDequeue
+*
+* $ED Description
+*    tries to remove the oldest message without blocking
+*
+* $EP Function Parameters
+*    $P ch - channel
+*
+* $FV Returned Value
+*    char * - the encoded message, or NULL if the channel is empty
+*
+*$. **********************************************************************/
+
+   static char * channelDequeue( Channel * ch );
+
+
+/***************************************************************************
+*
+* $FC checkValue
+*
+* $ED Description
+*    raises a lua error if the value at idx cannot be sent through a
+*    channel. Run before encoding so that encoding itself never fails
+*    half way through with references already taken.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P idx - absolute stack index of the value
+*    $P nested - 1 if the value is inside a table
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void checkValue( lua_State * L , int idx , int nested );
+
+
+/***************************************************************************
+*
+* $FC encodeValue
+*
+* $ED Description
+*    appends the value at idx, already accepted by checkValue, to the
+*    message
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P msg - message being built
+*    $P idx - absolute stack index of the value
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void encodeValue( lua_State * L , ChannelMessage * msg , int idx );
+
+
+/***************************************************************************
+*
+* $FC decodeValue
+*
+* $ED Description
+*    pushes the value encoded at *pos and advances it
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P pos - read position inside the message
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void decodeValue( lua_State * L , const char ** pos );
+
+
+/***************************************************************************
+*
+* $FC walkMessage
+*
+* $ED Description
+*    visits every channel referenced by a message, either taking a
+*    reference to it or releasing one
+*
+* $EP Function Parameters
+*    $P data - encoded message
+*    $P retain - 1 to take references, 0 to release them
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void walkMessage( const char * data , int retain );
+
+
+/***************************************************************************
+*
+* $FC channelBackoff
+*
+* $ED Description
+*    waits a little before a blocked operation retries
+*
+* $EP Function Parameters
+*    $P attempt - number of failed attempts so far
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void channelBackoff( int attempt );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: channelNew
+*  ****/
+
+Channel * channelNew( size_t capacity )
+{
+   Channel * ch;
+   size_t size = 2;
+   size_t i;
+
+   while ( size < capacity )
+   {
+      size <<= 1;
+   }
+
+   ch = ( Channel * ) calloc( 1 , sizeof( Channel ) );
+   if ( ch == NULL )
+   {
+      return NULL;
+   }
+
+   ch->cells = ( ChannelCell * ) malloc( size * sizeof( ChannelCell ) );
+   if ( ch->cells == NULL )
+   {
+      free( ch );
+      return NULL;
+   }
+
+   for ( i = 0 ; i < size ; i++ )
+   {
+      ch->cells[ i ].seq  = i;
+      ch->cells[ i ].data = NULL;
+   }
+
+   ch->mask = size - 1;
+   ch->refs = 1;
+
+   return ch;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelRelease
+*  ****/
+
+void channelRelease( Channel * ch )
+{
+   char * data;
+
+   if ( __sync_sub_and_fetch( &ch->refs , 1 ) != 0 )
+   {
+      return;
+   }
+
+   while ( ( data = channelDequeue( ch ) ) != NULL )
+   {
+      walkMessage( data , 0 );
+      free( data );
+   }
+
+   free( ch->cells );
+   free( ch );
+}
+
+
+/***************************************************************************
+*
+*  Function: channelEnqueue
+*  ****/
+
+int channelEnqueue( Channel * ch , char * data )
+{
+   ChannelCell * cell;
+   size_t pos = CHANNEL_LOAD( &ch->enqueuePos );
+   intptr_t dif;
+
+   for ( ;; )
+   {
+      cell = &ch->cells[ pos & ch->mask ];
+      dif  = ( intptr_t ) CHANNEL_LOAD( &cell->seq ) - ( intptr_t ) pos;
+
+      if ( dif == 0 )
+      {
+         if ( __sync_bool_compare_and_swap( &ch->enqueuePos , pos , pos + 1 ) )
+         {
+            break;
+         }
+         pos = CHANNEL_LOAD( &ch->enqueuePos );
+      }
+      else if ( dif < 0 )
+      {
+         return 0;
+      }
+      else
+      {
+         pos = CHANNEL_LOAD( &ch->enqueuePos );
+      }
+   }
+
+   cell->data = data;
+   CHANNEL_STORE( &cell->seq , pos + 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelDequeue
+*  ****/
+
+char * channelDequeue( Channel * ch )
+{
+   ChannelCell * cell;
+   size_t pos = CHANNEL_LOAD( &ch->dequeuePos );
+   intptr_t dif;
+   char * data;
+
+   for ( ;; )
+   {
+      cell = &ch->cells[ pos & ch->mask ];
+      dif  = ( intptr_t ) CHANNEL_LOAD( &cell->seq ) - ( intptr_t ) ( pos + 1 );
+
+      if ( dif == 0 )
+      {
+         if ( __sync_bool_compare_and_swap( &ch->dequeuePos , pos , pos + 1 ) )
+         {
+            break;
+         }
+         pos = CHANNEL_LOAD( &ch->dequeuePos );
+      }
+      else if ( dif < 0 )
+      {
+         return NULL;
+      }
+      else
+      {
+         pos = CHANNEL_LOAD( &ch->dequeuePos );
+      }
+   }
+
+   data = cell->data;
+   CHANNEL_STORE( &cell->seq , pos + ch->mask + 1 );
+
+   return data;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelBackoff
+*  ****/
+
+void channelBackoff( int attempt )
+{
+   struct timespec ts;
+   long ns;
+
+   if ( attempt < CHANNEL_SPINS )
+   {
+      sched_yield();
+      return;
+   }
+
+   ns = 1000L << ( ( attempt - CHANNEL_SPINS ) < 10 ? ( attempt - CHANNEL_SPINS ) : 10 );
+   if ( ns > CHANNEL_MAXSLEEP )
+   {
+      ns = CHANNEL_MAXSLEEP;
+   }
+
+   ts.tv_sec  = 0;
+   ts.tv_nsec = ns;
+   nanosleep( &ts , NULL );
+}
+
+
+/***************************************************************************
+*
+*  Function: messageWrite
+*  ****/
+
+static void messageWrite( ChannelMessage * msg , const void * src , size_t len )
+{
+   if ( msg->failed )
+   {
+      return;
+   }
+
+   if ( msg->len + len > msg->size )
+   {
+      size_t size = msg->size * 2;
+      char * data;
+
+      while ( size < msg->len + len )
+      {
+         size *= 2;
+      }
+
+      data = ( char * ) realloc( msg->data , size );
+      if ( data == NULL )
+      {
+         msg->failed = 1;
+         return;
+      }
+      msg->data = data;
+      msg->size = size;
+   }
+
+   memcpy( msg->data + msg->len , src , len );
+   msg->len += len;
+}
+
+
+/***************************************************************************
+*
+*  Function: messageTag
+*  ****/
+
+static void messageTag( ChannelMessage * msg , char tag )
+{
+   messageWrite( msg , &tag , 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: checkValue
+*  ****/
+
+void checkValue( lua_State * L , int idx , int nested )
+{
+   switch ( lua_type( L , idx ) )
+   {
+      case LUA_TNIL:
+      case LUA_TBOOLEAN:
+      case LUA_TNUMBER:
+      case LUA_TSTRING:
+         break;
+
+      case LUA_TTABLE:
+         if ( nested )
+         {
+            luaL_error( L , "cannot send nested tables through a channel" );
+         }
+
+         lua_pushnil( L );
+         while ( lua_next( L , idx ) != 0 )
+         {
+            checkValue( L , lua_gettop( L ) - 1 , 1 );
+            checkValue( L , lua_gettop( L ) , 1 );
+            lua_pop( L , 1 );
+         }
+         break;
+
+      case LUA_TUSERDATA:
+         luaL_checkudata( L , idx , LUAJAVACHANNELMETATABLE );
+         break;
+
+      default:
+         luaL_error( L , "cannot send a %s through a channel" , luaL_typename( L , idx ) );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: encodeValue
+*  ****/
+
+void encodeValue( lua_State * L , ChannelMessage * msg , int idx )
+{
+   switch ( lua_type( L , idx ) )
+   {
+      case LUA_TNIL:
+         messageTag( msg , CHANNEL_TNIL );
+         break;
+
+      case LUA_TBOOLEAN:
+         messageTag( msg , lua_toboolean( L , idx ) ? CHANNEL_TTRUE : CHANNEL_TFALSE );
+         break;
+
+      case LUA_TNUMBER:
+      {
+         lua_Number n = lua_tonumber( L , idx );
+
+         messageTag( msg , CHANNEL_TNUMBER );
+         messageWrite( msg , &n , sizeof( n ) );
+         break;
+      }
+
+      case LUA_TSTRING:
+      {
+         size_t len;
+         const char * s = lua_tolstring( L , idx , &len );
+
+         messageTag( msg , CHANNEL_TSTRING );
+         messageWrite( msg , &len , sizeof( len ) );
+         messageWrite( msg , s , len );
+         break;
+      }
+
+      case LUA_TTABLE:
+      {
+         size_t countPos;
+         size_t count = 0;
+         int narr = lua_objlen( L , idx );
+
+         messageTag( msg , CHANNEL_TTABLE );
+         messageWrite( msg , &narr , sizeof( narr ) );
+         countPos = msg->len;
+         messageWrite( msg , &count , sizeof( count ) );
+
+         lua_pushnil( L );
+         while ( lua_next( L , idx ) != 0 )
+         {
+            encodeValue( L , msg , lua_gettop( L ) - 1 );
+            encodeValue( L , msg , lua_gettop( L ) );
+            lua_pop( L , 1 );
+            count++;
+         }
+
+         if ( !msg->failed )
+         {
+            memcpy( msg->data + countPos , &count , sizeof( count ) );
+         }
+         break;
+      }
+
+      case LUA_TUSERDATA:
+         messageTag( msg , CHANNEL_TCHANNEL );
+         messageWrite( msg , lua_touserdata( L , idx ) , sizeof( Channel * ) );
+         break;
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: pushChannel
+*  ****/
+
+static void pushChannel( lua_State * L , Channel * ch )
+{
+   Channel ** ud = ( Channel ** ) lua_newuserdata( L , sizeof( Channel * ) );
+
+   *ud = ch;
+   luaL_getmetatable( L , LUAJAVACHANNELMETATABLE );
+   lua_setmetatable( L , -2 );
+}
+
+
+/***************************************************************************
+*
+*  Function: decodeValue
+*  ****/
+
+void decodeValue( lua_State * L , const char ** pos )
+{
+   char tag = **pos;
+
+   ( *pos )++;
+
+   switch ( tag )
+   {
+      case CHANNEL_TNIL:
+         lua_pushnil( L );
+         break;
+
+      case CHANNEL_TFALSE:
+         lua_pushboolean( L , 0 );
+         break;
+
+      case CHANNEL_TTRUE:
+         lua_pushboolean( L , 1 );
+         break;
+
+      case CHANNEL_TNUMBER:
+      {
+         lua_Number n;
+
+         memcpy( &n , *pos , sizeof( n ) );
+         *pos += sizeof( n );
+         lua_pushnumber( L , n );
+         break;
+      }
+
+      case CHANNEL_TSTRING:
+      {
+         size_t len;
+
+         memcpy( &len , *pos , sizeof( len ) );
+         *pos += sizeof( len );
+         lua_pushlstring( L , *pos , len );
+         *pos += len;
+         break;
+      }
+
+      case CHANNEL_TTABLE:
+      {
+         int narr;
+         size_t count;
+
+         memcpy( &narr , *pos , sizeof( narr ) );
+         *pos += sizeof( narr );
+         memcpy( &count , *pos , sizeof( count ) );
+         *pos += sizeof( count );
+
+         lua_createtable( L , narr , ( int ) count > narr ? ( int ) count - narr : 0 );
+         while ( count-- > 0 )
+         {
+            decodeValue( L , pos );
+            decodeValue( L , pos );
+            lua_rawset( L , -3 );
+         }
+         break;
+      }
+
+      case CHANNEL_TCHANNEL:
+      {
+         Channel * ch;
+
+         /* the reference taken by the sender is handed over to the userdata */
+         memcpy( &ch , *pos , sizeof( ch ) );
+         *pos += sizeof( ch );
+         pushChannel( L , ch );
+         break;
+      }
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: walkValue
+*  ****/
+
+static void walkValue( const char ** pos , int retain )
+{
+   char tag = **pos;
+
+   ( *pos )++;
+
+   switch ( tag )
+   {
+      case CHANNEL_TNUMBER:
+         *pos += sizeof( lua_Number );
+         break;
+
+      case CHANNEL_TSTRING:
+      {
+         size_t len;
+
+         memcpy( &len , *pos , sizeof( len ) );
+         *pos += sizeof( len ) + len;
+         break;
+      }
+
+      case CHANNEL_TTABLE:
+      {
+         size_t count;
+
+         *pos += sizeof( int );
+         memcpy( &count , *pos , sizeof( count ) );
+         *pos += sizeof( count );
+         while ( count-- > 0 )
+         {
+            walkValue( pos , retain );
+            walkValue( pos , retain );
+         }
+         break;
+      }
+
+      case CHANNEL_TCHANNEL:
+      {
+         Channel * ch;
+
+         memcpy( &ch , *pos , sizeof( ch ) );
+         *pos += sizeof( ch );
+         if ( retain )
+         {
+            __sync_add_and_fetch( &ch->refs , 1 );
+         }
+         else
+         {
+            channelRelease( ch );
+         }
+         break;
+      }
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: walkMessage
+*  ****/
+
+void walkMessage( const char * data , int retain )
+{
+   const char * pos = data;
+   int n;
+
+   memcpy( &n , pos , sizeof( n ) );
+   pos += sizeof( n );
+
+   while ( n-- > 0 )
+   {
+      walkValue( &pos , retain );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: encodeMessage
+*  ****/
+
+static char * encodeMessage( lua_State * L , int first , int last )
+{
+   ChannelMessage msg;
+   int n = last - first + 1;
+   int i;
+
+   for ( i = first ; i <= last ; i++ )
+   {
+      checkValue( L , i , 0 );
+   }
+
+   msg.size   = 64;
+   msg.len    = 0;
+   msg.failed = 0;
+   msg.data   = ( char * ) malloc( msg.size );
+   if ( msg.data == NULL )
+   {
+      luaL_error( L , "not enough memory for channel message" );
+   }
+
+   messageWrite( &msg , &n , sizeof( n ) );
+   for ( i = first ; i <= last ; i++ )
+   {
+      encodeValue( L , &msg , i );
+   }
+
+   if ( msg.failed )
+   {
+      free( msg.data );
+      luaL_error( L , "not enough memory for channel message" );
+   }
+
+   walkMessage( msg.data , 1 );
+
+   return msg.data;
+}
+
+
+/***************************************************************************
+*
+*  Function: decodeMessage
+*  ****/
+
+static int decodeMessage( lua_State * L , char * data )
+{
+   const char * pos = data;
+   int n;
+   int i;
+
+   memcpy( &n , pos , sizeof( n ) );
+   pos += sizeof( n );
+
+   if ( !lua_checkstack( L , n + LUA_MINSTACK ) )
+   {
+      walkMessage( data , 0 );
+      free( data );
+      return luaL_error( L , "too many values in channel message" );
+   }
+
+   for ( i = 0 ; i < n ; i++ )
+   {
+      decodeValue( L , &pos );
+   }
+
+   free( data );
+
+   return n;
+}
+
+
+/***************************************************************************
+*
+*  Function: checkChannel
+*  ****/
+
+static Channel * checkChannel( lua_State * L )
+{
+   return *( Channel ** ) luaL_checkudata( L , 1 , LUAJAVACHANNELMETATABLE );
+}
+
+
+/***************************************************************************
+*
+*  Function: channelSend
+*  ****/
+
+static int channelSend( lua_State * L )
+{
+   Channel * ch = checkChannel( L );
+   char * data = encodeMessage( L , 2 , lua_gettop( L ) );
+   int attempt = 0;
+
+   while ( !channelEnqueue( ch , data ) )
+   {
+      channelBackoff( attempt++ );
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelTrySend
+*  ****/
+
+static int channelTrySend( lua_State * L )
+{
+   Channel * ch = checkChannel( L );
+   char * data = encodeMessage( L , 2 , lua_gettop( L ) );
+
+   if ( !channelEnqueue( ch , data ) )
+   {
+      walkMessage( data , 0 );
+      free( data );
+      lua_pushboolean( L , 0 );
+      return 1;
+   }
+
+   lua_pushboolean( L , 1 );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelRecv
+*  ****/
+
+static int channelRecv( lua_State * L )
+{
+   Channel * ch = checkChannel( L );
+   char * data;
+   int attempt = 0;
+
+   while ( ( data = channelDequeue( ch ) ) == NULL )
+   {
+      channelBackoff( attempt++ );
+   }
+
+   lua_settop( L , 0 );
+   return decodeMessage( L , data );
+}
+
+
+/***************************************************************************
+*
+*  Function: channelTryRecv
+*  ****/
+
+static int channelTryRecv( lua_State * L )
+{
+   Channel * ch = checkChannel( L );
+   char * data = channelDequeue( ch );
+
+   lua_settop( L , 0 );
+
+   if ( data == NULL )
+   {
+      lua_pushboolean( L , 0 );
+      return 1;
+   }
+
+   lua_pushboolean( L , 1 );
+   return decodeMessage( L , data ) + 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelGc
+*  ****/
+
+static int channelGc( lua_State * L )
+{
+   Channel ** ud = ( Channel ** ) luaL_checkudata( L , 1 , LUAJAVACHANNELMETATABLE );
+
+   if ( *ud != NULL )
+   {
+      channelRelease( *ud );
+      *ud = NULL;
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: channelToString
+*  ****/
+
+static int channelToString( lua_State * L )
+{
+   Channel * ch = checkChannel( L );
+
+   if ( ch->name != NULL )
+   {
+      lua_pushfstring( L , "channel: %s (%p)" , ch->name , ch );
+   }
+   else
+   {
+      lua_pushfstring( L , "channel: %p" , ch );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaChannel
+*  ****/
+
+static int javaChannel( lua_State * L )
+{
+   lua_Integer capacity = luaL_checkinteger( L , 1 );
+   const char * name = luaL_optstring( L , 2 , NULL );
+   Channel * ch;
+
+   if ( capacity < 1 )
+   {
+      return luaL_argerror( L , 1 , "capacity must be positive" );
+   }
+
+   if ( name == NULL )
+   {
+      ch = channelNew( ( size_t ) capacity );
+      if ( ch == NULL )
+      {
+         return luaL_error( L , "not enough memory for channel" );
+      }
+      pushChannel( L , ch );
+      return 1;
+   }
+
+   pthread_mutex_lock( &named_mutex );
+
+   for ( ch = named_channels ; ch != NULL ; ch = ch->next )
+   {
+      if ( strcmp( ch->name , name ) == 0 )
+      {
+         break;
+      }
+   }
+
+   if ( ch == NULL )
+   {
+      ch = channelNew( ( size_t ) capacity );
+      if ( ch != NULL && ( ch->name = strdup( name ) ) == NULL )
+      {
+         channelRelease( ch );
+         ch = NULL;
+      }
+      if ( ch != NULL )
+      {
+         ch->next = named_channels;
+         named_channels = ch;
+      }
+   }
+
+   if ( ch != NULL )
+   {
+      __sync_add_and_fetch( &ch->refs , 1 );
+   }
+
+   pthread_mutex_unlock( &named_mutex );
+
+   if ( ch == NULL )
+   {
+      return luaL_error( L , "not enough memory for channel" );
+   }
+
+   pushChannel( L , ch );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openchannel
+*  ****/
+
+void luajava_openchannel( lua_State * L )
+{
+   static const luaL_Reg methods[] =
+   {
+      { "send" , channelSend } ,
+      { "try_send" , channelTrySend } ,
+      { "recv" , channelRecv } ,
+      { "try_recv" , channelTryRecv } ,
+      { NULL , NULL }
+   };
+
+   luaL_newmetatable( L , LUAJAVACHANNELMETATABLE );
+
+   lua_pushstring( L , "__gc" );
+   lua_pushcfunction( L , &channelGc );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__tostring" );
+   lua_pushcfunction( L , &channelToString );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__index" );
+   lua_newtable( L );
+   luaL_register( L , NULL , methods );
+   lua_rawset( L , -3 );
+
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "channel" );
+   lua_pushcfunction( L , &javaChannel );
+   lua_settable( L , -3 );
+}
@@ -0,0 +1,36 @@
+/***************************************************************************
+*
+* $ED
+*    Bounded multi-producer multi-consumer channels that copy Lua values
+*    between independent lua States without going through the JVM.
+*
+*****************************************************************************/
+
+#ifndef LUACHANNEL_H
+#define LUACHANNEL_H
+
+#include "lua.h"
+
+/* Metatable name of channel userdata */
+#define LUAJAVACHANNELMETATABLE "luajava.channel"
+
+
+/***************************************************************************
+*
+* $FC luajava_openchannel
+*
+* $ED Description
+*    registers the channel constructor in the table on top of the stack
+*    (the luajava table) and creates the channel metatable
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openchannel( lua_State * L );
+
+#endif
@@ -0,0 +1,821 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.frames, a cooperative scheduler that
+*    spreads the work of lua coroutines over the frames of an application.
+*
+*    local frames = luajava.frames(4)         -- 4 ms per tick
+*    local task = frames:spawn(f, ...)
+*    ...
+*    frames:tick()                            -- once per frame
+*
+*    A tick resumes the ready tasks round robin until its time budget is
+*    used up. A count hook checks the clock every quantum instructions and
+*    forces the running task to yield once its slice of the budget is
+*    over; such a task stays ready and runs again in the same tick if time
+*    is left. A task that yields by itself waits for the next tick.
+*
+*    Forced yields only happen at safe points: as any yield in Lua 5.1 they
+*    cannot cross a pcall, a metamethod or a C function, so code running
+*    there overruns its slice until it returns to plain lua code.
+*
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luaframes.h"
+
+
+/* Metatables of schedulers and of their tasks */
+#define LUAFRAMESMETATABLE    "luajava.frames"
+#define LUAFRAMETASKMETATABLE "luajava.frames.task"
+/* Default time budget of a tick, in milliseconds */
+#define LUAFRAMES_BUDGET      4
+/* Part of the budget a tick may exceed (by the granularity of the hook)
+   before it counts as an overrun */
+#define LUAFRAMES_TOLERANCE   0.1
+
+#define TASK_READY            0
+#define TASK_WAITING          1
+#define TASK_DONE             2
+#define TASK_ERROR            3
+#define TASK_CANCELLED        4
+
+static const char * const task_states[] =
+{
+   "ready" , "waiting" , "done" , "error" , "cancelled"
+};
+
+/* The task being resumed by a tick on this thread, read by the hook */
+typedef struct
+{
+   lua_State * co;
+   double deadline;
+   int preempted;
+} FrameSlice;
+
+typedef struct
+{
+   double budget;
+   int quantum;
+   int next;
+   int running;
+   unsigned long ticks;
+   unsigned long overruns;
+   double lastTick;
+   double maxTick;
+   FrameSlice slice;
+} FrameScheduler;
+
+typedef struct
+{
+   lua_State * co;
+   int state;
+   int started;
+   int running;
+   unsigned long id;
+   unsigned long resumes;
+   unsigned long preemptions;
+   double total;
+   double max;
+   double last;
+} FrameTask;
+
+static pthread_key_t slice_key;
+static pthread_once_t slice_once = PTHREAD_ONCE_INIT;
+static volatile unsigned long next_task = 0;
+
+
+/***************************************************************************
+*
+* $FC frameHook
+*
+* $ED Description
+*    count hook of the tasks, yielding once the slice is over
+*
+* $EP Function Parameters
+*    $P L - coroutine of the task
+*    $P ar - hook event
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void frameHook( lua_State * L , lua_Debug * ar );
+
+
+/***************************************************************************
+*
+* $FC framesTick
+*
+* $ED Description
+*    Implementation of frames:tick([budget]), returns the number of live
+*    tasks
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+*
+*$. **********************************************************************/
+
+   static int framesTick( lua_State * L );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: nowMillis
+*  ****/
+
+static double nowMillis( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC , &ts );
+
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+/***************************************************************************
+*
+*  Function: createSliceKey
+*  ****/
+
+static void createSliceKey( void )
+{
+   pthread_key_create( &slice_key , NULL );
+}
+
+
+/***************************************************************************
+*
+*  Function: frameHook
+*  ****/
+
+void frameHook( lua_State * L , lua_Debug * ar )
+{
+   FrameSlice * slice = ( FrameSlice * ) pthread_getspecific( slice_key );
+
+   /* coroutines created by the task inherit the hook, but only the task
+      itself may be preempted */
+   if ( slice == NULL || slice->co != L || !lua_isyieldable( L ) )
+   {
+      return;
+   }
+
+   if ( nowMillis() >= slice->deadline )
+   {
+      slice->preempted = 1;
+      lua_yield( L , 0 );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: checkFrames
+*  ****/
+
+static FrameScheduler * checkFrames( lua_State * L , int idx )
+{
+   return ( FrameScheduler * ) luaL_checkudata( L , idx , LUAFRAMESMETATABLE );
+}
+
+
+/***************************************************************************
+*
+*  Function: checkTask
+*  ****/
+
+static FrameTask * checkTask( lua_State * L , int idx )
+{
+   return ( FrameTask * ) luaL_checkudata( L , idx , LUAFRAMETASKMETATABLE );
+}
+
+
+/***************************************************************************
+*
+*  Function: newFrames
+*  ****/
+
+static int newFrames( lua_State * L )
+{
+   lua_Number budget = luaL_optnumber( L , 1 , LUAFRAMES_BUDGET );
+   int quantum = luaL_optint( L , 2 , LUAFRAMES_QUANTUM );
+   FrameScheduler * s;
+
+   luaL_argcheck( L , budget > 0 , 1 , "budget must be positive" );
+   luaL_argcheck( L , quantum > 0 , 2 , "quantum must be positive" );
+
+   s = ( FrameScheduler * ) lua_newuserdata( L , sizeof( FrameScheduler ) );
+   memset( s , 0 , sizeof( FrameScheduler ) );
+   s->budget  = ( double ) budget;
+   s->quantum = quantum;
+
+   luaL_getmetatable( L , LUAFRAMESMETATABLE );
+   lua_setmetatable( L , -2 );
+
+   /* the environment holds the live tasks */
+   lua_newtable( L );
+   lua_setfenv( L , -2 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: framesSpawn
+*  ****/
+
+static int framesSpawn( lua_State * L )
+{
+   FrameScheduler * s = checkFrames( L , 1 );
+   int nargs = lua_gettop( L ) - 2;
+   FrameTask * task;
+   lua_Debug ar;
+   lua_State * co;
+
+   luaL_checktype( L , 2 , LUA_TFUNCTION );
+
+   task = ( FrameTask * ) lua_newuserdata( L , sizeof( FrameTask ) );
+   memset( task , 0 , sizeof( FrameTask ) );
+   task->id = __sync_add_and_fetch( &next_task , 1 );
+   luaL_getmetatable( L , LUAFRAMETASKMETATABLE );
+   lua_setmetatable( L , -2 );
+
+   /* the environment of the task anchors its coroutine and keeps its
+      source, results or error */
+   lua_createtable( L , 0 , 3 );
+
+   lua_pushvalue( L , 2 );
+   lua_getinfo( L , ">S" , &ar );
+   lua_pushfstring( L , "%s:%d" , ar.short_src , ar.linedefined );
+   lua_setfield( L , -2 , "source" );
+
+   co = lua_newthread( L );
+   if ( !lua_checkstack( co , nargs + 1 ) )
+   {
+      return luaL_error( L , "too many arguments" );
+   }
+   lua_pushvalue( L , 2 );
+   lua_xmove( L , co , 1 );
+   if ( nargs > 0 )
+   {
+      int i;
+
+      luaL_checkstack( L , nargs , "too many arguments" );
+      for ( i = 3 ; i < 3 + nargs ; i++ )
+      {
+         lua_pushvalue( L , i );
+      }
+      lua_xmove( L , co , nargs );
+   }
+   lua_setfield( L , -2 , "co" );
+   lua_setfenv( L , -2 );
+
+   task->co = co;
+   lua_sethook( co , &frameHook , LUA_MASKCOUNT , s->quantum );
+
+   lua_getfenv( L , 1 );
+   lua_pushvalue( L , -2 );
+   lua_rawseti( L , -2 , ( int ) lua_objlen( L , -2 ) + 1 );
+   lua_pop( L , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: finishTask
+*  ****/
+
+static void finishTask( lua_State * L , FrameTask * task , int status )
+{
+   lua_State * co = task->co;
+
+   /* the task is on top of the stack */
+   lua_getfenv( L , -1 );
+
+   if ( status == 0 )
+   {
+      int nres = lua_gettop( co );
+      int j;
+
+      task->state = TASK_DONE;
+      lua_createtable( L , nres , 1 );
+      luaL_checkstack( L , nres , "too many results" );
+      lua_xmove( co , L , nres );
+      for ( j = nres ; j >= 1 ; j-- )
+      {
+         lua_rawseti( L , -1 - j , j );
+      }
+      lua_pushinteger( L , nres );
+      lua_setfield( L , -2 , "n" );
+      lua_setfield( L , -2 , "results" );
+   }
+   else
+   {
+      task->state = TASK_ERROR;
+      lua_xmove( co , L , 1 );
+      lua_setfield( L , -2 , "error" );
+   }
+
+   /* lets the coroutine be collected */
+   task->co = NULL;
+   lua_pushnil( L );
+   lua_setfield( L , -2 , "co" );
+   lua_pop( L , 1 );
+}
+
+
+/* What a tick hands to resumeTasks */
+typedef struct
+{
+   FrameScheduler * s;
+   double deadline;
+   int n;
+   int ready;
+} FrameTick;
+
+
+/***************************************************************************
+*
+*  Function: resumeTasks
+*  ****/
+
+/* Resumes the ready tasks until the budget is used up; called protected
+   with the scheduler, its task list and the FrameTick, so that a tick
+   raising an error can still be ended by framesTick */
+static int resumeTasks( lua_State * L )
+{
+   FrameTick * t = ( FrameTick * ) lua_touserdata( L , 3 );
+   FrameScheduler * s = t->s;
+   double now , elapsed;
+   int k , status , resumed;
+
+   for ( resumed = 1 ; resumed && t->ready > 0 && nowMillis() < t->deadline ; )
+   {
+      for ( k = 0 , resumed = 0 ; k < t->n && t->ready > 0 ; k++ )
+      {
+         FrameTask * task;
+
+         lua_rawgeti( L , 2 , ( s->next + k ) % t->n + 1 );
+         task = ( FrameTask * ) lua_touserdata( L , -1 );
+         if ( task->state != TASK_READY )
+         {
+            lua_pop( L , 1 );
+            continue;
+         }
+
+         now = nowMillis();
+         if ( now >= t->deadline )
+         {
+            lua_pop( L , 1 );
+            break;
+         }
+
+         /* the ready tasks share what is left of the budget */
+         s->slice.co = task->co;
+         s->slice.deadline = now + ( t->deadline - now ) / t->ready;
+         s->slice.preempted = 0;
+
+         resumed = 1;
+         task->running = 1;
+         status = lua_resume( task->co , task->started ? 0 : lua_gettop( task->co ) - 1 );
+         task->running = 0;
+         task->started = 1;
+
+         elapsed = nowMillis() - now;
+         task->resumes++;
+         task->total += elapsed;
+         task->last = elapsed;
+         if ( elapsed > task->max )
+         {
+            task->max = elapsed;
+         }
+
+         if ( status == LUA_YIELD )
+         {
+            lua_settop( task->co , 0 );
+            if ( s->slice.preempted )
+            {
+               task->preemptions++;
+            }
+            else
+            {
+               task->state = TASK_WAITING;
+               t->ready--;
+            }
+         }
+         else
+         {
+            finishTask( L , task , status );
+            t->ready--;
+         }
+         lua_pop( L , 1 );
+      }
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: framesTick
+*  ****/
+
+int framesTick( lua_State * L )
+{
+   FrameScheduler * s = checkFrames( L , 1 );
+   double budget = ( double ) luaL_optnumber( L , 2 , s->budget );
+   double start;
+   void * outer;
+   FrameTick t;
+   int n , i , live , status;
+
+   luaL_argcheck( L , !s->running , 1 , "tick already running" );
+
+   start = nowMillis();
+
+   lua_settop( L , 1 );
+   lua_getfenv( L , 1 );
+   n = ( int ) lua_objlen( L , 2 );
+
+   t.s = s;
+   t.deadline = start + budget;
+   t.n = n;
+
+   /* tasks that yielded in the last tick are ready again */
+   for ( i = 1 , t.ready = 0 ; i <= n ; i++ )
+   {
+      FrameTask * task;
+
+      lua_rawgeti( L , 2 , i );
+      task = ( FrameTask * ) lua_touserdata( L , -1 );
+      if ( task->state == TASK_WAITING )
+      {
+         task->state = TASK_READY;
+      }
+      if ( task->state == TASK_READY )
+      {
+         t.ready++;
+      }
+      lua_pop( L , 1 );
+   }
+
+   lua_pushcfunction( L , &resumeTasks );
+   lua_pushvalue( L , 1 );
+   lua_pushvalue( L , 2 );
+   lua_pushlightuserdata( L , &t );
+
+   outer = pthread_getspecific( slice_key );
+   pthread_setspecific( slice_key , &s->slice );
+   s->running = 1;
+
+   status = lua_pcall( L , 3 , 0 , 0 );
+
+   s->slice.co = NULL;
+   s->running = 0;
+   pthread_setspecific( slice_key , outer );
+
+   if ( status != 0 )
+   {
+      /* the error is raised again once the tick has been ended */
+      lua_error( L );
+   }
+
+   /* drops finished tasks, keeping the order of the others (and of
+      those spawned during the tick) */
+   n = ( int ) lua_objlen( L , 2 );
+   for ( i = 1 , live = 0 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , 2 , i );
+      if ( ( ( FrameTask * ) lua_touserdata( L , -1 ) )->state <= TASK_WAITING )
+      {
+         lua_rawseti( L , 2 , ++live );
+      }
+      else
+      {
+         lua_pop( L , 1 );
+      }
+   }
+   for ( i = live + 1 ; i <= n ; i++ )
+   {
+      lua_pushnil( L );
+      lua_rawseti( L , 2 , i );
+   }
+   s->next = ( live > 0 ) ? ( s->next + 1 ) % live : 0;
+
+   s->ticks++;
+   s->lastTick = nowMillis() - start;
+   if ( s->lastTick > s->maxTick )
+   {
+      s->maxTick = s->lastTick;
+   }
+   if ( s->lastTick > budget * ( 1 + LUAFRAMES_TOLERANCE ) )
+   {
+      s->overruns++;
+   }
+
+   lua_pushinteger( L , live );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: pushTaskStats
+*  ****/
+
+static void pushTaskStats( lua_State * L , int idx )
+{
+   FrameTask * task = ( FrameTask * ) lua_touserdata( L , idx );
+
+   lua_createtable( L , 0 , 8 );
+
+   lua_pushnumber( L , ( lua_Number ) task->id );
+   lua_setfield( L , -2 , "id" );
+
+   lua_getfenv( L , idx );
+   lua_getfield( L , -1 , "source" );
+   lua_setfield( L , -3 , "source" );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , task_states[ task->state ] );
+   lua_setfield( L , -2 , "state" );
+
+   lua_pushnumber( L , ( lua_Number ) task->resumes );
+   lua_setfield( L , -2 , "resumes" );
+
+   lua_pushnumber( L , ( lua_Number ) task->preemptions );
+   lua_setfield( L , -2 , "preemptions" );
+
+   lua_pushnumber( L , task->total );
+   lua_setfield( L , -2 , "total" );
+
+   lua_pushnumber( L , task->max );
+   lua_setfield( L , -2 , "max" );
+
+   lua_pushnumber( L , task->last );
+   lua_setfield( L , -2 , "last" );
+}
+
+
+/***************************************************************************
+*
+*  Function: framesStats
+*  ****/
+
+static int framesStats( lua_State * L )
+{
+   FrameScheduler * s = checkFrames( L , 1 );
+   int n , i;
+
+   lua_createtable( L , 0 , 7 );
+
+   lua_pushnumber( L , s->budget );
+   lua_setfield( L , -2 , "budget" );
+
+   lua_pushnumber( L , ( lua_Number ) s->ticks );
+   lua_setfield( L , -2 , "ticks" );
+
+   lua_pushnumber( L , ( lua_Number ) s->overruns );
+   lua_setfield( L , -2 , "overruns" );
+
+   lua_pushnumber( L , s->lastTick );
+   lua_setfield( L , -2 , "last" );
+
+   lua_pushnumber( L , s->maxTick );
+   lua_setfield( L , -2 , "max" );
+
+   lua_getfenv( L , 1 );
+   n = ( int ) lua_objlen( L , -1 );
+   lua_createtable( L , n , 0 );
+   for ( i = 1 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , -2 , i );
+      pushTaskStats( L , lua_gettop( L ) );
+      lua_rawseti( L , -3 , i );
+      lua_pop( L , 1 );
+   }
+   lua_setfield( L , -3 , "tasks" );
+   lua_pop( L , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: framesToString
+*  ****/
+
+static int framesToString( lua_State * L )
+{
+   FrameScheduler * s = checkFrames( L , 1 );
+
+   lua_getfenv( L , 1 );
+   lua_pushfstring( L , "frames (%d tasks, %f ms): %p" , ( int ) lua_objlen( L , -1 ) ,
+                    ( lua_Number ) s->budget , ( void * ) s );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskStatus
+*  ****/
+
+static int taskStatus( lua_State * L )
+{
+   FrameTask * task = checkTask( L , 1 );
+
+   lua_pushstring( L , task_states[ task->state ] );
+   if ( task->state != TASK_ERROR )
+   {
+      return 1;
+   }
+
+   lua_getfenv( L , 1 );
+   lua_getfield( L , -1 , "error" );
+   lua_remove( L , -2 );
+
+   return 2;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskResults
+*  ****/
+
+static int taskResults( lua_State * L )
+{
+   FrameTask * task = checkTask( L , 1 );
+   int n , i;
+
+   if ( task->state != TASK_DONE )
+   {
+      return 0;
+   }
+
+   lua_getfenv( L , 1 );
+   lua_getfield( L , -1 , "results" );
+   lua_getfield( L , -1 , "n" );
+   n = ( int ) lua_tointeger( L , -1 );
+   lua_pop( L , 1 );
+
+   luaL_checkstack( L , n , "too many results" );
+   for ( i = 1 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , -i , i );
+   }
+
+   return n;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskStats
+*  ****/
+
+static int taskStats( lua_State * L )
+{
+   checkTask( L , 1 );
+   pushTaskStats( L , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskCancel
+*  ****/
+
+static int taskCancel( lua_State * L )
+{
+   FrameTask * task = checkTask( L , 1 );
+
+   if ( task->state > TASK_WAITING )
+   {
+      return 0;
+   }
+   if ( task->running )
+   {
+      return luaL_error( L , "cannot cancel a running task" );
+   }
+
+   /* dropped from its scheduler by the next tick */
+   task->state = TASK_CANCELLED;
+   task->co = NULL;
+   lua_getfenv( L , 1 );
+   lua_pushnil( L );
+   lua_setfield( L , -2 , "co" );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskToString
+*  ****/
+
+static int taskToString( lua_State * L )
+{
+   FrameTask * task = checkTask( L , 1 );
+
+   lua_getfenv( L , 1 );
+   lua_getfield( L , -1 , "source" );
+   lua_pushfstring( L , "frame task %d (%s, %s)" , ( int ) task->id ,
+                    lua_tostring( L , -1 ) , task_states[ task->state ] );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openframes
+*  ****/
+
+void luajava_openframes( lua_State * L )
+{
+   pthread_once( &slice_once , &createSliceKey );
+
+   luaL_newmetatable( L , LUAFRAMESMETATABLE );
+
+   lua_pushstring( L , "__tostring" );
+   lua_pushcfunction( L , &framesToString );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__index" );
+   lua_newtable( L );
+
+   lua_pushstring( L , "spawn" );
+   lua_pushcfunction( L , &framesSpawn );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "tick" );
+   lua_pushcfunction( L , &framesTick );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "stats" );
+   lua_pushcfunction( L , &framesStats );
+   lua_rawset( L , -3 );
+
+   lua_rawset( L , -3 );
+
+   lua_pop( L , 1 );
+
+   luaL_newmetatable( L , LUAFRAMETASKMETATABLE );
+
+   lua_pushstring( L , "__tostring" );
+   lua_pushcfunction( L , &taskToString );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__index" );
+   lua_newtable( L );
+
+   lua_pushstring( L , "status" );
+   lua_pushcfunction( L , &taskStatus );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "results" );
+   lua_pushcfunction( L , &taskResults );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "stats" );
+   lua_pushcfunction( L , &taskStats );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "cancel" );
+   lua_pushcfunction( L , &taskCancel );
+   lua_rawset( L , -3 );
+
+   lua_rawset( L , -3 );
+
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "frames" );
+   lua_pushcfunction( L , &newFrames );
+   lua_settable( L , -3 );
+}
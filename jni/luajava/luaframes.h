@@ -0,0 +1,36 @@
+/***************************************************************************
+*
+* $ED
+*    Frame budgeted cooperative scheduling of lua coroutines, see
+*    luaframes.c.
+*
+*****************************************************************************/
+
+#ifndef LUAFRAMES_H
+#define LUAFRAMES_H
+
+#include "lua.h"
+
+/* Instructions between two checks of the time budget */
+#define LUAFRAMES_QUANTUM     1000
+
+
+/***************************************************************************
+*
+* $FC luajava_openframes
+*
+* $ED Description
+*    registers frames in the table on top of the stack (the luajava
+*    table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openframes( lua_State * L );
+
+#endif
@@ -0,0 +1,878 @@
+/***************************************************************************
+*
+* $ED
+*    This module is a heap profiler of a lua State. Snapshots count the
+*    objects of the state and their bytes by type, walking the heap with
+*    lua_heapwalk. While the profiler runs, the heap hook of the state
+*    samples about one object every LUAHEAP_INTERVAL bytes allocated, and
+*    notes the lua frame creating it ("source:line", or "[C]" outside of
+*    lua functions) until it is freed, so that snapshots also count the
+*    sampled objects still alive by allocation site. Objects created at a
+*    site that keeps growing, like a cache never emptied, pile up there
+*    in the difference of two snapshots. From Lua:
+*
+*    luajava.heap.start()               -- or start(interval)
+*    local before = luajava.heap.snapshot()
+*    ...
+*    local after = luajava.heap.snapshot()
+*    print(luajava.heap.report(luajava.heap.diff(before, after)))
+*
+*    Snapshots run a full collection first, unless snapshot(false).
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luaheap.h"
+
+
+/* Registry key of the profiler of a state */
+#define LUAHEAPKEY            "luajava.heap"
+
+#define NO_SITE               ( -1 )
+
+static const char * const heap_types[] =
+{
+   "table" , "string" , "closure" , "userdata" , "proto" , "thread" , "upvalue" , NULL
+};
+
+#define HEAP_TYPES            ( sizeof( heap_types ) / sizeof( *heap_types ) - 1 )
+
+typedef struct
+{
+   char * name;
+   unsigned int hash;
+} HeapSite;
+
+/* A sampled object, by address, and the site creating it */
+typedef struct
+{
+   const void * p;
+   int site;
+} HeapObject;
+
+typedef struct
+{
+   size_t interval;
+   int running;
+   unsigned long samples;
+   /* samples not kept for lack of memory */
+   unsigned long lost;
+
+   HeapSite * sites;
+   int nsites;
+   int sitesSize;
+   /* open addressing hash of the sites by name, of NO_SITE when free */
+   int * siteIndex;
+   int siteIndexSize;
+
+   /* open addressing hash of the objects, of NULL p when free */
+   HeapObject * objects;
+   int nobjects;
+   int objectsSize;
+} LuaHeap;
+
+typedef struct
+{
+   lua_Number count;
+   lua_Number bytes;
+} HeapCount;
+
+
+static unsigned int hashString( const char * s )
+{
+   unsigned int h = 5381;
+
+   for ( ; *s ; s++ )
+      h = h * 33 + ( unsigned char ) *s;
+
+   return h;
+}
+
+
+static unsigned int hashPointer( const void * p )
+{
+   return ( unsigned int ) ( ( uintptr_t ) p >> 3 ) * 2654435761u;
+}
+
+
+static int growSites( LuaHeap * h )
+{
+   int size = h->siteIndexSize != 0 ? h->siteIndexSize * 2 : 256;
+   HeapSite * sites = ( HeapSite * ) realloc( h->sites , size / 2 * sizeof( HeapSite ) );
+   int * index;
+   int i;
+
+   if ( sites == NULL )
+      return 1;
+   h->sites = sites;
+   h->sitesSize = size / 2;
+
+   index = ( int * ) malloc( size * sizeof( int ) );
+   if ( index == NULL )
+      return 1;
+   for ( i = 0 ; i < size ; i++ )
+      index[ i ] = NO_SITE;
+   for ( i = 0 ; i < h->nsites ; i++ )
+   {
+      unsigned int j = h->sites[ i ].hash & ( size - 1 );
+
+      while ( index[ j ] != NO_SITE )
+         j = ( j + 1 ) & ( size - 1 );
+      index[ j ] = i;
+   }
+
+   free( h->siteIndex );
+   h->siteIndex = index;
+   h->siteIndexSize = size;
+
+   return 0;
+}
+
+
+/* The index of a site, added if new, or NO_SITE if out of memory */
+static int findSite( LuaHeap * h , const char * name )
+{
+   unsigned int hash = hashString( name );
+   unsigned int j;
+   char * copy;
+
+   if ( h->nsites >= h->siteIndexSize / 2 && growSites( h ) )
+      return NO_SITE;
+
+   for ( j = hash & ( h->siteIndexSize - 1 ) ; h->siteIndex[ j ] != NO_SITE ;
+         j = ( j + 1 ) & ( h->siteIndexSize - 1 ) )
+   {
+      HeapSite * s = &h->sites[ h->siteIndex[ j ] ];
+
+      if ( s->hash == hash && strcmp( s->name , name ) == 0 )
+         return h->siteIndex[ j ];
+   }
+
+   copy = strdup( name );
+   if ( copy == NULL )
+      return NO_SITE;
+
+   h->sites[ h->nsites ].name = copy;
+   h->sites[ h->nsites ].hash = hash;
+   h->siteIndex[ j ] = h->nsites;
+
+   return h->nsites++;
+}
+
+
+static void putObject( HeapObject * objects , int size , const void * p , int site )
+{
+   unsigned int j = hashPointer( p ) & ( size - 1 );
+
+   while ( objects[ j ].p != NULL )
+      j = ( j + 1 ) & ( size - 1 );
+   objects[ j ].p = p;
+   objects[ j ].site = site;
+}
+
+
+static int addObject( LuaHeap * h , const void * p , int site )
+{
+   if ( h->nobjects >= h->objectsSize / 2 )
+   {
+      int size = h->objectsSize != 0 ? h->objectsSize * 2 : 1024;
+      HeapObject * objects = ( HeapObject * ) calloc( size , sizeof( HeapObject ) );
+      int i;
+
+      if ( objects == NULL )
+         return 1;
+      for ( i = 0 ; i < h->objectsSize ; i++ )
+      {
+         if ( h->objects[ i ].p != NULL )
+            putObject( objects , size , h->objects[ i ].p , h->objects[ i ].site );
+      }
+      free( h->objects );
+      h->objects = objects;
+      h->objectsSize = size;
+   }
+
+   putObject( h->objects , h->objectsSize , p , site );
+   h->nobjects++;
+
+   return 0;
+}
+
+
+/* The slot of a sampled object, or -1 */
+static int findObject( LuaHeap * h , const void * p )
+{
+   unsigned int mask = h->objectsSize - 1;
+   unsigned int j;
+
+   if ( h->nobjects == 0 )
+      return -1;
+
+   for ( j = hashPointer( p ) & mask ; h->objects[ j ].p != NULL ; j = ( j + 1 ) & mask )
+   {
+      if ( h->objects[ j ].p == p )
+         return ( int ) j;
+   }
+
+   return -1;
+}
+
+
+/* Removes the object of slot i, moving back the objects probed past it */
+static void removeObject( LuaHeap * h , int i )
+{
+   unsigned int mask = h->objectsSize - 1;
+   unsigned int hole = i;
+   unsigned int j = hole;
+
+   for ( ;; )
+   {
+      unsigned int home;
+
+      j = ( j + 1 ) & mask;
+      if ( h->objects[ j ].p == NULL )
+         break;
+      home = hashPointer( h->objects[ j ].p ) & mask;
+      /* moves it unless its home lies cyclically in ( hole , j ] */
+      if ( ( j > hole ) ? ( home <= hole || home > j ) : ( home <= hole && home > j ) )
+      {
+         h->objects[ hole ] = h->objects[ j ];
+         hole = j;
+      }
+   }
+   h->objects[ hole ].p = NULL;
+   h->nobjects--;
+}
+
+
+static void clearHeap( LuaHeap * h )
+{
+   int i;
+
+   for ( i = 0 ; i < h->nsites ; i++ )
+      free( h->sites[ i ].name );
+   free( h->sites );
+   free( h->siteIndex );
+   free( h->objects );
+
+   h->sites = NULL;
+   h->nsites = 0;
+   h->sitesSize = 0;
+   h->siteIndex = NULL;
+   h->siteIndexSize = 0;
+   h->objects = NULL;
+   h->nobjects = 0;
+   h->objectsSize = 0;
+   h->samples = 0;
+   h->lost = 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: heapHook
+*  ****/
+
+static void heapHook( lua_State * L , int event , const void * p , const char * type , void * ud )
+{
+   LuaHeap * h = ( LuaHeap * ) ud;
+   char name[ LUA_IDSIZE + 16 ];
+   lua_Debug ar;
+   int level;
+   int site;
+
+   if ( event == LUA_HEAPFREE )
+   {
+      int i = findObject( h , p );
+
+      if ( i >= 0 )
+         removeObject( h , i );
+      return;
+   }
+
+   /* the innermost lua frame, the object being created by a C function
+      if not by the frame itself */
+   strcpy( name , "[C]" );
+   for ( level = 0 ; lua_getstack( L , level , &ar ) ; level++ )
+   {
+      lua_getinfo( L , "Sl" , &ar );
+      if ( ar.currentline > 0 )
+      {
+         snprintf( name , sizeof( name ) , "%s:%d" , ar.short_src , ar.currentline );
+         break;
+      }
+   }
+
+   h->samples++;
+   site = findSite( h , name );
+   if ( site == NO_SITE || addObject( h , p , site ) )
+      h->lost++;
+}
+
+
+/***************************************************************************
+*
+*  Function: getHeap
+*  ****/
+
+static LuaHeap * getHeap( lua_State * L )
+{
+   LuaHeap * h;
+
+   lua_getfield( L , LUA_REGISTRYINDEX , LUAHEAPKEY );
+   h = ( LuaHeap * ) lua_touserdata( L , -1 );
+   lua_pop( L , 1 );
+
+   if ( h == NULL )
+   {
+      h = ( LuaHeap * ) lua_newuserdata( L , sizeof( LuaHeap ) );
+      memset( h , 0 , sizeof( LuaHeap ) );
+      luaL_getmetatable( L , LUAHEAPKEY );
+      lua_setmetatable( L , -2 );
+      lua_setfield( L , LUA_REGISTRYINDEX , LUAHEAPKEY );
+   }
+
+   return h;
+}
+
+
+/***************************************************************************
+*
+*  Function: luaheap_start
+*  ****/
+
+void luaheap_start( lua_State * L , size_t interval )
+{
+   LuaHeap * h = getHeap( L );
+
+   /* objects sampled before are forgotten */
+   lua_setheaphook( L , NULL , NULL , 0 );
+   clearHeap( h );
+
+   h->interval = interval != 0 ? interval : LUAHEAP_INTERVAL;
+   h->running = 1;
+   lua_setheaphook( L , &heapHook , h , h->interval );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaheap_stop
+*  ****/
+
+void luaheap_stop( lua_State * L )
+{
+   LuaHeap * h = getHeap( L );
+   void * ud;
+
+   h->running = 0;
+   if ( lua_getheaphook( L , &ud ) == &heapHook && ud == h )
+   {
+      lua_setheaphook( L , &heapHook , h , 0 );
+   }
+}
+
+
+typedef struct
+{
+   LuaHeap * h;
+   HeapCount total;
+   HeapCount types[ HEAP_TYPES ];
+   HeapCount * sites;
+} HeapWalk;
+
+
+static void countObject( const void * p , const char * type , size_t size , void * ud )
+{
+   HeapWalk * w = ( HeapWalk * ) ud;
+   unsigned int t;
+   int i;
+
+   w->total.count++;
+   w->total.bytes += size;
+
+   for ( t = 0 ; t < HEAP_TYPES ; t++ )
+   {
+      if ( strcmp( heap_types[ t ] , type ) == 0 )
+      {
+         w->types[ t ].count++;
+         w->types[ t ].bytes += size;
+         break;
+      }
+   }
+
+   i = findObject( w->h , p );
+   if ( i >= 0 )
+   {
+      w->sites[ w->h->objects[ i ].site ].count++;
+      w->sites[ w->h->objects[ i ].site ].bytes += size;
+   }
+}
+
+
+static void pushCount( lua_State * L , HeapCount * c )
+{
+   lua_createtable( L , 0 , 2 );
+   lua_pushnumber( L , c->count );
+   lua_setfield( L , -2 , "count" );
+   lua_pushnumber( L , c->bytes );
+   lua_setfield( L , -2 , "bytes" );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaheap_snapshot
+*  ****/
+
+void luaheap_snapshot( lua_State * L , int collect )
+{
+   LuaHeap * h = getHeap( L );
+   HeapWalk w;
+   unsigned int t;
+   int i;
+
+   if ( collect )
+   {
+      lua_gc( L , LUA_GCCOLLECT , 0 );
+   }
+
+   memset( &w , 0 , sizeof( w ) );
+   w.h = h;
+   w.sites = ( HeapCount * ) calloc( h->nsites + 1 , sizeof( HeapCount ) );
+   if ( w.sites == NULL )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   lua_heapwalk( L , &countObject , &w );
+
+   /* the tables of the snapshot are not sampled */
+   if ( h->running )
+   {
+      lua_setheaphook( L , &heapHook , h , 0 );
+   }
+
+   lua_createtable( L , 0 , 6 );
+
+   pushCount( L , &w.total );
+   lua_setfield( L , -2 , "total" );
+
+   lua_createtable( L , 0 , HEAP_TYPES );
+   for ( t = 0 ; t < HEAP_TYPES ; t++ )
+   {
+      pushCount( L , &w.types[ t ] );
+      lua_setfield( L , -2 , heap_types[ t ] );
+   }
+   lua_setfield( L , -2 , "types" );
+
+   lua_newtable( L );
+   for ( i = 0 ; i < h->nsites ; i++ )
+   {
+      if ( w.sites[ i ].count != 0 )
+      {
+         pushCount( L , &w.sites[ i ] );
+         lua_setfield( L , -2 , h->sites[ i ].name );
+      }
+   }
+   lua_setfield( L , -2 , "sites" );
+
+   lua_pushnumber( L , ( lua_Number ) h->samples );
+   lua_setfield( L , -2 , "samples" );
+
+   lua_pushnumber( L , ( lua_Number ) h->lost );
+   lua_setfield( L , -2 , "lost" );
+
+   lua_pushnumber( L , ( lua_Number ) h->interval );
+   lua_setfield( L , -2 , "interval" );
+
+   free( w.sites );
+
+   if ( h->running )
+   {
+      lua_setheaphook( L , &heapHook , h , h->interval );
+   }
+}
+
+
+static HeapCount getCount( lua_State * L , int index )
+{
+   HeapCount c = { 0 , 0 };
+
+   if ( index < 0 )
+      index = lua_gettop( L ) + index + 1;
+
+   if ( lua_istable( L , index ) )
+   {
+      lua_getfield( L , index , "count" );
+      c.count = lua_tonumber( L , -1 );
+      lua_getfield( L , index , "bytes" );
+      c.bytes = lua_tonumber( L , -1 );
+      lua_pop( L , 2 );
+   }
+
+   return c;
+}
+
+
+/* Pushes the table of the counts of b less those of a, for the keys
+   whose counts differ */
+static void pushDiff( lua_State * L , int a , int b )
+{
+   int result;
+
+   lua_newtable( L );
+   result = lua_gettop( L );
+
+   if ( lua_istable( L , b ) )
+   {
+      lua_pushnil( L );
+      while ( lua_next( L , b ) )
+      {
+         HeapCount cb = getCount( L , -1 );
+         HeapCount ca = { 0 , 0 };
+
+         lua_pop( L , 1 );
+         if ( lua_istable( L , a ) )
+         {
+            lua_pushvalue( L , -1 );
+            lua_gettable( L , a );
+            ca = getCount( L , -1 );
+            lua_pop( L , 1 );
+         }
+         cb.count -= ca.count;
+         cb.bytes -= ca.bytes;
+         if ( cb.count != 0 || cb.bytes != 0 )
+         {
+            lua_pushvalue( L , -1 );
+            pushCount( L , &cb );
+            lua_settable( L , result );
+         }
+      }
+   }
+
+   if ( lua_istable( L , a ) )
+   {
+      lua_pushnil( L );
+      while ( lua_next( L , a ) )
+      {
+         HeapCount ca = getCount( L , -1 );
+         int inB = 0;
+
+         lua_pop( L , 1 );
+         if ( lua_istable( L , b ) )
+         {
+            lua_pushvalue( L , -1 );
+            lua_gettable( L , b );
+            inB = !lua_isnil( L , -1 );
+            lua_pop( L , 1 );
+         }
+         if ( !inB && ( ca.count != 0 || ca.bytes != 0 ) )
+         {
+            ca.count = -ca.count;
+            ca.bytes = -ca.bytes;
+            lua_pushvalue( L , -1 );
+            pushCount( L , &ca );
+            lua_settable( L , result );
+         }
+      }
+   }
+}
+
+
+typedef struct
+{
+   const char * name;
+   HeapCount c;
+} ReportLine;
+
+
+static int compareLines( const void * a , const void * b )
+{
+   lua_Number x = ( ( const ReportLine * ) a )->c.bytes;
+   lua_Number y = ( ( const ReportLine * ) b )->c.bytes;
+
+   return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+static void addLine( luaL_Buffer * b , const char * name , HeapCount * c , lua_Number interval )
+{
+   char line[ 160 ];
+
+   if ( interval > 0 )
+      snprintf( line , sizeof( line ) , "%-48.48s %12.0f %14.0f %14.0f\n" , name , c->count , c->bytes ,
+                c->count * interval );
+   else
+      snprintf( line , sizeof( line ) , "%-48.48s %12.0f %14.0f\n" , name , c->count , c->bytes );
+   luaL_addstring( b , line );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaheap_report
+*  ****/
+
+void luaheap_report( lua_State * L , int index , int top )
+{
+   ReportLine * lines;
+   HeapCount total;
+   lua_Number interval;
+   luaL_Buffer b;
+   unsigned int t;
+   int types;
+   int sites;
+   int nsites = 0;
+   int i;
+
+   if ( index < 0 )
+      index = lua_gettop( L ) + index + 1;
+
+   lua_getfield( L , index , "interval" );
+   interval = lua_tonumber( L , -1 );
+   lua_pop( L , 1 );
+   lua_getfield( L , index , "total" );
+   total = getCount( L , -1 );
+   lua_getfield( L , index , "types" );
+   types = lua_gettop( L );
+   lua_getfield( L , index , "sites" );
+   sites = lua_gettop( L );
+
+   /* site names stay on the stack, in the snapshot */
+   if ( lua_istable( L , sites ) )
+   {
+      lua_pushnil( L );
+      while ( lua_next( L , sites ) )
+      {
+         nsites++;
+         lua_pop( L , 1 );
+      }
+   }
+   lines = ( ReportLine * ) malloc( ( nsites + 1 ) * sizeof( ReportLine ) );
+   if ( lines == NULL )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   nsites = 0;
+   if ( lua_istable( L , sites ) )
+   {
+      lua_pushnil( L );
+      while ( lua_next( L , sites ) )
+      {
+         if ( lua_type( L , -2 ) == LUA_TSTRING )
+         {
+            lines[ nsites ].name = lua_tostring( L , -2 );
+            lines[ nsites ].c = getCount( L , -1 );
+            nsites++;
+         }
+         lua_pop( L , 1 );
+      }
+   }
+   qsort( lines , nsites , sizeof( ReportLine ) , compareLines );
+
+   luaL_buffinit( L , &b );
+   {
+      char line[ 160 ];
+
+      snprintf( line , sizeof( line ) , "%-48s %12s %14s\n" , "type" , "objects" , "bytes" );
+      luaL_addstring( &b , line );
+   }
+   for ( t = 0 ; t < HEAP_TYPES ; t++ )
+   {
+      HeapCount c = { 0 , 0 };
+
+      if ( lua_istable( L , types ) )
+      {
+         lua_getfield( L , types , heap_types[ t ] );
+         c = getCount( L , -1 );
+         lua_pop( L , 1 );
+      }
+      if ( c.count != 0 || c.bytes != 0 )
+         addLine( &b , heap_types[ t ] , &c , 0 );
+   }
+   addLine( &b , "total" , &total , 0 );
+
+   /* a sampled object stands for about interval bytes allocated there */
+   if ( nsites > 0 )
+   {
+      char line[ 160 ];
+
+      snprintf( line , sizeof( line ) , "\n%-48s %12s %14s %14s\n" , "sampled site" , "objects" , "bytes" ,
+                "est. bytes" );
+      luaL_addstring( &b , line );
+      for ( i = 0 ; i < nsites && i < top ; i++ )
+         addLine( &b , lines[ i ].name , &lines[ i ].c , interval );
+   }
+   free( lines );
+
+   luaL_pushresult( &b );
+   lua_replace( L , -4 );
+   lua_pop( L , 2 );
+}
+
+
+/***************************************************************************
+*
+*  Lua interface
+*
+*****************************************************************************/
+
+/***************************************************************************
+*
+*  Function: heapGc
+*  ****/
+
+static int heapGc( lua_State * L )
+{
+   LuaHeap * h = ( LuaHeap * ) lua_touserdata( L , 1 );
+   void * ud;
+
+   if ( lua_getheaphook( L , &ud ) == &heapHook && ud == h )
+   {
+      lua_setheaphook( L , NULL , NULL , 0 );
+   }
+   clearHeap( h );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.heap.start
+*  ****/
+
+static int heapStart( lua_State * L )
+{
+   lua_Number interval = luaL_optnumber( L , 1 , 0 );
+
+   luaL_argcheck( L , interval >= 0 , 1 , "interval must not be negative" );
+
+   luaheap_start( L , ( size_t ) interval );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.heap.stop
+*  ****/
+
+static int heapStop( lua_State * L )
+{
+   luaheap_stop( L );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.heap.snapshot
+*  ****/
+
+static int heapSnapshot( lua_State * L )
+{
+   luaheap_snapshot( L , lua_isnoneornil( L , 1 ) || lua_toboolean( L , 1 ) );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.heap.diff
+*  ****/
+
+static int heapDiff( lua_State * L )
+{
+   HeapCount a;
+   HeapCount b;
+
+   luaL_checktype( L , 1 , LUA_TTABLE );
+   luaL_checktype( L , 2 , LUA_TTABLE );
+   lua_settop( L , 2 );
+
+   lua_createtable( L , 0 , 4 );
+
+   lua_getfield( L , 2 , "interval" );
+   lua_setfield( L , 3 , "interval" );
+
+   lua_getfield( L , 1 , "total" );
+   a = getCount( L , -1 );
+   lua_getfield( L , 2 , "total" );
+   b = getCount( L , -1 );
+   lua_pop( L , 2 );
+   b.count -= a.count;
+   b.bytes -= a.bytes;
+   pushCount( L , &b );
+   lua_setfield( L , 3 , "total" );
+
+   lua_getfield( L , 1 , "types" );
+   lua_getfield( L , 2 , "types" );
+   pushDiff( L , 4 , 5 );
+   lua_setfield( L , 3 , "types" );
+   lua_pop( L , 2 );
+
+   lua_getfield( L , 1 , "sites" );
+   lua_getfield( L , 2 , "sites" );
+   pushDiff( L , 4 , 5 );
+   lua_setfield( L , 3 , "sites" );
+   lua_pop( L , 2 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.heap.report
+*  ****/
+
+static int heapReport( lua_State * L )
+{
+   int top = luaL_optint( L , 2 , LUAHEAP_TOP );
+
+   if ( lua_isnoneornil( L , 1 ) )
+   {
+      lua_settop( L , 0 );
+      luaheap_snapshot( L , 1 );
+   }
+   luaL_checktype( L , 1 , LUA_TTABLE );
+
+   luaheap_report( L , 1 , top );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openheap
+*  ****/
+
+void luajava_openheap( lua_State * L )
+{
+   static const luaL_Reg functions[] =
+   {
+      { "start" , &heapStart } ,
+      { "stop" , &heapStop } ,
+      { "snapshot" , &heapSnapshot } ,
+      { "diff" , &heapDiff } ,
+      { "report" , &heapReport } ,
+      { NULL , NULL }
+   };
+
+   luaL_newmetatable( L , LUAHEAPKEY );
+   lua_pushcfunction( L , &heapGc );
+   lua_setfield( L , -2 , "__gc" );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "heap" );
+   lua_newtable( L );
+   luaL_register( L , NULL , functions );
+   lua_settable( L , -3 );
+}
@@ -0,0 +1,125 @@
+/***************************************************************************
+*
+* $ED
+*    Heap profiler of lua States: live objects by type and by allocation
+*    site, see luaheap.c.
+*
+*****************************************************************************/
+
+#ifndef LUAHEAP_H
+#define LUAHEAP_H
+
+#include <stddef.h>
+
+#include "lua.h"
+
+/* Default mean number of bytes allocated between two sampled objects */
+#define LUAHEAP_INTERVAL      32768
+/* Allocation sites listed by default in reports */
+#define LUAHEAP_TOP           20
+
+
+/***************************************************************************
+*
+* $FC luaheap_start
+*
+* $ED Description
+*    starts sampling the objects created by the state with the lua frame
+*    creating them, discarding the samples of a previous run
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P interval - mean number of bytes allocated between two samples,
+*                  0 for LUAHEAP_INTERVAL
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaheap_start( lua_State * L , size_t interval );
+
+
+/***************************************************************************
+*
+* $FC luaheap_stop
+*
+* $ED Description
+*    stops sampling new objects; the objects sampled are still followed
+*    until they are freed
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaheap_stop( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luaheap_snapshot
+*
+* $ED Description
+*    pushes a table of the objects of the state: { total = t, types =
+*    { table = t , string = t, ... }, sites = { ["src:line"] = t, ... } }
+*    where each t is { count = objects, bytes = bytes }, along with the
+*    number of samples taken, those lost for lack of memory and the
+*    interval. Sites count the sampled objects still alive.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P collect - non zero to run a full collection first, so that only
+*                 reachable objects are counted
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaheap_snapshot( lua_State * L , int collect );
+
+
+/***************************************************************************
+*
+* $FC luaheap_report
+*
+* $ED Description
+*    pushes a snapshot, or a difference of snapshots, formatted for people
+*    to read: the types, then the sites with the most bytes and an
+*    estimate of the bytes allocated there, from the sampling interval
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P index - stack index of the snapshot
+*    $P top - number of sites listed
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaheap_report( lua_State * L , int index , int top );
+
+
+/***************************************************************************
+*
+* $FC luajava_openheap
+*
+* $ED Description
+*    registers heap in the table on top of the stack (the luajava table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openheap( lua_State * L );
+
+#endif
@@ -36,14 +36,27 @@
 #include <jni.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
 
+#include "luachannel.h"
+#include "luaserialize.h"
+#include "luascheduler.h"
+#include "luaparallel.h"
+#include "luaframes.h"
+#include "luastats.h"
+#include "luaprofile.h"
+#include "luatrace.h"
+#include "luaheap.h"
+#include "luarefs.h"
+#include "luastartup.h"
+
 
-/* Constant that is used to index the JNI Environment */
-#define LUAJAVAJNIENVTAG      "__JNIEnv"
 /* Defines wheter the metatable is of a java Object */
 #define LUAJAVAOBJECTIND      "__IsJavaObject"
 /* Defines the lua State Index Property Name */
@@ -56,15 +69,104 @@
 #define LUACALLMETAMETHODTAG  "__call"
 /* Constant that defines where in the metatable should I place the function name */
 #define LUAJAVAOBJFUNCCALLED  "__FunctionCalled"
+/* Maximum nesting of tables converted by tojava and pushTable */
+#define LUAJAVAMAXNESTING     64
+
+/* Target types of luajava.tojava, in the order of table_target_names */
+#define LUAJAVA_TODEFAULT     0
+#define LUAJAVA_TOLIST        1
+#define LUAJAVA_TOMAP         2
+#define LUAJAVA_TOOBJARRAY    3
+#define LUAJAVA_TODOUBLEARRAY 4
+#define LUAJAVA_TOINTARRAY    5
+#define LUAJAVA_TOSTRINGARRAY 6
+/* Metatable of the state of luajava.iter iterators */
+#define LUAJAVAITERMETATABLE  "luajava.iter"
+/* Default number of elements fetched per JNI call by luajava.iter */
+#define LUAJAVAITERCHUNK      256
+/* Registry field holding the coroutine driver used by LuaObject.callAsync */
+#define LUAJAVAASYNCINDEX     "luajava.async"
+
+static const char * const table_target_names[] =
+{
+   "default" , "list" , "map" , "object[]" , "double[]" , "int[]" , "string[]" , NULL
+};
 
 
 
+/* The VM is cached in JNI_OnLoad; each thread gets its own JNIEnv from it */
+static JavaVM *  java_vm              = NULL;
+static pthread_key_t jni_env_key;
+static pthread_key_t jni_attached_key;
+static jfieldID  cptr_peer_field      = NULL;
+
 static jclass    throwable_class      = NULL;
 static jmethodID get_message_method   = NULL;
 static jclass    java_function_class  = NULL;
 static jmethodID java_function_method = NULL;
 static jclass    luajava_api_class    = NULL;
 static jclass    java_lang_class      = NULL;
+static jmethodID class_get_name       = NULL;
+static jclass    java_object_class    = NULL;
+static jclass    java_boolean_class   = NULL;
+static jmethodID boolean_value_of     = NULL;
+static jclass    java_double_class    = NULL;
+static jmethodID double_value_of      = NULL;
+static jmethodID get_lua_object_method = NULL;
+static jclass    java_string_class    = NULL;
+static jclass    java_number_class    = NULL;
+static jmethodID number_double_value  = NULL;
+static jmethodID boolean_boolean_value = NULL;
+static jclass    collection_class     = NULL;
+static jmethodID collection_to_array  = NULL;
+static jclass    map_class            = NULL;
+static jmethodID map_entry_set        = NULL;
+static jclass    map_entry_class      = NULL;
+static jmethodID map_entry_get_key    = NULL;
+static jmethodID map_entry_get_value  = NULL;
+static jclass    arraylist_class      = NULL;
+static jmethodID arraylist_init       = NULL;
+static jclass    arrays_class         = NULL;
+static jmethodID arrays_as_list       = NULL;
+static jclass    hashmap_class        = NULL;
+static jmethodID hashmap_init         = NULL;
+static jmethodID hashmap_put          = NULL;
+static jclass    object_array_class   = NULL;
+static jclass    byte_array_class     = NULL;
+static jclass    double_array_class   = NULL;
+static jclass    float_array_class    = NULL;
+static jclass    int_array_class      = NULL;
+static jclass    long_array_class     = NULL;
+static jclass    boolean_array_class  = NULL;
+static jclass    lua_object_class     = NULL;
+static jfieldID  lua_object_ref       = NULL;
+static jmethodID integer_int_value    = NULL;
+static jclass    lua_state_factory_class = NULL;
+static jmethodID get_existing_state   = NULL;
+static jmethodID iter_source_method   = NULL;
+static jmethodID iter_fill_method     = NULL;
+
+
+/* State of an iterator created by luajava.iter */
+typedef struct
+{
+   jobject      source;   /* Iterator, Enumeration or array */
+   jobjectArray buffer;   /* elements fetched by the last call to iterFill */
+   jint         offset;   /* elements fetched so far */
+   jint         count;    /* elements in the buffer */
+   jint         pos;      /* next element of the buffer */
+   int          finished;
+} JavaIterState;
+
+/* Pairs fetched by a call of LuaState._nextChunk */
+typedef struct
+{
+   JNIEnv *     env;
+   jobject      luaState;
+   jobjectArray buffer;
+   jsize        capacity;
+   jint         count;
+} NextChunk;
 
 
 /***************************************************************************
@@ -276,6 +378,45 @@ static jclass    java_lang_class      = NULL;
    static int pushJavaClass( lua_State * L , jobject javaObject );
 
 
+/***************************************************************************
+*
+* $FC pushJavaFunction
+* 
+* $ED Description
+*    Function to create a lua proxy to a JavaFunction object
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P javaFunction - JavaFunction object to be pushed on the stack
+* 
+* $FV Returned Value
+*    int - 1 on success, 0 if the metatable could not be set
+* 
+*$. **********************************************************************/
+
+   static int pushJavaFunction( lua_State * L , jobject javaFunction );
+
+
+/***************************************************************************
+*
+* $FC getGlobalClass
+* 
+* $ED Description
+*    Finds a java class and returns a global reference to it. Aborts if
+*    the class cannot be found, like the other bindings in luajava_open.
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P name - class name in JNI format
+* 
+* $FV Returned Value
+*    jclass - global reference to the class
+* 
+*$. **********************************************************************/
+
+   static jclass getGlobalClass( JNIEnv * env , const char * name );
+
+
 /***************************************************************************
 *
 * $FC isJavaObject
@@ -335,21 +476,21 @@ static jclass    java_lang_class      = NULL;
 
 /***************************************************************************
 *
-* $FC pushJNIEnv
+* $FC detachThread
 * 
 * $ED Description
-*    function that pushes the jni environment into the lua state
+*    pthread key destructor that detaches from the VM a native thread
+*    that was attached by getEnvFromState
 * 
 * $EP Function Parameters
-*    $P env - java environment
-*    $P L - lua State
+*    $P value - thread specific value of jni_attached_key
 * 
 * $FV Returned Value
 *    void
 * 
 *$. **********************************************************************/
 
-   static void pushJNIEnv( JNIEnv * env , lua_State * L );
+   static void detachThread( void * value );
 
 
    /***************************************************************************
@@ -357,7 +498,10 @@ static jclass    java_lang_class      = NULL;
 * $FC getEnvFromState
 * 
 * $ED Description
-*    auxiliar function to get the JNIEnv from the lua state
+*    auxiliar function to get the JNIEnv of the calling thread. The env is
+*    cached per thread; threads unknown to the VM are attached to it and
+*    detached when they exit. The lua state is not consulted, so any
+*    thread may safely use any state it owns.
 * 
 * $EP Function Parameters
 *    $P L - lua State
@@ -368,6 +512,282 @@ static jclass    java_lang_class      = NULL;
 *$. **********************************************************************/
 
    static JNIEnv * getEnvFromState( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC toJavaValue
+* 
+* $ED Description
+*    Converts the lua value at the given index into a java local reference,
+*    the same way LuaState.toJavaObject does, without leaving native code
+*    for the primitive types.
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P luaState - the LuaState java object owning L
+*    $P L - lua State
+*    $P idx - index on the stack
+* 
+* $FV Returned Value
+*    jobject - local reference to the converted value, or NULL for nil
+* 
+*$. **********************************************************************/
+
+   static jobject toJavaValue( JNIEnv * env , jobject luaState , lua_State * L , int idx );
+
+
+/***************************************************************************
+*
+* $FC handleJavaException
+* 
+* $ED Description
+*    Clears a pending java exception and pushes its message on the stack
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P L - lua State
+* 
+* $FV Returned Value
+*    int - 1 if there was an exception, 0 otherwise
+* 
+*$. **********************************************************************/
+
+   static int handleJavaException( JNIEnv * env , lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC getLuaStateObject
+* 
+* $ED Description
+*    Returns a local reference to the LuaState java object of L
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P L - lua State
+* 
+* $FV Returned Value
+*    jobject - the LuaState, or NULL if L was not opened by LuaJava
+* 
+*$. **********************************************************************/
+
+   static jobject getLuaStateObject( JNIEnv * env , lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC tableToJava
+* 
+* $ED Description
+*    Converts the table at the given index into a java List, Map or array
+*    in a single pass. Nested tables are converted as well.
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P luaState - the LuaState java object owning L
+*    $P L - lua State
+*    $P idx - index of the table on the stack
+*    $P target - one of the LUAJAVA_TO* constants
+*    $P depth - current nesting
+*    $P path - tables being converted, used to detect cycles
+*    $P error - receives the error message when the conversion fails
+* 
+* $FV Returned Value
+*    jobject - local reference to the result, NULL on error
+* 
+*$. **********************************************************************/
+
+   static jobject tableToJava( JNIEnv * env , jobject luaState , lua_State * L , int idx ,
+                               int target , int depth , const void ** path , const char ** error );
+
+
+/***************************************************************************
+*
+* $FC pushJavaValue
+* 
+* $ED Description
+*    Pushes a java value like LuaState.pushObjectValue does, converting
+*    collections, maps and arrays (except byte[]) into tables. When path
+*    is NULL, containers are pushed as plain java objects.
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P L - lua State
+*    $P obj - value to be pushed
+*    $P depth - current nesting
+*    $P path - containers being converted, used to detect cycles
+*    $P error - receives the error message when the conversion fails
+* 
+* $FV Returned Value
+*    int - 1 on success, 0 on error (nothing is pushed)
+* 
+*$. **********************************************************************/
+
+   static int pushJavaValue( JNIEnv * env , lua_State * L , jobject obj ,
+                             int depth , jobject * path , const char ** error );
+
+
+/***************************************************************************
+*
+* $FC pushJavaTable
+* 
+* $ED Description
+*    Pushes a table with the contents of a java Collection, Map or array.
+* 
+* $EP Function Parameters
+*    $P env - java environment
+*    $P L - lua State
+*    $P obj - container to be converted
+*    $P depth - current nesting
+*    $P path - containers being converted, used to detect cycles
+*    $P error - receives the error message when the conversion fails
+* 
+* $FV Returned Value
+*    int - 1 on success, 0 if obj is not a container or on error
+* 
+*$. **********************************************************************/
+
+   static int pushJavaTable( JNIEnv * env , lua_State * L , jobject obj ,
+                             int depth , jobject * path , const char ** error );
+
+
+/***************************************************************************
+*
+* $FC javaToJava
+* 
+* $ED Description
+*    Implementation of lua function luajava.tojava
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - Parameters will be received by the stack
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaToJava( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC javaIter
+* 
+* $ED Description
+*    Implementation of lua function luajava.iter
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - Parameters will be received by the stack
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaIter( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC javaIterNext
+* 
+* $ED Description
+*    Iterator function returned by luajava.iter. Refills its buffer from
+*    java when it runs empty.
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - Parameters will be received by the stack
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaIterNext( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC javaIterGc
+* 
+* $ED Description
+*    __gc metamethod of the luajava.iter state
+* 
+* $EP Function Parameters
+*    $P L - lua State
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaIterGc( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC javaParallelMap
+* 
+* $ED Description
+*    Implementation of lua function luajava.parallel_map. Besides lua
+*    tables it accepts Java double[], float[], int[] and long[] arrays,
+*    returning a new double[].
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - Parameters will be received by the stack
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaParallelMap( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC javaParallelReduce
+* 
+* $ED Description
+*    Implementation of lua function luajava.parallel_reduce, accepting the
+*    same arrays as luajava.parallel_map
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - Parameters will be received by the stack
+* 
+* $FV Returned Value
+*    int - Number of values to be returned by the function
+* 
+*$. **********************************************************************/
+
+   static int javaParallelReduce( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC nextChunk
+* 
+* $ED Description
+*    Fills the buffer of a NextChunk with the pairs following a key, for
+*    LuaState._nextChunk. Called with lua_pcall, since lua_next raises an
+*    error when the key is no longer in the table.
+* 
+* $EP Function Parameters
+*    $P L - lua State
+*    $P Stack - the table, the NextChunk as light userdata and the key
+* 
+* $FV Returned Value
+*    int - 1, the last key fetched if the buffer was filled, or 0
+* 
+*$. **********************************************************************/
+
+   static int nextChunk( lua_State * L );
    
 
 /********************* Implementations ***************************/
@@ -379,6 +799,7 @@ static jclass    java_lang_class      = NULL;
 
 int objectIndex( lua_State * L )
 {
+   LUASTATS_ENTER( "objectIndex" );
    lua_Number stateIndex;
    const char * key;
    jmethodID method;
@@ -429,8 +850,11 @@ int objectIndex( lua_State * L )
 
    str = ( *javaEnv )->NewStringUTF( javaEnv , key );
 
+   luatrace_begin( "java.index" , key );
    checkField = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method ,
                                                    (jint)stateIndex , *obj , str );
+   luatrace_end( "java.index" , key );
+   luaprofile_java( L , key );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -489,36 +913,436 @@ int objectIndex( lua_State * L )
 }
 
 
+
 /***************************************************************************
 *
-*  Function: objectIndexReturn
+*  Function: javaIter
 *  ****/
 
-int objectIndexReturn( lua_State * L )
+int javaIter( lua_State * L )
 {
-   lua_Number stateIndex;
-   jobject * pObject;
-   jmethodID method;
-   jthrowable exp;
-   const char * methodName;
-   jint ret;
-   jstring str;
+   JavaIterState * state;
+   jobject source , buffer;
+   int chunk;
    JNIEnv * javaEnv;
 
-   /* Gets the luaState index */
-   lua_pushstring( L , LUAJAVASTATEINDEX );
-   lua_rawget( L , LUA_REGISTRYINDEX );
-
-   if ( !lua_isnumber( L , -1 ) )
+   if ( !isJavaObject( L , 1 ) )
    {
-      lua_pushstring( L , "Impossible to identify luaState id." );
+      lua_pushstring( L , "Not a valid Java Object." );
       lua_error( L );
    }
 
-   stateIndex = lua_tonumber( L , -1 );
-   lua_pop( L , 1 );
+   chunk = luaL_optint( L , 2 , LUAJAVAITERCHUNK );
+   luaL_argcheck( L , chunk > 0 , 2 , "chunk size must be positive" );
 
-   /* Checks if is a valid java object */
+   /* Gets the JNI Environment */
+   javaEnv = getEnvFromState( L );
+   if ( javaEnv == NULL )
+   {
+      lua_pushstring( L , "Invalid JNI Environment." );
+      lua_error( L );
+   }
+
+   source = ( *javaEnv )->CallStaticObjectMethod( javaEnv , luajava_api_class , iter_source_method ,
+                                                  *( jobject * ) lua_touserdata( L , 1 ) );
+
+   if ( handleJavaException( javaEnv , L ) )
+   {
+      lua_error( L );
+   }
+
+   buffer = ( *javaEnv )->NewObjectArray( javaEnv , chunk , java_object_class , NULL );
+
+   if ( handleJavaException( javaEnv , L ) )
+   {
+      ( *javaEnv )->DeleteLocalRef( javaEnv , source );
+      lua_error( L );
+   }
+
+   state = ( JavaIterState * ) lua_newuserdata( L , sizeof( JavaIterState ) );
+   state->source   = ( *javaEnv )->NewGlobalRef( javaEnv , source );
+   state->buffer   = ( *javaEnv )->NewGlobalRef( javaEnv , buffer );
+   state->offset   = 0;
+   state->count    = 0;
+   state->pos      = 0;
+   state->finished = 0;
+
+   ( *javaEnv )->DeleteLocalRef( javaEnv , source );
+   ( *javaEnv )->DeleteLocalRef( javaEnv , buffer );
+
+   if ( luaL_newmetatable( L , LUAJAVAITERMETATABLE ) )
+   {
+      lua_pushstring( L , LUAGCMETAMETHODTAG );
+      lua_pushcfunction( L , &javaIterGc );
+      lua_rawset( L , -3 );
+   }
+   lua_setmetatable( L , -2 );
+
+   lua_pushcclosure( L , &javaIterNext , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaIterNext
+*  ****/
+
+int javaIterNext( lua_State * L )
+{
+   LUASTATS_ENTER( "javaIterNext" );
+   JavaIterState * state;
+   jobject element;
+   JNIEnv * javaEnv;
+
+   state = ( JavaIterState * ) lua_touserdata( L , lua_upvalueindex( 1 ) );
+
+   /* Gets the JNI Environment */
+   javaEnv = getEnvFromState( L );
+   if ( javaEnv == NULL )
+   {
+      lua_pushstring( L , "Invalid JNI Environment." );
+      lua_error( L );
+   }
+
+   if ( state->pos >= state->count )
+   {
+      if ( state->finished )
+      {
+         return 0;
+      }
+
+      state->count = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , iter_fill_method ,
+                                                        state->source , state->offset , state->buffer );
+
+      if ( handleJavaException( javaEnv , L ) )
+      {
+         state->count    = 0;
+         state->finished = 1;
+         lua_error( L );
+      }
+
+      state->offset += state->count;
+      state->pos     = 0;
+
+      if ( state->count < ( *javaEnv )->GetArrayLength( javaEnv , state->buffer ) )
+      {
+         state->finished = 1;
+      }
+
+      if ( state->count == 0 )
+      {
+         return 0;
+      }
+   }
+
+   element = ( *javaEnv )->GetObjectArrayElement( javaEnv , state->buffer , state->pos );
+   ( *javaEnv )->SetObjectArrayElement( javaEnv , state->buffer , state->pos , NULL );
+   state->pos++;
+
+   if ( !pushJavaValue( javaEnv , L , element , 0 , NULL , NULL ) )
+   {
+      ( *javaEnv )->DeleteLocalRef( javaEnv , element );
+      if ( !handleJavaException( javaEnv , L ) )
+         lua_pushstring( L , "Cannot convert iterator element." );
+      lua_error( L );
+   }
+
+   ( *javaEnv )->DeleteLocalRef( javaEnv , element );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaIterGc
+*  ****/
+
+int javaIterGc( lua_State * L )
+{
+   JavaIterState * state = ( JavaIterState * ) lua_touserdata( L , 1 );
+   JNIEnv * javaEnv = getEnvFromState( L );
+
+   if ( javaEnv != NULL )
+   {
+      ( *javaEnv )->DeleteGlobalRef( javaEnv , state->source );
+      ( *javaEnv )->DeleteGlobalRef( javaEnv , state->buffer );
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaParallel
+*  ****/
+
+static int javaParallel( lua_State * L , int reduce )
+{
+   JNIEnv * javaEnv;
+   jobject arr , out = NULL;
+   jclass type;
+   lua_Integer chunk;
+   jsize n , i;
+   int init , job , status;
+
+   if ( !isJavaObject( L , 2 ) )
+   {
+      return reduce ? luajava_parallelreduce( L ) : luajava_parallelmap( L );
+   }
+
+   luaL_checkany( L , 1 );
+   chunk = luaL_optinteger( L , 3 , 0 );
+   luaL_argcheck( L , chunk >= 0 , 3 , "chunk size must not be negative" );
+   init = ( reduce && lua_gettop( L ) >= 4 ) ? 4 : 0;
+
+   /* Gets the JNI Environment */
+   javaEnv = getEnvFromState( L );
+   if ( javaEnv == NULL )
+   {
+      lua_pushstring( L , "Invalid JNI Environment." );
+      lua_error( L );
+   }
+
+   /* the element type is found first: no JNI call may be made while an
+      array is held with GetPrimitiveArrayCritical */
+   arr = *( jobject * ) lua_touserdata( L , 2 );
+   if ( ( *javaEnv )->IsInstanceOf( javaEnv , arr , double_array_class ) )
+   {
+      type = double_array_class;
+   }
+   else if ( ( *javaEnv )->IsInstanceOf( javaEnv , arr , float_array_class ) )
+   {
+      type = float_array_class;
+   }
+   else if ( ( *javaEnv )->IsInstanceOf( javaEnv , arr , int_array_class ) )
+   {
+      type = int_array_class;
+   }
+   else if ( ( *javaEnv )->IsInstanceOf( javaEnv , arr , long_array_class ) )
+   {
+      type = long_array_class;
+   }
+   else
+   {
+      return luaL_argerror( L , 2 , "table or numeric Java array expected" );
+   }
+
+   n = ( *javaEnv )->GetArrayLength( javaEnv , arr );
+
+   /* the function is compiled, and a source run, before any array is
+      held: lua code may reach Java */
+   if ( luajava_parallelprepare( L , 1 , 0 , ( size_t ) n , ( size_t ) chunk , reduce ) != 0 )
+   {
+      lua_error( L );
+   }
+   job = lua_gettop( L );
+
+   if ( !reduce )
+   {
+      out = ( *javaEnv )->NewDoubleArray( javaEnv , n );
+      if ( handleJavaException( javaEnv , L ) )
+      {
+         lua_error( L );
+      }
+   }
+
+   if ( type == double_array_class )
+   {
+      jdouble * in;
+      jdouble * outElems = NULL;
+
+      /* the workers run straight on the pinned arrays, which are held only
+         while they run: no lua code runs in L and no JNI call is made
+         meanwhile */
+      in = ( jdouble * ) ( *javaEnv )->GetPrimitiveArrayCritical( javaEnv , arr , NULL );
+      if ( in != NULL && out != NULL )
+      {
+         outElems = ( jdouble * ) ( *javaEnv )->GetPrimitiveArrayCritical( javaEnv , out , NULL );
+         if ( outElems == NULL )
+         {
+            ( *javaEnv )->ReleasePrimitiveArrayCritical( javaEnv , arr , in , JNI_ABORT );
+            in = NULL;
+         }
+      }
+
+      if ( in == NULL )
+      {
+         ( *javaEnv )->ExceptionClear( javaEnv );
+         if ( out != NULL )
+         {
+            ( *javaEnv )->DeleteLocalRef( javaEnv , out );
+         }
+         luaL_error( L , "Could not access the Java array." );
+      }
+
+      luajava_parallelrun( L , job , in , outElems );
+
+      if ( outElems != NULL )
+      {
+         ( *javaEnv )->ReleasePrimitiveArrayCritical( javaEnv , out , outElems , 0 );
+      }
+      ( *javaEnv )->ReleasePrimitiveArrayCritical( javaEnv , arr , in , JNI_ABORT );
+
+      /* a reduce folds the ranges here, once the arrays are released */
+      status = luajava_parallelfinish( L , job , init );
+   }
+   else
+   {
+      /* other element types are widened into a scratch buffer first */
+      double * in = ( double * ) lua_newuserdata( L , ( n ? n : 1 ) * sizeof( double ) );
+      double * outElems = reduce ? NULL
+                                 : ( double * ) lua_newuserdata( L , ( n ? n : 1 ) * sizeof( double ) );
+      void * elems = ( *javaEnv )->GetPrimitiveArrayCritical( javaEnv , arr , NULL );
+
+      if ( elems == NULL )
+      {
+         ( *javaEnv )->ExceptionClear( javaEnv );
+         if ( out != NULL )
+         {
+            ( *javaEnv )->DeleteLocalRef( javaEnv , out );
+         }
+         luaL_error( L , "Could not access the Java array." );
+      }
+
+      if ( type == float_array_class )
+      {
+         for ( i = 0 ; i < n ; i++ )
+            in[ i ] = ( double ) ( ( jfloat * ) elems )[ i ];
+      }
+      else if ( type == int_array_class )
+      {
+         for ( i = 0 ; i < n ; i++ )
+            in[ i ] = ( double ) ( ( jint * ) elems )[ i ];
+      }
+      else
+      {
+         for ( i = 0 ; i < n ; i++ )
+            in[ i ] = ( double ) ( ( jlong * ) elems )[ i ];
+      }
+      ( *javaEnv )->ReleasePrimitiveArrayCritical( javaEnv , arr , elems , JNI_ABORT );
+
+      luajava_parallelrun( L , job , in , outElems );
+      status = luajava_parallelfinish( L , job , init );
+
+      if ( status == 0 && out != NULL )
+      {
+         ( *javaEnv )->SetDoubleArrayRegion( javaEnv , out , 0 , n , outElems );
+      }
+   }
+
+   if ( status != 0 )
+   {
+      if ( out != NULL )
+      {
+         ( *javaEnv )->DeleteLocalRef( javaEnv , out );
+      }
+      lua_error( L );
+   }
+
+   if ( out != NULL )
+   {
+      lua_pop( L , 1 );
+      pushJavaObject( L , out );
+      ( *javaEnv )->DeleteLocalRef( javaEnv , out );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaParallelMap
+*  ****/
+
+int javaParallelMap( lua_State * L )
+{
+   return javaParallel( L , 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: javaParallelReduce
+*  ****/
+
+int javaParallelReduce( lua_State * L )
+{
+   return javaParallel( L , 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: nextChunk
+*  ****/
+
+int nextChunk( lua_State * L )
+{
+   NextChunk * chunk = ( NextChunk * ) lua_touserdata( L , 2 );
+   JNIEnv * env = chunk->env;
+   jobject key , value;
+
+   while ( chunk->count < chunk->capacity && lua_next( L , 1 ) != 0 )
+   {
+      key   = toJavaValue( env , chunk->luaState , L , -2 );
+      value = toJavaValue( env , chunk->luaState , L , -1 );
+      lua_pop( L , 1 );
+
+      if ( ( *env )->ExceptionCheck( env ) )
+      {
+         return 0;
+      }
+
+      ( *env )->SetObjectArrayElement( env , chunk->buffer , 2 * chunk->count , key );
+      ( *env )->SetObjectArrayElement( env , chunk->buffer , 2 * chunk->count + 1 , value );
+      ( *env )->DeleteLocalRef( env , key );
+      if ( value != NULL )
+      {
+         ( *env )->DeleteLocalRef( env , value );
+      }
+      chunk->count++;
+   }
+
+   return ( chunk->count == chunk->capacity ) ? 1 : 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: objectIndexReturn
+*  ****/
+
+int objectIndexReturn( lua_State * L )
+{
+   LUASTATS_ENTER( "objectIndexReturn" );
+   lua_Number stateIndex;
+   jobject * pObject;
+   jmethodID method;
+   jthrowable exp;
+   const char * methodName;
+   jint ret;
+   jstring str;
+   JNIEnv * javaEnv;
+
+   /* Gets the luaState index */
+   lua_pushstring( L , LUAJAVASTATEINDEX );
+   lua_rawget( L , LUA_REGISTRYINDEX );
+
+   if ( !lua_isnumber( L , -1 ) )
+   {
+      lua_pushstring( L , "Impossible to identify luaState id." );
+      lua_error( L );
+   }
+
+   stateIndex = lua_tonumber( L , -1 );
+   lua_pop( L , 1 );
+
+   /* Checks if is a valid java object */
    if ( !isJavaObject( L , 1 ) )
    {
       lua_pushstring( L , "Not a valid OO function call." );
@@ -550,6 +1374,7 @@ int objectIndexReturn( lua_State * L )
       lua_error( L );
    }
    methodName = lua_tostring( L , -1 );
+   luastats_method( methodName );
 
    lua_pop( L , 2 );
 
@@ -570,8 +1395,11 @@ int objectIndexReturn( lua_State * L )
 
    str = ( *javaEnv )->NewStringUTF( javaEnv , methodName );
 
+   luatrace_begin( "java.call" , methodName );
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method , (jint)stateIndex , 
                                             *pObject , str );
+   luatrace_end( "java.call" , methodName );
+   luaprofile_java( L , methodName );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -617,6 +1445,7 @@ int objectIndexReturn( lua_State * L )
 
 int classIndex( lua_State * L )
 {
+   LUASTATS_ENTER( "classIndex" );
    lua_Number stateIndex;
    jobject * obj;
    jmethodID method;
@@ -674,6 +1503,7 @@ int classIndex( lua_State * L )
    /* Return 1 for field, 2 for method or 0 for error */
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method, (jint)stateIndex , 
                                             *obj , str );
+   luaprofile_java( L , fieldName );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -738,6 +1568,7 @@ int classIndex( lua_State * L )
 
 int gc( lua_State * L )
 {
+   LUASTATS_ENTER( "gc" );
    jobject * pObj;
    JNIEnv * javaEnv;
 
@@ -747,6 +1578,10 @@ int gc( lua_State * L )
    }
 
    pObj = ( jobject * ) lua_touserdata( L , 1 );
+   if ( *pObj == NULL )
+   {
+      return 0;
+   }
 
    /* Gets the JNI Environment */
    javaEnv = getEnvFromState( L );
@@ -757,11 +1592,31 @@ int gc( lua_State * L )
    }
 
    ( *javaEnv )->DeleteGlobalRef( javaEnv , *pObj );
+   luarefs_release( ( LuaRef * ) pObj );
+   *pObj = NULL;
 
    return 0;
 }
 
 
+/***************************************************************************
+*
+*  Function: traceSpan
+*  ****/
+
+/* Tells the tracer of the state, if any, of a span, see lua_settracer */
+static void traceSpan( lua_State * L , int event , const char * cat , const char * name )
+{
+   void * ud;
+   lua_Tracer tracer = lua_gettracer( L , &ud );
+
+   if ( tracer != NULL )
+   {
+      tracer( L , event , cat , name , ud );
+   }
+}
+
+
 /***************************************************************************
 *
 *  Function: javaBindClass
@@ -769,6 +1624,7 @@ int gc( lua_State * L )
 
 int javaBindClass( lua_State * L )
 {
+   LUASTATS_ENTER( "javaBindClass" );
    int top;
    jmethodID method;
    const char * className;
@@ -805,8 +1661,11 @@ int javaBindClass( lua_State * L )
 
    javaClassName = ( *javaEnv )->NewStringUTF( javaEnv , className );
 
+   traceSpan( L , LUA_TRACEBEGIN , "bind" , className );
    classInstance = ( *javaEnv )->CallStaticObjectMethod( javaEnv , java_lang_class ,
                                                          method , javaClassName );
+   traceSpan( L , LUA_TRACEEND , "bind" , className );
+   luaprofile_java( L , NULL );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -852,6 +1711,7 @@ int javaBindClass( lua_State * L )
 *  ****/
 int createProxy( lua_State * L )
 {
+  LUASTATS_ENTER( "createProxy" );
   jint ret;
   lua_Number stateIndex;
   const char * impl;
@@ -901,6 +1761,7 @@ int createProxy( lua_State * L )
    str = ( *javaEnv )->NewStringUTF( javaEnv , impl );
 
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method, (jint)stateIndex , str );
+   luaprofile_java( L , NULL );
    
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -944,6 +1805,7 @@ int createProxy( lua_State * L )
 
 int javaNew( lua_State * L )
 {
+   LUASTATS_ENTER( "javaNew" );
    int top;
    jint ret;
    jclass clazz;
@@ -1012,6 +1874,7 @@ int javaNew( lua_State * L )
    }
 
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , clazz , method , (jint)stateIndex , classInstance );
+   luaprofile_java( L , NULL );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -1051,6 +1914,7 @@ int javaNew( lua_State * L )
 
 int javaNewInstance( lua_State * L )
 {
+   LUASTATS_ENTER( "javaNewInstance" );
    jint ret;
    jmethodID method;
    const char * className;
@@ -1096,6 +1960,7 @@ int javaNewInstance( lua_State * L )
    
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method, (jint)stateIndex , 
                                             javaClassName );
+   luaprofile_java( L , NULL );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -1140,6 +2005,7 @@ int javaNewInstance( lua_State * L )
 
 int javaLoadLib( lua_State * L )
 {
+   LUASTATS_ENTER( "javaLoadLib" );
    jint ret;
    int top;
    const char * className, * methodName;
@@ -1196,6 +2062,7 @@ int javaLoadLib( lua_State * L )
    
    ret = ( *javaEnv )->CallStaticIntMethod( javaEnv , luajava_api_class , method, (jint)stateIndex , 
                                             javaClassName , javaMethodName );
+   luaprofile_java( L , NULL );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -1242,7 +2109,7 @@ int javaLoadLib( lua_State * L )
 
 int pushJavaClass( lua_State * L , jobject javaObject )
 {
-   jobject * userData , globalRef;
+   jobject globalRef;
 
    /* Gets the JNI Environment */
    JNIEnv * javaEnv = getEnvFromState( L );
@@ -1254,8 +2121,7 @@ int pushJavaClass( lua_State * L , jobject javaObject )
 
    globalRef = ( *javaEnv )->NewGlobalRef( javaEnv , javaObject );
 
-   userData = ( jobject * ) lua_newuserdata( L , sizeof( jobject ) );
-   *userData = globalRef;
+   luarefs_push( L , globalRef , LUAREFS_CLASS );
 
    /* Creates metatable */
    lua_newtable( L );
@@ -1292,7 +2158,7 @@ int pushJavaClass( lua_State * L , jobject javaObject )
 
 int pushJavaObject( lua_State * L , jobject javaObject )
 {
-   jobject * userData , globalRef;
+   jobject globalRef;
 
    /* Gets the JNI Environment */
    JNIEnv * javaEnv = getEnvFromState( L );
@@ -1304,8 +2170,7 @@ int pushJavaObject( lua_State * L , jobject javaObject )
 
    globalRef = ( *javaEnv )->NewGlobalRef( javaEnv , javaObject );
 
-   userData = ( jobject * ) lua_newuserdata( L , sizeof( jobject ) );
-   *userData = globalRef;
+   luarefs_push( L , globalRef , LUAREFS_OBJECT );
 
    /* Creates metatable */
    lua_newtable( L );
@@ -1337,16 +2202,85 @@ int pushJavaObject( lua_State * L , jobject javaObject )
 
 /***************************************************************************
 *
-*  Function: isJavaObject
+*  Function: pushJavaFunction
 *  ****/
 
-int isJavaObject( lua_State * L , int idx )
+int pushJavaFunction( lua_State * L , jobject javaFunction )
 {
-   if ( !lua_isuserdata( L , idx ) )
-      return 0;
-
-   if ( lua_getmetatable( L , idx ) == 0 )
-      return 0;
+   jobject globalRef;
+
+   /* Gets the JNI Environment */
+   JNIEnv * javaEnv = getEnvFromState( L );
+   if ( javaEnv == NULL )
+   {
+      lua_pushstring( L , "Invalid JNI Environment." );
+      lua_error( L );
+   }
+
+   globalRef = ( *javaEnv )->NewGlobalRef( javaEnv , javaFunction );
+
+   luarefs_push( L , globalRef , LUAREFS_FUNCTION );
+
+   /* Creates metatable */
+   lua_newtable( L );
+
+   /* pushes the __call metamethod */
+   lua_pushstring( L , LUACALLMETAMETHODTAG );
+   lua_pushcfunction( L , &luaJavaFunctionCall );
+   lua_rawset( L , -3 );
+
+   /* pushes the __gc metamethod */
+   lua_pushstring( L , LUAGCMETAMETHODTAG );
+   lua_pushcfunction( L , &gc );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , LUAJAVAOBJECTIND );
+   lua_pushboolean( L , 1 );
+   lua_rawset( L , -3 );
+
+   return lua_setmetatable( L , -2 );
+}
+
+
+/***************************************************************************
+*
+*  Function: getGlobalClass
+*  ****/
+
+jclass getGlobalClass( JNIEnv * env , const char * name )
+{
+   jclass tempClass , globalClass = NULL;
+
+   tempClass = ( *env )->FindClass( env , name );
+
+   if ( tempClass != NULL )
+   {
+      globalClass = ( *env )->NewGlobalRef( env , tempClass );
+      ( *env )->DeleteLocalRef( env , tempClass );
+   }
+
+   if ( globalClass == NULL )
+   {
+      fprintf( stderr , "Error. Couldn't bind java class %s\n" , name );
+      exit( 1 );
+   }
+
+   return globalClass;
+}
+
+
+/***************************************************************************
+*
+*  Function: isJavaObject
+*  ****/
+
+int isJavaObject( lua_State * L , int idx )
+{
+   if ( !lua_isuserdata( L , idx ) )
+      return 0;
+
+   if ( lua_getmetatable( L , idx ) == 0 )
+      return 0;
 
    lua_pushstring( L , LUAJAVAOBJECTIND );
    lua_rawget( L , -2 );
@@ -1368,17 +2302,14 @@ int isJavaObject( lua_State * L , int idx )
 
 lua_State * getStateFromCPtr( JNIEnv * env , jobject cptr )
 {
-   lua_State * L;
-
-   jclass classPtr       = ( *env )->GetObjectClass( env , cptr );
-   jfieldID CPtr_peer_ID = ( *env )->GetFieldID( env , classPtr , "peer" , "J" );
-   jbyte * peer          = ( jbyte * ) ( *env )->GetLongField( env , cptr , CPtr_peer_ID );
-
-   L = ( lua_State * ) peer;
-
-   pushJNIEnv( env ,  L );
+   if ( cptr_peer_field == NULL )
+   {
+      jclass classPtr = ( *env )->GetObjectClass( env , cptr );
+      cptr_peer_field = ( *env )->GetFieldID( env , classPtr , "peer" , "J" );
+      ( *env )->DeleteLocalRef( env , classPtr );
+   }
 
-   return L;
+   return ( lua_State * ) ( intptr_t ) ( *env )->GetLongField( env , cptr , cptr_peer_field );
 }
 
 
@@ -1389,6 +2320,7 @@ lua_State * getStateFromCPtr( JNIEnv * env , jobject cptr )
 
 int luaJavaFunctionCall( lua_State * L )
 {
+   LUASTATS_ENTER( "luaJavaFunctionCall" );
    jobject * obj;
    jthrowable exp;
    int ret;
@@ -1419,6 +2351,7 @@ int luaJavaFunctionCall( lua_State * L )
    }
 
    ret = ( *javaEnv )->CallIntMethod( javaEnv , *obj , java_function_method );
+   luaprofile_java( L , NULL );
 
    exp = ( *javaEnv )->ExceptionOccurred( javaEnv );
 
@@ -1453,248 +2386,1704 @@ int luaJavaFunctionCall( lua_State * L )
 
 /***************************************************************************
 *
-*  Function: luaJavaFunctionCall
+*  Function: getEnvFromState
 *  ****/
 
 JNIEnv * getEnvFromState( lua_State * L )
 {
-   JNIEnv ** udEnv;
+   JNIEnv * env = ( JNIEnv * ) pthread_getspecific( jni_env_key );
+   jint status;
 
-   lua_pushstring( L , LUAJAVAJNIENVTAG );
-   lua_rawget( L , LUA_REGISTRYINDEX );
+   if ( env != NULL || java_vm == NULL )
+   {
+      return env;
+   }
 
-   if ( !lua_isuserdata( L , -1 ) )
+   status = ( *java_vm )->GetEnv( java_vm , ( void ** ) &env , JNI_VERSION_1_4 );
+
+   if ( status == JNI_EDETACHED )
+   {
+#ifdef __ANDROID__
+      status = ( *java_vm )->AttachCurrentThread( java_vm , &env , NULL );
+#else
+      status = ( *java_vm )->AttachCurrentThread( java_vm , ( void ** ) &env , NULL );
+#endif
+      if ( status != JNI_OK )
+      {
+         return NULL;
+      }
+      pthread_setspecific( jni_attached_key , ( void * ) java_vm );
+   }
+   else if ( status != JNI_OK )
    {
-      lua_pop( L , 1 );
       return NULL;
    }
 
-   udEnv = ( JNIEnv ** ) lua_touserdata( L , -1 );
+   pthread_setspecific( jni_env_key , env );
 
-   lua_pop( L , 1 );
+   return env;
+}
+
+
+/***************************************************************************
+*
+*  Function: refClassName
+*  ****/
+
+static const char * refClassName( lua_State * L , LuaRef * ref , char * buf , size_t size )
+{
+   JNIEnv * javaEnv = getEnvFromState( L );
+   jobject classObject;
+   jstring name = NULL;
+   const char * cName;
+
+   snprintf( buf , size , "?" );
+   if ( javaEnv == NULL || class_get_name == NULL )
+   {
+      return buf;
+   }
+
+   /* a class is counted under its own name */
+   if ( ref->kind == LUAREFS_CLASS )
+      classObject = ( *javaEnv )->NewLocalRef( javaEnv , ref->object );
+   else
+      classObject = ( *javaEnv )->GetObjectClass( javaEnv , ref->object );
+
+   if ( classObject != NULL )
+   {
+      name = ( jstring ) ( *javaEnv )->CallObjectMethod( javaEnv , classObject , class_get_name );
+      ( *javaEnv )->DeleteLocalRef( javaEnv , classObject );
+   }
+   if ( ( *javaEnv )->ExceptionCheck( javaEnv ) )
+   {
+      ( *javaEnv )->ExceptionClear( javaEnv );
+   }
+   if ( name == NULL )
+   {
+      return buf;
+   }
+
+   cName = ( *javaEnv )->GetStringUTFChars( javaEnv , name , NULL );
+   if ( cName != NULL )
+   {
+      snprintf( buf , size , ref->kind == LUAREFS_CLASS ? "class %s" : "%s" , cName );
+      ( *javaEnv )->ReleaseStringUTFChars( javaEnv , name , cName );
+   }
+   ( *javaEnv )->DeleteLocalRef( javaEnv , name );
+
+   return buf;
+}
+
+
+/***************************************************************************
+*
+*  Function: detachThread
+*  ****/
+
+void detachThread( void * value )
+{
+   JavaVM * vm = ( JavaVM * ) value;
+
+   ( *vm )->DetachCurrentThread( vm );
+}
+
+
+/***************************************************************************
+*
+*  Function: toJavaValue
+*  ****/
+
+jobject toJavaValue( JNIEnv * env , jobject luaState , lua_State * L , int idx )
+{
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   switch ( lua_type( L , idx ) )
+   {
+      case LUA_TBOOLEAN:
+         return ( *env )->CallStaticObjectMethod( env , java_boolean_class , boolean_value_of ,
+                                                  ( jboolean ) lua_toboolean( L , idx ) );
+
+      case LUA_TNUMBER:
+         return ( *env )->CallStaticObjectMethod( env , java_double_class , double_value_of ,
+                                                  ( jdouble ) lua_tonumber( L , idx ) );
+
+      case LUA_TSTRING:
+         return ( *env )->NewStringUTF( env , lua_tostring( L , idx ) );
+
+      case LUA_TNONE:
+      case LUA_TNIL:
+         return NULL;
+
+      case LUA_TUSERDATA:
+         if ( isJavaObject( L , idx ) )
+         {
+            return ( *env )->NewLocalRef( env , *( jobject * ) lua_touserdata( L , idx ) );
+         }
+         /* other userdata is wrapped like tables and functions */
+
+      default:
+         return ( *env )->CallObjectMethod( env , luaState , get_lua_object_method , ( jint ) idx );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: handleJavaException
+*  ****/
+
+int handleJavaException( JNIEnv * env , lua_State * L )
+{
+   jthrowable exp;
+   jobject jstr;
+   const char * cStr;
+
+   exp = ( *env )->ExceptionOccurred( env );
+
+   if ( exp == NULL )
+   {
+      return 0;
+   }
+
+   ( *env )->ExceptionClear( env );
+   jstr = ( *env )->CallObjectMethod( env , exp , get_message_method );
+
+   if ( jstr == NULL )
+   {
+      jmethodID methodId;
+
+      methodId = ( *env )->GetMethodID( env , throwable_class , "toString" , "()Ljava/lang/String;" );
+      jstr = ( *env )->CallObjectMethod( env , exp , methodId );
+   }
+
+   cStr = ( *env )->GetStringUTFChars( env , jstr , NULL );
+
+   lua_pushstring( L , cStr );
 
-   return * udEnv;
+   ( *env )->ReleaseStringUTFChars( env , jstr, cStr );
+   ( *env )->DeleteLocalRef( env , jstr );
+   ( *env )->DeleteLocalRef( env , exp );
+
+   return 1;
 }
 
 
 /***************************************************************************
 *
-*  Function: pushJNIEnv
+*  Function: getLuaStateObject
 *  ****/
 
-void pushJNIEnv( JNIEnv * env , lua_State * L )
+jobject getLuaStateObject( JNIEnv * env , lua_State * L )
 {
-   JNIEnv ** udEnv;
+   lua_Number stateIndex;
 
-   lua_pushstring( L , LUAJAVAJNIENVTAG );
+   lua_pushstring( L , LUAJAVASTATEINDEX );
    lua_rawget( L , LUA_REGISTRYINDEX );
 
-   if ( !lua_isnil( L , -1 ) )
+   if ( !lua_isnumber( L , -1 ) )
    {
-      udEnv = ( JNIEnv ** ) lua_touserdata( L , -1 );
-      *udEnv = env;
       lua_pop( L , 1 );
+      return NULL;
    }
-   else
+
+   stateIndex = lua_tonumber( L , -1 );
+   lua_pop( L , 1 );
+
+   return ( *env )->CallStaticObjectMethod( env , lua_state_factory_class , get_existing_state ,
+                                            ( jint ) stateIndex );
+}
+
+
+/***************************************************************************
+*
+*  Function: tableToJava
+*  ****/
+
+jobject tableToJava( JNIEnv * env , jobject luaState , lua_State * L , int idx ,
+                     int target , int depth , const void ** path , const char ** error )
+{
+   const void * self;
+   jobject result = NULL;
+   jobject key , value;
+   int n , count , i;
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   self = lua_topointer( L , idx );
+   for ( i = 0 ; i < depth ; i++ )
+   {
+      if ( path[ i ] == self )
+      {
+         *error = "Cannot convert a table with cycles.";
+         return NULL;
+      }
+   }
+
+   if ( depth >= LUAJAVAMAXNESTING )
+   {
+      *error = "Table nesting too deep.";
+      return NULL;
+   }
+
+   if ( !lua_checkstack( L , 4 ) )
    {
+      *error = "Stack overflow.";
+      return NULL;
+   }
+
+   if ( ( *env )->PushLocalFrame( env , 16 ) < 0 )
+   {
+      return NULL;
+   }
+
+   path[ depth ] = self;
+   n = ( int ) lua_objlen( L , idx );
+
+   /* counts the entries, needed to tell sequences apart and to size maps */
+   count = 0;
+   lua_pushnil( L );
+   while ( lua_next( L , idx ) != 0 )
+   {
+      count++;
       lua_pop( L , 1 );
-      udEnv = ( JNIEnv ** ) lua_newuserdata( L , sizeof( JNIEnv * ) );
-      *udEnv = env;
+   }
+
+   if ( target == LUAJAVA_TODEFAULT )
+   {
+      target = ( count == n ) ? LUAJAVA_TOLIST : LUAJAVA_TOMAP;
+   }
+
+   switch ( target )
+   {
+      case LUAJAVA_TOLIST:
+      case LUAJAVA_TOOBJARRAY:
+      {
+         jobjectArray arr = ( *env )->NewObjectArray( env , n , java_object_class , NULL );
+
+         for ( i = 0 ; arr != NULL && i < n ; i++ )
+         {
+            lua_rawgeti( L , idx , i + 1 );
+            if ( lua_istable( L , -1 ) )
+               value = tableToJava( env , luaState , L , -1 , LUAJAVA_TODEFAULT , depth + 1 , path , error );
+            else
+               value = toJavaValue( env , luaState , L , -1 );
+            lua_pop( L , 1 );
+
+            if ( *error != NULL || ( *env )->ExceptionCheck( env ) )
+            {
+               arr = NULL;
+               break;
+            }
+
+            ( *env )->SetObjectArrayElement( env , arr , i , value );
+            ( *env )->DeleteLocalRef( env , value );
+         }
+
+         if ( arr != NULL && target == LUAJAVA_TOLIST )
+         {
+            value  = ( *env )->CallStaticObjectMethod( env , arrays_class , arrays_as_list , arr );
+            result = ( *env )->NewObject( env , arraylist_class , arraylist_init , value );
+         }
+         else
+         {
+            result = arr;
+         }
+         break;
+      }
+
+      case LUAJAVA_TOMAP:
+      {
+         result = ( *env )->NewObject( env , hashmap_class , hashmap_init , ( jint ) ( count * 4 / 3 + 1 ) );
+
+         lua_pushnil( L );
+         while ( result != NULL && lua_next( L , idx ) != 0 )
+         {
+            value = NULL;
+
+            if ( lua_istable( L , -2 ) )
+               key = tableToJava( env , luaState , L , -2 , LUAJAVA_TODEFAULT , depth + 1 , path , error );
+            else
+               key = toJavaValue( env , luaState , L , -2 );
+
+            if ( *error == NULL && !( *env )->ExceptionCheck( env ) )
+            {
+               if ( lua_istable( L , -1 ) )
+                  value = tableToJava( env , luaState , L , -1 , LUAJAVA_TODEFAULT , depth + 1 , path , error );
+               else
+                  value = toJavaValue( env , luaState , L , -1 );
+            }
+
+            lua_pop( L , 1 );
+
+            if ( *error != NULL || ( *env )->ExceptionCheck( env ) )
+            {
+               lua_pop( L , 1 );
+               result = NULL;
+               break;
+            }
+
+            ( *env )->DeleteLocalRef( env ,
+               ( *env )->CallObjectMethod( env , result , hashmap_put , key , value ) );
+            ( *env )->DeleteLocalRef( env , key );
+            ( *env )->DeleteLocalRef( env , value );
+         }
+         break;
+      }
+
+      case LUAJAVA_TODOUBLEARRAY:
+      case LUAJAVA_TOINTARRAY:
+      {
+         void * elems;
+
+         if ( target == LUAJAVA_TODOUBLEARRAY )
+            result = ( *env )->NewDoubleArray( env , n );
+         else
+            result = ( *env )->NewIntArray( env , n );
+
+         if ( result == NULL )
+         {
+            break;
+         }
+
+         /* only lua_rawgeti and lua_tonumber run inside the critical region */
+         elems = ( *env )->GetPrimitiveArrayCritical( env , result , NULL );
+         if ( elems == NULL )
+         {
+            result = NULL;
+            break;
+         }
+
+         for ( i = 0 ; i < n ; i++ )
+         {
+            lua_rawgeti( L , idx , i + 1 );
+            if ( lua_type( L , -1 ) != LUA_TNUMBER )
+            {
+               lua_pop( L , 1 );
+               *error = "Table element is not a number.";
+               break;
+            }
+            if ( target == LUAJAVA_TODOUBLEARRAY )
+               ( ( jdouble * ) elems )[ i ] = ( jdouble ) lua_tonumber( L , -1 );
+            else
+               ( ( jint * ) elems )[ i ] = ( jint ) lua_tointeger( L , -1 );
+            lua_pop( L , 1 );
+         }
+
+         ( *env )->ReleasePrimitiveArrayCritical( env , result , elems , 0 );
+
+         if ( *error != NULL )
+         {
+            result = NULL;
+         }
+         break;
+      }
 
-      lua_pushstring( L , LUAJAVAJNIENVTAG );
-      lua_insert( L , -2 );
-      lua_rawset( L , LUA_REGISTRYINDEX );
+      case LUAJAVA_TOSTRINGARRAY:
+      {
+         result = ( *env )->NewObjectArray( env , n , java_string_class , NULL );
+
+         for ( i = 0 ; result != NULL && i < n ; i++ )
+         {
+            lua_rawgeti( L , idx , i + 1 );
+            if ( !lua_isstring( L , -1 ) )
+            {
+               lua_pop( L , 1 );
+               *error = "Table element is not a string.";
+               result = NULL;
+               break;
+            }
+            value = ( *env )->NewStringUTF( env , lua_tostring( L , -1 ) );
+            lua_pop( L , 1 );
+
+            if ( value == NULL )
+            {
+               result = NULL;
+               break;
+            }
+
+            ( *env )->SetObjectArrayElement( env , result , i , value );
+            ( *env )->DeleteLocalRef( env , value );
+         }
+         break;
+      }
    }
+
+   return ( *env )->PopLocalFrame( env , result );
 }
 
-/*
-** Assumes the table is on top of the stack.
-*/
-static void set_info (lua_State *L) {
-	lua_pushliteral (L, "_COPYRIGHT");
-	lua_pushliteral (L, "Copyright (C) 2003-2007 Kepler Project");
-	lua_settable (L, -3);
-	lua_pushliteral (L, "_DESCRIPTION");
-	lua_pushliteral (L, "LuaJava is a script tool for Java");
-	lua_settable (L, -3);
-	lua_pushliteral (L, "_NAME");
-	lua_pushliteral (L, "LuaJava");
-	lua_settable (L, -3);
-	lua_pushliteral (L, "_VERSION");
-	lua_pushliteral (L, "1.1");
-	lua_settable (L, -3);
+
+/***************************************************************************
+*
+*  Function: pushJavaValue
+*  ****/
+
+int pushJavaValue( JNIEnv * env , lua_State * L , jobject obj ,
+                   int depth , jobject * path , const char ** error )
+{
+   if ( obj == NULL )
+   {
+      lua_pushnil( L );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , java_string_class ) )
+   {
+      const char * str = ( *env )->GetStringUTFChars( env , obj , NULL );
+
+      if ( str == NULL )
+      {
+         return 0;
+      }
+      lua_pushstring( L , str );
+      ( *env )->ReleaseStringUTFChars( env , obj , str );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , java_number_class ) )
+   {
+      lua_pushnumber( L , ( lua_Number ) ( *env )->CallDoubleMethod( env , obj , number_double_value ) );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , java_boolean_class ) )
+   {
+      lua_pushboolean( L , ( *env )->CallBooleanMethod( env , obj , boolean_boolean_value ) );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , byte_array_class ) )
+   {
+      jsize len = ( *env )->GetArrayLength( env , obj );
+      jbyte * bytes = ( *env )->GetByteArrayElements( env , obj , NULL );
+
+      if ( bytes == NULL )
+      {
+         return 0;
+      }
+      lua_pushlstring( L , ( const char * ) bytes , len );
+      ( *env )->ReleaseByteArrayElements( env , obj , bytes , JNI_ABORT );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , lua_object_class ) )
+   {
+      jobject ref = ( *env )->GetObjectField( env , obj , lua_object_ref );
+
+      lua_rawgeti( L , LUA_REGISTRYINDEX , ( *env )->CallIntMethod( env , ref , integer_int_value ) );
+      ( *env )->DeleteLocalRef( env , ref );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , java_function_class ) )
+   {
+      pushJavaFunction( L , obj );
+   }
+   else if ( path == NULL || !pushJavaTable( env , L , obj , depth , path , error ) )
+   {
+      if ( path != NULL && ( *error != NULL || ( *env )->ExceptionCheck( env ) ) )
+      {
+         return 0;
+      }
+      pushJavaObject( L , obj );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: pushJavaTable
+*  ****/
+
+int pushJavaTable( JNIEnv * env , lua_State * L , jobject obj ,
+                   int depth , jobject * path , const char ** error )
+{
+   jobject arr = NULL;
+   jsize n , i , j , chunk;
+   int top = lua_gettop( L );
+   int isMap = 0;
+
+   if ( ( *env )->IsInstanceOf( env , obj , collection_class ) )
+   {
+      arr = ( *env )->CallObjectMethod( env , obj , collection_to_array );
+   }
+   else if ( ( *env )->IsInstanceOf( env , obj , map_class ) )
+   {
+      jobject entries = ( *env )->CallObjectMethod( env , obj , map_entry_set );
+
+      if ( entries == NULL )
+      {
+         return 0;
+      }
+      arr = ( *env )->CallObjectMethod( env , entries , collection_to_array );
+      ( *env )->DeleteLocalRef( env , entries );
+      isMap = 1;
+   }
+   else if ( !( *env )->IsInstanceOf( env , obj , object_array_class ) &&
+             !( *env )->IsInstanceOf( env , obj , double_array_class ) &&
+             !( *env )->IsInstanceOf( env , obj , float_array_class ) &&
+             !( *env )->IsInstanceOf( env , obj , int_array_class ) &&
+             !( *env )->IsInstanceOf( env , obj , long_array_class ) &&
+             !( *env )->IsInstanceOf( env , obj , boolean_array_class ) )
+   {
+      /* not a container */
+      return 0;
+   }
+
+   if ( ( *env )->ExceptionCheck( env ) )
+   {
+      return 0;
+   }
+
+   for ( i = 0 ; i < depth ; i++ )
+   {
+      if ( ( *env )->IsSameObject( env , path[ i ] , obj ) )
+      {
+         *error = "Cannot convert a java object graph with cycles.";
+         return 0;
+      }
+   }
+
+   if ( depth >= LUAJAVAMAXNESTING )
+   {
+      *error = "Table nesting too deep.";
+      return 0;
+   }
+
+   if ( !lua_checkstack( L , 4 ) )
+   {
+      *error = "Stack overflow.";
+      return 0;
+   }
+
+   if ( ( *env )->PushLocalFrame( env , 16 ) < 0 )
+   {
+      return 0;
+   }
+
+   path[ depth ] = obj;
+
+   if ( arr == NULL )
+   {
+      arr = obj;
+   }
+
+   n = ( *env )->GetArrayLength( env , arr );
+
+   if ( isMap )
+   {
+      lua_createtable( L , 0 , n );
+
+      for ( i = 0 ; i < n ; i++ )
+      {
+         jobject entry = ( *env )->GetObjectArrayElement( env , arr , i );
+         jobject key   = ( *env )->CallObjectMethod( env , entry , map_entry_get_key );
+         jobject value = ( *env )->CallObjectMethod( env , entry , map_entry_get_value );
+
+         if ( ( *env )->ExceptionCheck( env ) )
+         {
+            break;
+         }
+
+         /* nil cannot be a table key */
+         if ( key != NULL )
+         {
+            if ( !pushJavaValue( env , L , key , depth + 1 , path , error ) )
+               break;
+            if ( !pushJavaValue( env , L , value , depth + 1 , path , error ) )
+               break;
+            lua_rawset( L , -3 );
+         }
+
+         ( *env )->DeleteLocalRef( env , entry );
+         ( *env )->DeleteLocalRef( env , key );
+         ( *env )->DeleteLocalRef( env , value );
+      }
+   }
+   else if ( ( *env )->IsInstanceOf( env , arr , object_array_class ) )
+   {
+      lua_createtable( L , n , 0 );
+
+      for ( i = 0 ; i < n ; i++ )
+      {
+         jobject value = ( *env )->GetObjectArrayElement( env , arr , i );
+
+         if ( !pushJavaValue( env , L , value , depth + 1 , path , error ) )
+            break;
+         lua_rawseti( L , -2 , i + 1 );
+
+         ( *env )->DeleteLocalRef( env , value );
+      }
+   }
+   else
+   {
+      /* primitive arrays are copied in chunks, without a JNI call per element */
+      union
+      {
+         jdouble d[ 256 ];
+         jfloat f[ 256 ];
+         jint i[ 256 ];
+         jlong l[ 256 ];
+         jboolean z[ 256 ];
+      } buf;
+
+      lua_createtable( L , n , 0 );
+
+      for ( i = 0 ; i < n ; i += chunk )
+      {
+         chunk = ( n - i < 256 ) ? n - i : 256;
+
+         if ( ( *env )->IsInstanceOf( env , arr , double_array_class ) )
+         {
+            ( *env )->GetDoubleArrayRegion( env , arr , i , chunk , buf.d );
+            for ( j = 0 ; j < chunk ; j++ )
+            {
+               lua_pushnumber( L , ( lua_Number ) buf.d[ j ] );
+               lua_rawseti( L , -2 , i + j + 1 );
+            }
+         }
+         else if ( ( *env )->IsInstanceOf( env , arr , float_array_class ) )
+         {
+            ( *env )->GetFloatArrayRegion( env , arr , i , chunk , buf.f );
+            for ( j = 0 ; j < chunk ; j++ )
+            {
+               lua_pushnumber( L , ( lua_Number ) buf.f[ j ] );
+               lua_rawseti( L , -2 , i + j + 1 );
+            }
+         }
+         else if ( ( *env )->IsInstanceOf( env , arr , int_array_class ) )
+         {
+            ( *env )->GetIntArrayRegion( env , arr , i , chunk , buf.i );
+            for ( j = 0 ; j < chunk ; j++ )
+            {
+               lua_pushnumber( L , ( lua_Number ) buf.i[ j ] );
+               lua_rawseti( L , -2 , i + j + 1 );
+            }
+         }
+         else if ( ( *env )->IsInstanceOf( env , arr , long_array_class ) )
+         {
+            ( *env )->GetLongArrayRegion( env , arr , i , chunk , buf.l );
+            for ( j = 0 ; j < chunk ; j++ )
+            {
+               lua_pushnumber( L , ( lua_Number ) buf.l[ j ] );
+               lua_rawseti( L , -2 , i + j + 1 );
+            }
+         }
+         else
+         {
+            ( *env )->GetBooleanArrayRegion( env , arr , i , chunk , buf.z );
+            for ( j = 0 ; j < chunk ; j++ )
+            {
+               lua_pushboolean( L , buf.z[ j ] );
+               lua_rawseti( L , -2 , i + j + 1 );
+            }
+         }
+      }
+   }
+
+   ( *env )->PopLocalFrame( env , NULL );
+
+   if ( *error != NULL || ( *env )->ExceptionCheck( env ) )
+   {
+      lua_settop( L , top );
+      return 0;
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaToJava
+*  ****/
+
+int javaToJava( lua_State * L )
+{
+   LUASTATS_ENTER( "javaToJava" );
+   const void * path[ LUAJAVAMAXNESTING ];
+   const char * error = NULL;
+   jobject luaState , result;
+   int target;
+   JNIEnv * javaEnv;
+
+   luaL_checktype( L , 1 , LUA_TTABLE );
+   target = luaL_checkoption( L , 2 , "default" , table_target_names );
+
+   /* Gets the JNI Environment */
+   javaEnv = getEnvFromState( L );
+   if ( javaEnv == NULL )
+   {
+      lua_pushstring( L , "Invalid JNI Environment." );
+      lua_error( L );
+   }
+
+   luaState = getLuaStateObject( javaEnv , L );
+   if ( luaState == NULL )
+   {
+      if ( !handleJavaException( javaEnv , L ) )
+         lua_pushstring( L , "Impossible to identify luaState id." );
+      lua_error( L );
+   }
+
+   result = tableToJava( javaEnv , luaState , L , 1 , target , 0 , path , &error );
+
+   ( *javaEnv )->DeleteLocalRef( javaEnv , luaState );
+
+   if ( handleJavaException( javaEnv , L ) )
+   {
+      lua_error( L );
+   }
+
+   if ( error != NULL )
+   {
+      lua_pushstring( L , error );
+      lua_error( L );
+   }
+
+   pushJavaObject( L , result );
+
+   ( *javaEnv )->DeleteLocalRef( javaEnv , result );
+
+   return 1;
+}
+
+/*
+** Assumes the table is on top of the stack.
+*/
+static void set_info (lua_State *L) {
+	lua_pushliteral (L, "_COPYRIGHT");
+	lua_pushliteral (L, "Copyright (C) 2003-2007 Kepler Project");
+	lua_settable (L, -3);
+	lua_pushliteral (L, "_DESCRIPTION");
+	lua_pushliteral (L, "LuaJava is a script tool for Java");
+	lua_settable (L, -3);
+	lua_pushliteral (L, "_NAME");
+	lua_pushliteral (L, "LuaJava");
+	lua_settable (L, -3);
+	lua_pushliteral (L, "_VERSION");
+	lua_pushliteral (L, "1.1");
+	lua_settable (L, -3);
+}
+
+/**************************** JNI FUNCTIONS ****************************/
+
+/************************************************************************
+*   JNI Called function
+*      Called by the VM when the library is loaded
+************************************************************************/
+
+JNIEXPORT jint JNICALL JNI_OnLoad( JavaVM * vm , void * reserved )
+{
+   java_vm = vm;
+
+   if ( pthread_key_create( &jni_env_key , NULL ) != 0 ||
+        pthread_key_create( &jni_attached_key , &detachThread ) != 0 )
+   {
+      fprintf( stderr , "Could not create the JNIEnv thread keys\n" );
+      return JNI_ERR;
+   }
+
+   return JNI_VERSION_1_4;
+}
+
+
+/* async(fn) returns a step function resuming a coroutine running fn; each
+   step returns "yield", "done" or "error" followed by the values. Java
+   (LuaObject.callAsync) calls the steps, resuming a coroutine that yielded
+   a java.util.concurrent.Future with (true, value) or (false, message)
+   once the future completes. await(future) is that yield, or a blocking
+   get() outside a coroutine. As any yield in Lua 5.1 it cannot cross a
+   pcall or a metamethod. The coroutine library is looked up on each
+   call since luajava_open runs before the libraries are opened. */
+static const char asyncSource[] =
+   "local function async(fn)\n"
+   "  local co = coroutine.create(fn)\n"
+   "  local function step(ok, ...)\n"
+   "    if not ok then return 'error', ... end\n"
+   "    if coroutine.status(co) == 'dead' then return 'done', ... end\n"
+   "    return 'yield', ...\n"
+   "  end\n"
+   "  return function(...) return step(coroutine.resume(co, ...)) end\n"
+   "end\n"
+   "local function await(future)\n"
+   "  if coroutine.running() then\n"
+   "    local ok, value = coroutine.yield(future)\n"
+   "    if ok == false then error(value, 0) end\n"
+   "    return value\n"
+   "  end\n"
+   "  return future:get()\n"
+   "end\n"
+   "return async, await\n";
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState_luajava_1open
+  ( JNIEnv * env , jobject jobj , jobject cptr , jint stateId )
+{
+  LUASTATS_ENTER( "LuaState.luajava_open" );
+
+  lua_State* L;
+
+  jclass tempClass;
+
+  L = getStateFromCPtr( env , cptr );
+
+  lua_pushstring( L , LUAJAVASTATEINDEX );
+  lua_pushnumber( L , (lua_Number)stateId );
+  lua_settable( L , LUA_REGISTRYINDEX );
+
+
+  lua_newtable( L );
+
+  lua_setglobal( L , "luajava" );
+
+  lua_getglobal( L , "luajava" );
+  
+  set_info( L);
+  
+  lua_pushstring( L , "bindClass" );
+  lua_pushcfunction( L , &javaBindClass );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "new" );
+  lua_pushcfunction( L , &javaNew );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "newInstance" );
+  lua_pushcfunction( L , &javaNewInstance );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "loadLib" );
+  lua_pushcfunction( L , &javaLoadLib );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "createProxy" );
+  lua_pushcfunction( L , &createProxy );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "tojava" );
+  lua_pushcfunction( L , &javaToJava );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "iter" );
+  lua_pushcfunction( L , &javaIter );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "await" );
+  if ( luaL_loadbuffer( L , asyncSource , sizeof( asyncSource ) - 1 , "=await" ) == 0 )
+  {
+    lua_call( L , 0 , 2 );
+    lua_insert( L , -2 );
+    lua_setfield( L , LUA_REGISTRYINDEX , LUAJAVAASYNCINDEX );
+  }
+  lua_settable( L , -3 );
+
+  luajava_openchannel( L );
+  luajava_openserialize( L );
+  luajava_openscheduler( L );
+  luajava_openparallel( L );
+  luajava_openframes( L );
+  luajava_openstats( L );
+  luajava_openprofile( L );
+  luajava_opentrace( L );
+  luajava_openheap( L );
+  luajava_openrefs( L , &refClassName );
+  luajava_openstartup( L );
+
+  /* replaces the table only versions registered by luajava_openparallel */
+  lua_pushstring( L , "parallel_map" );
+  lua_pushcfunction( L , &javaParallelMap );
+  lua_settable( L , -3 );
+
+  lua_pushstring( L , "parallel_reduce" );
+  lua_pushcfunction( L , &javaParallelReduce );
+  lua_settable( L , -3 );
+
+  lua_pop( L , 1 );
+
+  if ( luajava_api_class == NULL )
+  {
+    tempClass = ( *env )->FindClass( env , "org/keplerproject/luajava/LuaJavaAPI" );
+
+    if ( tempClass == NULL )
+    {
+      fprintf( stderr , "Could not find LuaJavaAPI class\n" );
+      exit( 1 );
+    }
+
+    if ( ( luajava_api_class = ( *env )->NewGlobalRef( env , tempClass ) ) == NULL )
+    {
+      fprintf( stderr , "Could not bind to LuaJavaAPI class\n" );
+      exit( 1 );
+    }
+  }
+
+  if ( iter_source_method == NULL )
+  {
+    iter_source_method = ( *env )->GetStaticMethodID( env , luajava_api_class , "iterSource" ,
+                                                      "(Ljava/lang/Object;)Ljava/lang/Object;" );
+    iter_fill_method   = ( *env )->GetStaticMethodID( env , luajava_api_class , "iterFill" ,
+                                                      "(Ljava/lang/Object;I[Ljava/lang/Object;)I" );
+
+    if ( iter_source_method == NULL || iter_fill_method == NULL )
+    {
+      fprintf( stderr , "Could not find iterator methods in LuaJavaAPI\n" );
+      exit( 1 );
+    }
+  }
+
+  if ( java_function_class == NULL )
+  {
+    tempClass = ( *env )->FindClass( env , "org/keplerproject/luajava/JavaFunction" );
+
+    if ( tempClass == NULL )
+    {
+      fprintf( stderr , "Could not find JavaFunction interface\n" );
+      exit( 1 );
+    }
+
+    if ( ( java_function_class = ( *env )->NewGlobalRef( env , tempClass ) ) == NULL )
+    {
+      fprintf( stderr , "Could not bind to JavaFunction interface\n" );
+      exit( 1 );
+    }
+  }
+
+  if ( java_function_method == NULL )
+  {
+    java_function_method = ( *env )->GetMethodID( env , java_function_class , "execute" , "()I");
+    if ( !java_function_method )
+    {
+      fprintf( stderr , "Could not find <execute> method in JavaFunction\n" );
+      exit( 1 );
+    }
+  }
+
+  if ( throwable_class == NULL )
+  {
+    tempClass = ( *env )->FindClass( env , "java/lang/Throwable" );
+
+    if ( tempClass == NULL )
+    {
+      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
+      exit( 1 );
+    }
+
+    throwable_class = ( *env )->NewGlobalRef( env , tempClass );
+
+    if ( throwable_class == NULL )
+    {
+      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
+      exit( 1 );
+    }
+  }
+
+  if ( get_message_method == NULL )
+  {
+    get_message_method = ( *env )->GetMethodID( env , throwable_class , "getMessage" ,
+                                                "()Ljava/lang/String;" );
+
+    if ( get_message_method == NULL )
+    {
+      fprintf(stderr, "Could not find <getMessage> method in java.lang.Throwable\n");
+      exit(1);
+    }
+  }
+
+  if ( java_lang_class == NULL )
+  {
+    tempClass = ( *env )->FindClass( env , "java/lang/Class" );
+
+    if ( tempClass == NULL )
+    {
+      fprintf( stderr , "Error. Coundn't bind java class java.lang.Class\n" );
+      exit( 1 );
+    }
+
+    java_lang_class = ( *env )->NewGlobalRef( env , tempClass );
+
+    if ( java_lang_class == NULL )
+    {
+      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
+      exit( 1 );
+    }
+
+    class_get_name = ( *env )->GetMethodID( env , java_lang_class , "getName" , "()Ljava/lang/String;" );
+  }
+
+  if ( java_object_class == NULL )
+  {
+    java_object_class = getGlobalClass( env , "java/lang/Object" );
+  }
+
+  if ( java_boolean_class == NULL )
+  {
+    java_boolean_class = getGlobalClass( env , "java/lang/Boolean" );
+
+    boolean_value_of      = ( *env )->GetStaticMethodID( env , java_boolean_class , "valueOf" ,
+                                                         "(Z)Ljava/lang/Boolean;" );
+    boolean_boolean_value = ( *env )->GetMethodID( env , java_boolean_class , "booleanValue" , "()Z" );
+  }
+
+  if ( java_double_class == NULL )
+  {
+    java_double_class = getGlobalClass( env , "java/lang/Double" );
+
+    double_value_of = ( *env )->GetStaticMethodID( env , java_double_class , "valueOf" ,
+                                                   "(D)Ljava/lang/Double;" );
+  }
+
+  /* classes used by the bulk conversions between tables and collections */
+  if ( collection_class == NULL )
+  {
+    java_string_class   = getGlobalClass( env , "java/lang/String" );
+    java_number_class   = getGlobalClass( env , "java/lang/Number" );
+    number_double_value = ( *env )->GetMethodID( env , java_number_class , "doubleValue" , "()D" );
+
+    collection_class    = getGlobalClass( env , "java/util/Collection" );
+    collection_to_array = ( *env )->GetMethodID( env , collection_class , "toArray" ,
+                                                 "()[Ljava/lang/Object;" );
+
+    map_class           = getGlobalClass( env , "java/util/Map" );
+    map_entry_set       = ( *env )->GetMethodID( env , map_class , "entrySet" , "()Ljava/util/Set;" );
+    map_entry_class     = getGlobalClass( env , "java/util/Map$Entry" );
+    map_entry_get_key   = ( *env )->GetMethodID( env , map_entry_class , "getKey" , "()Ljava/lang/Object;" );
+    map_entry_get_value = ( *env )->GetMethodID( env , map_entry_class , "getValue" , "()Ljava/lang/Object;" );
+
+    arraylist_class     = getGlobalClass( env , "java/util/ArrayList" );
+    arraylist_init      = ( *env )->GetMethodID( env , arraylist_class , "<init>" , "(Ljava/util/Collection;)V" );
+    arrays_class        = getGlobalClass( env , "java/util/Arrays" );
+    arrays_as_list      = ( *env )->GetStaticMethodID( env , arrays_class , "asList" ,
+                                                       "([Ljava/lang/Object;)Ljava/util/List;" );
+    hashmap_class       = getGlobalClass( env , "java/util/HashMap" );
+    hashmap_init        = ( *env )->GetMethodID( env , hashmap_class , "<init>" , "(I)V" );
+    hashmap_put         = ( *env )->GetMethodID( env , hashmap_class , "put" ,
+                                                 "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;" );
+
+    object_array_class  = getGlobalClass( env , "[Ljava/lang/Object;" );
+    byte_array_class    = getGlobalClass( env , "[B" );
+    double_array_class  = getGlobalClass( env , "[D" );
+    float_array_class   = getGlobalClass( env , "[F" );
+    int_array_class     = getGlobalClass( env , "[I" );
+    long_array_class    = getGlobalClass( env , "[J" );
+    boolean_array_class = getGlobalClass( env , "[Z" );
+
+    lua_object_class    = getGlobalClass( env , "org/keplerproject/luajava/LuaObject" );
+    lua_object_ref      = ( *env )->GetFieldID( env , lua_object_class , "ref" , "Ljava/lang/Integer;" );
+    tempClass           = ( *env )->FindClass( env , "java/lang/Integer" );
+    integer_int_value   = ( *env )->GetMethodID( env , tempClass , "intValue" , "()I" );
+
+    lua_state_factory_class = getGlobalClass( env , "org/keplerproject/luajava/LuaStateFactory" );
+    get_existing_state  = ( *env )->GetStaticMethodID( env , lua_state_factory_class , "getExistingState" ,
+                                                       "(I)Lorg/keplerproject/luajava/LuaState;" );
+  }
+
+  if ( get_lua_object_method == NULL )
+  {
+    get_lua_object_method = ( *env )->GetMethodID( env , ( *env )->GetObjectClass( env , jobj ) ,
+                                                   "getLuaObject" ,
+                                                   "(I)Lorg/keplerproject/luajava/LuaObject;" );
+
+    if ( get_lua_object_method == NULL )
+    {
+      fprintf( stderr , "Could not find <getLuaObject> method in LuaState\n" );
+      exit( 1 );
+    }
+  }
+
+}
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1getObjectFromUserdata
+  (JNIEnv * env , jobject jobj , jobject cptr , jint index )
+{
+   LUASTATS_ENTER( "LuaState._getObjectFromUserdata" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   jobject *   obj;
+
+   if ( !isJavaObject( L , index ) )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "java/lang/Exception" ) ,
+                          "Index is not a java object" );
+      return NULL;
+   }
+
+   obj = ( jobject * ) lua_touserdata( L , index );
+
+   return *obj;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isObject
+  (JNIEnv * env , jobject jobj , jobject cptr , jint index )
+{
+   LUASTATS_ENTER( "LuaState._isObject" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return (isJavaObject( L , index ) ? JNI_TRUE : JNI_FALSE );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaObject
+  (JNIEnv * env , jobject jobj , jobject cptr , jobject obj )
+{
+   LUASTATS_ENTER( "LuaState._pushJavaObject" );
+
+   /* Get luastate */
+   lua_State* L = getStateFromCPtr( env , cptr );
+
+   pushJavaObject( L , obj );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaFunction
+  (JNIEnv * env , jobject jobj , jobject cptr , jobject obj )
+{
+   LUASTATS_ENTER( "LuaState._pushJavaFunction" );
+
+   /* Get luastate */
+   lua_State* L = getStateFromCPtr( env , cptr );
+
+   if ( pushJavaFunction( L , obj ) == 0 )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          "Index is not a java object" );
+   }
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isJavaFunction
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+{
+   LUASTATS_ENTER( "LuaState._isJavaFunction" );
+
+   /* Get luastate */
+   lua_State* L = getStateFromCPtr( env , cptr );
+   jobject * obj;
+
+   if ( !isJavaObject( L , idx ) )
+   {
+      return JNI_FALSE;
+   }
+
+   obj = ( jobject * ) lua_touserdata( L , idx );
+
+   return ( *env )->IsInstanceOf( env , *obj , java_function_class );
+
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1tableSize
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+{
+   LUASTATS_ENTER( "LuaState._tableSize" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   jint n = 0;
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   lua_pushnil( L );
+   while ( lua_next( L , idx ) != 0 )
+   {
+      n++;
+      lua_pop( L , 1 );
+   }
+
+   return n;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jobjectArray JNICALL Java_org_keplerproject_luajava_LuaState__1rawGetRange
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jint first , jint count)
+{
+   LUASTATS_ENTER( "LuaState._rawGetRange" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   jobjectArray arr;
+   jobject value;
+   jint i;
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   arr = ( *env )->NewObjectArray( env , count , java_object_class , NULL );
+   if ( arr == NULL )
+   {
+      return NULL;
+   }
+
+   for ( i = 0 ; i < count ; i++ )
+   {
+      lua_rawgeti( L , idx , first + i );
+      value = toJavaValue( env , jobj , L , -1 );
+      lua_pop( L , 1 );
+
+      if ( ( *env )->ExceptionCheck( env ) )
+      {
+         return NULL;
+      }
+
+      if ( value != NULL )
+      {
+         ( *env )->SetObjectArrayElement( env , arr , i , value );
+         ( *env )->DeleteLocalRef( env , value );
+      }
+   }
+
+   return arr;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1nextChunk
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jobjectArray buffer)
+{
+   LUASTATS_ENTER( "LuaState._nextChunk" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   NextChunk chunk;
+   int top = lua_gettop( L );
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = top + idx + 1;
+   }
+
+   chunk.env      = env;
+   chunk.luaState = jobj;
+   chunk.buffer   = buffer;
+   chunk.capacity = ( *env )->GetArrayLength( env , buffer ) / 2;
+   chunk.count    = 0;
+
+   /* a key removed from the table since the last chunk, and then dropped
+      by a rehash, makes lua_next raise an error */
+   lua_pushcfunction( L , &nextChunk );
+   lua_pushvalue( L , idx );
+   lua_pushlightuserdata( L , &chunk );
+   lua_pushvalue( L , top );
+   if ( lua_pcall( L , 3 , 1 , 0 ) != 0 )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          lua_tostring( L , -1 ) );
+      lua_settop( L , top - 1 );
+      return chunk.count;
+   }
+
+   /* the last key is left on the stack only if the buffer was filled */
+   if ( lua_isnil( L , -1 ) )
+   {
+      lua_settop( L , top - 1 );
+   }
+   else
+   {
+      lua_remove( L , top );
+   }
+
+   return chunk.count;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1iterChunk
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jobjectArray buffer)
+{
+   LUASTATS_ENTER( "LuaState._iterChunk" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   jsize capacity = ( *env )->GetArrayLength( env , buffer );
+   const char * error = NULL;
+   lua_State * co = NULL;
+   jobject value;
+   jint n = 0;
+   int top = lua_gettop( L );
+   int kind , status , nres;
+   lua_Number control = 0;
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = top + idx + 1;
+   }
+
+   /* the cursor is { table , nil , index } , { function , state , control } or { thread } */
+   lua_rawgeti( L , idx , 1 );
+   kind = lua_type( L , -1 );
+   if ( kind == LUA_TTHREAD )
+   {
+      co = lua_tothread( L , -1 );
+   }
+   else if ( kind == LUA_TTABLE )
+   {
+      lua_rawgeti( L , idx , 3 );
+      control = lua_tonumber( L , -1 );
+      lua_pop( L , 1 );
+   }
+   lua_settop( L , top );
+
+   while ( n < capacity && error == NULL )
+   {
+      if ( kind == LUA_TTABLE )
+      {
+         lua_rawgeti( L , idx , 1 );
+         lua_rawgeti( L , -1 , ( int ) control + 1 );
+         lua_remove( L , -2 );
+         if ( lua_isnil( L , -1 ) )
+         {
+            break;
+         }
+         control++;
+      }
+      else if ( kind == LUA_TTHREAD )
+      {
+         if ( lua_status( co ) == 0 && lua_gettop( co ) == 0 )
+         {
+            /* finished coroutine */
+            break;
+         }
+
+         status = lua_resume( co , ( lua_status( co ) == LUA_YIELD ) ? 0 : lua_gettop( co ) - 1 );
+         nres   = lua_gettop( co );
+
+         if ( status != 0 && status != LUA_YIELD )
+         {
+            error = lua_tostring( co , -1 );
+            lua_xmove( co , L , 1 );
+            break;
+         }
+
+         if ( nres == 0 || lua_isnil( co , 1 ) )
+         {
+            /* yielding or returning nil, or nothing, ends the iteration */
+            lua_settop( co , 0 );
+            break;
+         }
+
+         /* the first value returned by the body is the last one; the
+            coroutine is then dead with an empty stack */
+         lua_settop( co , 1 );
+         lua_xmove( co , L , 1 );
+      }
+      else
+      {
+         lua_rawgeti( L , idx , 1 );
+         lua_rawgeti( L , idx , 2 );
+         lua_rawgeti( L , idx , 3 );
+
+         if ( lua_pcall( L , 2 , 1 , 0 ) != 0 )
+         {
+            error = lua_tostring( L , -1 );
+            break;
+         }
+
+         if ( lua_isnil( L , -1 ) )
+         {
+            break;
+         }
+
+         lua_pushvalue( L , -1 );
+         lua_rawseti( L , idx , 3 );
+      }
+
+      value = toJavaValue( env , jobj , L , -1 );
+      lua_settop( L , top );
+
+      if ( ( *env )->ExceptionCheck( env ) )
+      {
+         return n;
+      }
+
+      ( *env )->SetObjectArrayElement( env , buffer , n++ , value );
+      ( *env )->DeleteLocalRef( env , value );
+   }
+
+   if ( kind == LUA_TTABLE )
+   {
+      lua_pushnumber( L , control );
+      lua_rawseti( L , idx , 3 );
+   }
+
+   if ( error != NULL )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          error );
+   }
+
+   lua_settop( L , top );
+
+   return n;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
+
+JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1tableToJava
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jstring type)
+{
+   LUASTATS_ENTER( "LuaState._tableToJava" );
+
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   const void * path[ LUAJAVAMAXNESTING ];
+   const char * error = NULL;
+   const char * name;
+   jobject result;
+   int target;
+
+   if ( !lua_istable( L , idx ) )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          "Index is not a table" );
+      return NULL;
+   }
+
+   name = ( type == NULL ) ? NULL : ( *env )->GetStringUTFChars( env , type , NULL );
+   for ( target = 0 ; name != NULL && table_target_names[ target ] != NULL ; target++ )
+   {
+      if ( strcmp( table_target_names[ target ] , name ) == 0 )
+         break;
+   }
+   if ( name != NULL )
+   {
+      ( *env )->ReleaseStringUTFChars( env , type , name );
+   }
+   if ( name == NULL )
+   {
+      target = LUAJAVA_TODEFAULT;
+   }
+   else if ( table_target_names[ target ] == NULL )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          "Invalid conversion type" );
+      return NULL;
+   }
+
+   result = tableToJava( env , jobj , L , idx , target , 0 , path , &error );
+
+   if ( error != NULL && !( *env )->ExceptionCheck( env ) )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          error );
+   }
+
+   return result;
 }
 
-/**************************** JNI FUNCTIONS ****************************/
 
 /************************************************************************
 *   JNI Called function
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState_luajava_1open
-  ( JNIEnv * env , jobject jobj , jobject cptr , jint stateId )
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushTable
+  (JNIEnv * env , jobject jobj , jobject cptr , jobject obj)
 {
-  lua_State* L;
-
-  jclass tempClass;
-
-  L = getStateFromCPtr( env , cptr );
-
-  lua_pushstring( L , LUAJAVASTATEINDEX );
-  lua_pushnumber( L , (lua_Number)stateId );
-  lua_settable( L , LUA_REGISTRYINDEX );
-
-
-  lua_newtable( L );
-
-  lua_setglobal( L , "luajava" );
+   LUASTATS_ENTER( "LuaState._pushTable" );
 
-  lua_getglobal( L , "luajava" );
-  
-  set_info( L);
-  
-  lua_pushstring( L , "bindClass" );
-  lua_pushcfunction( L , &javaBindClass );
-  lua_settable( L , -3 );
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   jobject path[ LUAJAVAMAXNESTING ];
+   const char * error = NULL;
 
-  lua_pushstring( L , "new" );
-  lua_pushcfunction( L , &javaNew );
-  lua_settable( L , -3 );
+   if ( obj != NULL && pushJavaTable( env , L , obj , 0 , path , &error ) )
+   {
+      return;
+   }
 
-  lua_pushstring( L , "newInstance" );
-  lua_pushcfunction( L , &javaNewInstance );
-  lua_settable( L , -3 );
+   if ( ( *env )->ExceptionCheck( env ) )
+   {
+      return;
+   }
 
-  lua_pushstring( L , "loadLib" );
-  lua_pushcfunction( L , &javaLoadLib );
-  lua_settable( L , -3 );
+   ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                       ( error != NULL ) ? error : "Object is not a collection, map or array" );
+}
 
-  lua_pushstring( L , "createProxy" );
-  lua_pushcfunction( L , &createProxy );
-  lua_settable( L , -3 );
 
-  lua_pop( L , 1 );
+/***************************************************************************
+*
+*  Function: deserializeFromBuffer
+*  ****/
 
-  if ( luajava_api_class == NULL )
-  {
-    tempClass = ( *env )->FindClass( env , "org/keplerproject/luajava/LuaJavaAPI" );
+static int deserializeFromBuffer( lua_State * L )
+{
+   SerializeBuffer * buf = ( SerializeBuffer * ) lua_touserdata( L , 1 );
 
-    if ( tempClass == NULL )
-    {
-      fprintf( stderr , "Could not find LuaJavaAPI class\n" );
-      exit( 1 );
-    }
+   luajava_deserialize( L , buf->data , buf->len );
 
-    if ( ( luajava_api_class = ( *env )->NewGlobalRef( env , tempClass ) ) == NULL )
-    {
-      fprintf( stderr , "Could not bind to LuaJavaAPI class\n" );
-      exit( 1 );
-    }
-  }
+   return 1;
+}
 
-  if ( java_function_class == NULL )
-  {
-    tempClass = ( *env )->FindClass( env , "org/keplerproject/luajava/JavaFunction" );
 
-    if ( tempClass == NULL )
-    {
-      fprintf( stderr , "Could not find JavaFunction interface\n" );
-      exit( 1 );
-    }
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
 
-    if ( ( java_function_class = ( *env )->NewGlobalRef( env , tempClass ) ) == NULL )
-    {
-      fprintf( stderr , "Could not bind to JavaFunction interface\n" );
-      exit( 1 );
-    }
-  }
+JNIEXPORT jbyteArray JNICALL Java_org_keplerproject_luajava_LuaState__1serialize
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+{
+   LUASTATS_ENTER( "LuaState._serialize" );
 
-  if ( java_function_method == NULL )
-  {
-    java_function_method = ( *env )->GetMethodID( env , java_function_class , "execute" , "()I");
-    if ( !java_function_method )
-    {
-      fprintf( stderr , "Could not find <execute> method in JavaFunction\n" );
-      exit( 1 );
-    }
-  }
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   SerializeBuffer buf = { NULL , 0 , 0 };
+   jbyteArray result = NULL;
 
-  if ( throwable_class == NULL )
-  {
-    tempClass = ( *env )->FindClass( env , "java/lang/Throwable" );
+   if ( luajava_serializeto( L , idx , &buf ) != 0 )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          lua_tostring( L , -1 ) );
+      lua_pop( L , 1 );
+   }
+   else
+   {
+      result = ( *env )->NewByteArray( env , ( jsize ) buf.len );
+      if ( result != NULL )
+      {
+         ( *env )->SetByteArrayRegion( env , result , 0 , ( jsize ) buf.len , ( jbyte * ) buf.data );
+      }
+   }
 
-    if ( tempClass == NULL )
-    {
-      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
-      exit( 1 );
-    }
+   free( buf.data );
 
-    throwable_class = ( *env )->NewGlobalRef( env , tempClass );
+   return result;
+}
 
-    if ( throwable_class == NULL )
-    {
-      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
-      exit( 1 );
-    }
-  }
 
-  if ( get_message_method == NULL )
-  {
-    get_message_method = ( *env )->GetMethodID( env , throwable_class , "getMessage" ,
-                                                "()Ljava/lang/String;" );
+/************************************************************************
+*   JNI Called function
+*      LuaJava API Functin
+************************************************************************/
 
-    if ( get_message_method == NULL )
-    {
-      fprintf(stderr, "Could not find <getMessage> method in java.lang.Throwable\n");
-      exit(1);
-    }
-  }
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1deserialize
+  (JNIEnv * env , jobject jobj , jobject cptr , jbyteArray bytes)
+{
+   LUASTATS_ENTER( "LuaState._deserialize" );
 
-  if ( java_lang_class == NULL )
-  {
-    tempClass = ( *env )->FindClass( env , "java/lang/Class" );
+   /* Get luastate */
+   lua_State * L = getStateFromCPtr( env , cptr );
+   SerializeBuffer buf;
 
-    if ( tempClass == NULL )
-    {
-      fprintf( stderr , "Error. Coundn't bind java class java.lang.Class\n" );
-      exit( 1 );
-    }
+   buf.len  = ( size_t ) ( *env )->GetArrayLength( env , bytes );
+   buf.size = buf.len;
+   buf.data = ( char * ) ( *env )->GetByteArrayElements( env , bytes , NULL );
+   if ( buf.data == NULL )
+   {
+      return;
+   }
 
-    java_lang_class = ( *env )->NewGlobalRef( env , tempClass );
+   lua_pushcfunction( L , &deserializeFromBuffer );
+   lua_pushlightuserdata( L , &buf );
 
-    if ( java_lang_class == NULL )
-    {
-      fprintf( stderr , "Error. Couldn't bind java class java.lang.Throwable\n" );
-      exit( 1 );
-    }
-  }
+   if ( lua_pcall( L , 1 , 1 , 0 ) != 0 )
+   {
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          lua_tostring( L , -1 ) );
+      lua_pop( L , 1 );
+   }
 
-  pushJNIEnv( env , L );
+   ( *env )->ReleaseByteArrayElements( env , bytes , ( jbyte * ) buf.data , JNI_ABORT );
 }
 
+
 /************************************************************************
 *   JNI Called function
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1getObjectFromUserdata
-  (JNIEnv * env , jobject jobj , jobject cptr , jint index )
+JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1spawn
+  (JNIEnv * env , jobject jobj , jobject cptr , jint nargs)
 {
+   LUASTATS_ENTER( "LuaState._spawn" );
+
    /* Get luastate */
    lua_State * L = getStateFromCPtr( env , cptr );
-   jobject *   obj;
+   LuaTask * task;
+   jobject obj;
+   jclass tempClass;
 
-   if ( !isJavaObject( L , index ) )
+   lua_pushcfunction( L , &luajava_taskspawn );
+   lua_insert( L , -( nargs + 2 ) );
+
+   if ( lua_pcall( L , nargs + 1 , 1 , 0 ) != 0 )
    {
-      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "java/lang/Exception" ) ,
-                          "Index is not a java object" );
+      ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
+                          lua_tostring( L , -1 ) );
+      lua_pop( L , 1 );
       return NULL;
    }
 
-   obj = ( jobject * ) lua_touserdata( L , index );
+   task = luajava_checktask( L , -1 );
+   lua_pop( L , 1 );
 
-   return *obj;
+   tempClass = ( *env )->FindClass( env , "org/keplerproject/luajava/CPtr" );
+   obj = ( *env )->AllocObject( env , tempClass );
+   if ( obj == NULL )
+   {
+      luajava_taskrelease( task );
+      return NULL;
+   }
+   ( *env )->SetLongField( env , obj , cptr_peer_field , ( jlong ) ( intptr_t ) task );
+
+   return obj;
 }
 
 
@@ -1703,13 +4092,14 @@ JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1getObjectFro
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isObject
-  (JNIEnv * env , jobject jobj , jobject cptr , jint index )
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaTask__1await
+  (JNIEnv * env , jobject jobj , jobject cptr , jlong millis)
 {
-   /* Get luastate */
-   lua_State * L = getStateFromCPtr( env , cptr );
+   LUASTATS_ENTER( "LuaTask._await" );
 
-   return (isJavaObject( L , index ) ? JNI_TRUE : JNI_FALSE );
+   LuaTask * task = ( LuaTask * ) getStateFromCPtr( env , cptr );
+
+   return luajava_taskwait( task , ( long ) millis );
 }
 
 
@@ -1718,13 +4108,14 @@ JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isObject
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaObject
-  (JNIEnv * env , jobject jobj , jobject cptr , jobject obj )
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaTask__1retain
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
-   /* Get luastate */
-   lua_State* L = getStateFromCPtr( env , cptr );
+   LUASTATS_ENTER( "LuaTask._retain" );
 
-   pushJavaObject( L , obj );
+   LuaTask * task = ( LuaTask * ) getStateFromCPtr( env , cptr );
+
+   luajava_taskretain( task );
 }
 
 
@@ -1733,41 +4124,38 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaObject
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaFunction
-  (JNIEnv * env , jobject jobj , jobject cptr , jobject obj )
+JNIEXPORT jbyteArray JNICALL Java_org_keplerproject_luajava_LuaTask__1result
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
-   /* Get luastate */
-   lua_State* L = getStateFromCPtr( env , cptr );
-
-   jobject * userData , globalRef;
-
-   globalRef = ( *env )->NewGlobalRef( env , obj );
-
-   userData = ( jobject * ) lua_newuserdata( L , sizeof( jobject ) );
-   *userData = globalRef;
+   LUASTATS_ENTER( "LuaTask._result" );
 
-   /* Creates metatable */
-   lua_newtable( L );
-
-   /* pushes the __index metamethod */
-   lua_pushstring( L , LUACALLMETAMETHODTAG );
-   lua_pushcfunction( L , &luaJavaFunctionCall );
-   lua_rawset( L , -3 );
+   LuaTask * task = ( LuaTask * ) getStateFromCPtr( env , cptr );
+   jbyteArray result;
+   const char * data;
+   size_t len;
+   int state = luajava_taskwait( task , 0 );
 
-   /* pusher the __gc metamethod */
-   lua_pushstring( L , LUAGCMETAMETHODTAG );
-   lua_pushcfunction( L , &gc );
-   lua_rawset( L , -3 );
+   if ( state == LUATASK_PENDING )
+   {
+      return NULL;
+   }
 
-   lua_pushstring( L , LUAJAVAOBJECTIND );
-   lua_pushboolean( L , 1 );
-   lua_rawset( L , -3 );
+   data = luajava_taskresult( task , &len );
 
-   if ( lua_setmetatable( L , -2 ) == 0 )
+   if ( state == LUATASK_ERROR )
    {
       ( *env )->ThrowNew( env , ( *env )->FindClass( env , "org/keplerproject/luajava/LuaException" ) ,
-                          "Index is not a java object" );
+                          ( data != NULL ) ? data : "task failed" );
+      return NULL;
+   }
+
+   result = ( *env )->NewByteArray( env , ( jsize ) len );
+   if ( result != NULL )
+   {
+      ( *env )->SetByteArrayRegion( env , result , 0 , ( jsize ) len , ( const jbyte * ) data );
    }
+
+   return result;
 }
 
 
@@ -1776,22 +4164,14 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushJavaFunctio
 *      LuaJava API Functin
 ************************************************************************/
 
-JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isJavaFunction
-  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaTask__1release
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
-   /* Get luastate */
-   lua_State* L = getStateFromCPtr( env , cptr );
-   jobject * obj;
-
-   if ( !isJavaObject( L , idx ) )
-   {
-      return JNI_FALSE;
-   }
-
-   obj = ( jobject * ) lua_touserdata( L , idx );
+   LUASTATS_ENTER( "LuaTask._release" );
 
-   return ( *env )->IsInstanceOf( env , *obj , java_function_class );
+   LuaTask * task = ( LuaTask * ) getStateFromCPtr( env , cptr );
 
+   luajava_taskrelease( task );
 }
 
 
@@ -1805,6 +4185,8 @@ JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaState__1isJavaFunct
 JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1open
   (JNIEnv * env , jobject jobj)
 {
+   LUASTATS_ENTER( "LuaState._open" );
+
    lua_State * L = lua_open();
 
    jobject obj;
@@ -1830,6 +4212,8 @@ JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1open
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openBase
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openBase" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_base( L );
@@ -1847,6 +4231,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openBase
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openTable
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_table( L );
@@ -1864,6 +4250,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openTable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openIo
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openIo" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_io( L );
@@ -1881,6 +4269,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openIo
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openOs
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openOs" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_os( L );
@@ -1898,6 +4288,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openOs
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openString
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openString" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_string( L );
@@ -1915,6 +4307,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openString
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openMath
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openMath" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_math( L );
@@ -1932,6 +4326,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openMath
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openDebug
   (JNIEnv * env, jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openDebug" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_debug( L );
@@ -1949,6 +4345,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openDebug
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openPackage
   (JNIEnv * env, jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openPackage" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    //luaopen_package( L );
@@ -1966,6 +4364,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openPackage
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openLibs
   (JNIEnv * env, jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._openLibs" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_openlibs( L );
@@ -1980,6 +4380,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1openLibs
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1close
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._close" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_close( L );
@@ -1994,6 +4396,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1close
 JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1newthread
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._newthread" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
    lua_State * newThread;
    
@@ -2023,6 +4427,8 @@ JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1newthread
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getTop
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._getTop" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_gettop( L );
@@ -2037,6 +4443,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getTop
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setTop
   (JNIEnv * env , jobject jobj , jobject cptr , jint top)
 {
+   LUASTATS_ENTER( "LuaState._setTop" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_settop( L , ( int ) top );
@@ -2051,6 +4459,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setTop
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushValue
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._pushValue" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_pushvalue( L , ( int ) idx );
@@ -2065,6 +4475,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushValue
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1remove
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._remove" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_remove( L , ( int ) idx );
@@ -2079,6 +4491,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1remove
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1insert
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._insert" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_insert( L , ( int ) idx );
@@ -2093,6 +4507,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1insert
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1replace
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._replace" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_replace( L , ( int ) idx );
@@ -2107,6 +4523,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1replace
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1checkStack
   (JNIEnv * env , jobject jobj , jobject cptr , jint sz)
 {
+   LUASTATS_ENTER( "LuaState._checkStack" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_checkstack( L , ( int ) sz );
@@ -2121,6 +4539,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1checkStack
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1xmove
   (JNIEnv * env , jobject jobj , jobject from , jobject to , jint n)
 {
+   LUASTATS_ENTER( "LuaState._xmove" );
+
    lua_State * fr = getStateFromCPtr( env , from );
    lua_State * t  = getStateFromCPtr( env , to );
 
@@ -2136,6 +4556,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1xmove
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNumber
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isNumber" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isnumber( L , ( int ) idx );
@@ -2150,6 +4572,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNumber
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isString
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isString" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isstring( L , ( int ) idx );
@@ -2164,6 +4588,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isString
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isFunction
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isFunction" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isfunction( L , ( int ) idx );
@@ -2178,6 +4604,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isFunction
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isCFunction
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isCFunction" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_iscfunction( L , ( int ) idx );
@@ -2192,6 +4620,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isCFunction
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isUserdata
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isUserdata" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isuserdata( L , ( int ) idx );
@@ -2206,6 +4636,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isUserdata
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_istable( L , ( int ) idx );
@@ -2220,6 +4652,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isTable
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isBoolean
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isBoolean" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isboolean( L , ( int ) idx );
@@ -2234,6 +4668,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isBoolean
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNil
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isNil" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isnil( L , ( int ) idx );
@@ -2248,6 +4684,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNil
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNone
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isNone" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isnone( L , ( int ) idx );
@@ -2262,6 +4700,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNone
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNoneOrNil
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._isNoneOrNil" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_isnoneornil( L , ( int ) idx );
@@ -2276,6 +4716,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1isNoneOrNil
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1type
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._type" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_type( L , ( int ) idx );
@@ -2290,6 +4732,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1type
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1typeName
   (JNIEnv * env , jobject jobj , jobject cptr , jint tp)
 {
+   LUASTATS_ENTER( "LuaState._typeName" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * name = lua_typename( L , tp );
@@ -2306,6 +4750,8 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1typeName
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1equal
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx1 , jint idx2)
 {
+   LUASTATS_ENTER( "LuaState._equal" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_equal( L , idx1 , idx2 );
@@ -2320,6 +4766,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1equal
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1rawequal
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx1 , jint idx2)
 {
+   LUASTATS_ENTER( "LuaState._rawequal" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_rawequal( L , idx1 , idx2 );
@@ -2334,6 +4782,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1rawequal
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1lessthan
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx1 , jint idx2)
 {
+   LUASTATS_ENTER( "LuaState._lessthan" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_lessthan( L , idx1 ,idx2 );
@@ -2348,6 +4798,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1lessthan
 JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1toNumber
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._toNumber" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jdouble ) lua_tonumber( L , idx );
@@ -2362,6 +4814,8 @@ JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1toNumber
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1toInteger
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._toInteger" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_tointeger( L , idx );
@@ -2376,6 +4830,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1toInteger
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1toBoolean
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._toBoolean" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_toboolean( L , idx );
@@ -2390,6 +4846,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1toBoolean
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1toString
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._toString" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * str = lua_tostring( L , idx );
@@ -2406,6 +4864,8 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1toString
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1strlen
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._strlen" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_strlen( L , idx );
@@ -2420,6 +4880,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1strlen
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1objlen
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._objlen" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_objlen( L , idx );
@@ -2434,6 +4896,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1objlen
 JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1toThread
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._toThread" );
+
    lua_State * L , * thr;
 
    jobject obj;
@@ -2463,6 +4927,8 @@ JNIEXPORT jobject JNICALL Java_org_keplerproject_luajava_LuaState__1toThread
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushNil
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._pushNil" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_pushnil( L );
@@ -2477,6 +4943,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushNil
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushNumber
   (JNIEnv * env , jobject jobj , jobject cptr , jdouble number)
 {
+   LUASTATS_ENTER( "LuaState._pushNumber" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_pushnumber( L , ( lua_Number ) number );
@@ -2491,6 +4959,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushNumber
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushString__Lorg_keplerproject_luajava_CPtr_2Ljava_lang_String_2
   (JNIEnv * env , jobject jobj , jobject cptr , jstring str)
 {
+   LUASTATS_ENTER( "LuaState._pushString__Lorg_keplerproject_luajava_CPtr_2Ljava_lang_String_2" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
    const char * uniStr;
 
@@ -2510,6 +4980,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushString__Lor
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushString__Lorg_keplerproject_luajava_CPtr_2_3BI
   (JNIEnv * env , jobject jobj , jobject cptr , jbyteArray bytes , jint n)
 {
+   LUASTATS_ENTER( "LuaState._pushString__Lorg_keplerproject_luajava_CPtr_2_3BI" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
    char * cBytes;
    
@@ -2529,6 +5001,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushString__Lor
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushBoolean
   (JNIEnv * env , jobject jobj , jobject cptr , jint jbool)
 {
+   LUASTATS_ENTER( "LuaState._pushBoolean" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_pushboolean( L , ( int ) jbool );
@@ -2543,6 +5017,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pushBoolean
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._getTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_gettable( L , ( int ) idx );
@@ -2557,6 +5033,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getTable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getField
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jstring k)
 {
+   LUASTATS_ENTER( "LuaState._getField" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * uniStr;
@@ -2575,6 +5053,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getField
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawGet
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._rawGet" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_rawget( L , (int)idx );
@@ -2589,6 +5069,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawGet
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawGetI
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx, jint n)
 {
+   LUASTATS_ENTER( "LuaState._rawGetI" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_rawgeti( L , idx , n );
@@ -2603,6 +5085,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawGetI
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1createTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint narr , jint nrec)
 {
+   LUASTATS_ENTER( "LuaState._createTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_createtable( L , ( int ) narr , ( int ) nrec );
@@ -2617,6 +5101,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1createTable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1newTable
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._newTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_newtable( L );
@@ -2631,6 +5117,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1newTable
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getMetaTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._getMetaTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return lua_getmetatable( L , idx );
@@ -2645,6 +5133,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getMetaTable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getFEnv
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._getFEnv" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_getfenv( L , ( int ) idx );
@@ -2659,6 +5149,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getFEnv
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._setTable" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_settable( L , ( int ) idx );
@@ -2673,6 +5165,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setTable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setField
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jstring k)
 {
+   LUASTATS_ENTER( "LuaState._setField" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * uniStr;
@@ -2692,9 +5186,262 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setField
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawSet
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._rawSet" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   lua_rawset( L , (int)idx );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawSetI
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx, jint n)
+{
+   LUASTATS_ENTER( "LuaState._rawSetI" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   lua_rawseti( L , idx , n );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setMetaTable
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+{
+   LUASTATS_ENTER( "LuaState._setMetaTable" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return lua_setmetatable( L , idx );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setFEnv
+  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+{
+   LUASTATS_ENTER( "LuaState._setFEnv" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return lua_setfenv( L , idx );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1call
+  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs , jint nResults)
+{
+   LUASTATS_ENTER( "LuaState._call" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   lua_call( L , nArgs , nResults );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1pcall
+  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs , jint nResults , jint errFunc)
+{
+   LUASTATS_ENTER( "LuaState._pcall" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   int ret;
+
+   luatrace_begin( "pcall" , "pcall" );
+   ret = lua_pcall( L , nArgs , nResults , errFunc );
+   luatrace_end( "pcall" , "pcall" );
+
+   return ( jint ) ret;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1yield
+  (JNIEnv * env , jobject jobj , jobject cptr , jint nResults)
+{
+   LUASTATS_ENTER( "LuaState._yield" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jint ) lua_yield( L , nResults );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1resume
+  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs)
+{
+   LUASTATS_ENTER( "LuaState._resume" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jint ) lua_resume( L , nArgs );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1status
+  (JNIEnv * env , jobject jobj , jobject cptr)
+{
+   LUASTATS_ENTER( "LuaState._status" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jint ) lua_status( L );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1gc
+  (JNIEnv * env , jobject jobj , jobject cptr , jint what , jint data)
+{
+   LUASTATS_ENTER( "LuaState._gc" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jint ) lua_gc( L , what , data );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setQuota
+  (JNIEnv * env , jobject jobj , jobject cptr , jlong instructions , jlong millis , jint mode)
+{
+   LUASTATS_ENTER( "LuaState._setQuota" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   lua_setquota( L , ( unsigned long ) instructions , ( unsigned long ) millis , mode );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jlong JNICALL Java_org_keplerproject_luajava_LuaState__1getQuotaUsed
+  (JNIEnv * env , jobject jobj , jobject cptr)
+{
+   LUASTATS_ENTER( "LuaState._getQuotaUsed" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jlong ) lua_quotaused( L );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1interrupt
+  (JNIEnv * env , jobject jobj , jobject cptr)
+{
+   LUASTATS_ENTER( "LuaState._interrupt" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   lua_interrupt( L );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1startProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr , jint mode , jint interval , jint size)
+{
+   LUASTATS_ENTER( "LuaState._startProfiler" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   return ( jint ) luaprofile_start( L , mode , interval , size );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1stopProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr)
+{
+   LUASTATS_ENTER( "LuaState._stopProfiler" );
+
+   lua_State * L = getStateFromCPtr( env , cptr );
+
+   luaprofile_stop( L );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Lua Exported Function
+************************************************************************/
+
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1getProfile
+  (JNIEnv * env , jobject jobj , jobject cptr)
+{
+   LUASTATS_ENTER( "LuaState._getProfile" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   jstring str;
 
-   lua_rawset( L , (int)idx );
+   luaprofile_folded( L );
+   str = ( *env )->NewStringUTF( env , lua_tostring( L , -1 ) );
+   lua_pop( L , 1 );
+
+   return str;
 }
 
 
@@ -2703,12 +5450,14 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawSet
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawSetI
-  (JNIEnv * env , jobject jobj , jobject cptr , jint idx, jint n)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1startHeapProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr , jint interval)
 {
+   LUASTATS_ENTER( "LuaState._startHeapProfiler" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
-   lua_rawseti( L , idx , n );
+   luaheap_start( L , ( size_t ) interval );
 }
 
 
@@ -2717,12 +5466,14 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1rawSetI
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setMetaTable
-  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1stopHeapProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._stopHeapProfiler" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
-   return lua_setmetatable( L , idx );
+   luaheap_stop( L );
 }
 
 
@@ -2731,12 +5482,20 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setMetaTable
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setFEnv
-  (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1getHeapReport
+  (JNIEnv * env , jobject jobj , jobject cptr , jint top)
 {
+   LUASTATS_ENTER( "LuaState._getHeapReport" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   jstring str;
 
-   return lua_setfenv( L , idx );
+   luaheap_snapshot( L , 1 );
+   luaheap_report( L , -1 , top );
+   str = ( *env )->NewStringUTF( env , lua_tostring( L , -1 ) );
+   lua_pop( L , 2 );
+
+   return str;
 }
 
 
@@ -2745,12 +5504,19 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1setFEnv
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1call
-  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs , jint nResults)
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1getRefStats
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._getRefStats" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   jstring str;
 
-   lua_call( L , nArgs , nResults );
+   luarefs_report( L );
+   str = ( *env )->NewStringUTF( env , lua_tostring( L , -1 ) );
+   lua_pop( L , 1 );
+
+   return str;
 }
 
 
@@ -2759,12 +5525,14 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1call
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1pcall
-  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs , jint nResults , jint errFunc)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1startStartupProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._startStartupProfiler" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
-   return ( jint ) lua_pcall( L , nArgs , nResults , errFunc );
+   luastartup_start( L );
 }
 
 
@@ -2773,12 +5541,14 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1pcall
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1yield
-  (JNIEnv * env , jobject jobj , jobject cptr , jint nResults)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1stopStartupProfiler
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._stopStartupProfiler" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
-   return ( jint ) lua_yield( L , nResults );
+   luastartup_stop( L );
 }
 
 
@@ -2787,12 +5557,19 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1yield
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1resume
-  (JNIEnv * env , jobject jobj , jobject cptr , jint nArgs)
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1getStartupReport
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._getStartupReport" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   jstring str;
 
-   return ( jint ) lua_resume( L , nArgs );
+   luastartup_report( L );
+   str = ( *env )->NewStringUTF( env , lua_tostring( L , -1 ) );
+   lua_pop( L , 1 );
+
+   return str;
 }
 
 
@@ -2801,12 +5578,34 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1resume
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1status
-  (JNIEnv * env , jobject jobj , jobject cptr)
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1traceSpan
+  (JNIEnv * env , jobject jobj , jobject cptr , jint event , jstring cat , jstring name)
 {
+   LUASTATS_ENTER( "LuaState._traceSpan" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   const char * cCat;
+   const char * cName;
 
-   return ( jint ) lua_status( L );
+   if ( lua_gettracer( L , NULL ) == NULL )
+   {
+      return;
+   }
+
+   cCat = ( *env )->GetStringUTFChars( env , cat , NULL );
+   cName = ( *env )->GetStringUTFChars( env , name , NULL );
+   if ( cCat != NULL && cName != NULL )
+   {
+      traceSpan( L , event , cCat , cName );
+   }
+   if ( cCat != NULL )
+   {
+      ( *env )->ReleaseStringUTFChars( env , cat , cCat );
+   }
+   if ( cName != NULL )
+   {
+      ( *env )->ReleaseStringUTFChars( env , name , cName );
+   }
 }
 
 
@@ -2815,12 +5614,14 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1status
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1gc
-  (JNIEnv * env , jobject jobj , jobject cptr , jint what , jint data)
+JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getGcCount
+  (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._getGcCount" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
-   return ( jint ) lua_gc( L , what , data );
+   return ( jint ) lua_getgccount( L );
 }
 
 
@@ -2829,12 +5630,44 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1gc
 *      Lua Exported Function
 ************************************************************************/
 
-JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getGcCount
+JNIEXPORT jdoubleArray JNICALL Java_org_keplerproject_luajava_LuaState__1getGcStats
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._getGcStats" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
+   jdouble values[ 9 + 2 * LUA_GCPHASES + LUA_GCPAUSEBINS ];
+   jdoubleArray result;
+   lua_GCStats s;
+   int n = 0;
+   int i;
+
+   lua_gcstats( L , &s );
+
+   /* in the order read by the LuaGcStats constructor */
+   values[ n++ ] = s.cycles;
+   values[ n++ ] = s.steps;
+   values[ n++ ] = s.finalized;
+   values[ n++ ] = s.allocated;
+   values[ n++ ] = s.freed;
+   values[ n++ ] = s.debtmax;
+   values[ n++ ] = s.steptime;
+   values[ n++ ] = s.stepmax;
+   values[ n++ ] = s.atomicmax;
+   for ( i = 0 ; i < LUA_GCPHASES ; i++ )
+      values[ n++ ] = s.phasesteps[ i ];
+   for ( i = 0 ; i < LUA_GCPHASES ; i++ )
+      values[ n++ ] = s.phasetime[ i ];
+   for ( i = 0 ; i < LUA_GCPAUSEBINS ; i++ )
+      values[ n++ ] = s.pauses[ i ];
+
+   result = ( *env )->NewDoubleArray( env , n );
+   if ( result != NULL )
+   {
+      ( *env )->SetDoubleArrayRegion( env , result , 0 , n , values );
+   }
 
-   return ( jint ) lua_getgccount( L );
+   return result;
 }
 
 
@@ -2846,6 +5679,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1getGcCount
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1next
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._next" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_next( L , idx );
@@ -2860,6 +5695,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1next
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1error
   (JNIEnv * env , jobject jobj , jobject cptr)
 {
+   LUASTATS_ENTER( "LuaState._error" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) lua_error( L );
@@ -2874,6 +5711,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1error
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1concat
   (JNIEnv * env , jobject jobj , jobject cptr , jint n)
 {
+   LUASTATS_ENTER( "LuaState._concat" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_concat( L , n );
@@ -2888,6 +5727,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1concat
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pop
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx)
 {
+   LUASTATS_ENTER( "LuaState._pop" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    lua_pop( L , ( int ) idx );
@@ -2902,6 +5743,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1pop
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setGlobal
   (JNIEnv * env , jobject jobj , jobject cptr , jstring name)
 {
+   LUASTATS_ENTER( "LuaState._setGlobal" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * str = ( *env )->GetStringUTFChars( env , name, NULL );
@@ -2920,6 +5763,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1setGlobal
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getGlobal
   (JNIEnv * env , jobject jobj , jobject cptr , jstring name)
 {
+   LUASTATS_ENTER( "LuaState._getGlobal" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * str = ( *env )->GetStringUTFChars( env , name, NULL );
@@ -2938,13 +5783,17 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1getGlobal
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LdoFile
   (JNIEnv * env , jobject jobj , jobject cptr , jstring fileName)
 {
+   LUASTATS_ENTER( "LuaState._LdoFile" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * file = ( *env )->GetStringUTFChars( env , fileName, NULL );
 
    int ret;
 
+   luatrace_begin( "pcall" , file );
    ret = luaL_dofile( L , file );
+   luatrace_end( "pcall" , file );
 
    ( *env )->ReleaseStringUTFChars( env , fileName , file );
 
@@ -2960,13 +5809,17 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LdoFile
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LdoString
   (JNIEnv * env , jobject jobj , jobject cptr , jstring str)
 {
+   LUASTATS_ENTER( "LuaState._LdoString" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    const char * utfStr = ( * env )->GetStringUTFChars( env , str , NULL );
 
    int ret;
 
+   luatrace_begin( "pcall" , "doString" );
    ret = luaL_dostring( L , utfStr );
+   luatrace_end( "pcall" , "doString" );
 
    return ( jint ) ret;
 }
@@ -2980,6 +5833,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LdoString
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LgetMetaField
   (JNIEnv * env , jobject jobj , jobject cptr , jint obj , jstring e)
 {
+   LUASTATS_ENTER( "LuaState._LgetMetaField" );
+
    lua_State * L    = getStateFromCPtr( env , cptr );
    const char * str = ( *env )->GetStringUTFChars( env , e , NULL );
    int ret;
@@ -3000,6 +5855,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LgetMetaField
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LcallMeta
   (JNIEnv * env , jobject jobj , jobject cptr , jint obj , jstring e)
 {
+   LUASTATS_ENTER( "LuaState._LcallMeta" );
+
    lua_State * L    = getStateFromCPtr( env , cptr );
    const char * str = ( *env )->GetStringUTFChars( env , e , NULL );
    int ret;
@@ -3020,6 +5877,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LcallMeta
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1Ltyperror
   (JNIEnv * env , jobject jobj , jobject cptr , jint nArg , jstring tName)
 {
+   LUASTATS_ENTER( "LuaState._Ltyperror" );
+
    lua_State * L     = getStateFromCPtr( env , cptr );
    const char * name = ( *env )->GetStringUTFChars( env , tName , NULL );
    int ret;
@@ -3040,6 +5899,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1Ltyperror
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LargError
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg , jstring extraMsg)
 {
+   LUASTATS_ENTER( "LuaState._LargError" );
+
    lua_State * L    = getStateFromCPtr( env , cptr );
    const char * msg = ( *env )->GetStringUTFChars( env , extraMsg , NULL );
    int ret;
@@ -3060,6 +5921,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LargError
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckString
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg)
 {
+   LUASTATS_ENTER( "LuaState._LcheckString" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
    const char * res;
 
@@ -3077,6 +5940,8 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckString
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LoptString
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg , jstring def)
 {
+   LUASTATS_ENTER( "LuaState._LoptString" );
+
    lua_State * L  = getStateFromCPtr( env , cptr );
    const char * d = ( *env )->GetStringUTFChars( env , def , NULL );
    const char * res;
@@ -3100,6 +5965,8 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LoptString
 JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckNumber
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg)
 {
+   LUASTATS_ENTER( "LuaState._LcheckNumber" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jdouble ) luaL_checknumber( L , ( int ) numArg );
@@ -3114,6 +5981,8 @@ JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckNumber
 JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1LoptNumber
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg , jdouble def)
 {
+   LUASTATS_ENTER( "LuaState._LoptNumber" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jdouble ) luaL_optnumber( L , ( int ) numArg , ( lua_Number ) def );
@@ -3128,6 +5997,8 @@ JNIEXPORT jdouble JNICALL Java_org_keplerproject_luajava_LuaState__1LoptNumber
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckInteger
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg)
 {
+   LUASTATS_ENTER( "LuaState._LcheckInteger" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) luaL_checkinteger( L , ( int ) numArg );
@@ -3142,6 +6013,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckInteger
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LoptInteger
   (JNIEnv * env , jobject jobj , jobject cptr , jint numArg , jint def)
 {
+   LUASTATS_ENTER( "LuaState._LoptInteger" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) luaL_optinteger( L , ( int ) numArg , ( lua_Integer ) def );
@@ -3156,6 +6029,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LoptInteger
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckStack
   (JNIEnv * env , jobject jobj , jobject cptr , jint sz , jstring msg)
 {
+   LUASTATS_ENTER( "LuaState._LcheckStack" );
+
    lua_State * L  = getStateFromCPtr( env , cptr );
    const char * m = ( *env )->GetStringUTFChars( env , msg , NULL );
 
@@ -3173,6 +6048,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckStack
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckType
   (JNIEnv * env , jobject jobj , jobject cptr , jint nArg , jint t)
 {
+   LUASTATS_ENTER( "LuaState._LcheckType" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_checktype( L , ( int ) nArg , ( int ) t );
@@ -3187,6 +6064,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckType
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckAny
   (JNIEnv * env , jobject jobj , jobject cptr , jint nArg)
 {
+   LUASTATS_ENTER( "LuaState._LcheckAny" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_checkany( L , ( int ) nArg );
@@ -3201,6 +6080,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LcheckAny
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LnewMetatable
   (JNIEnv * env , jobject jobj , jobject cptr , jstring tName)
 {
+   LUASTATS_ENTER( "LuaState._LnewMetatable" );
+
    lua_State * L     = getStateFromCPtr( env , cptr );
    const char * name = ( *env )->GetStringUTFChars( env , tName , NULL );
    int ret;
@@ -3221,6 +6102,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LnewMetatable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LgetMetatable
   (JNIEnv * env , jobject jobj , jobject cptr , jstring tName)
 {
+   LUASTATS_ENTER( "LuaState._LgetMetatable" );
+
    lua_State * L     = getStateFromCPtr( env , cptr );
    const char * name = ( *env )->GetStringUTFChars( env , tName , NULL );
 
@@ -3238,6 +6121,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LgetMetatable
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1Lwhere
   (JNIEnv * env , jobject jobj , jobject cptr , jint lvl)
 {
+   LUASTATS_ENTER( "LuaState._Lwhere" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_where( L , ( int ) lvl );
@@ -3252,6 +6137,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1Lwhere
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1Lref
   (JNIEnv * env , jobject jobj , jobject cptr , jint t)
 {
+   LUASTATS_ENTER( "LuaState._Lref" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) luaL_ref( L , ( int ) t );
@@ -3266,6 +6153,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1Lref
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LunRef
   (JNIEnv * env , jobject jobj , jobject cptr , jint t , jint ref)
 {
+   LUASTATS_ENTER( "LuaState._LunRef" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_unref( L , ( int ) t , ( int ) ref );
@@ -3280,6 +6169,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LunRef
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LgetN
   (JNIEnv * env , jobject jobj , jobject cptr , jint t)
 {
+   LUASTATS_ENTER( "LuaState._LgetN" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    return ( jint ) luaL_getn( L , ( int ) t );
@@ -3294,6 +6185,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LgetN
 JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LsetN
   (JNIEnv * env , jobject jobj , jobject cptr , jint t , jint n)
 {
+   LUASTATS_ENTER( "LuaState._LsetN" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
 
    luaL_setn( L , ( int ) t , ( int ) n );
@@ -3308,6 +6201,8 @@ JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaState__1LsetN
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadFile
   (JNIEnv * env , jobject jobj , jobject cptr , jstring fileName)
 {
+   LUASTATS_ENTER( "LuaState._LloadFile" );
+
    lua_State * L   = getStateFromCPtr( env , cptr );
    const char * fn = ( *env )->GetStringUTFChars( env , fileName , NULL );
    int ret;
@@ -3328,12 +6223,16 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadFile
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadBuffer
   (JNIEnv * env , jobject jobj , jobject cptr , jbyteArray buff , jlong sz , jstring n)
 {
+   LUASTATS_ENTER( "LuaState._LloadBuffer" );
+
    lua_State * L = getStateFromCPtr( env , cptr );
    jbyte * cBuff = ( *env )->GetByteArrayElements( env , buff, NULL );
    const char * name = ( * env )->GetStringUTFChars( env , n , NULL );
    int ret;
 
+   traceSpan( L , LUA_TRACEBEGIN , "parse" , name );
    ret = luaL_loadbuffer( L , ( const char * ) cBuff, ( int ) sz, name );
+   traceSpan( L , LUA_TRACEEND , "parse" , name );
 
    ( *env )->ReleaseStringUTFChars( env , n , name );
 
@@ -3351,6 +6250,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadBuffer
 JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadString
   (JNIEnv * env , jobject jobj , jobject cptr , jstring str)
 {
+   LUASTATS_ENTER( "LuaState._LloadString" );
+
    lua_State * L   = getStateFromCPtr( env , cptr );
    const char * fn = ( *env )->GetStringUTFChars( env , str , NULL );
    int ret;
@@ -3371,6 +6272,8 @@ JNIEXPORT jint JNICALL Java_org_keplerproject_luajava_LuaState__1LloadString
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1Lgsub
   (JNIEnv * env , jobject jobj , jobject cptr , jstring s , jstring p , jstring r)
 {
+   LUASTATS_ENTER( "LuaState._Lgsub" );
+
    lua_State * L   = getStateFromCPtr( env , cptr );
    const char * utS = ( *env )->GetStringUTFChars( env , s , NULL );
    const char * utP = ( *env )->GetStringUTFChars( env , p , NULL );
@@ -3394,6 +6297,8 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1Lgsub
 JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LfindTable
   (JNIEnv * env , jobject jobj , jobject cptr , jint idx , jstring fname , jint szhint)
 {
+   LUASTATS_ENTER( "LuaState._LfindTable" );
+
    lua_State * L   = getStateFromCPtr( env , cptr );
    const char * name = ( *env )->GetStringUTFChars( env , fname , NULL );
 
@@ -3403,3 +6308,283 @@ JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaState__1LfindTable
 
    return ( *env )->NewStringUTF( env , sub );
 }
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaStats__1setEnabled
+  (JNIEnv * env , jclass cls , jboolean on)
+{
+   return ( jboolean ) luastats_enable( on == JNI_TRUE );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaStats__1isEnabled
+  (JNIEnv * env , jclass cls)
+{
+   return ( jboolean ) ( luastats_enabled != 0 );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaStats__1reset
+  (JNIEnv * env , jclass cls)
+{
+   luastats_reset();
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+************************************************************************/
+
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaStats__1report
+  (JNIEnv * env , jclass cls)
+{
+   char * report = luastats_report();
+   jstring str;
+
+   if ( report == NULL )
+   {
+      return NULL;
+   }
+
+   str = ( *env )->NewStringUTF( env , report );
+   free( report );
+
+   return str;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+*
+*   Returns name and counters of each entry point, in turn: a String and
+*   a long[] { count , nanos , max nanos , histogram... }
+************************************************************************/
+
+JNIEXPORT jobjectArray JNICALL Java_org_keplerproject_luajava_LuaStats__1calls
+  (JNIEnv * env , jclass cls)
+{
+   LuaStatsSlot * slot;
+   jobjectArray result;
+   jclass objectClass;
+   int n = 0;
+   int i = 0;
+
+   for ( slot = luastats_first() ; slot != NULL ; slot = slot->next )
+      n++;
+
+   objectClass = ( *env )->FindClass( env , "java/lang/Object" );
+   result = ( *env )->NewObjectArray( env , n * 2 , objectClass , NULL );
+   if ( result == NULL )
+   {
+      return NULL;
+   }
+
+   for ( slot = luastats_first() ; slot != NULL && i < n ; slot = slot->next , i++ )
+   {
+      LuaStatsSlot s;
+      jlong values[ 3 + LUASTATS_BUCKETS ];
+      jlongArray array;
+      jstring name;
+      int b;
+
+      luastats_read( slot , &s );
+      values[ 0 ] = ( jlong ) s.count;
+      values[ 1 ] = ( jlong ) s.nanos;
+      values[ 2 ] = ( jlong ) s.maxNanos;
+      for ( b = 0 ; b < LUASTATS_BUCKETS ; b++ )
+         values[ 3 + b ] = ( jlong ) s.histogram[ b ];
+
+      name = ( *env )->NewStringUTF( env , s.name );
+      array = ( *env )->NewLongArray( env , 3 + LUASTATS_BUCKETS );
+      if ( name == NULL || array == NULL )
+      {
+         return NULL;
+      }
+      ( *env )->SetLongArrayRegion( env , array , 0 , 3 + LUASTATS_BUCKETS , values );
+
+      ( *env )->SetObjectArrayElement( env , result , i * 2 , name );
+      ( *env )->SetObjectArrayElement( env , result , i * 2 + 1 , array );
+      ( *env )->DeleteLocalRef( env , name );
+      ( *env )->DeleteLocalRef( env , array );
+   }
+
+   return result;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Bridge stats, see luastats.c
+*
+*   Returns the Java methods called from Lua and their call counts
+************************************************************************/
+
+JNIEXPORT jobjectArray JNICALL Java_org_keplerproject_luajava_LuaStats__1methods
+  (JNIEnv * env , jclass cls , jlongArray counts)
+{
+   const char * names[ LUASTATS_METHODS ];
+   unsigned long c[ LUASTATS_METHODS ];
+   jlong values[ LUASTATS_METHODS ];
+   jobjectArray result;
+   jclass stringClass;
+   int n;
+   int i;
+
+   n = luastats_methods( names , c , LUASTATS_METHODS );
+
+   stringClass = ( *env )->FindClass( env , "java/lang/String" );
+   result = ( *env )->NewObjectArray( env , n , stringClass , NULL );
+   if ( result == NULL )
+   {
+      return NULL;
+   }
+
+   for ( i = 0 ; i < n ; i++ )
+   {
+      jstring name = ( *env )->NewStringUTF( env , names[ i ] );
+
+      if ( name == NULL )
+      {
+         return NULL;
+      }
+      ( *env )->SetObjectArrayElement( env , result , i , name );
+      ( *env )->DeleteLocalRef( env , name );
+      values[ i ] = ( jlong ) c[ i ];
+   }
+
+   ( *env )->SetLongArrayRegion( env , counts , 0 , n , values );
+
+   return result;
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaTrace__1start
+  (JNIEnv * env , jclass cls , jboolean gcSteps)
+{
+   return ( jboolean ) luatrace_start( gcSteps );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaTrace__1stop
+  (JNIEnv * env , jclass cls)
+{
+   return ( jboolean ) luatrace_stop();
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT jboolean JNICALL Java_org_keplerproject_luajava_LuaTrace__1isEnabled
+  (JNIEnv * env , jclass cls)
+{
+   return ( jboolean ) ( luatrace_enabled != 0 );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaTrace__1begin
+  (JNIEnv * env , jclass cls , jstring name)
+{
+   const char * str;
+
+   if ( !luatrace_enabled )
+   {
+      return;
+   }
+
+   str = ( *env )->GetStringUTFChars( env , name , NULL );
+   if ( str == NULL )
+   {
+      return;
+   }
+   luatrace_begin( "java" , str );
+   ( *env )->ReleaseStringUTFChars( env , name , str );
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT void JNICALL Java_org_keplerproject_luajava_LuaTrace__1end
+  (JNIEnv * env , jclass cls , jstring name)
+{
+   const char * str = NULL;
+
+   if ( !luatrace_enabled )
+   {
+      return;
+   }
+
+   if ( name != NULL )
+   {
+      str = ( *env )->GetStringUTFChars( env , name , NULL );
+      if ( str == NULL )
+      {
+         return;
+      }
+   }
+   luatrace_end( "java" , str );
+   if ( str != NULL )
+   {
+      ( *env )->ReleaseStringUTFChars( env , name , str );
+   }
+}
+
+
+/************************************************************************
+*   JNI Called function
+*      Tracing, see luatrace.c
+************************************************************************/
+
+JNIEXPORT jstring JNICALL Java_org_keplerproject_luajava_LuaTrace__1json
+  (JNIEnv * env , jclass cls)
+{
+   char * json = luatrace_json();
+   jstring str;
+
+   if ( json == NULL )
+   {
+      return NULL;
+   }
+
+   str = ( *env )->NewStringUTF( env , json );
+   free( json );
+
+   return str;
+}
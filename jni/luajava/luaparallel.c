@@ -0,0 +1,863 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.parallel_map and parallel_reduce.
+*
+*    The function is compiled once in the calling State and its bytecode
+*    (or source) is loaded once per job into every worker State that runs
+*    part of it. The input is split into ranges of chunk elements, each
+*    range becoming one native task on the scheduler.
+*
+*    Arrays of numbers are read and written in place by the workers, with
+*    no lua values crossing States. Tables holding other values are sent
+*    to the workers as serialized slices, and the results come back the
+*    same way.
+*
+*    A job runs in three steps: it is prepared in the calling State, run
+*    on the workers without touching that State, then finished in it. Only
+*    the run needs the input and output arrays, so pinned Java arrays are
+*    held while the workers run and never while lua code runs in the
+*    calling State.
+*
+*    A reduce folds each range in a worker starting from its first value,
+*    then folds the partial results in order in the calling State, so the
+*    function must be associative.
+*
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luaserialize.h"
+#include "luascheduler.h"
+#include "luaparallel.h"
+
+
+/* Metatable of the userdata owning the ranges of a job */
+#define LUAPARALLELMETATABLE  "luajava.parallel"
+/* Ranges per worker when no chunk size is given */
+#define PARALLEL_RANGES       4
+
+typedef struct
+{
+   unsigned long id;
+   const char * code;
+   size_t codelen;
+   int fromSource;
+   int reduce;
+   int numeric;
+   /* numeric jobs, given by luajava_parallelrun */
+   const double * in;
+   double * out;
+   size_t n;
+   size_t chunk;
+} ParallelJob;
+
+typedef struct
+{
+   ParallelJob * job;
+   size_t first;
+   size_t count;
+   double acc;
+   SerializeBuffer input;
+   SerializeBuffer output;
+   LuaTask * task;
+} ParallelRange;
+
+/* The userdata of a job, with its function in its environment */
+typedef struct
+{
+   ParallelJob job;
+   SerializeBuffer code;
+   size_t count;
+   ParallelRange * ranges;
+   /* outcome of the run */
+   int failed;
+   char * error;
+   size_t errorlen;
+} ParallelRanges;
+
+static volatile unsigned long next_job = 0;
+
+
+/***************************************************************************
+*
+* $FC rangeMain
+*
+* $ED Description
+*    runs one range of a job in a worker State
+*
+* $EP Function Parameters
+*    $P L - worker lua State, with the range as light userdata at 1
+*
+* $FV Returned Value
+*    int - 0
+*
+*$. **********************************************************************/
+
+   static int rangeMain( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC prepareJob
+*
+* $ED Description
+*    compiles the function and splits the input into ranges. Runs in
+*    protected mode.
+*
+* $EP Function Parameters
+*    $P L - lua State with the job settings as light userdata at 1, the
+*          function at 2 and the input table or nil at 3
+*
+* $FV Returned Value
+*    int - 1, the job userdata
+*
+*$. **********************************************************************/
+
+   static int prepareJob( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC finishJob
+*
+* $ED Description
+*    raises the error of a job that failed, or gathers its results. Runs
+*    in protected mode.
+*
+* $EP Function Parameters
+*    $P L - lua State with the job userdata at 1 and the optional initial
+*          reduce value at 2
+*
+* $FV Returned Value
+*    int - 1, the result
+*
+*$. **********************************************************************/
+
+   static int finishJob( lua_State * L );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: rangesGc
+*  ****/
+
+static int rangesGc( lua_State * L )
+{
+   ParallelRanges * rs = ( ParallelRanges * ) lua_touserdata( L , 1 );
+   size_t i;
+
+   for ( i = 0 ; i < rs->count ; i++ )
+   {
+      free( rs->ranges[ i ].input.data );
+      free( rs->ranges[ i ].output.data );
+   }
+   free( rs->ranges );
+   free( rs->code.data );
+   free( rs->error );
+   rs->count  = 0;
+   rs->ranges = NULL;
+   rs->error  = NULL;
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: pushJobFunction
+*  ****/
+
+static void pushJobFunction( lua_State * L , ParallelJob * job )
+{
+   lua_getfield( L , LUA_REGISTRYINDEX , "luajava.parallel.id" );
+   if ( lua_tonumber( L , -1 ) == ( lua_Number ) job->id )
+   {
+      lua_pop( L , 1 );
+      lua_getfield( L , LUA_REGISTRYINDEX , "luajava.parallel.fn" );
+      return;
+   }
+   lua_pop( L , 1 );
+
+   if ( luaL_loadbuffer( L , job->code , job->codelen , "=parallel" ) != 0 )
+   {
+      lua_error( L );
+   }
+   if ( job->fromSource )
+   {
+      lua_call( L , 0 , 1 );
+   }
+
+   lua_pushvalue( L , -1 );
+   lua_setfield( L , LUA_REGISTRYINDEX , "luajava.parallel.fn" );
+   lua_pushnumber( L , ( lua_Number ) job->id );
+   lua_setfield( L , LUA_REGISTRYINDEX , "luajava.parallel.id" );
+}
+
+
+/***************************************************************************
+*
+*  Function: checkNumber
+*  ****/
+
+static double checkNumber( lua_State * L , int reduce )
+{
+   if ( lua_type( L , -1 ) != LUA_TNUMBER )
+   {
+      luaL_error( L , "%s: function returned a %s for a number" ,
+                  reduce ? "parallel_reduce" : "parallel_map" , luaL_typename( L , -1 ) );
+   }
+
+   return ( double ) lua_tonumber( L , -1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: rangeMain
+*  ****/
+
+int rangeMain( lua_State * L )
+{
+   ParallelRange * r = ( ParallelRange * ) lua_touserdata( L , 1 );
+   ParallelJob * job = r->job;
+   size_t i;
+   int fn , t;
+
+   pushJobFunction( L , job );
+   fn = lua_gettop( L );
+
+   if ( job->numeric )
+   {
+      const double * in = job->in + r->first;
+
+      if ( job->reduce )
+      {
+         double acc = in[ 0 ];
+
+         for ( i = 1 ; i < r->count ; i++ )
+         {
+            lua_pushvalue( L , fn );
+            lua_pushnumber( L , acc );
+            lua_pushnumber( L , in[ i ] );
+            lua_call( L , 2 , 1 );
+            acc = checkNumber( L , 1 );
+            lua_pop( L , 1 );
+         }
+         r->acc = acc;
+      }
+      else
+      {
+         double * out = job->out + r->first;
+
+         for ( i = 0 ; i < r->count ; i++ )
+         {
+            lua_pushvalue( L , fn );
+            lua_pushnumber( L , in[ i ] );
+            lua_pushnumber( L , ( lua_Number ) ( r->first + i + 1 ) );
+            lua_call( L , 2 , 1 );
+            out[ i ] = checkNumber( L , 0 );
+            lua_pop( L , 1 );
+         }
+      }
+      return 0;
+   }
+
+   luajava_deserialize( L , r->input.data , r->input.len );
+   t = lua_gettop( L );
+
+   if ( job->reduce )
+   {
+      lua_createtable( L , 1 , 0 );
+      lua_rawgeti( L , t , 1 );
+      for ( i = 2 ; i <= r->count ; i++ )
+      {
+         lua_pushvalue( L , fn );
+         lua_insert( L , -2 );
+         lua_rawgeti( L , t , ( int ) i );
+         lua_call( L , 2 , 1 );
+      }
+      lua_rawseti( L , -2 , 1 );
+   }
+   else
+   {
+      lua_createtable( L , ( int ) r->count , 0 );
+      for ( i = 1 ; i <= r->count ; i++ )
+      {
+         lua_pushvalue( L , fn );
+         lua_rawgeti( L , t , ( int ) i );
+         lua_pushnumber( L , ( lua_Number ) ( r->first + i ) );
+         lua_call( L , 2 , 1 );
+         lua_rawseti( L , -2 , ( int ) i );
+      }
+   }
+
+   if ( luajava_serializeto( L , -1 , &r->output ) != 0 )
+   {
+      lua_error( L );
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: prepareFunction
+*  ****/
+
+static void prepareFunction( lua_State * L , ParallelJob * job , ParallelRanges * rs )
+{
+   if ( lua_type( L , 2 ) == LUA_TSTRING )
+   {
+      size_t len;
+      const char * source = lua_tolstring( L , 2 , &len );
+
+      /* the workers may outlive the string on the stack */
+      if ( luajava_bufferwriter( L , source , len , &rs->code ) != 0 )
+      {
+         luaL_error( L , "not enough memory" );
+      }
+      job->code = rs->code.data;
+      job->codelen = rs->code.len;
+      job->fromSource = 1;
+
+      if ( luaL_loadbuffer( L , job->code , job->codelen , "=parallel" ) != 0 )
+      {
+         lua_error( L );
+      }
+      lua_call( L , 0 , 1 );
+      if ( !lua_isfunction( L , -1 ) )
+      {
+         luaL_error( L , "function source must return a function" );
+      }
+      return;
+   }
+
+   if ( !lua_isfunction( L , 2 ) || lua_iscfunction( L , 2 ) )
+   {
+      luaL_error( L , "lua function or source string expected, got %s" ,
+                  lua_iscfunction( L , 2 ) ? "C function" : luaL_typename( L , 2 ) );
+   }
+   if ( lua_getupvalue( L , 2 , 1 ) != NULL )
+   {
+      luaL_error( L , "parallel functions cannot have upvalues" );
+   }
+
+   lua_pushvalue( L , 2 );
+   if ( lua_dump( L , luajava_bufferwriter , &rs->code ) != 0 )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   job->code = rs->code.data;
+   job->codelen = rs->code.len;
+   job->fromSource = 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: prepareJob
+*  ****/
+
+int prepareJob( lua_State * L )
+{
+   ParallelJob * settings = ( ParallelJob * ) lua_touserdata( L , 1 );
+   ParallelRanges * rs;
+   ParallelJob * job;
+   size_t i , count , first;
+   int workers = luajava_workers();
+
+   if ( workers == 0 )
+   {
+      luaL_error( L , "could not start the scheduler" );
+   }
+
+   rs = ( ParallelRanges * ) lua_newuserdata( L , sizeof( ParallelRanges ) );
+   memset( rs , 0 , sizeof( ParallelRanges ) );
+   luaL_getmetatable( L , LUAPARALLELMETATABLE );
+   lua_setmetatable( L , -2 );
+   lua_replace( L , 1 );
+   job = &rs->job;
+   *job = *settings;
+
+   /* the function is kept in the environment of the job, for the reduce
+      to fold the ranges with */
+   prepareFunction( L , job , rs );
+   lua_createtable( L , 1 , 0 );
+   lua_insert( L , -2 );
+   lua_rawseti( L , -2 , 1 );
+   lua_setfenv( L , 1 );
+
+   if ( !job->numeric )
+   {
+      job->n = lua_objlen( L , 3 );
+   }
+   if ( job->chunk == 0 )
+   {
+      job->chunk = job->n / ( ( size_t ) workers * PARALLEL_RANGES ) + 1;
+   }
+   job->id = __sync_add_and_fetch( &next_job , 1 );
+
+   count = ( job->n + job->chunk - 1 ) / job->chunk;
+   rs->ranges = ( ParallelRange * ) calloc( count ? count : 1 , sizeof( ParallelRange ) );
+   if ( rs->ranges == NULL )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   rs->count = count;
+
+   for ( i = 0 , first = 0 ; i < count ; i++ , first += job->chunk )
+   {
+      ParallelRange * r = &rs->ranges[ i ];
+
+      r->job   = job;
+      r->first = first;
+      r->count = ( job->n - first < job->chunk ) ? job->n - first : job->chunk;
+
+      if ( !job->numeric )
+      {
+         size_t k;
+
+         lua_createtable( L , ( int ) r->count , 0 );
+         for ( k = 1 ; k <= r->count ; k++ )
+         {
+            lua_rawgeti( L , 3 , ( int ) ( first + k ) );
+            lua_rawseti( L , -2 , ( int ) k );
+         }
+         if ( luajava_serializeto( L , -1 , &r->input ) != 0 )
+         {
+            lua_error( L );
+         }
+         lua_pop( L , 1 );
+      }
+   }
+
+   lua_settop( L , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_parallelprepare
+*  ****/
+
+int luajava_parallelprepare( lua_State * L , int fn , int input , size_t n , size_t chunk ,
+                             int reduce )
+{
+   ParallelJob settings;
+
+   if ( fn < 0 && fn > LUA_REGISTRYINDEX )
+   {
+      fn = lua_gettop( L ) + fn + 1;
+   }
+   if ( input < 0 && input > LUA_REGISTRYINDEX )
+   {
+      input = lua_gettop( L ) + input + 1;
+   }
+
+   if ( !lua_checkstack( L , 4 ) )
+   {
+      lua_pushstring( L , "stack overflow" );
+      return LUA_ERRMEM;
+   }
+
+   memset( &settings , 0 , sizeof( settings ) );
+   settings.n       = n;
+   settings.chunk   = chunk;
+   settings.reduce  = reduce;
+   settings.numeric = ( input == 0 );
+
+   lua_pushcfunction( L , &prepareJob );
+   lua_pushlightuserdata( L , &settings );
+   lua_pushvalue( L , fn );
+   if ( input != 0 )
+   {
+      lua_pushvalue( L , input );
+   }
+   else
+   {
+      lua_pushnil( L );
+   }
+
+   return lua_pcall( L , 3 , 1 , 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_parallelrun
+*  ****/
+
+void luajava_parallelrun( lua_State * L , int job , const double * in , double * out )
+{
+   ParallelRanges * rs = ( ParallelRanges * ) lua_touserdata( L , job );
+   size_t i;
+
+   rs->job.in  = in;
+   rs->job.out = out;
+
+   for ( i = 0 ; i < rs->count ; i++ )
+   {
+      rs->ranges[ i ].task = luajava_spawnnative( &rangeMain , &rs->ranges[ i ] );
+      if ( rs->ranges[ i ].task == NULL )
+      {
+         rs->failed = 1;
+         break;
+      }
+   }
+
+   /* the message is copied, since it belongs to the task */
+   for ( i = 0 ; i < rs->count && rs->ranges[ i ].task != NULL ; i++ )
+   {
+      if ( luajava_taskwait( rs->ranges[ i ].task , -1 ) == LUATASK_ERROR && rs->error == NULL )
+      {
+         const char * error;
+         size_t len = 0;
+
+         error = luajava_taskresult( rs->ranges[ i ].task , &len );
+         if ( error == NULL )
+         {
+            error = "parallel task failed";
+            len = strlen( error );
+         }
+         rs->error = ( char * ) malloc( len ? len : 1 );
+         if ( rs->error != NULL )
+         {
+            memcpy( rs->error , error , len );
+            rs->errorlen = len;
+         }
+         else
+         {
+            rs->failed = 1;
+         }
+      }
+   }
+
+   for ( i = 0 ; i < rs->count && rs->ranges[ i ].task != NULL ; i++ )
+   {
+      luajava_taskrelease( rs->ranges[ i ].task );
+      rs->ranges[ i ].task = NULL;
+   }
+
+   rs->job.in  = NULL;
+   rs->job.out = NULL;
+}
+
+
+/***************************************************************************
+*
+*  Function: finishJob
+*  ****/
+
+int finishJob( lua_State * L )
+{
+   ParallelRanges * rs = ( ParallelRanges * ) lua_touserdata( L , 1 );
+   ParallelJob * job = &rs->job;
+   int hasInit = lua_gettop( L ) >= 2;
+   size_t i;
+   int fn;
+
+   if ( rs->error != NULL )
+   {
+      lua_pushlstring( L , rs->error , rs->errorlen );
+      return lua_error( L );
+   }
+   if ( rs->failed )
+   {
+      return luaL_error( L , "could not start parallel tasks" );
+   }
+
+   if ( !job->reduce )
+   {
+      if ( job->numeric )
+      {
+         lua_pushnil( L );
+         return 1;
+      }
+
+      lua_createtable( L , ( int ) job->n , 0 );
+      for ( i = 0 ; i < rs->count ; i++ )
+      {
+         ParallelRange * r = &rs->ranges[ i ];
+         size_t k;
+
+         luajava_deserialize( L , r->output.data , r->output.len );
+         for ( k = 1 ; k <= r->count ; k++ )
+         {
+            lua_rawgeti( L , -1 , ( int ) k );
+            lua_rawseti( L , -3 , ( int ) ( r->first + k ) );
+         }
+         lua_pop( L , 1 );
+      }
+      return 1;
+   }
+
+   lua_getfenv( L , 1 );
+   lua_rawgeti( L , -1 , 1 );
+   lua_replace( L , -2 );
+   fn = lua_gettop( L );
+
+   if ( hasInit )
+   {
+      lua_pushvalue( L , 2 );
+   }
+   for ( i = 0 ; i < rs->count ; i++ )
+   {
+      ParallelRange * r = &rs->ranges[ i ];
+
+      if ( i > 0 || hasInit )
+      {
+         lua_pushvalue( L , fn );
+         lua_insert( L , -2 );
+      }
+
+      if ( job->numeric )
+      {
+         lua_pushnumber( L , r->acc );
+      }
+      else
+      {
+         luajava_deserialize( L , r->output.data , r->output.len );
+         lua_rawgeti( L , -1 , 1 );
+         lua_remove( L , -2 );
+      }
+
+      if ( i > 0 || hasInit )
+      {
+         lua_call( L , 2 , 1 );
+      }
+   }
+   if ( rs->count == 0 && !hasInit )
+   {
+      lua_pushnil( L );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_parallelfinish
+*  ****/
+
+int luajava_parallelfinish( lua_State * L , int job , int init )
+{
+   if ( job < 0 && job > LUA_REGISTRYINDEX )
+   {
+      job = lua_gettop( L ) + job + 1;
+   }
+   if ( init < 0 && init > LUA_REGISTRYINDEX )
+   {
+      init = lua_gettop( L ) + init + 1;
+   }
+
+   if ( !lua_checkstack( L , 3 ) )
+   {
+      lua_pushstring( L , "stack overflow" );
+      return LUA_ERRMEM;
+   }
+
+   lua_pushcfunction( L , &finishJob );
+   lua_pushvalue( L , job );
+   if ( init != 0 )
+   {
+      lua_pushvalue( L , init );
+   }
+
+   return lua_pcall( L , ( init != 0 ) ? 2 : 1 , 1 , 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: runParallel
+*  ****/
+
+static int runParallel( lua_State * L , int fn , int input , const double * in , double * out ,
+                        size_t n , size_t chunk , int reduce , int init )
+{
+   int status = luajava_parallelprepare( L , fn , input , n , chunk , reduce );
+
+   if ( status != 0 )
+   {
+      return status;
+   }
+
+   luajava_parallelrun( L , -1 , in , out );
+   status = luajava_parallelfinish( L , -1 , init );
+   lua_remove( L , -2 );
+
+   return status;
+}
+
+
+/***************************************************************************
+*
+*  Function: numericInput
+*  ****/
+
+static double * numericInput( lua_State * L , int t , size_t n )
+{
+   double * in;
+   size_t i;
+
+   for ( i = 1 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , t , ( int ) i );
+      if ( lua_type( L , -1 ) != LUA_TNUMBER )
+      {
+         lua_pop( L , 1 );
+         return NULL;
+      }
+      lua_pop( L , 1 );
+   }
+
+   /* the buffer is a userdata left on the stack, so it is collected even
+      if the job fails */
+   in = ( double * ) lua_newuserdata( L , ( n ? n : 1 ) * sizeof( double ) );
+   for ( i = 0 ; i < n ; i++ )
+   {
+      lua_rawgeti( L , t , ( int ) ( i + 1 ) );
+      in[ i ] = ( double ) lua_tonumber( L , -1 );
+      lua_pop( L , 1 );
+   }
+
+   return in;
+}
+
+
+/***************************************************************************
+*
+*  Function: checkChunk
+*  ****/
+
+static size_t checkChunk( lua_State * L , int idx )
+{
+   lua_Integer chunk = luaL_optinteger( L , idx , 0 );
+
+   if ( chunk < 0 )
+   {
+      luaL_argerror( L , idx , "chunk size must not be negative" );
+   }
+
+   return ( size_t ) chunk;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_parallelmap
+*  ****/
+
+int luajava_parallelmap( lua_State * L )
+{
+   size_t n , i;
+   size_t chunk;
+   double * in;
+   double * out;
+
+   luaL_checkany( L , 1 );
+   luaL_checktype( L , 2 , LUA_TTABLE );
+   chunk = checkChunk( L , 3 );
+   lua_settop( L , 3 );
+
+   n = lua_objlen( L , 2 );
+   in = numericInput( L , 2 , n );
+
+   if ( in == NULL )
+   {
+      if ( runParallel( L , 1 , 2 , NULL , NULL , n , chunk , 0 , 0 ) != 0 )
+      {
+         return lua_error( L );
+      }
+      return 1;
+   }
+
+   out = ( double * ) lua_newuserdata( L , ( n ? n : 1 ) * sizeof( double ) );
+   if ( runParallel( L , 1 , 0 , in , out , n , chunk , 0 , 0 ) != 0 )
+   {
+      return lua_error( L );
+   }
+   lua_pop( L , 1 );
+
+   lua_createtable( L , ( int ) n , 0 );
+   for ( i = 0 ; i < n ; i++ )
+   {
+      lua_pushnumber( L , out[ i ] );
+      lua_rawseti( L , -2 , ( int ) ( i + 1 ) );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_parallelreduce
+*  ****/
+
+int luajava_parallelreduce( lua_State * L )
+{
+   size_t n;
+   size_t chunk;
+   double * in;
+   int init;
+
+   luaL_checkany( L , 1 );
+   luaL_checktype( L , 2 , LUA_TTABLE );
+   chunk = checkChunk( L , 3 );
+   init = ( lua_gettop( L ) >= 4 ) ? 4 : 0;
+   lua_settop( L , 4 );
+
+   n = lua_objlen( L , 2 );
+   in = numericInput( L , 2 , n );
+
+   if ( in == NULL )
+   {
+      if ( runParallel( L , 1 , 2 , NULL , NULL , n , chunk , 1 , init ) != 0 )
+      {
+         return lua_error( L );
+      }
+      return 1;
+   }
+
+   if ( runParallel( L , 1 , 0 , in , NULL , n , chunk , 1 , init ) != 0 )
+   {
+      return lua_error( L );
+   }
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openparallel
+*  ****/
+
+void luajava_openparallel( lua_State * L )
+{
+   luaL_newmetatable( L , LUAPARALLELMETATABLE );
+   lua_pushstring( L , "__gc" );
+   lua_pushcfunction( L , &rangesGc );
+   lua_rawset( L , -3 );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "parallel_map" );
+   lua_pushcfunction( L , &luajava_parallelmap );
+   lua_settable( L , -3 );
+
+   lua_pushstring( L , "parallel_reduce" );
+   lua_pushcfunction( L , &luajava_parallelreduce );
+   lua_settable( L , -3 );
+}
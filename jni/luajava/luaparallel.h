@@ -0,0 +1,154 @@
+/***************************************************************************
+*
+* $ED
+*    Data parallel map and reduce over arrays, running on the workers of
+*    the scheduler in luascheduler.c.
+*
+*****************************************************************************/
+
+#ifndef LUAPARALLEL_H
+#define LUAPARALLEL_H
+
+#include <stddef.h>
+
+#include "lua.h"
+
+
+/***************************************************************************
+*
+* $FC luajava_parallelprepare
+*
+* $ED Description
+*    prepares a map or reduce on the scheduler workers, in ranges of chunk
+*    elements. fn is the stack index of a lua function without upvalues or
+*    of a source string returning one, which is compiled or run here; the
+*    function is called as fn(value, index) by a map and as fn(acc, value)
+*    by a reduce. The input is the table at index input, or an array of n
+*    numbers given to luajava_parallelrun when input is 0, in which case
+*    the function must return numbers.
+*    Never raises lua errors, so the caller may hold native resources.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P fn - stack index of the function or source
+*    $P input - stack index of the input table, or 0 for numbers
+*    $P n - number of elements, when input is 0
+*    $P chunk - elements per range, 0 to pick one from the worker count
+*    $P reduce - whether to reduce rather than map
+*
+* $FV Returned Value
+*    int - 0 on success with the job pushed, or a lua_pcall error code with
+*          the message pushed
+*
+*$. **********************************************************************/
+
+int luajava_parallelprepare( lua_State * L , int fn , int input , size_t n , size_t chunk ,
+                             int reduce );
+
+
+/***************************************************************************
+*
+* $FC luajava_parallelrun
+*
+* $ED Description
+*    runs a prepared job on the workers and waits for them. The workers
+*    read in and write out directly, so both may point into pinned Java
+*    arrays: no lua code runs and nothing is allocated in L meanwhile.
+*    Never raises lua errors; a failure is raised by luajava_parallelfinish.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P job - stack index of the job
+*    $P in - input numbers, NULL for a table
+*    $P out - receives the mapped numbers, NULL for a table or a reduce
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_parallelrun( lua_State * L , int job , const double * in , double * out );
+
+
+/***************************************************************************
+*
+* $FC luajava_parallelfinish
+*
+* $ED Description
+*    raises the error of a job run, or gathers its results: the mapped
+*    table for a map of a table, nil for a map of numbers, and for a
+*    reduce the partial results of the ranges folded in order, starting
+*    from init if given.
+*    Never raises lua errors.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P job - stack index of the job
+*    $P init - stack index of the initial reduce value, or 0
+*
+* $FV Returned Value
+*    int - 0 on success with the result pushed, or a lua_pcall error code
+*          with the message pushed
+*
+*$. **********************************************************************/
+
+int luajava_parallelfinish( lua_State * L , int job , int init );
+
+
+/***************************************************************************
+*
+* $FC luajava_parallelmap
+*
+* $ED Description
+*    lua_CFunction behind luajava.parallel_map(fn, table [, chunk]) for
+*    lua tables
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    int - 1, the table of results
+*
+*$. **********************************************************************/
+
+int luajava_parallelmap( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luajava_parallelreduce
+*
+* $ED Description
+*    lua_CFunction behind luajava.parallel_reduce(fn, table [, chunk
+*    [, init]]) for lua tables
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    int - 1, the reduced value
+*
+*$. **********************************************************************/
+
+int luajava_parallelreduce( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luajava_openparallel
+*
+* $ED Description
+*    registers parallel_map and parallel_reduce in the table on top of
+*    the stack (the luajava table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openparallel( lua_State * L );
+
+#endif
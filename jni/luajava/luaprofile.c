@@ -0,0 +1,900 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.profile, a sampling profiler of lua
+*    code:
+*
+*    luajava.profile.start()            -- or start('count', 10000)
+*    ...
+*    luajava.profile.stop()
+*    local stacks = luajava.profile.folded()
+*
+*    The profiler is a sampler of the lua core (see lua_setsampler). By
+*    time, a timer thread ticks every interval and asks the state for a
+*    sample with lua_requestsample: the thread running then samples its
+*    stack at its next instruction, and the VM pays nothing in between.
+*    Ticks while a C function runs are sampled once it returns, in its
+*    lua caller; ticks during calls into Java are sampled by the bridge
+*    through luaprofile_java, under a "[java] name" frame; ticks while the
+*    state is idle, between two calls into it from C, are dropped. By
+*    count, a sample is taken every interval instructions, at the cost of
+*    counting them.
+*
+*    A sample walks the stack of the running coroutine with lua_getstack
+*    and lua_getinfo, and keeps its innermost frames in a ring buffer
+*    allocated by start, as indices into a table of frame labels: "name
+*    source:line" for lua functions, "[C] name" for C functions. Stacks
+*    are exported in the folded format of flame graph tools.
+*
+*    The timer is a thread rather than a signal: a signal handler could
+*    not safely walk a lua stack, and the VM on Android relies on signals
+*    itself.
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luaprofile.h"
+
+
+/* Registry key and metatable of the profiler of a state */
+#define LUAPROFILEKEY         "luajava.profiler"
+/* Registry key of the thread the timer requests samples from */
+#define LUAPROFILETHREAD      "luajava.profiler.thread"
+/* Distinct frame labels; further frames are labelled "(other)" */
+#define LUAPROFILE_FRAMES     65536
+
+#define JAVA_SOURCE           "[java]"
+/* Index of the frames that do not fit */
+#define OTHER_FRAME           0xffffffff
+
+static const char * const profile_modes[] = { "time" , "count" , NULL };
+
+typedef struct
+{
+   uint32_t weight;
+   uint16_t depth;
+   uint16_t truncated;
+   uint32_t frames[ LUAPROFILE_DEPTH ];
+} ProfileSample;
+
+/* A frame label, keyed by the source and name pointers seen by
+   lua_getinfo, checked against copies of their contents as the pointers
+   may be reused once the strings are collected */
+typedef struct
+{
+   const char * source;
+   const char * name;
+   int linedefined;
+   int line;
+   char * sourceCopy;
+   char * nameCopy;
+   char * label;
+} ProfileFrame;
+
+typedef struct
+{
+   int running;
+   int mode;
+   int interval;
+   int instructions;
+
+   /* timer, by time */
+   lua_State * L;
+   pthread_t timer;
+   int timerStarted;
+   volatile int stopping;
+   volatile int ticks;
+
+   ProfileSample * samples;
+   int size;
+   int head;
+   int count;
+   unsigned long dropped;
+   unsigned long luaSamples;
+   unsigned long javaSamples;
+
+   ProfileFrame * frames;
+   int nframes;
+   int framesSize;
+   int * index;
+   int indexSize;
+} LuaProfiler;
+
+
+/***************************************************************************
+*
+* $FC profileSample
+*
+* $ED Description
+*    sampler of profiled states, see lua_setsampler
+*
+* $EP Function Parameters
+*    $P L - thread running
+*    $P count - instructions run since the last call, 0 on entry from C
+*    $P ud - the profiler
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void profileSample( lua_State * L , int count , void * ud );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: nowNanos
+*  ****/
+
+static int64_t nowNanos( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC , &ts );
+
+   return ( int64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/***************************************************************************
+*
+*  Function: copyString
+*  ****/
+
+static char * copyString( const char * s )
+{
+   char * copy;
+
+   if ( s == NULL )
+   {
+      return NULL;
+   }
+   copy = ( char * ) malloc( strlen( s ) + 1 );
+   if ( copy != NULL )
+   {
+      strcpy( copy , s );
+   }
+   return copy;
+}
+
+
+/***************************************************************************
+*
+*  Function: clearFrames
+*  ****/
+
+static void clearFrames( LuaProfiler * p )
+{
+   int i;
+
+   for ( i = 0 ; i < p->nframes ; i++ )
+   {
+      free( p->frames[ i ].sourceCopy );
+      free( p->frames[ i ].nameCopy );
+      free( p->frames[ i ].label );
+   }
+   free( p->frames );
+   free( p->index );
+   p->frames = NULL;
+   p->index = NULL;
+   p->nframes = 0;
+   p->framesSize = 0;
+   p->indexSize = 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: hashFrame
+*  ****/
+
+static unsigned int hashFrame( const char * source , const char * name , int line )
+{
+   size_t h = ( size_t ) source ^ ( ( size_t ) name >> 3 ) ^ ( ( size_t ) line * 2654435761u );
+
+   return ( unsigned int ) ( h ^ ( h >> 15 ) );
+}
+
+
+/***************************************************************************
+*
+*  Function: sameFrame
+*  ****/
+
+static int sameFrame( ProfileFrame * f , const char * source , const char * name ,
+                      int linedefined , int line )
+{
+   if ( f->source != source || f->name != name ||
+        f->linedefined != linedefined || f->line != line )
+   {
+      return 0;
+   }
+   if ( strcmp( f->sourceCopy , source ) != 0 )
+   {
+      return 0;
+   }
+   return name == NULL || ( f->nameCopy != NULL && strcmp( f->nameCopy , name ) == 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: growFrames
+*  ****/
+
+static int growFrames( LuaProfiler * p )
+{
+   int size = p->indexSize ? p->indexSize * 2 : 1024;
+   ProfileFrame * frames;
+   int * index;
+   int i;
+
+   index = ( int * ) calloc( size , sizeof( int ) );
+   if ( index == NULL )
+   {
+      return 0;
+   }
+   frames = ( ProfileFrame * ) realloc( p->frames , ( size / 2 ) * sizeof( ProfileFrame ) );
+   if ( frames == NULL )
+   {
+      free( index );
+      return 0;
+   }
+   p->frames = frames;
+   p->framesSize = size / 2;
+
+   free( p->index );
+   p->index = index;
+   p->indexSize = size;
+
+   for ( i = 0 ; i < p->nframes ; i++ )
+   {
+      ProfileFrame * f = &p->frames[ i ];
+      unsigned int h = hashFrame( f->source , f->name , f->line );
+
+      while ( p->index[ h & ( size - 1 ) ] != 0 )
+         h++;
+      p->index[ h & ( size - 1 ) ] = i + 1;
+   }
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: frameLabel
+*  ****/
+
+static char * frameLabel( lua_State * L , lua_Debug * ar , int java , const char * name )
+{
+   char label[ LUA_IDSIZE + 128 ];
+
+   if ( java )
+   {
+      snprintf( label , sizeof( label ) , "[java] %s" , name ? name : "?" );
+   }
+   else if ( *ar->what == 'C' )
+   {
+      snprintf( label , sizeof( label ) , name ? "[C] %s" : "[C]" , name );
+   }
+   else if ( ar->currentline < 0 )
+   {
+      snprintf( label , sizeof( label ) , "%s" , ar->short_src );
+   }
+   else
+   {
+      lua_getinfo( L , "n" , ar );
+      if ( ar->name != NULL )
+      {
+         snprintf( label , sizeof( label ) , "%s %s:%d" , ar->name , ar->short_src ,
+                   ar->currentline );
+      }
+      else
+      {
+         snprintf( label , sizeof( label ) , "%s:%d" , ar->short_src , ar->currentline );
+      }
+   }
+   return copyString( label );
+}
+
+
+/***************************************************************************
+*
+*  Function: frameId
+*  ****/
+
+static uint32_t frameId( LuaProfiler * p , lua_State * L , lua_Debug * ar ,
+                         int java , const char * name )
+{
+   const char * source;
+   ProfileFrame * f;
+   unsigned int h;
+   int id;
+
+   lua_getinfo( L , "Sl" , ar );
+   source = ar->source;
+
+   /* lua frames are told apart by source and lines, others by name */
+   if ( java )
+   {
+      source = JAVA_SOURCE;
+      if ( name == NULL )
+      {
+         lua_getinfo( L , "n" , ar );
+         name = ar->name;
+      }
+   }
+   else if ( *ar->what == 'C' )
+   {
+      lua_getinfo( L , "n" , ar );
+      name = ar->name;
+   }
+   else
+   {
+      name = NULL;
+   }
+
+   h = hashFrame( source , name , ar->currentline );
+   if ( p->indexSize != 0 )
+   {
+      while ( ( id = p->index[ h & ( p->indexSize - 1 ) ] ) != 0 )
+      {
+         if ( sameFrame( &p->frames[ id - 1 ] , source , name , ar->linedefined , ar->currentline ) )
+         {
+            return ( uint32_t ) ( id - 1 );
+         }
+         h++;
+      }
+   }
+
+   /* a new frame: the index is kept at most half full */
+   if ( p->nframes >= LUAPROFILE_FRAMES )
+   {
+      return OTHER_FRAME;
+   }
+   if ( p->nframes >= p->framesSize )
+   {
+      if ( !growFrames( p ) )
+      {
+         return OTHER_FRAME;
+      }
+      return frameId( p , L , ar , java , name );
+   }
+
+   f = &p->frames[ p->nframes ];
+   f->source = source;
+   f->name = name;
+   f->linedefined = ar->linedefined;
+   f->line = ar->currentline;
+   f->sourceCopy = copyString( source );
+   f->nameCopy = copyString( name );
+   f->label = frameLabel( L , ar , java , name );
+   if ( f->sourceCopy == NULL || f->label == NULL || ( name != NULL && f->nameCopy == NULL ) )
+   {
+      free( f->sourceCopy );
+      free( f->nameCopy );
+      free( f->label );
+      return OTHER_FRAME;
+   }
+
+   p->index[ h & ( p->indexSize - 1 ) ] = ++p->nframes;
+
+   return ( uint32_t ) ( p->nframes - 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: takeSample
+*  ****/
+
+static void takeSample( LuaProfiler * p , lua_State * L , int weight ,
+                        int java , const char * name )
+{
+   ProfileSample * s = &p->samples[ p->head ];
+   lua_Debug ar;
+   int depth = 0;
+
+   while ( depth < LUAPROFILE_DEPTH && lua_getstack( L , depth , &ar ) )
+   {
+      s->frames[ depth ] = frameId( p , L , &ar , java && depth == 0 , name );
+      depth++;
+   }
+   if ( depth == 0 )
+   {
+      return;
+   }
+   s->depth = ( uint16_t ) depth;
+   s->truncated = depth == LUAPROFILE_DEPTH && lua_getstack( L , depth , &ar );
+   s->weight = ( uint32_t ) weight;
+
+   if ( java )
+      p->javaSamples += s->weight;
+   else
+      p->luaSamples += s->weight;
+
+   p->head = ( p->head + 1 ) % p->size;
+   if ( p->count < p->size )
+      p->count++;
+   else
+      p->dropped++;
+}
+
+
+/***************************************************************************
+*
+*  Function: profileSample
+*  ****/
+
+void profileSample( lua_State * L , int count , void * ud )
+{
+   LuaProfiler * p = ( LuaProfiler * ) ud;
+   int weight;
+
+   if ( p->mode == LUAPROFILE_COUNT )
+   {
+      if ( count <= 0 )
+      {
+         return;
+      }
+      p->instructions += count;
+      if ( p->instructions < p->interval )
+      {
+         return;
+      }
+      weight = p->instructions / p->interval;
+      p->instructions -= weight * p->interval;
+   }
+   else
+   {
+      /* entered from C: the ticks since the state was left are dropped */
+      weight = __sync_lock_test_and_set( &p->ticks , 0 );
+      if ( count == LUA_SAMPLEENTRY || weight == 0 )
+      {
+         return;
+      }
+   }
+
+   takeSample( p , L , weight , 0 , NULL );
+}
+
+
+/***************************************************************************
+*
+*  Function: profileTimer
+*  ****/
+
+static void * profileTimer( void * arg )
+{
+   LuaProfiler * p = ( LuaProfiler * ) arg;
+   int64_t period = ( int64_t ) p->interval * 1000;
+   int64_t next = nowNanos() + period;
+
+   while ( !p->stopping )
+   {
+      int64_t wait = next - nowNanos();
+
+      if ( wait > 0 )
+      {
+         struct timespec ts;
+
+         ts.tv_sec = ( time_t ) ( wait / 1000000000 );
+         ts.tv_nsec = ( long ) ( wait % 1000000000 );
+         nanosleep( &ts , NULL );
+         continue;
+      }
+
+      __sync_add_and_fetch( &p->ticks , 1 );
+      lua_requestsample( p->L );
+
+      /* ticks missed while not scheduled are not made up */
+      next += period;
+      if ( next < nowNanos() )
+      {
+         next = nowNanos() + period;
+      }
+   }
+   return NULL;
+}
+
+
+/***************************************************************************
+*
+*  Function: getProfiler
+*  ****/
+
+static LuaProfiler * getProfiler( lua_State * L )
+{
+   LuaProfiler * p;
+
+   lua_getfield( L , LUA_REGISTRYINDEX , LUAPROFILEKEY );
+   p = ( LuaProfiler * ) lua_touserdata( L , -1 );
+   lua_pop( L , 1 );
+
+   if ( p == NULL )
+   {
+      p = ( LuaProfiler * ) lua_newuserdata( L , sizeof( LuaProfiler ) );
+      memset( p , 0 , sizeof( LuaProfiler ) );
+      luaL_getmetatable( L , LUAPROFILEKEY );
+      lua_setmetatable( L , -2 );
+      lua_setfield( L , LUA_REGISTRYINDEX , LUAPROFILEKEY );
+   }
+
+   return p;
+}
+
+
+/***************************************************************************
+*
+*  Function: runningProfiler
+*  ****/
+
+static LuaProfiler * runningProfiler( lua_State * L )
+{
+   void * ud;
+
+   if ( lua_getsampler( L , &ud ) != &profileSample )
+   {
+      return NULL;
+   }
+   return ( LuaProfiler * ) ud;
+}
+
+
+/***************************************************************************
+*
+*  Function: stopProfiler
+*  ****/
+
+static void stopProfiler( lua_State * L , LuaProfiler * p )
+{
+   if ( runningProfiler( L ) == p )
+   {
+      lua_setsampler( L , NULL , NULL , 0 );
+   }
+   if ( p->timerStarted )
+   {
+      p->stopping = 1;
+      pthread_join( p->timer , NULL );
+      p->timerStarted = 0;
+   }
+   p->running = 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luaprofile_start
+*  ****/
+
+int luaprofile_start( lua_State * L , int mode , int interval , int size )
+{
+   LuaProfiler * p = getProfiler( L );
+
+   stopProfiler( L , p );
+
+   if ( size <= 0 )
+      size = LUAPROFILE_SAMPLES;
+   if ( interval <= 0 )
+      interval = mode == LUAPROFILE_COUNT ? LUAPROFILE_INSTR : LUAPROFILE_INTERVAL;
+
+   if ( p->samples == NULL || p->size != size )
+   {
+      free( p->samples );
+      p->size = 0;
+      p->samples = ( ProfileSample * ) malloc( size * sizeof( ProfileSample ) );
+      if ( p->samples == NULL )
+      {
+         return 1;
+      }
+      p->size = size;
+   }
+   clearFrames( p );
+
+   p->mode = mode;
+   p->interval = interval;
+   p->instructions = 0;
+   p->ticks = 0;
+   p->head = 0;
+   p->count = 0;
+   p->dropped = 0;
+   p->luaSamples = 0;
+   p->javaSamples = 0;
+
+   if ( mode == LUAPROFILE_COUNT )
+   {
+      lua_setsampler( L , &profileSample , p , interval );
+   }
+   else
+   {
+      /* the thread is anchored while the timer uses it */
+      lua_pushthread( L );
+      lua_setfield( L , LUA_REGISTRYINDEX , LUAPROFILETHREAD );
+      p->L = L;
+      p->stopping = 0;
+
+      lua_setsampler( L , &profileSample , p , 0 );
+      if ( pthread_create( &p->timer , NULL , &profileTimer , p ) != 0 )
+      {
+         lua_setsampler( L , NULL , NULL , 0 );
+         return 1;
+      }
+      p->timerStarted = 1;
+   }
+   p->running = 1;
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luaprofile_stop
+*  ****/
+
+void luaprofile_stop( lua_State * L )
+{
+   stopProfiler( L , getProfiler( L ) );
+
+   lua_pushnil( L );
+   lua_setfield( L , LUA_REGISTRYINDEX , LUAPROFILETHREAD );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaprofile_java
+*  ****/
+
+void luaprofile_java( lua_State * L , const char * name )
+{
+   LuaProfiler * p = runningProfiler( L );
+   int weight;
+
+   if ( p == NULL || p->mode != LUAPROFILE_TIME )
+   {
+      return;
+   }
+
+   /* lua code called back by Java has sampled its own ticks */
+   weight = __sync_lock_test_and_set( &p->ticks , 0 );
+   if ( weight > 0 )
+   {
+      takeSample( p , L , weight , 1 , name );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: compareStacks
+*  ****/
+
+typedef struct
+{
+   const char * stack;
+   lua_Number count;
+} FoldedStack;
+
+static int compareStacks( const void * a , const void * b )
+{
+   return strcmp( ( ( const FoldedStack * ) a )->stack , ( ( const FoldedStack * ) b )->stack );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaprofile_folded
+*  ****/
+
+void luaprofile_folded( lua_State * L )
+{
+   LuaProfiler * p = getProfiler( L );
+   FoldedStack * stacks;
+   luaL_Buffer b;
+   int i , j , n , t;
+
+   /* counts the samples of each distinct stack */
+   lua_newtable( L );
+   t = lua_gettop( L );
+
+   for ( i = 0 ; i < p->count ; i++ )
+   {
+      ProfileSample * s = &p->samples[ ( p->head - p->count + i + p->size ) % p->size ];
+
+      luaL_buffinit( L , &b );
+      if ( s->truncated )
+      {
+         luaL_addstring( &b , "(truncated);" );
+      }
+      for ( j = s->depth - 1 ; j >= 0 ; j-- )
+      {
+         luaL_addstring( &b , s->frames[ j ] == OTHER_FRAME ? "(other)" :
+                              p->frames[ s->frames[ j ] ].label );
+         if ( j > 0 )
+            luaL_addchar( &b , ';' );
+      }
+      luaL_pushresult( &b );
+
+      lua_pushvalue( L , -1 );
+      lua_rawget( L , t );
+      lua_pushnumber( L , lua_tonumber( L , -1 ) + s->weight );
+      lua_remove( L , -2 );
+      lua_rawset( L , t );
+   }
+
+   for ( n = 0 , lua_pushnil( L ) ; lua_next( L , t ) ; lua_pop( L , 1 ) )
+      n++;
+
+   stacks = ( FoldedStack * ) malloc( ( n + 1 ) * sizeof( FoldedStack ) );
+   if ( stacks == NULL )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   for ( i = 0 , lua_pushnil( L ) ; lua_next( L , t ) ; lua_pop( L , 1 ) , i++ )
+   {
+      stacks[ i ].stack = lua_tostring( L , -2 );
+      stacks[ i ].count = lua_tonumber( L , -1 );
+   }
+   qsort( stacks , n , sizeof( FoldedStack ) , compareStacks );
+
+   /* the strings stay anchored in the table under the buffer */
+   luaL_buffinit( L , &b );
+   for ( i = 0 ; i < n ; i++ )
+   {
+      char count[ 32 ];
+
+      luaL_addstring( &b , stacks[ i ].stack );
+      snprintf( count , sizeof( count ) , " %.0f\n" , ( double ) stacks[ i ].count );
+      luaL_addstring( &b , count );
+   }
+   free( stacks );
+   luaL_pushresult( &b );
+   lua_remove( L , t );
+}
+
+
+/***************************************************************************
+*
+*  Function: profileGc
+*  ****/
+
+static int profileGc( lua_State * L )
+{
+   LuaProfiler * p = ( LuaProfiler * ) lua_touserdata( L , 1 );
+
+   stopProfiler( L , p );
+   clearFrames( p );
+   free( p->samples );
+   p->samples = NULL;
+   p->count = 0;
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: profileStart
+*  ****/
+
+static int profileStart( lua_State * L )
+{
+   int mode = luaL_checkoption( L , 1 , "time" , profile_modes );
+   int interval = luaL_optint( L , 2 , 0 );
+   int size = luaL_optint( L , 3 , 0 );
+
+   luaL_argcheck( L , interval >= 0 , 2 , "interval must not be negative" );
+   luaL_argcheck( L , size >= 0 , 3 , "size must not be negative" );
+
+   if ( luaprofile_start( L , mode , interval , size ) != 0 )
+   {
+      return luaL_error( L , "not enough memory for %d samples" , size );
+   }
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: profileStop
+*  ****/
+
+static int profileStop( lua_State * L )
+{
+   luaprofile_stop( L );
+   lua_pushinteger( L , getProfiler( L )->count );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: profileFolded
+*  ****/
+
+static int profileFolded( lua_State * L )
+{
+   luaprofile_folded( L );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: profileInfo
+*  ****/
+
+static int profileInfo( lua_State * L )
+{
+   LuaProfiler * p = getProfiler( L );
+
+   lua_createtable( L , 0 , 8 );
+
+   lua_pushboolean( L , p->running );
+   lua_setfield( L , -2 , "running" );
+
+   lua_pushstring( L , profile_modes[ p->mode ] );
+   lua_setfield( L , -2 , "mode" );
+
+   lua_pushinteger( L , p->interval );
+   lua_setfield( L , -2 , "interval" );
+
+   lua_pushinteger( L , p->count );
+   lua_setfield( L , -2 , "samples" );
+
+   lua_pushnumber( L , ( lua_Number ) p->dropped );
+   lua_setfield( L , -2 , "dropped" );
+
+   lua_pushnumber( L , ( lua_Number ) p->luaSamples );
+   lua_setfield( L , -2 , "lua" );
+
+   lua_pushnumber( L , ( lua_Number ) p->javaSamples );
+   lua_setfield( L , -2 , "java" );
+
+   lua_pushinteger( L , p->nframes );
+   lua_setfield( L , -2 , "frames" );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openprofile
+*  ****/
+
+void luajava_openprofile( lua_State * L )
+{
+   static const luaL_Reg functions[] =
+   {
+      { "start" , &profileStart } ,
+      { "stop" , &profileStop } ,
+      { "folded" , &profileFolded } ,
+      { "info" , &profileInfo } ,
+      { NULL , NULL }
+   };
+
+   luaL_newmetatable( L , LUAPROFILEKEY );
+   lua_pushcfunction( L , &profileGc );
+   lua_setfield( L , -2 , "__gc" );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "profile" );
+   lua_newtable( L );
+   luaL_register( L , NULL , functions );
+   lua_settable( L , -3 );
+}
@@ -0,0 +1,128 @@
+/***************************************************************************
+*
+* $ED
+*    Sampling profiler of lua code, with folded stack output, see
+*    luaprofile.c.
+*
+*****************************************************************************/
+
+#ifndef LUAPROFILE_H
+#define LUAPROFILE_H
+
+#include "lua.h"
+
+/* Sampling modes: every interval microseconds of wall clock time while
+   the state runs, or every interval lua instructions */
+#define LUAPROFILE_TIME       0
+#define LUAPROFILE_COUNT      1
+
+/* Default intervals of the modes */
+#define LUAPROFILE_INTERVAL   1000
+#define LUAPROFILE_INSTR      10000
+/* Default number of samples kept; older ones are overwritten */
+#define LUAPROFILE_SAMPLES    4096
+/* Frames kept per sample, from the innermost */
+#define LUAPROFILE_DEPTH      32
+
+
+/***************************************************************************
+*
+* $FC luaprofile_start
+*
+* $ED Description
+*    starts profiling the state, discarding the samples of a previous run
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P mode - LUAPROFILE_TIME or LUAPROFILE_COUNT
+*    $P interval - microseconds or instructions between samples, 0 for
+*                  the default of the mode
+*    $P size - number of samples kept, 0 for the default
+*
+* $FV Returned Value
+*    int - 0 on success, non zero if out of memory
+*
+*$. **********************************************************************/
+
+int luaprofile_start( lua_State * L , int mode , int interval , int size );
+
+
+/***************************************************************************
+*
+* $FC luaprofile_stop
+*
+* $ED Description
+*    stops profiling the state; its samples are kept until the next start
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaprofile_stop( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luaprofile_folded
+*
+* $ED Description
+*    pushes the samples of the state as folded stacks: one line per
+*    distinct stack, its frames from the outermost separated by ';',
+*    followed by a space and its number of samples
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaprofile_folded( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luaprofile_java
+*
+* $ED Description
+*    samples the ticks of the timer that elapsed during a call from lua
+*    into Java, with the stack of the caller under a "[java] name" frame.
+*    To be called by the bridge once the call returns.
+*
+* $EP Function Parameters
+*    $P L - lua State making the call
+*    $P name - what was called, or NULL for the name of the C function
+*              making the call
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luaprofile_java( lua_State * L , const char * name );
+
+
+/***************************************************************************
+*
+* $FC luajava_openprofile
+*
+* $ED Description
+*    registers profile in the table on top of the stack (the luajava
+*    table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openprofile( lua_State * L );
+
+#endif
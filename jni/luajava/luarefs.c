@@ -0,0 +1,619 @@
+/***************************************************************************
+*
+* $ED
+*    This module counts the JNI global references held by the userdata
+*    of Java objects, classes and functions, which are only deleted when
+*    the collector finalizes them. Global references are a limited
+*    resource, whose exhaustion aborts the virtual machine on Android.
+*
+*    Each state counts the references it holds, those it created and its
+*    high-water mark, and so does the process. The userdata of a state
+*    are linked in a list, through which references are counted by class
+*    when asked. Optionally, the lua traceback creating each reference is
+*    kept, and the tracebacks holding the most references are listed.
+*    From Lua:
+*
+*    luajava.refstats('traceback', 5)   -- capture, list top 5; 0 stops
+*    ...
+*    print(luajava.refstats 'report')
+*    local s = luajava.refstats()       -- s.live, s.high, s.classes...
+*    luajava.refstats 'reset'           -- high-water marks to live
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luarefs.h"
+
+
+/* Registry key of the accounting of a state */
+#define LUAREFSKEY            "luajava.refs"
+
+#define NO_HOLDER             ( -1 )
+#define OTHER_HOLDER          "(other tracebacks)"
+
+static const char * const refs_options[] = { "get" , "report" , "traceback" , "reset" , NULL };
+
+/* A creation traceback and the references it holds */
+typedef struct
+{
+   char * traceback;
+   unsigned int hash;
+   long live;
+   long high;
+} RefHolder;
+
+typedef struct LuaRefs
+{
+   LuaRef * first;
+   long live;
+   long high;
+   long created;
+   /* the state was closed: freed with its last reference */
+   int closed;
+   /* holders listed, 0 when tracebacks are not captured */
+   int top;
+   RefHolder * holders;
+   int nholders;
+   int holdersSize;
+} LuaRefs;
+
+/* References of all the states of the process */
+static volatile long processLive = 0;
+static volatile long processHigh = 0;
+static volatile long processCreated = 0;
+
+static LuaRefsNamer refsNamer = NULL;
+
+
+static void raiseHigh( volatile long * high , long live )
+{
+   long h;
+
+   while ( ( h = *high ) < live && !__sync_bool_compare_and_swap( high , h , live ) )
+      ;
+}
+
+
+static void freeRefs( LuaRefs * refs )
+{
+   int i;
+
+   for ( i = 0 ; i < refs->nholders ; i++ )
+      free( refs->holders[ i ].traceback );
+   free( refs->holders );
+   free( refs );
+}
+
+
+/***************************************************************************
+*
+*  Function: getRefs
+*  ****/
+
+/* NULL once the state is closing */
+static LuaRefs * getRefs( lua_State * L )
+{
+   LuaRefs ** p;
+
+   lua_getfield( L , LUA_REGISTRYINDEX , LUAREFSKEY );
+   p = ( LuaRefs ** ) lua_touserdata( L , -1 );
+   lua_pop( L , 1 );
+
+   if ( p == NULL )
+   {
+      LuaRefs * refs = ( LuaRefs * ) calloc( 1 , sizeof( LuaRefs ) );
+
+      if ( refs == NULL )
+      {
+         luaL_error( L , "not enough memory" );
+      }
+      p = ( LuaRefs ** ) lua_newuserdata( L , sizeof( LuaRefs * ) );
+      *p = refs;
+      luaL_getmetatable( L , LUAREFSKEY );
+      lua_setmetatable( L , -2 );
+      lua_setfield( L , LUA_REGISTRYINDEX , LUAREFSKEY );
+   }
+
+   return *p;
+}
+
+
+static LuaRefs * checkRefs( lua_State * L )
+{
+   LuaRefs * refs = getRefs( L );
+
+   if ( refs == NULL )
+   {
+      luaL_error( L , "lua state is closing" );
+   }
+
+   return refs;
+}
+
+
+/* Formats the traceback of the running function into tb */
+static void traceback( lua_State * L , char * tb , size_t size )
+{
+   lua_Debug ar;
+   size_t len = 0;
+   int level;
+
+   tb[ 0 ] = '\0';
+   for ( level = 0 ; level < LUAREFS_DEPTH && lua_getstack( L , level , &ar ) && len < size ; level++ )
+   {
+      char where[ LUA_IDSIZE + 16 ];
+      char what[ 96 ];
+
+      lua_getinfo( L , "Snl" , &ar );
+
+      if ( ar.currentline > 0 )
+         snprintf( where , sizeof( where ) , "%s:%d" , ar.short_src , ar.currentline );
+      else
+         snprintf( where , sizeof( where ) , "%s" , ar.short_src );
+
+      if ( *ar.namewhat != '\0' )
+         snprintf( what , sizeof( what ) , "function '%s'" , ar.name );
+      else if ( *ar.what == 'm' )
+         snprintf( what , sizeof( what ) , "main chunk" );
+      else if ( *ar.what == 'C' )
+         snprintf( what , sizeof( what ) , "?" );
+      else
+         snprintf( what , sizeof( what ) , "function <%s:%d>" , ar.short_src , ar.linedefined );
+
+      len += snprintf( tb + len , size - len , "%s%s: in %s" , level > 0 ? "\n" : "" , where , what );
+   }
+}
+
+
+/* The holder of a traceback, added if new */
+static int findHolder( LuaRefs * refs , const char * tb )
+{
+   unsigned int hash = 5381;
+   const char * c;
+   int i;
+
+   for ( c = tb ; *c ; c++ )
+      hash = hash * 33 + ( unsigned char ) *c;
+
+   for ( i = 0 ; i < refs->nholders ; i++ )
+   {
+      if ( refs->holders[ i ].hash == hash && strcmp( refs->holders[ i ].traceback , tb ) == 0 )
+         return i;
+   }
+
+   if ( refs->nholders == LUAREFS_HOLDERS - 1 )
+      tb = OTHER_HOLDER;
+   else if ( refs->nholders == LUAREFS_HOLDERS )
+      return LUAREFS_HOLDERS - 1;
+
+   if ( refs->nholders == refs->holdersSize )
+   {
+      int size = refs->holdersSize != 0 ? refs->holdersSize * 2 : 64;
+      RefHolder * holders = ( RefHolder * ) realloc( refs->holders , size * sizeof( RefHolder ) );
+
+      if ( holders == NULL )
+         return NO_HOLDER;
+      refs->holders = holders;
+      refs->holdersSize = size;
+   }
+
+   i = refs->nholders;
+   refs->holders[ i ].traceback = strdup( tb );
+   if ( refs->holders[ i ].traceback == NULL )
+      return NO_HOLDER;
+   refs->holders[ i ].hash = hash;
+   refs->holders[ i ].live = 0;
+   refs->holders[ i ].high = 0;
+   refs->nholders++;
+
+   return i;
+}
+
+
+/***************************************************************************
+*
+*  Function: luarefs_push
+*  ****/
+
+LuaRef * luarefs_push( lua_State * L , jobject object , int kind )
+{
+   LuaRefs * refs = getRefs( L );
+   LuaRef * ref = ( LuaRef * ) lua_newuserdata( L , sizeof( LuaRef ) );
+
+   ref->object = object;
+   ref->owner = refs;
+   ref->kind = kind;
+   ref->holder = NO_HOLDER;
+
+   /* pushed by a finalizer of the closing state: not counted */
+   if ( refs == NULL )
+      return ref;
+
+   ref->prev = NULL;
+   ref->next = refs->first;
+   if ( refs->first != NULL )
+      refs->first->prev = ref;
+   refs->first = ref;
+
+   refs->created++;
+   if ( ++refs->live > refs->high )
+      refs->high = refs->live;
+
+   __sync_fetch_and_add( &processCreated , 1 );
+   raiseHigh( &processHigh , __sync_add_and_fetch( &processLive , 1 ) );
+
+   if ( refs->top > 0 )
+   {
+      char tb[ LUAREFS_DEPTH * 128 ];
+
+      traceback( L , tb , sizeof( tb ) );
+      ref->holder = findHolder( refs , tb );
+      if ( ref->holder != NO_HOLDER )
+      {
+         RefHolder * h = &refs->holders[ ref->holder ];
+
+         if ( ++h->live > h->high )
+            h->high = h->live;
+      }
+   }
+
+   return ref;
+}
+
+
+/***************************************************************************
+*
+*  Function: luarefs_release
+*  ****/
+
+void luarefs_release( LuaRef * ref )
+{
+   LuaRefs * refs = ref->owner;
+
+   if ( refs == NULL )
+      return;
+   ref->owner = NULL;
+
+   if ( ref->prev != NULL )
+      ref->prev->next = ref->next;
+   else
+      refs->first = ref->next;
+   if ( ref->next != NULL )
+      ref->next->prev = ref->prev;
+
+   if ( ref->holder != NO_HOLDER )
+      refs->holders[ ref->holder ].live--;
+
+   refs->live--;
+   __sync_fetch_and_sub( &processLive , 1 );
+
+   if ( refs->closed && refs->live == 0 )
+      freeRefs( refs );
+}
+
+
+static int compareStrings( const void * a , const void * b )
+{
+   return strcmp( *( char * const * ) a , *( char * const * ) b );
+}
+
+
+/* Pushes a table of the number of references by class name. The names
+   are copied before any allocation of the state, whose collector may
+   release references meanwhile. */
+static void pushClasses( lua_State * L , LuaRefs * refs )
+{
+   char ** names = NULL;
+   LuaRef * ref;
+   long n = 0;
+   long i;
+
+   if ( refs->live > 0 && refsNamer != NULL )
+   {
+      names = ( char ** ) malloc( refs->live * sizeof( char * ) );
+      if ( names == NULL )
+      {
+         luaL_error( L , "not enough memory" );
+      }
+      for ( ref = refs->first ; ref != NULL ; ref = ref->next )
+      {
+         char buf[ 256 ];
+
+         names[ n ] = strdup( refsNamer( L , ref , buf , sizeof( buf ) ) );
+         if ( names[ n ] != NULL )
+            n++;
+      }
+      qsort( names , n , sizeof( char * ) , compareStrings );
+   }
+
+   lua_newtable( L );
+   for ( i = 0 ; i < n ; )
+   {
+      long j = i + 1;
+
+      while ( j < n && strcmp( names[ j ] , names[ i ] ) == 0 )
+         j++;
+      lua_pushnumber( L , ( lua_Number ) ( j - i ) );
+      lua_setfield( L , -2 , names[ i ] );
+      i = j;
+   }
+
+   for ( i = 0 ; i < n ; i++ )
+      free( names[ i ] );
+   free( names );
+}
+
+
+/* Holders sorted by the references they hold, most first */
+static int compareHolders( const void * a , const void * b )
+{
+   long x = ( ( const RefHolder * ) a )->live;
+   long y = ( ( const RefHolder * ) b )->live;
+
+   return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+/* Pushes an array of the top holders, { traceback = , live = , high = } */
+static void pushHolders( lua_State * L , LuaRefs * refs )
+{
+   RefHolder * sorted = NULL;
+   int n = refs->nholders;
+   int i;
+
+   if ( n > 0 )
+   {
+      sorted = ( RefHolder * ) malloc( n * sizeof( RefHolder ) );
+      if ( sorted == NULL )
+      {
+         luaL_error( L , "not enough memory" );
+      }
+      memcpy( sorted , refs->holders , n * sizeof( RefHolder ) );
+      qsort( sorted , n , sizeof( RefHolder ) , compareHolders );
+      if ( n > refs->top )
+         n = refs->top;
+   }
+
+   /* tracebacks stay allocated while the state is open */
+   lua_createtable( L , n , 0 );
+   for ( i = 0 ; i < n && sorted[ i ].live > 0 ; i++ )
+   {
+      lua_createtable( L , 0 , 3 );
+      lua_pushstring( L , sorted[ i ].traceback );
+      lua_setfield( L , -2 , "traceback" );
+      lua_pushnumber( L , ( lua_Number ) sorted[ i ].live );
+      lua_setfield( L , -2 , "live" );
+      lua_pushnumber( L , ( lua_Number ) sorted[ i ].high );
+      lua_setfield( L , -2 , "high" );
+      lua_rawseti( L , -2 , i + 1 );
+   }
+
+   free( sorted );
+}
+
+
+static void pushStats( lua_State * L , LuaRefs * refs )
+{
+   lua_createtable( L , 0 , 6 );
+
+   lua_pushnumber( L , ( lua_Number ) refs->live );
+   lua_setfield( L , -2 , "live" );
+   lua_pushnumber( L , ( lua_Number ) refs->high );
+   lua_setfield( L , -2 , "high" );
+   lua_pushnumber( L , ( lua_Number ) refs->created );
+   lua_setfield( L , -2 , "created" );
+
+   lua_createtable( L , 0 , 3 );
+   lua_pushnumber( L , ( lua_Number ) processLive );
+   lua_setfield( L , -2 , "live" );
+   lua_pushnumber( L , ( lua_Number ) processHigh );
+   lua_setfield( L , -2 , "high" );
+   lua_pushnumber( L , ( lua_Number ) processCreated );
+   lua_setfield( L , -2 , "created" );
+   lua_setfield( L , -2 , "process" );
+
+   pushClasses( L , refs );
+   lua_setfield( L , -2 , "classes" );
+
+   pushHolders( L , refs );
+   lua_setfield( L , -2 , "holders" );
+}
+
+
+typedef struct
+{
+   const char * name;
+   lua_Number count;
+} ClassLine;
+
+
+static int compareClasses( const void * a , const void * b )
+{
+   lua_Number x = ( ( const ClassLine * ) a )->count;
+   lua_Number y = ( ( const ClassLine * ) b )->count;
+
+   return x < y ? 1 : x > y ? -1 : strcmp( ( ( const ClassLine * ) a )->name , ( ( const ClassLine * ) b )->name );
+}
+
+
+/***************************************************************************
+*
+*  Function: luarefs_report
+*  ****/
+
+void luarefs_report( lua_State * L )
+{
+   LuaRefs * refs = checkRefs( L );
+   ClassLine * lines;
+   luaL_Buffer b;
+   char line[ 160 ];
+   int stats;
+   int n = 0;
+   int i;
+
+   pushStats( L , refs );
+   stats = lua_gettop( L );
+
+   lua_getfield( L , stats , "classes" );
+   lua_pushnil( L );
+   while ( lua_next( L , -2 ) )
+   {
+      n++;
+      lua_pop( L , 1 );
+   }
+   lines = ( ClassLine * ) malloc( ( n + 1 ) * sizeof( ClassLine ) );
+   if ( lines == NULL )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   n = 0;
+   lua_pushnil( L );
+   while ( lua_next( L , -2 ) )
+   {
+      lines[ n ].name = lua_tostring( L , -2 );
+      lines[ n ].count = lua_tonumber( L , -1 );
+      n++;
+      lua_pop( L , 1 );
+   }
+   qsort( lines , n , sizeof( ClassLine ) , compareClasses );
+
+   luaL_buffinit( L , &b );
+
+   snprintf( line , sizeof( line ) , "%-48s %10s %10s %12s\n" , "global references" , "live" , "high" ,
+             "created" );
+   luaL_addstring( &b , line );
+   snprintf( line , sizeof( line ) , "%-48s %10ld %10ld %12ld\n" , "state" , refs->live , refs->high ,
+             refs->created );
+   luaL_addstring( &b , line );
+   snprintf( line , sizeof( line ) , "%-48s %10ld %10ld %12ld\n" , "process" , ( long ) processLive ,
+             ( long ) processHigh , ( long ) processCreated );
+   luaL_addstring( &b , line );
+
+   if ( n > 0 )
+   {
+      snprintf( line , sizeof( line ) , "\n%-48s %10s\n" , "class" , "live" );
+      luaL_addstring( &b , line );
+      for ( i = 0 ; i < n ; i++ )
+      {
+         snprintf( line , sizeof( line ) , "%-48.48s %10.0f\n" , lines[ i ].name , lines[ i ].count );
+         luaL_addstring( &b , line );
+      }
+   }
+   free( lines );
+
+   lua_getfield( L , stats , "holders" );
+   n = ( int ) lua_objlen( L , -1 );
+   for ( i = 1 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , -1 , i );
+      lua_getfield( L , -1 , "live" );
+      lua_getfield( L , -2 , "high" );
+      snprintf( line , sizeof( line ) , "\n%ld live (high %ld) created at:\n" , ( long ) lua_tonumber( L , -2 ) ,
+                ( long ) lua_tonumber( L , -1 ) );
+      lua_pop( L , 2 );
+      luaL_addstring( &b , line );
+      lua_getfield( L , -1 , "traceback" );
+      luaL_addstring( &b , lua_tostring( L , -1 ) );
+      luaL_addchar( &b , '\n' );
+      lua_pop( L , 2 );
+   }
+   lua_pop( L , 1 );
+
+   luaL_pushresult( &b );
+   lua_replace( L , stats );
+   lua_settop( L , stats );
+}
+
+
+/***************************************************************************
+*
+*  Lua interface
+*
+*****************************************************************************/
+
+/***************************************************************************
+*
+*  Function: refsGc
+*  ****/
+
+static int refsGc( lua_State * L )
+{
+   LuaRefs ** p = ( LuaRefs ** ) lua_touserdata( L , 1 );
+   LuaRefs * refs = *p;
+
+   /* references still held are released later in the closing */
+   *p = NULL;
+   refs->closed = 1;
+   if ( refs->live == 0 )
+      freeRefs( refs );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.refstats
+*  ****/
+
+static int refstats( lua_State * L )
+{
+   LuaRefs * refs = checkRefs( L );
+
+   switch ( luaL_checkoption( L , 1 , "get" , refs_options ) )
+   {
+      case 1:
+         luarefs_report( L );
+         return 1;
+
+      case 2:
+      {
+         int top = luaL_optint( L , 2 , LUAREFS_TOP );
+
+         luaL_argcheck( L , top >= 0 , 2 , "number of holders must not be negative" );
+         lua_pushinteger( L , refs->top );
+         refs->top = top;
+         return 1;
+      }
+
+      case 3:
+      {
+         int i;
+
+         refs->high = refs->live;
+         processHigh = processLive;
+         for ( i = 0 ; i < refs->nholders ; i++ )
+            refs->holders[ i ].high = refs->holders[ i ].live;
+         return 0;
+      }
+   }
+
+   pushStats( L , refs );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openrefs
+*  ****/
+
+void luajava_openrefs( lua_State * L , LuaRefsNamer namer )
+{
+   refsNamer = namer;
+
+   luaL_newmetatable( L , LUAREFSKEY );
+   lua_pushcfunction( L , &refsGc );
+   lua_setfield( L , -2 , "__gc" );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "refstats" );
+   lua_pushcfunction( L , &refstats );
+   lua_settable( L , -3 );
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+*
+* $ED
+*    Accounting of the JNI global references held by lua States, see
+*    luarefs.c.
+*
+*****************************************************************************/
+
+#ifndef LUAREFS_H
+#define LUAREFS_H
+
+#include <stddef.h>
+#include <jni.h>
+
+#include "lua.h"
+
+/* What a reference is pushed as */
+#define LUAREFS_OBJECT        0
+#define LUAREFS_CLASS         1
+#define LUAREFS_FUNCTION      2
+
+/* Default number of holders listed while tracebacks are captured */
+#define LUAREFS_TOP           10
+/* Distinct creation tracebacks kept; further ones share one holder */
+#define LUAREFS_HOLDERS       1024
+/* Lua frames kept in a creation traceback */
+#define LUAREFS_DEPTH         12
+
+struct LuaRefs;
+
+/* The userdata of a Java object, class or function. Its global
+   reference comes first, so that the bridge reads it as a jobject. */
+typedef struct LuaRef
+{
+   jobject object;
+   struct LuaRef * prev;
+   struct LuaRef * next;
+   struct LuaRefs * owner;
+   int kind;
+   int holder;
+} LuaRef;
+
+/* Writes the name of the class of a reference to buf, returning buf */
+typedef const char * ( *LuaRefsNamer )( lua_State * L , LuaRef * ref , char * buf , size_t size );
+
+
+/***************************************************************************
+*
+* $FC luarefs_push
+*
+* $ED Description
+*    pushes a new userdata holding a global reference, and counts the
+*    reference as held by the state until luarefs_release
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P object - the global reference
+*    $P kind - LUAREFS_OBJECT, LUAREFS_CLASS or LUAREFS_FUNCTION
+*
+* $FV Returned Value
+*    LuaRef * - the userdata
+*
+*$. **********************************************************************/
+
+LuaRef * luarefs_push( lua_State * L , jobject object , int kind );
+
+
+/***************************************************************************
+*
+* $FC luarefs_release
+*
+* $ED Description
+*    counts the global reference of a userdata as deleted, to be called
+*    once by its __gc metamethod
+*
+* $EP Function Parameters
+*    $P ref - the userdata
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luarefs_release( LuaRef * ref );
+
+
+/***************************************************************************
+*
+* $FC luarefs_report
+*
+* $ED Description
+*    pushes the global references held by the state and by the process,
+*    formatted for people to read: counts and high-water marks, live
+*    references by class, then the creation tracebacks holding the most
+*    references
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luarefs_report( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luajava_openrefs
+*
+* $ED Description
+*    registers refstats in the table on top of the stack (the luajava
+*    table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P namer - gives the class names of references
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openrefs( lua_State * L , LuaRefsNamer namer );
+
+#endif
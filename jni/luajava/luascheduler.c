@@ -0,0 +1,1000 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.spawn, a work-stealing scheduler for
+*    lua tasks.
+*
+*    One worker thread per core is started on first use, each owning a
+*    plain lua State with the standard libraries and the luajava channel,
+*    serialization and scheduler functions (the Java bridge is not
+*    available to tasks). A task is a dumped lua function together with
+*    its serialized arguments, so nothing is shared between States.
+*
+*    Every worker has a deque of ready tasks. Tasks spawned by a worker go
+*    to the bottom of its own deque and are popped from there (LIFO, which
+*    keeps related work hot); tasks spawned from other threads are dealt
+*    round robin. An idle worker steals from the top of the others' deques
+*    and sleeps when no task is pending anywhere. A worker waiting for a
+*    task keeps running other tasks meanwhile, so joins inside tasks do not
+*    block the pool.
+*
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#include "luachannel.h"
+#include "luaserialize.h"
+#include "luascheduler.h"
+#include "luaparallel.h"
+
+
+/* Initial capacity of a worker deque */
+#define SCHEDULER_DEQUESIZE  64
+/* Kilobytes of incremental collection after each task */
+#define SCHEDULER_GCSTEP     16
+
+struct LuaTask
+{
+   lua_CFunction native;
+   void * ud;
+   SerializeBuffer code;
+   SerializeBuffer args;
+   SerializeBuffer result;
+   volatile int state;
+   volatile int refs;
+};
+
+typedef struct
+{
+   pthread_mutex_t lock;
+   LuaTask ** items;
+   size_t head;
+   size_t count;
+   size_t size;
+   lua_State * L;
+   pthread_t thread;
+   int index;
+} Worker;
+
+static Worker * workers = NULL;
+static int nworkers = 0;
+static pthread_once_t scheduler_once = PTHREAD_ONCE_INIT;
+static pthread_key_t worker_key;
+
+/* Number of tasks sitting in deques; workers sleep on wake_cond when 0 */
+static volatile int pending = 0;
+static volatile unsigned int next_worker = 0;
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+
+/* Broadcast whenever a task finishes */
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+
+/***************************************************************************
+*
+* $FC startScheduler
+*
+* $ED Description
+*    creates the worker States and threads, once per process
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void startScheduler( void );
+
+
+/***************************************************************************
+*
+* $FC findTask
+*
+* $ED Description
+*    pops a task from the worker's own deque, or steals one from another
+*    worker
+*
+* $EP Function Parameters
+*    $P self - calling worker
+*
+* $FV Returned Value
+*    LuaTask * - a task, or NULL if none is ready
+*
+*$. **********************************************************************/
+
+   static LuaTask * findTask( Worker * self );
+
+
+/***************************************************************************
+*
+* $FC runTask
+*
+* $ED Description
+*    runs a task in the worker's State and publishes its results
+*
+* $EP Function Parameters
+*    $P self - calling worker
+*    $P task - task taken from a deque
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void runTask( Worker * self , LuaTask * task );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: packValues
+*  ****/
+
+static int packValues( lua_State * L , int first , int n , SerializeBuffer * buf )
+{
+   int i , status;
+
+   lua_createtable( L , n , 1 );
+   for ( i = 0 ; i < n ; i++ )
+   {
+      lua_pushvalue( L , first + i );
+      lua_rawseti( L , -2 , i + 1 );
+   }
+   lua_pushinteger( L , n );
+   lua_setfield( L , -2 , "n" );
+
+   /* on error the caller frees what it allocated */
+   status = luajava_serializeto( L , -1 , buf );
+   lua_remove( L , ( status == 0 ) ? -1 : -2 );
+
+   return status;
+}
+
+
+/***************************************************************************
+*
+*  Function: unpackValues
+*  ****/
+
+static int unpackValues( lua_State * L , const char * data , size_t len )
+{
+   int n , i , t;
+
+   luajava_deserialize( L , data , len );
+   t = lua_gettop( L );
+
+   lua_getfield( L , t , "n" );
+   n = ( int ) lua_tointeger( L , -1 );
+   lua_pop( L , 1 );
+
+   luaL_checkstack( L , n , "too many task values" );
+   for ( i = 1 ; i <= n ; i++ )
+   {
+      lua_rawgeti( L , t , i );
+   }
+   lua_remove( L , t );
+
+   return n;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskFree
+*  ****/
+
+static void taskFree( LuaTask * task )
+{
+   free( task->code.data );
+   free( task->args.data );
+   free( task->result.data );
+   free( task );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_taskrelease
+*  ****/
+
+void luajava_taskrelease( LuaTask * task )
+{
+   if ( __sync_sub_and_fetch( &task->refs , 1 ) == 0 )
+   {
+      taskFree( task );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_taskretain
+*  ****/
+
+void luajava_taskretain( LuaTask * task )
+{
+   __sync_add_and_fetch( &task->refs , 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: dequePush
+*  ****/
+
+static int dequePush( Worker * w , LuaTask * task )
+{
+   pthread_mutex_lock( &w->lock );
+
+   if ( w->count == w->size )
+   {
+      LuaTask ** items = ( LuaTask ** ) malloc( 2 * w->size * sizeof( LuaTask * ) );
+      size_t i;
+
+      if ( items == NULL )
+      {
+         pthread_mutex_unlock( &w->lock );
+         return 0;
+      }
+      for ( i = 0 ; i < w->count ; i++ )
+      {
+         items[ i ] = w->items[ ( w->head + i ) % w->size ];
+      }
+      free( w->items );
+      w->items = items;
+      w->head  = 0;
+      w->size *= 2;
+   }
+
+   w->items[ ( w->head + w->count ) % w->size ] = task;
+   w->count++;
+
+   pthread_mutex_unlock( &w->lock );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: dequePop
+*  ****/
+
+static LuaTask * dequePop( Worker * w )
+{
+   LuaTask * task = NULL;
+
+   pthread_mutex_lock( &w->lock );
+   if ( w->count > 0 )
+   {
+      w->count--;
+      task = w->items[ ( w->head + w->count ) % w->size ];
+   }
+   pthread_mutex_unlock( &w->lock );
+
+   return task;
+}
+
+
+/***************************************************************************
+*
+*  Function: dequeSteal
+*  ****/
+
+static LuaTask * dequeSteal( Worker * w )
+{
+   LuaTask * task = NULL;
+
+   pthread_mutex_lock( &w->lock );
+   if ( w->count > 0 )
+   {
+      task = w->items[ w->head ];
+      w->head = ( w->head + 1 ) % w->size;
+      w->count--;
+   }
+   pthread_mutex_unlock( &w->lock );
+
+   return task;
+}
+
+
+/***************************************************************************
+*
+*  Function: findTask
+*  ****/
+
+LuaTask * findTask( Worker * self )
+{
+   LuaTask * task = dequePop( self );
+   int i;
+
+   for ( i = 1 ; task == NULL && i < nworkers ; i++ )
+   {
+      task = dequeSteal( &workers[ ( self->index + i ) % nworkers ] );
+   }
+
+   if ( task != NULL )
+   {
+      __sync_sub_and_fetch( &pending , 1 );
+   }
+
+   return task;
+}
+
+
+/***************************************************************************
+*
+*  Function: runProtected
+*  ****/
+
+static int runProtected( lua_State * L )
+{
+   LuaTask * task = ( LuaTask * ) lua_touserdata( L , 1 );
+
+   lua_settop( L , 0 );
+
+   if ( task->native != NULL )
+   {
+      lua_pushcfunction( L , task->native );
+      lua_pushlightuserdata( L , task->ud );
+      lua_call( L , 1 , 0 );
+      return 0;
+   }
+
+   if ( luaL_loadbuffer( L , task->code.data , task->code.len , "=task" ) != 0 )
+   {
+      return lua_error( L );
+   }
+   unpackValues( L , task->args.data , task->args.len );
+
+   lua_call( L , lua_gettop( L ) - 1 , LUA_MULTRET );
+
+   if ( packValues( L , 1 , lua_gettop( L ) , &task->result ) != 0 )
+   {
+      return lua_error( L );
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: runTask
+*  ****/
+
+void runTask( Worker * self , LuaTask * task )
+{
+   lua_State * L = self->L;
+   int top = lua_gettop( L );
+   int state = LUATASK_DONE;
+
+   lua_pushcfunction( L , &runProtected );
+   lua_pushlightuserdata( L , task );
+
+   if ( lua_pcall( L , 1 , 0 , 0 ) != 0 )
+   {
+      size_t len;
+      const char * msg = lua_tolstring( L , -1 , &len );
+
+      if ( msg == NULL )
+      {
+         msg = "task failed";
+         len = strlen( msg );
+      }
+
+      free( task->result.data );
+      task->result.data = ( char * ) malloc( len + 1 );
+      task->result.len  = 0;
+      task->result.size = 0;
+      if ( task->result.data != NULL )
+      {
+         memcpy( task->result.data , msg , len + 1 );
+         task->result.len = len;
+      }
+      state = LUATASK_ERROR;
+   }
+
+   lua_settop( L , top );
+   lua_gc( L , LUA_GCSTEP , SCHEDULER_GCSTEP );
+
+   pthread_mutex_lock( &done_mutex );
+   task->state = state;
+   pthread_cond_broadcast( &done_cond );
+   pthread_mutex_unlock( &done_mutex );
+
+   luajava_taskrelease( task );
+}
+
+
+/***************************************************************************
+*
+*  Function: workerMain
+*  ****/
+
+static void * workerMain( void * arg )
+{
+   Worker * self = ( Worker * ) arg;
+   LuaTask * task;
+
+   pthread_setspecific( worker_key , self );
+
+   for ( ;; )
+   {
+      task = findTask( self );
+      if ( task != NULL )
+      {
+         runTask( self , task );
+         continue;
+      }
+
+      pthread_mutex_lock( &wake_mutex );
+      while ( pending == 0 )
+      {
+         pthread_cond_wait( &wake_cond , &wake_mutex );
+      }
+      pthread_mutex_unlock( &wake_mutex );
+   }
+
+   return NULL;
+}
+
+
+/***************************************************************************
+*
+*  Function: startScheduler
+*  ****/
+
+void startScheduler( void )
+{
+   long n = sysconf( _SC_NPROCESSORS_ONLN );
+   int i;
+
+   if ( n < 1 )
+   {
+      n = 1;
+   }
+
+   pthread_key_create( &worker_key , NULL );
+
+   workers = ( Worker * ) calloc( ( size_t ) n , sizeof( Worker ) );
+   if ( workers == NULL )
+   {
+      return;
+   }
+
+   for ( i = 0 ; i < n ; i++ )
+   {
+      Worker * w = &workers[ i ];
+
+      pthread_mutex_init( &w->lock , NULL );
+      w->size  = SCHEDULER_DEQUESIZE;
+      w->items = ( LuaTask ** ) malloc( w->size * sizeof( LuaTask * ) );
+      w->index = i;
+      w->L     = luaL_newstate();
+      if ( w->items == NULL || w->L == NULL )
+      {
+         break;
+      }
+
+      luaL_openlibs( w->L );
+      lua_newtable( w->L );
+      luajava_openchannel( w->L );
+      luajava_openserialize( w->L );
+      luajava_openscheduler( w->L );
+      luajava_openparallel( w->L );
+      lua_setglobal( w->L , "luajava" );
+   }
+
+   /* workers are started only once all of them are set up, since they
+      steal from each other */
+   nworkers = i;
+   for ( i = 0 ; i < nworkers ; i++ )
+   {
+      if ( pthread_create( &workers[ i ].thread , NULL , &workerMain , &workers[ i ] ) != 0 )
+      {
+         break;
+      }
+   }
+   if ( i < nworkers )
+   {
+      /* workers without a thread are dropped: findTask and dealing
+         only use the first nworkers deques, and nothing has been dealt
+         to the dropped ones yet */
+      nworkers = ( i > 0 ) ? i : 0;
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_workers
+*  ****/
+
+int luajava_workers( void )
+{
+   pthread_once( &scheduler_once , &startScheduler );
+
+   return nworkers;
+}
+
+
+/***************************************************************************
+*
+*  Function: enqueueTask
+*  ****/
+
+static int enqueueTask( LuaTask * task )
+{
+   Worker * target;
+
+   task->state = LUATASK_PENDING;
+   task->refs  = 2;
+
+   target = ( Worker * ) pthread_getspecific( worker_key );
+   if ( target == NULL )
+   {
+      target = &workers[ __sync_fetch_and_add( &next_worker , 1 ) % nworkers ];
+   }
+
+   if ( !dequePush( target , task ) )
+   {
+      taskFree( task );
+      return 0;
+   }
+
+   __sync_add_and_fetch( &pending , 1 );
+   pthread_mutex_lock( &wake_mutex );
+   pthread_cond_signal( &wake_cond );
+   pthread_mutex_unlock( &wake_mutex );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_spawn
+*  ****/
+
+LuaTask * luajava_spawn( lua_State * L , int func , int nargs )
+{
+   LuaTask * task;
+
+   if ( func < 0 && func > LUA_REGISTRYINDEX )
+   {
+      func = lua_gettop( L ) + func + 1;
+   }
+
+   if ( luajava_workers() == 0 )
+   {
+      luaL_error( L , "could not start the scheduler" );
+   }
+
+   if ( lua_type( L , func ) != LUA_TSTRING )
+   {
+      if ( !lua_isfunction( L , func ) || lua_iscfunction( L , func ) )
+      {
+         luaL_typerror( L , func , "lua function or source string" );
+      }
+      if ( lua_getupvalue( L , func , 1 ) != NULL )
+      {
+         luaL_argerror( L , func , "spawned functions cannot have upvalues" );
+      }
+   }
+
+   task = ( LuaTask * ) calloc( 1 , sizeof( LuaTask ) );
+   if ( task == NULL )
+   {
+      luaL_error( L , "not enough memory for task" );
+   }
+
+   if ( lua_type( L , func ) == LUA_TSTRING )
+   {
+      size_t len;
+      const char * s = lua_tolstring( L , func , &len );
+
+      luajava_bufferwriter( L , s , len , &task->code );
+   }
+   else
+   {
+      lua_pushvalue( L , func );
+      lua_dump( L , luajava_bufferwriter , &task->code );
+      lua_pop( L , 1 );
+   }
+
+   if ( task->code.data == NULL )
+   {
+      free( task );
+      luaL_error( L , "not enough memory for task" );
+   }
+
+   if ( packValues( L , func + 1 , nargs , &task->args ) != 0 )
+   {
+      taskFree( task );
+      lua_error( L );
+   }
+
+   if ( !enqueueTask( task ) )
+   {
+      luaL_error( L , "not enough memory for task" );
+   }
+
+   return task;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_spawnnative
+*  ****/
+
+LuaTask * luajava_spawnnative( lua_CFunction fn , void * ud )
+{
+   LuaTask * task;
+
+   if ( luajava_workers() == 0 )
+   {
+      return NULL;
+   }
+
+   task = ( LuaTask * ) calloc( 1 , sizeof( LuaTask ) );
+   if ( task == NULL )
+   {
+      return NULL;
+   }
+
+   task->native = fn;
+   task->ud     = ud;
+
+   return enqueueTask( task ) ? task : NULL;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskState
+*  ****/
+
+static int taskState( LuaTask * task )
+{
+   __sync_synchronize();
+
+   return task->state;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_taskwait
+*  ****/
+
+int luajava_taskwait( LuaTask * task , long millis )
+{
+   Worker * self = ( Worker * ) pthread_getspecific( worker_key );
+   struct timespec deadline;
+   struct timeval now;
+   int state;
+
+   gettimeofday( &now , NULL );
+   deadline.tv_sec  = now.tv_sec + ( ( millis > 0 ) ? millis / 1000 : 0 );
+   deadline.tv_nsec = now.tv_usec * 1000L + ( ( millis > 0 ) ? ( millis % 1000 ) * 1000000L : 0 );
+   if ( deadline.tv_nsec >= 1000000000L )
+   {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+   }
+
+   while ( ( state = taskState( task ) ) == LUATASK_PENDING )
+   {
+      if ( self != NULL )
+      {
+         LuaTask * other = findTask( self );
+
+         if ( other != NULL )
+         {
+            runTask( self , other );
+            continue;
+         }
+      }
+
+      if ( millis == 0 )
+      {
+         break;
+      }
+
+      pthread_mutex_lock( &done_mutex );
+      if ( task->state == LUATASK_PENDING )
+      {
+         if ( self != NULL )
+         {
+            /* wake up regularly to look for tasks to help with */
+            struct timespec shortWait;
+
+            gettimeofday( &now , NULL );
+            shortWait.tv_sec  = now.tv_sec;
+            shortWait.tv_nsec = now.tv_usec * 1000L + 1000000L;
+            if ( shortWait.tv_nsec >= 1000000000L )
+            {
+               shortWait.tv_sec++;
+               shortWait.tv_nsec -= 1000000000L;
+            }
+            if ( millis > 0 && ( shortWait.tv_sec > deadline.tv_sec ||
+                 ( shortWait.tv_sec == deadline.tv_sec && shortWait.tv_nsec > deadline.tv_nsec ) ) )
+            {
+               shortWait = deadline;
+            }
+            pthread_cond_timedwait( &done_cond , &done_mutex , &shortWait );
+         }
+         else if ( millis < 0 )
+         {
+            pthread_cond_wait( &done_cond , &done_mutex );
+         }
+         else if ( pthread_cond_timedwait( &done_cond , &done_mutex , &deadline ) == ETIMEDOUT )
+         {
+            pthread_mutex_unlock( &done_mutex );
+            return taskState( task );
+         }
+      }
+      pthread_mutex_unlock( &done_mutex );
+
+      if ( millis > 0 && self != NULL )
+      {
+         gettimeofday( &now , NULL );
+         if ( now.tv_sec > deadline.tv_sec ||
+              ( now.tv_sec == deadline.tv_sec && now.tv_usec * 1000L >= deadline.tv_nsec ) )
+         {
+            return taskState( task );
+         }
+      }
+   }
+
+   return state;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_taskresult
+*  ****/
+
+const char * luajava_taskresult( LuaTask * task , size_t * len )
+{
+   *len = task->result.len;
+
+   return task->result.data;
+}
+
+
+/***************************************************************************
+*
+*  Function: checkTask
+*  ****/
+
+static LuaTask * checkTask( lua_State * L , int idx )
+{
+   LuaTask ** ud = ( LuaTask ** ) luaL_checkudata( L , idx , LUAJAVATASKMETATABLE );
+
+   if ( *ud == NULL )
+   {
+      luaL_argerror( L , idx , "released task" );
+   }
+
+   return *ud;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskJoin
+*  ****/
+
+static int taskJoin( lua_State * L )
+{
+   LuaTask * task = checkTask( L , 1 );
+   const char * data;
+   size_t len;
+   int state = luajava_taskwait( task , -1 );
+
+   data = luajava_taskresult( task , &len );
+   if ( state == LUATASK_ERROR )
+   {
+      lua_pushlstring( L , ( data != NULL ) ? data : "task failed" , ( data != NULL ) ? len : 11 );
+      return lua_error( L );
+   }
+
+   lua_settop( L , 0 );
+   return unpackValues( L , data , len );
+}
+
+
+/***************************************************************************
+*
+*  Function: taskDone
+*  ****/
+
+static int taskDone( lua_State * L )
+{
+   LuaTask * task = checkTask( L , 1 );
+
+   lua_pushboolean( L , taskState( task ) != LUATASK_PENDING );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskGc
+*  ****/
+
+static int taskGc( lua_State * L )
+{
+   LuaTask ** ud = ( LuaTask ** ) luaL_checkudata( L , 1 , LUAJAVATASKMETATABLE );
+
+   if ( *ud != NULL )
+   {
+      luajava_taskrelease( *ud );
+      *ud = NULL;
+   }
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: taskToString
+*  ****/
+
+static int taskToString( lua_State * L )
+{
+   LuaTask * task = checkTask( L , 1 );
+   static const char * const names[] = { "pending" , "done" , "error" };
+
+   lua_pushfstring( L , "task (%s): %p" , names[ taskState( task ) ] , task );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luaSpawn
+*  ****/
+
+static int luaSpawn( lua_State * L )
+{
+   LuaTask ** ud;
+   int nargs;
+
+   luaL_checkany( L , 1 );
+   nargs = lua_gettop( L ) - 1;
+
+   /* the userdata comes first, so that a memory error raised while
+      creating it cannot leak a task already queued */
+   ud = ( LuaTask ** ) lua_newuserdata( L , sizeof( LuaTask * ) );
+   *ud = NULL;
+   luaL_getmetatable( L , LUAJAVATASKMETATABLE );
+   lua_setmetatable( L , -2 );
+
+   *ud = luajava_spawn( L , 1 , nargs );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luaWorkers
+*  ****/
+
+static int luaWorkers( lua_State * L )
+{
+   lua_pushinteger( L , luajava_workers() );
+
+   return 1;
+}
+
+
+/* Inside a coroutine await yields until the task is done, so a coroutine
+   scheduler can go on with other work; elsewhere it is the same as join.
+   The coroutine library is looked up on each call since luajava_open runs
+   before the libraries are opened. */
+static const char awaitSource[] =
+   "local join, done = ...\n"
+   "return function(task)\n"
+   "  if coroutine.running() then\n"
+   "    while not done(task) do coroutine.yield() end\n"
+   "  end\n"
+   "  return join(task)\n"
+   "end\n";
+
+
+/***************************************************************************
+*
+*  Function: luajava_openscheduler
+*  ****/
+
+void luajava_openscheduler( lua_State * L )
+{
+   luaL_newmetatable( L , LUAJAVATASKMETATABLE );
+
+   lua_pushstring( L , "__gc" );
+   lua_pushcfunction( L , &taskGc );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__tostring" );
+   lua_pushcfunction( L , &taskToString );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "__index" );
+   lua_newtable( L );
+
+   lua_pushstring( L , "join" );
+   lua_pushcfunction( L , &taskJoin );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "done" );
+   lua_pushcfunction( L , &taskDone );
+   lua_rawset( L , -3 );
+
+   lua_pushstring( L , "await" );
+   if ( luaL_loadbuffer( L , awaitSource , sizeof( awaitSource ) - 1 , "=await" ) == 0 )
+   {
+      lua_pushcfunction( L , &taskJoin );
+      lua_pushcfunction( L , &taskDone );
+      lua_call( L , 2 , 1 );
+   }
+   lua_rawset( L , -3 );
+
+   lua_rawset( L , -3 );
+
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "spawn" );
+   lua_pushcfunction( L , &luaSpawn );
+   lua_settable( L , -3 );
+
+   lua_pushstring( L , "workers" );
+   lua_pushcfunction( L , &luaWorkers );
+   lua_settable( L , -3 );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_taskspawn
+*  ****/
+
+int luajava_taskspawn( lua_State * L )
+{
+   return luaSpawn( L );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_checktask
+*  ****/
+
+LuaTask * luajava_checktask( lua_State * L , int idx )
+{
+   LuaTask * task = checkTask( L , idx );
+
+   luajava_taskretain( task );
+
+   return task;
+}
@@ -0,0 +1,222 @@
+/***************************************************************************
+*
+* $ED
+*    Work-stealing scheduler running lua tasks on one worker thread per
+*    core, each worker owning its own lua State.
+*
+*****************************************************************************/
+
+#ifndef LUASCHEDULER_H
+#define LUASCHEDULER_H
+
+#include <stddef.h>
+
+#include "lua.h"
+
+/* Metatable name of task userdata */
+#define LUAJAVATASKMETATABLE "luajava.task"
+
+/* Task states */
+#define LUATASK_PENDING   0
+#define LUATASK_DONE      1
+#define LUATASK_ERROR     2
+
+typedef struct LuaTask LuaTask;
+
+
+/***************************************************************************
+*
+* $FC luajava_spawn
+*
+* $ED Description
+*    spawns the function at stack index func called with the nargs values
+*    that follow it. The function is dumped and the arguments serialized,
+*    so the function must be a lua function without upvalues (or a string
+*    with lua source) and the arguments must be serializable. Raises a lua
+*    error otherwise. The values are left on the stack.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P func - stack index of the function
+*    $P nargs - number of arguments after the function
+*
+* $FV Returned Value
+*    LuaTask * - the task, holding one reference for the caller
+*
+*$. **********************************************************************/
+
+LuaTask * luajava_spawn( lua_State * L , int func , int nargs );
+
+
+/***************************************************************************
+*
+* $FC luajava_spawnnative
+*
+* $ED Description
+*    spawns a C function that is called in a worker State with ud as a
+*    light userdata. The function reports its results through ud; errors
+*    it raises make the task fail with their message.
+*
+* $EP Function Parameters
+*    $P fn - function to run
+*    $P ud - its argument
+*
+* $FV Returned Value
+*    LuaTask * - the task holding one reference for the caller, or NULL
+*                if it could not be created
+*
+*$. **********************************************************************/
+
+LuaTask * luajava_spawnnative( lua_CFunction fn , void * ud );
+
+
+/***************************************************************************
+*
+* $FC luajava_taskwait
+*
+* $ED Description
+*    waits for a task to finish. On a worker thread other tasks are run
+*    while waiting, so joining from a task cannot starve the pool.
+*
+* $EP Function Parameters
+*    $P task - task
+*    $P millis - maximum time to wait, or a negative value for no limit
+*
+* $FV Returned Value
+*    int - the task state, LUATASK_PENDING if the time ran out
+*
+*$. **********************************************************************/
+
+int luajava_taskwait( LuaTask * task , long millis );
+
+
+/***************************************************************************
+*
+* $FC luajava_taskresult
+*
+* $ED Description
+*    returns the results of a finished task, serialized as a table holding
+*    the values at keys 1..n and their count in n, or the error message if
+*    the task failed. The data belongs to the task.
+*
+* $EP Function Parameters
+*    $P task - finished task
+*    $P len - receives the length of the data
+*
+* $FV Returned Value
+*    const char * - serialized results or error message
+*
+*$. **********************************************************************/
+
+const char * luajava_taskresult( LuaTask * task , size_t * len );
+
+
+/***************************************************************************
+*
+* $FC luajava_taskrelease
+*
+* $ED Description
+*    drops the caller's reference to a task
+*
+* $EP Function Parameters
+*    $P task - task
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_taskrelease( LuaTask * task );
+
+
+/***************************************************************************
+*
+* $FC luajava_taskretain
+*
+* $ED Description
+*    adds a reference to a task, dropped with luajava_taskrelease
+*
+* $EP Function Parameters
+*    $P task - task
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_taskretain( LuaTask * task );
+
+
+/***************************************************************************
+*
+* $FC luajava_workers
+*
+* $ED Description
+*    returns the number of worker threads, starting them on first use
+*
+* $FV Returned Value
+*    int - number of workers
+*
+*$. **********************************************************************/
+
+int luajava_workers( void );
+
+
+/***************************************************************************
+*
+* $FC luajava_taskspawn
+*
+* $ED Description
+*    lua_CFunction behind luajava.spawn: spawns its first argument with
+*    the remaining ones and returns a task userdata
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    int - 1
+*
+*$. **********************************************************************/
+
+int luajava_taskspawn( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luajava_checktask
+*
+* $ED Description
+*    returns the task held by the userdata at idx with a new reference for
+*    the caller, raising a lua error if it is not a task
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P idx - stack index of the task userdata
+*
+* $FV Returned Value
+*    LuaTask * - task
+*
+*$. **********************************************************************/
+
+LuaTask * luajava_checktask( lua_State * L , int idx );
+
+
+/***************************************************************************
+*
+* $FC luajava_openscheduler
+*
+* $ED Description
+*    registers spawn and workers in the table on top of the stack (the
+*    luajava table) and creates the task metatable
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openscheduler( lua_State * L );
+
+#endif
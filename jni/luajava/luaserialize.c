@@ -0,0 +1,773 @@
+/***************************************************************************
+*
+* $ED
+*    This module implements luajava.serialize and luajava.deserialize.
+*
+*    A serialized value starts with the bytes 'L' 'S' and the format
+*    version, followed by one encoded value:
+*
+*       0x00                      nil
+*       0x01 / 0x02               false / true
+*       0x03 varint               number with an integral value that fits
+*                                 in 32 bits, zigzag encoded
+*       0x04 8 bytes              any other number, IEEE 754 big endian
+*       0x05 varint bytes         string
+*       0x06 varint varint ...    table: array length n, hash size m,
+*                                 then n values for keys 1..n, then m
+*                                 key / value pairs
+*       0x07 varint               reference to an earlier table or string
+*
+*    Varints are unsigned LEB128. Every table, and every string of at
+*    least LUASERIALIZE_MINREF bytes, gets the next reference number
+*    (starting at 0) when it is first written, so shared tables and
+*    repeated strings are stored once and cycles are preserved.
+*
+*    The Java decoder is org.keplerproject.luajava.LuaDeserializer.
+*
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luaserialize.h"
+
+
+#define LUASERIALIZE_TNIL     0x00
+#define LUASERIALIZE_TFALSE   0x01
+#define LUASERIALIZE_TTRUE    0x02
+#define LUASERIALIZE_TINT     0x03
+#define LUASERIALIZE_TDOUBLE  0x04
+#define LUASERIALIZE_TSTRING  0x05
+#define LUASERIALIZE_TTABLE   0x06
+#define LUASERIALIZE_TREF     0x07
+
+/* Strings shorter than this are cheaper to repeat than to reference */
+#define LUASERIALIZE_MINREF   3
+/* Maximum nesting of tables */
+#define LUASERIALIZE_MAXDEPTH 200
+/* Size of the staging buffer in front of the writer */
+#define LUASERIALIZE_BUFSIZE  256
+
+typedef struct
+{
+   lua_State * L;
+   lua_Writer writer;
+   void * ud;
+   int seen;
+   int nextRef;
+   size_t n;
+   unsigned char buf[ LUASERIALIZE_BUFSIZE ];
+} Serializer;
+
+typedef struct
+{
+   lua_State * L;
+   const unsigned char * pos;
+   const unsigned char * end;
+   int refs;
+   int nextRef;
+} Deserializer;
+
+
+/***************************************************************************
+*
+* $FC writeValue
+*
+* $ED Description
+*    encodes the value at idx
+*
+* $EP Function Parameters
+*    $P S - serializer
+*    $P idx - absolute stack index of the value
+*    $P depth - current table nesting
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void writeValue( Serializer * S , int idx , int depth );
+
+
+/***************************************************************************
+*
+* $FC readValue
+*
+* $ED Description
+*    decodes one value and pushes it
+*
+* $EP Function Parameters
+*    $P D - deserializer
+*    $P depth - current table nesting
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+   static void readValue( Deserializer * D , int depth );
+
+
+/********************* Implementations ***************************/
+
+/***************************************************************************
+*
+*  Function: flushSerializer
+*  ****/
+
+static void flushSerializer( Serializer * S )
+{
+   if ( S->n > 0 )
+   {
+      if ( S->writer( S->L , S->buf , S->n , S->ud ) != 0 )
+      {
+         luaL_error( S->L , "serialize: write error" );
+      }
+      S->n = 0;
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: writeBytes
+*  ****/
+
+static void writeBytes( Serializer * S , const void * p , size_t len )
+{
+   if ( S->n + len > LUASERIALIZE_BUFSIZE )
+   {
+      flushSerializer( S );
+
+      if ( len > LUASERIALIZE_BUFSIZE )
+      {
+         if ( S->writer( S->L , p , len , S->ud ) != 0 )
+         {
+            luaL_error( S->L , "serialize: write error" );
+         }
+         return;
+      }
+   }
+
+   memcpy( S->buf + S->n , p , len );
+   S->n += len;
+}
+
+
+/***************************************************************************
+*
+*  Function: writeByte
+*  ****/
+
+static void writeByte( Serializer * S , unsigned char b )
+{
+   if ( S->n == LUASERIALIZE_BUFSIZE )
+   {
+      flushSerializer( S );
+   }
+   S->buf[ S->n++ ] = b;
+}
+
+
+/***************************************************************************
+*
+*  Function: writeVarint
+*  ****/
+
+static void writeVarint( Serializer * S , uint32_t v )
+{
+   while ( v >= 0x80 )
+   {
+      writeByte( S , ( unsigned char ) ( v | 0x80 ) );
+      v >>= 7;
+   }
+   writeByte( S , ( unsigned char ) v );
+}
+
+
+/***************************************************************************
+*
+*  Function: writeNumber
+*  ****/
+
+static void writeNumber( Serializer * S , lua_Number n )
+{
+   unsigned char b[ 8 ];
+   uint64_t bits;
+   double d = ( double ) n;
+   int i;
+
+   if ( n >= -2147483648.0 && n <= 2147483647.0 && ( lua_Number ) ( int32_t ) n == n &&
+        !( n == 0 && 1 / n < 0 ) )
+   {
+      int32_t v = ( int32_t ) n;
+
+      writeByte( S , LUASERIALIZE_TINT );
+      writeVarint( S , ( ( uint32_t ) v << 1 ) ^ ( uint32_t ) ( v >> 31 ) );
+      return;
+   }
+
+   memcpy( &bits , &d , sizeof( bits ) );
+   for ( i = 7 ; i >= 0 ; i-- )
+   {
+      b[ i ] = ( unsigned char ) bits;
+      bits >>= 8;
+   }
+
+   writeByte( S , LUASERIALIZE_TDOUBLE );
+   writeBytes( S , b , 8 );
+}
+
+
+/***************************************************************************
+*
+*  Function: writeRef
+*  ****/
+
+static int writeRef( Serializer * S , int idx )
+{
+   lua_pushvalue( S->L , idx );
+   lua_rawget( S->L , S->seen );
+
+   if ( !lua_isnil( S->L , -1 ) )
+   {
+      writeByte( S , LUASERIALIZE_TREF );
+      writeVarint( S , ( uint32_t ) lua_tointeger( S->L , -1 ) );
+      lua_pop( S->L , 1 );
+      return 1;
+   }
+
+   lua_pop( S->L , 1 );
+   lua_pushvalue( S->L , idx );
+   lua_pushinteger( S->L , S->nextRef++ );
+   lua_rawset( S->L , S->seen );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: writeTable
+*  ****/
+
+static void writeTable( Serializer * S , int idx , int depth )
+{
+   lua_State * L = S->L;
+   int narr = 0;
+   int nhash = 0;
+   int i;
+
+   if ( depth >= LUASERIALIZE_MAXDEPTH )
+   {
+      luaL_error( L , "serialize: tables nested too deeply" );
+   }
+   luaL_checkstack( L , 4 , "serialize: tables nested too deeply" );
+
+   for ( ;; )
+   {
+      lua_rawgeti( L , idx , narr + 1 );
+      if ( lua_isnil( L , -1 ) )
+      {
+         lua_pop( L , 1 );
+         break;
+      }
+      lua_pop( L , 1 );
+      narr++;
+   }
+
+   lua_pushnil( L );
+   while ( lua_next( L , idx ) != 0 )
+   {
+      lua_pop( L , 1 );
+      if ( lua_type( L , -1 ) == LUA_TNUMBER )
+      {
+         lua_Number k = lua_tonumber( L , -1 );
+
+         if ( k >= 1 && k <= narr && ( lua_Number ) ( int ) k == k )
+         {
+            continue;
+         }
+      }
+      nhash++;
+   }
+
+   writeByte( S , LUASERIALIZE_TTABLE );
+   writeVarint( S , ( uint32_t ) narr );
+   writeVarint( S , ( uint32_t ) nhash );
+
+   for ( i = 1 ; i <= narr ; i++ )
+   {
+      lua_rawgeti( L , idx , i );
+      writeValue( S , lua_gettop( L ) , depth + 1 );
+      lua_pop( L , 1 );
+   }
+
+   lua_pushnil( L );
+   while ( lua_next( L , idx ) != 0 )
+   {
+      if ( lua_type( L , -2 ) == LUA_TNUMBER )
+      {
+         lua_Number k = lua_tonumber( L , -2 );
+
+         if ( k >= 1 && k <= narr && ( lua_Number ) ( int ) k == k )
+         {
+            lua_pop( L , 1 );
+            continue;
+         }
+      }
+      writeValue( S , lua_gettop( L ) - 1 , depth + 1 );
+      writeValue( S , lua_gettop( L ) , depth + 1 );
+      lua_pop( L , 1 );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: writeValue
+*  ****/
+
+void writeValue( Serializer * S , int idx , int depth )
+{
+   lua_State * L = S->L;
+
+   switch ( lua_type( L , idx ) )
+   {
+      case LUA_TNIL:
+         writeByte( S , LUASERIALIZE_TNIL );
+         break;
+
+      case LUA_TBOOLEAN:
+         writeByte( S , lua_toboolean( L , idx ) ? LUASERIALIZE_TTRUE : LUASERIALIZE_TFALSE );
+         break;
+
+      case LUA_TNUMBER:
+         writeNumber( S , lua_tonumber( L , idx ) );
+         break;
+
+      case LUA_TSTRING:
+      {
+         size_t len;
+         const char * s = lua_tolstring( L , idx , &len );
+
+         if ( len >= LUASERIALIZE_MINREF && writeRef( S , idx ) )
+         {
+            break;
+         }
+         writeByte( S , LUASERIALIZE_TSTRING );
+         writeVarint( S , ( uint32_t ) len );
+         writeBytes( S , s , len );
+         break;
+      }
+
+      case LUA_TTABLE:
+         if ( !writeRef( S , idx ) )
+         {
+            writeTable( S , idx , depth );
+         }
+         break;
+
+      default:
+         luaL_error( L , "serialize: cannot serialize a %s" , luaL_typename( L , idx ) );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_serialize
+*  ****/
+
+void luajava_serialize( lua_State * L , int idx , lua_Writer writer , void * ud )
+{
+   Serializer S;
+   unsigned char header[ 3 ];
+
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   S.L       = L;
+   S.writer  = writer;
+   S.ud      = ud;
+   S.nextRef = 0;
+   S.n       = 0;
+
+   lua_newtable( L );
+   S.seen = lua_gettop( L );
+
+   header[ 0 ] = 'L';
+   header[ 1 ] = 'S';
+   header[ 2 ] = LUASERIALIZE_VERSION;
+   writeBytes( &S , header , 3 );
+
+   writeValue( &S , idx , 0 );
+   flushSerializer( &S );
+
+   lua_pop( L , 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: corrupt
+*  ****/
+
+static void corrupt( Deserializer * D )
+{
+   luaL_error( D->L , "deserialize: corrupt or truncated data" );
+}
+
+
+/***************************************************************************
+*
+*  Function: readVarint
+*  ****/
+
+static uint32_t readVarint( Deserializer * D )
+{
+   uint32_t v = 0;
+   int shift = 0;
+
+   for ( ;; )
+   {
+      unsigned char b;
+
+      if ( D->pos >= D->end || shift > 28 )
+      {
+         corrupt( D );
+      }
+
+      b = *D->pos++;
+      v |= ( uint32_t ) ( b & 0x7f ) << shift;
+
+      if ( !( b & 0x80 ) )
+      {
+         return v;
+      }
+      shift += 7;
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: readValue
+*  ****/
+
+void readValue( Deserializer * D , int depth )
+{
+   lua_State * L = D->L;
+   unsigned char tag;
+
+   if ( D->pos >= D->end )
+   {
+      corrupt( D );
+   }
+
+   tag = *D->pos++;
+
+   switch ( tag )
+   {
+      case LUASERIALIZE_TNIL:
+         lua_pushnil( L );
+         break;
+
+      case LUASERIALIZE_TFALSE:
+         lua_pushboolean( L , 0 );
+         break;
+
+      case LUASERIALIZE_TTRUE:
+         lua_pushboolean( L , 1 );
+         break;
+
+      case LUASERIALIZE_TINT:
+      {
+         uint32_t v = readVarint( D );
+
+         lua_pushnumber( L , ( lua_Number ) ( int32_t ) ( ( v >> 1 ) ^ ( 0U - ( v & 1 ) ) ) );
+         break;
+      }
+
+      case LUASERIALIZE_TDOUBLE:
+      {
+         uint64_t bits = 0;
+         double d;
+         int i;
+
+         if ( D->end - D->pos < 8 )
+         {
+            corrupt( D );
+         }
+         for ( i = 0 ; i < 8 ; i++ )
+         {
+            bits = ( bits << 8 ) | *D->pos++;
+         }
+         memcpy( &d , &bits , sizeof( d ) );
+         lua_pushnumber( L , ( lua_Number ) d );
+         break;
+      }
+
+      case LUASERIALIZE_TSTRING:
+      {
+         uint32_t len = readVarint( D );
+
+         if ( ( size_t ) ( D->end - D->pos ) < len )
+         {
+            corrupt( D );
+         }
+         lua_pushlstring( L , ( const char * ) D->pos , len );
+         D->pos += len;
+
+         if ( len >= LUASERIALIZE_MINREF )
+         {
+            lua_pushvalue( L , -1 );
+            lua_rawseti( L , D->refs , D->nextRef++ );
+         }
+         break;
+      }
+
+      case LUASERIALIZE_TTABLE:
+      {
+         uint32_t narr = readVarint( D );
+         uint32_t nhash = readVarint( D );
+         uint32_t i;
+         int t;
+
+         /* every element takes at least one byte, which bounds the sizes */
+         if ( depth >= LUASERIALIZE_MAXDEPTH ||
+              narr > ( uint32_t ) ( D->end - D->pos ) ||
+              nhash > ( uint32_t ) ( D->end - D->pos ) / 2 )
+         {
+            corrupt( D );
+         }
+         luaL_checkstack( L , 4 , "deserialize: tables nested too deeply" );
+
+         lua_createtable( L , ( int ) narr , ( int ) nhash );
+         t = lua_gettop( L );
+         lua_pushvalue( L , t );
+         lua_rawseti( L , D->refs , D->nextRef++ );
+
+         for ( i = 1 ; i <= narr ; i++ )
+         {
+            readValue( D , depth + 1 );
+            lua_rawseti( L , t , ( int ) i );
+         }
+
+         for ( i = 0 ; i < nhash ; i++ )
+         {
+            readValue( D , depth + 1 );
+            if ( lua_isnil( L , -1 ) ||
+                 ( lua_type( L , -1 ) == LUA_TNUMBER && lua_tonumber( L , -1 ) != lua_tonumber( L , -1 ) ) )
+            {
+               corrupt( D );
+            }
+            readValue( D , depth + 1 );
+            lua_rawset( L , t );
+         }
+         break;
+      }
+
+      case LUASERIALIZE_TREF:
+      {
+         uint32_t ref = readVarint( D );
+
+         if ( ref >= ( uint32_t ) D->nextRef )
+         {
+            corrupt( D );
+         }
+         lua_rawgeti( L , D->refs , ( int ) ref );
+         break;
+      }
+
+      default:
+         corrupt( D );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_deserialize
+*  ****/
+
+void luajava_deserialize( lua_State * L , const char * data , size_t len )
+{
+   Deserializer D;
+
+   D.L       = L;
+   D.pos     = ( const unsigned char * ) data;
+   D.end     = D.pos + len;
+   D.nextRef = 0;
+
+   if ( len < 3 || data[ 0 ] != 'L' || data[ 1 ] != 'S' )
+   {
+      luaL_error( L , "deserialize: not serialized data" );
+   }
+   if ( data[ 2 ] != LUASERIALIZE_VERSION )
+   {
+      luaL_error( L , "deserialize: unsupported version %d" , ( int ) data[ 2 ] );
+   }
+   D.pos += 3;
+
+   lua_newtable( L );
+   D.refs = lua_gettop( L );
+
+   readValue( &D , 0 );
+
+   if ( D.pos != D.end )
+   {
+      corrupt( &D );
+   }
+
+   lua_remove( L , D.refs );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_bufferwriter
+*  ****/
+
+int luajava_bufferwriter( lua_State * L , const void * p , size_t sz , void * ud )
+{
+   SerializeBuffer * buf = ( SerializeBuffer * ) ud;
+
+   ( void ) L;
+
+   if ( buf->len + sz > buf->size )
+   {
+      size_t size = ( buf->size == 0 ) ? 256 : buf->size * 2;
+      char * data;
+
+      while ( size < buf->len + sz )
+      {
+         size *= 2;
+      }
+
+      data = ( char * ) realloc( buf->data , size );
+      if ( data == NULL )
+      {
+         return 1;
+      }
+      buf->data = data;
+      buf->size = size;
+   }
+
+   memcpy( buf->data + buf->len , p , sz );
+   buf->len += sz;
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: serializeProtected
+*  ****/
+
+static int serializeProtected( lua_State * L )
+{
+   luajava_serialize( L , 2 , luajava_bufferwriter , lua_touserdata( L , 1 ) );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_serializeto
+*  ****/
+
+int luajava_serializeto( lua_State * L , int idx , SerializeBuffer * buf )
+{
+   if ( idx < 0 && idx > LUA_REGISTRYINDEX )
+   {
+      idx = lua_gettop( L ) + idx + 1;
+   }
+
+   lua_pushcfunction( L , &serializeProtected );
+   lua_pushlightuserdata( L , buf );
+   lua_pushvalue( L , idx );
+
+   return lua_pcall( L , 2 , 0 , 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: luaBufferWriter
+*  ****/
+
+static int luaBufferWriter( lua_State * L , const void * p , size_t sz , void * ud )
+{
+   ( void ) L;
+   luaL_addlstring( ( luaL_Buffer * ) ud , ( const char * ) p , sz );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaSerialize
+*  ****/
+
+static int javaSerialize( lua_State * L )
+{
+   luaL_Buffer b;
+   lua_State * B;
+
+   luaL_checkany( L , 1 );
+   lua_settop( L , 1 );
+
+   /* the buffer lives on its own thread so that its stack discipline is
+      not disturbed by the table traversal on this one */
+   B = lua_newthread( L );
+   luaL_buffinit( B , &b );
+
+   luajava_serialize( L , 1 , luaBufferWriter , &b );
+
+   luaL_pushresult( &b );
+   lua_xmove( B , L , 1 );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: javaDeserialize
+*  ****/
+
+static int javaDeserialize( lua_State * L )
+{
+   size_t len;
+   const char * data = luaL_checklstring( L , 1 , &len );
+
+   luajava_deserialize( L , data , len );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openserialize
+*  ****/
+
+void luajava_openserialize( lua_State * L )
+{
+   lua_pushstring( L , "serialize" );
+   lua_pushcfunction( L , &javaSerialize );
+   lua_settable( L , -3 );
+
+   lua_pushstring( L , "deserialize" );
+   lua_pushcfunction( L , &javaDeserialize );
+   lua_settable( L , -3 );
+}
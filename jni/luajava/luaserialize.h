@@ -0,0 +1,132 @@
+/***************************************************************************
+*
+* $ED
+*    Compact binary serialization of lua value graphs, see luaserialize.c
+*    for the format.
+*
+*****************************************************************************/
+
+#ifndef LUASERIALIZE_H
+#define LUASERIALIZE_H
+
+#include <stddef.h>
+
+#include "lua.h"
+
+/* Current version of the serialization format */
+#define LUASERIALIZE_VERSION  1
+
+/* Growable malloc'ed buffer filled by luajava_bufferwriter */
+typedef struct
+{
+   char * data;
+   size_t len;
+   size_t size;
+} SerializeBuffer;
+
+
+/***************************************************************************
+*
+* $FC luajava_serialize
+*
+* $ED Description
+*    encodes the value at idx and streams it to writer in small pieces.
+*    Raises a lua error if the graph contains values that cannot be
+*    serialized or if writer returns non zero.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P idx - stack index of the value
+*    $P writer - receives the encoded bytes, as with lua_dump
+*    $P ud - user data passed to writer
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_serialize( lua_State * L , int idx , lua_Writer writer , void * ud );
+
+
+/***************************************************************************
+*
+* $FC luajava_deserialize
+*
+* $ED Description
+*    decodes a serialized value and pushes it onto the stack. Raises a
+*    lua error if the data is truncated, corrupt or of another version.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P data - encoded bytes
+*    $P len - number of bytes
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_deserialize( lua_State * L , const char * data , size_t len );
+
+
+/***************************************************************************
+*
+* $FC luajava_bufferwriter
+*
+* $ED Description
+*    lua_Writer appending to the SerializeBuffer passed as ud
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P p - bytes to append
+*    $P sz - number of bytes
+*    $P ud - SerializeBuffer
+*
+* $FV Returned Value
+*    int - 0, or 1 if memory ran out
+*
+*$. **********************************************************************/
+
+int luajava_bufferwriter( lua_State * L , const void * p , size_t sz , void * ud );
+
+
+/***************************************************************************
+*
+* $FC luajava_serializeto
+*
+* $ED Description
+*    serializes the value at idx into buf in protected mode. On error the
+*    message is left on the stack; buf must still be freed by the caller.
+*
+* $EP Function Parameters
+*    $P L - lua State
+*    $P idx - stack index of the value
+*    $P buf - buffer receiving the encoded bytes
+*
+* $FV Returned Value
+*    int - 0 on success, or a lua_pcall error code
+*
+*$. **********************************************************************/
+
+int luajava_serializeto( lua_State * L , int idx , SerializeBuffer * buf );
+
+
+/***************************************************************************
+*
+* $FC luajava_openserialize
+*
+* $ED Description
+*    registers serialize and deserialize in the table on top of the
+*    stack (the luajava table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openserialize( lua_State * L );
+
+#endif
@@ -0,0 +1,553 @@
+/***************************************************************************
+*
+* $ED
+*    This module is a startup profiler of a lua State. While it runs, it
+*    takes the place of the tracer of the state, still calling the one
+*    installed before, and merges the spans told to it into a tree: the
+*    spans opened inside another are its children, and the spans of the
+*    same category and name under the same parent are merged. Loading a
+*    module gives, for instance:
+*
+*    require mod          the whole require
+*      search mod         running package.loaders, with path probing
+*        parse file       luaL_loadfile, or LloadBuffer from Java
+*        read mod         reading an asset, from Main's loader
+*      execute mod        running the main chunk of the module
+*        bind class       luajava.bindClass, as import.lua resolves
+*
+*    along with the steps of the collector. From Lua:
+*
+*    luajava.startup.start()
+*    require 'import'
+*    print(luajava.startup.report())
+*
+*    Spans left open by errors are closed with the first enclosing span
+*    that ends.
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luastartup.h"
+
+
+/* Registry key of the profiler of a state */
+#define LUASTARTUPKEY         "luajava.startup"
+
+#define NO_NODE               ( -1 )
+#define ROOT                  0
+
+typedef struct
+{
+   char cat[ 16 ];
+   char name[ LUASTARTUP_NAME ];
+   int parent;
+   int child;
+   int lastChild;
+   int sibling;
+   unsigned long count;
+   /* milliseconds spent in the spans closed */
+   double total;
+} StartupNode;
+
+typedef struct
+{
+   lua_Tracer previous;
+   void * previousud;
+   int running;
+   double start;
+   double stop;
+
+   StartupNode * nodes;
+   int nnodes;
+   int nodesSize;
+
+   /* spans open, NO_NODE for those not recorded, and their start */
+   int open[ LUASTARTUP_DEPTH ];
+   double started[ LUASTARTUP_DEPTH ];
+   int depth;
+   /* spans opened beyond LUASTARTUP_DEPTH, not recorded */
+   int overflow;
+   unsigned long dropped;
+} LuaStartup;
+
+
+static double now( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC , &ts );
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static void clearStartup( LuaStartup * s )
+{
+   free( s->nodes );
+   s->nodes = NULL;
+   s->nnodes = 0;
+   s->nodesSize = 0;
+   s->depth = 0;
+   s->overflow = 0;
+   s->dropped = 0;
+}
+
+
+/* The child of parent with that category and name, added if new */
+static int findChild( LuaStartup * s , int parent , const char * cat , const char * name )
+{
+   StartupNode * n;
+   char c[ sizeof( n->cat ) ];
+   char m[ sizeof( n->name ) ];
+   int i;
+
+   snprintf( c , sizeof( c ) , "%s" , cat != NULL ? cat : "" );
+   snprintf( m , sizeof( m ) , "%s" , name != NULL ? name : "" );
+
+   for ( i = parent != NO_NODE ? s->nodes[ parent ].child : NO_NODE ; i != NO_NODE ; i = s->nodes[ i ].sibling )
+   {
+      if ( strcmp( s->nodes[ i ].cat , c ) == 0 && strcmp( s->nodes[ i ].name , m ) == 0 )
+         return i;
+   }
+
+   if ( s->nnodes == LUASTARTUP_NODES )
+      return NO_NODE;
+   if ( s->nnodes == s->nodesSize )
+   {
+      int size = s->nodesSize != 0 ? s->nodesSize * 2 : 64;
+      StartupNode * nodes = ( StartupNode * ) realloc( s->nodes , size * sizeof( StartupNode ) );
+
+      if ( nodes == NULL )
+         return NO_NODE;
+      s->nodes = nodes;
+      s->nodesSize = size;
+   }
+
+   i = s->nnodes++;
+   n = &s->nodes[ i ];
+   memcpy( n->cat , c , sizeof( c ) );
+   memcpy( n->name , m , sizeof( m ) );
+   n->parent = parent;
+   n->child = NO_NODE;
+   n->lastChild = NO_NODE;
+   n->sibling = NO_NODE;
+   n->count = 0;
+   n->total = 0;
+
+   /* children stay in the order they first ran */
+   if ( parent != NO_NODE )
+   {
+      if ( s->nodes[ parent ].lastChild != NO_NODE )
+         s->nodes[ s->nodes[ parent ].lastChild ].sibling = i;
+      else
+         s->nodes[ parent ].child = i;
+      s->nodes[ parent ].lastChild = i;
+   }
+
+   return i;
+}
+
+
+static void beginSpan( LuaStartup * s , const char * cat , const char * name )
+{
+   int parent = s->depth > 0 ? s->open[ s->depth - 1 ] : ROOT;
+   int node = NO_NODE;
+
+   if ( s->depth == LUASTARTUP_DEPTH )
+   {
+      s->overflow++;
+      s->dropped++;
+      return;
+   }
+
+   if ( parent != NO_NODE )
+      node = findChild( s , parent , cat , name );
+   if ( node != NO_NODE )
+      s->nodes[ node ].count++;
+   else
+      s->dropped++;
+
+   s->open[ s->depth ] = node;
+   s->started[ s->depth ] = now();
+   s->depth++;
+}
+
+
+static void endSpan( LuaStartup * s , const char * cat , const char * name )
+{
+   double t;
+   int i;
+
+   if ( s->overflow > 0 )
+   {
+      s->overflow--;
+      return;
+   }
+   if ( s->depth == 0 )
+      return;
+
+   /* a span not recorded ends first */
+   i = s->depth - 1;
+   if ( s->open[ i ] != NO_NODE )
+   {
+      for ( ; i >= 0 ; i-- )
+      {
+         StartupNode * n = s->open[ i ] != NO_NODE ? &s->nodes[ s->open[ i ] ] : NULL;
+
+         if ( n != NULL && strncmp( n->cat , cat != NULL ? cat : "" , sizeof( n->cat ) - 1 ) == 0 &&
+              strncmp( n->name , name != NULL ? name : "" , sizeof( n->name ) - 1 ) == 0 )
+            break;
+      }
+      if ( i < 0 )
+         return;
+   }
+
+   /* closes the span and those left open inside it */
+   t = now();
+   while ( s->depth > i )
+   {
+      s->depth--;
+      if ( s->open[ s->depth ] != NO_NODE )
+         s->nodes[ s->open[ s->depth ] ].total += t - s->started[ s->depth ];
+   }
+}
+
+
+/* Tracer of the state while the profiler runs */
+static void startupTrace( lua_State * L , int event , const char * cat , const char * name , void * ud )
+{
+   LuaStartup * s = ( LuaStartup * ) ud;
+
+   if ( event == LUA_TRACEBEGIN )
+      beginSpan( s , cat , name );
+   else
+      endSpan( s , cat , name );
+
+   if ( s->previous != NULL )
+      s->previous( L , event , cat , name , s->previousud );
+}
+
+
+/***************************************************************************
+*
+*  Function: getStartup
+*  ****/
+
+static LuaStartup * getStartup( lua_State * L )
+{
+   LuaStartup * s;
+
+   lua_getfield( L , LUA_REGISTRYINDEX , LUASTARTUPKEY );
+   s = ( LuaStartup * ) lua_touserdata( L , -1 );
+   lua_pop( L , 1 );
+
+   if ( s == NULL )
+   {
+      s = ( LuaStartup * ) lua_newuserdata( L , sizeof( LuaStartup ) );
+      memset( s , 0 , sizeof( LuaStartup ) );
+      luaL_getmetatable( L , LUASTARTUPKEY );
+      lua_setmetatable( L , -2 );
+      lua_setfield( L , LUA_REGISTRYINDEX , LUASTARTUPKEY );
+   }
+
+   return s;
+}
+
+
+static int isInstalled( lua_State * L , LuaStartup * s )
+{
+   void * ud;
+
+   return lua_gettracer( L , &ud ) == &startupTrace && ud == s;
+}
+
+
+/***************************************************************************
+*
+*  Function: luastartup_start
+*  ****/
+
+void luastartup_start( lua_State * L )
+{
+   LuaStartup * s = getStartup( L );
+
+   clearStartup( s );
+   if ( findChild( s , NO_NODE , "" , "startup" ) != ROOT )
+   {
+      luaL_error( L , "not enough memory" );
+   }
+   s->nodes[ ROOT ].count = 1;
+
+   if ( !isInstalled( L , s ) )
+   {
+      s->previous = lua_gettracer( L , &s->previousud );
+      lua_settracer( L , &startupTrace , s );
+   }
+   s->running = 1;
+   s->start = now();
+}
+
+
+/***************************************************************************
+*
+*  Function: luastartup_stop
+*  ****/
+
+void luastartup_stop( lua_State * L )
+{
+   LuaStartup * s = getStartup( L );
+
+   if ( isInstalled( L , s ) )
+   {
+      lua_settracer( L , s->previous , s->previousud );
+   }
+   if ( s->running )
+   {
+      s->running = 0;
+      s->stop = now();
+   }
+}
+
+
+/* The tree as it was when reported. Reporting allocates, and so may run
+   the collector, whose spans add nodes that are left out. */
+typedef struct
+{
+   LuaStartup * s;
+   double * totals;
+   int nnodes;
+} StartupTree;
+
+
+/* Pushes a userdata of the totals of the nodes, counting the spans still
+   open until now */
+static void getTree( lua_State * L , LuaStartup * s , StartupTree * tree )
+{
+   double t = now();
+   int i;
+
+   tree->s = s;
+   tree->nnodes = s->nnodes;
+   tree->totals = ( double * ) lua_newuserdata( L , ( s->nnodes + 1 ) * sizeof( double ) );
+   for ( i = 0 ; i < s->nnodes ; i++ )
+      tree->totals[ i ] = s->nodes[ i ].total;
+   for ( i = 0 ; i < s->depth ; i++ )
+   {
+      if ( s->open[ i ] != NO_NODE )
+         tree->totals[ s->open[ i ] ] += t - s->started[ i ];
+   }
+   if ( s->nnodes > 0 )
+      tree->totals[ ROOT ] = ( s->running ? t : s->stop ) - s->start;
+}
+
+
+static int nextNode( StartupTree * tree , int node )
+{
+   while ( node != NO_NODE && node >= tree->nnodes )
+      node = tree->s->nodes[ node ].sibling;
+
+   return node;
+}
+
+
+static double selfTime( StartupTree * tree , int node )
+{
+   double self = tree->totals[ node ];
+   int i;
+
+   for ( i = nextNode( tree , tree->s->nodes[ node ].child ) ; i != NO_NODE ;
+         i = nextNode( tree , tree->s->nodes[ i ].sibling ) )
+      self -= tree->totals[ i ];
+
+   return self > 0 ? self : 0;
+}
+
+
+static void addNode( luaL_Buffer * b , StartupTree * tree , int node , int level )
+{
+   StartupNode * n = &tree->s->nodes[ node ];
+   char line[ 64 + 2 * LUASTARTUP_DEPTH + sizeof( n->cat ) + LUASTARTUP_NAME ];
+   int i;
+
+   snprintf( line , sizeof( line ) , "%12.3f %12.3f %8lu  %*s%s%s%s\n" , tree->totals[ node ] ,
+             selfTime( tree , node ) , n->count , 2 * level , "" , n->cat , *n->cat ? " " : "" ,
+             n->name );
+   luaL_addstring( b , line );
+
+   for ( i = nextNode( tree , tree->s->nodes[ node ].child ) ; i != NO_NODE ;
+         i = nextNode( tree , tree->s->nodes[ i ].sibling ) )
+      addNode( b , tree , i , level + 1 );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastartup_report
+*  ****/
+
+void luastartup_report( lua_State * L )
+{
+   LuaStartup * s = getStartup( L );
+   StartupTree tree;
+   luaL_Buffer b;
+   char line[ 96 ];
+
+   getTree( L , s , &tree );
+   luaL_buffinit( L , &b );
+   snprintf( line , sizeof( line ) , "%12s %12s %8s  %s\n" , "total ms" , "self ms" , "count" , "span" );
+   luaL_addstring( &b , line );
+   if ( tree.nnodes > 0 )
+      addNode( &b , &tree , ROOT , 0 );
+   if ( s->dropped > 0 )
+   {
+      snprintf( line , sizeof( line ) , "%lu spans not recorded\n" , s->dropped );
+      luaL_addstring( &b , line );
+   }
+   luaL_pushresult( &b );
+   lua_remove( L , -2 );
+}
+
+
+/* { cat = , name = , count = , total = , self = , children... } */
+static void pushNode( lua_State * L , StartupTree * tree , int node )
+{
+   int i;
+   int k = 1;
+
+   luaL_checkstack( L , 3 , "startup tree too deep" );
+   lua_createtable( L , 0 , 5 );
+   lua_pushstring( L , tree->s->nodes[ node ].cat );
+   lua_setfield( L , -2 , "cat" );
+   lua_pushstring( L , tree->s->nodes[ node ].name );
+   lua_setfield( L , -2 , "name" );
+   lua_pushnumber( L , ( lua_Number ) tree->s->nodes[ node ].count );
+   lua_setfield( L , -2 , "count" );
+   lua_pushnumber( L , tree->totals[ node ] );
+   lua_setfield( L , -2 , "total" );
+   lua_pushnumber( L , selfTime( tree , node ) );
+   lua_setfield( L , -2 , "self" );
+
+   for ( i = nextNode( tree , tree->s->nodes[ node ].child ) ; i != NO_NODE ;
+         i = nextNode( tree , tree->s->nodes[ i ].sibling ) )
+   {
+      pushNode( L , tree , i );
+      lua_rawseti( L , -2 , k++ );
+   }
+}
+
+
+/***************************************************************************
+*
+*  Lua interface
+*
+*****************************************************************************/
+
+/***************************************************************************
+*
+*  Function: startupGc
+*  ****/
+
+static int startupGc( lua_State * L )
+{
+   LuaStartup * s = ( LuaStartup * ) lua_touserdata( L , 1 );
+
+   if ( isInstalled( L , s ) )
+   {
+      lua_settracer( L , s->previous , s->previousud );
+   }
+   clearStartup( s );
+
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.startup.start
+*  ****/
+
+static int startupStart( lua_State * L )
+{
+   luastartup_start( L );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.startup.stop
+*  ****/
+
+static int startupStop( lua_State * L )
+{
+   luastartup_stop( L );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.startup.report
+*  ****/
+
+static int startupReport( lua_State * L )
+{
+   luastartup_report( L );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.startup.tree
+*  ****/
+
+static int startupTree( lua_State * L )
+{
+   LuaStartup * s = getStartup( L );
+   StartupTree tree;
+
+   if ( s->nnodes == 0 )
+   {
+      lua_pushnil( L );
+      return 1;
+   }
+
+   getTree( L , s , &tree );
+   pushNode( L , &tree , ROOT );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openstartup
+*  ****/
+
+void luajava_openstartup( lua_State * L )
+{
+   static const luaL_Reg functions[] =
+   {
+      { "start" , &startupStart } ,
+      { "stop" , &startupStop } ,
+      { "report" , &startupReport } ,
+      { "tree" , &startupTree } ,
+      { NULL , NULL }
+   };
+
+   luaL_newmetatable( L , LUASTARTUPKEY );
+   lua_pushcfunction( L , &startupGc );
+   lua_setfield( L , -2 , "__gc" );
+   lua_pop( L , 1 );
+
+   lua_pushstring( L , "startup" );
+   lua_newtable( L );
+   luaL_register( L , NULL , functions );
+   lua_settable( L , -3 );
+}
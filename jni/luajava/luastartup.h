@@ -0,0 +1,99 @@
+/***************************************************************************
+*
+* $ED
+*    Startup profiler of lua States: time spent loading modules, as a
+*    tree, see luastartup.c.
+*
+*****************************************************************************/
+
+#ifndef LUASTARTUP_H
+#define LUASTARTUP_H
+
+#include "lua.h"
+
+/* Nodes of the tree; spans beyond are not recorded */
+#define LUASTARTUP_NODES      4096
+/* Spans open at once */
+#define LUASTARTUP_DEPTH      64
+/* Characters kept of span names */
+#define LUASTARTUP_NAME       64
+
+
+/***************************************************************************
+*
+* $FC luastartup_start
+*
+* $ED Description
+*    starts recording the spans told to the tracer of the state, after
+*    the tracer installed before, which is still called; the spans of a
+*    previous run are discarded
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastartup_start( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luastartup_stop
+*
+* $ED Description
+*    stops recording spans, giving the tracer back to the one installed
+*    before; the spans recorded are kept
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastartup_stop( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luastartup_report
+*
+* $ED Description
+*    pushes the spans recorded, formatted for people to read: a line per
+*    node of the tree, indented under its parent, with its total and self
+*    times in milliseconds and the number of spans merged in it
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastartup_report( lua_State * L );
+
+
+/***************************************************************************
+*
+* $FC luajava_openstartup
+*
+* $ED Description
+*    registers startup in the table on top of the stack (the luajava
+*    table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openstartup( lua_State * L );
+
+#endif
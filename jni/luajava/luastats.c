@@ -0,0 +1,523 @@
+/***************************************************************************
+*
+* $ED
+*    This module counts and times the crossings between Lua and Java: the
+*    JNI natives called from Java and the C functions through which Lua
+*    reaches Java objects, classes and functions. Each such entry point
+*    declares a LuaStatsSlot with LUASTATS_ENTER, registered on its first
+*    call with stats enabled. Calls of Java methods from Lua are also
+*    counted by method name.
+*
+*    Stats are compiled in but disabled by default, at the cost of a test
+*    per crossing. From Lua:
+*
+*    luajava.stats 'on'                 -- or 'off', 'reset'
+*    ...
+*    print(luajava.stats 'report')
+*    local s = luajava.stats()          -- s.calls.objectIndex.count, ...
+*
+*    and from Java through the LuaStats class. Stats are global to the
+*    process, and shared by its lua States.
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luastats.h"
+
+
+volatile int luastats_enabled = 0;
+
+/* Entry points registered so far */
+static LuaStatsSlot * volatile slots = NULL;
+
+/* Call counts of Java methods, by name: an open addressing hash table
+   whose last entry collects the names that do not fit */
+typedef struct
+{
+   const char * name;
+   unsigned long count;
+} MethodCount;
+
+static MethodCount methods[ LUASTATS_METHODS ];
+static int methodsUsed = 0;
+static pthread_mutex_t methodsLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define OTHER_METHODS         "(other)"
+
+
+static int64_t nowNanos( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC , &ts );
+
+   return ( int64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void lockSlot( LuaStatsSlot * slot )
+{
+   while ( __sync_lock_test_and_set( &slot->lock , 1 ) )
+   {
+      while ( slot->lock )
+         ;
+   }
+}
+
+
+static void unlockSlot( LuaStatsSlot * slot )
+{
+   __sync_lock_release( &slot->lock );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_begin
+*  ****/
+
+int64_t luastats_begin( LuaStatsSlot * slot )
+{
+   int64_t now;
+
+   if ( !slot->registered && __sync_bool_compare_and_swap( &slot->registered , 0 , 1 ) )
+   {
+      LuaStatsSlot * head;
+
+      do
+      {
+         head = slots;
+         slot->next = head;
+      }
+      while ( !__sync_bool_compare_and_swap( &slots , head , slot ) );
+   }
+
+   lockSlot( slot );
+   slot->count++;
+   unlockSlot( slot );
+
+   now = nowNanos();
+
+   return now != 0 ? now : 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_end
+*  ****/
+
+void luastats_end( LuaStatsScope * scope )
+{
+   LuaStatsSlot * slot = scope->slot;
+   int64_t elapsed = nowNanos() - scope->start;
+   int bucket = 0;
+
+   if ( elapsed < 0 )
+      elapsed = 0;
+
+   while ( bucket < LUASTATS_BUCKETS - 1 && ( elapsed >> ( bucket + 1 ) ) != 0 )
+      bucket++;
+
+   lockSlot( slot );
+   slot->nanos += elapsed;
+   if ( ( uint64_t ) elapsed > slot->maxNanos )
+      slot->maxNanos = elapsed;
+   slot->histogram[ bucket ]++;
+   unlockSlot( slot );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_method
+*  ****/
+
+void luastats_method( const char * name )
+{
+   unsigned int h = 5381;
+   const char * c;
+   int i;
+
+   if ( !luastats_enabled )
+      return;
+
+   for ( c = name ; *c ; c++ )
+      h = h * 33 + ( unsigned char ) *c;
+
+   pthread_mutex_lock( &methodsLock );
+
+   for ( i = h % ( LUASTATS_METHODS - 1 ) ; ; i = ( i + 1 ) % ( LUASTATS_METHODS - 1 ) )
+   {
+      MethodCount * m = &methods[ i ];
+
+      if ( m->name != NULL && strcmp( m->name , name ) == 0 )
+      {
+         m->count++;
+         break;
+      }
+      if ( m->name == NULL )
+      {
+         /* keeps the table half empty for short probes */
+         char * copy = NULL;
+
+         if ( methodsUsed < LUASTATS_METHODS / 2 )
+            copy = strdup( name );
+         if ( copy == NULL )
+         {
+            m = &methods[ LUASTATS_METHODS - 1 ];
+            m->name = OTHER_METHODS;
+         }
+         else
+         {
+            m->name = copy;
+            methodsUsed++;
+         }
+         m->count++;
+         break;
+      }
+   }
+
+   pthread_mutex_unlock( &methodsLock );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_enable
+*  ****/
+
+int luastats_enable( int on )
+{
+   int was = luastats_enabled;
+
+   luastats_enabled = on;
+
+   return was;
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_reset
+*  ****/
+
+void luastats_reset( void )
+{
+   LuaStatsSlot * slot;
+   int i;
+
+   for ( slot = slots ; slot != NULL ; slot = slot->next )
+   {
+      lockSlot( slot );
+      slot->count = 0;
+      slot->nanos = 0;
+      slot->maxNanos = 0;
+      memset( slot->histogram , 0 , sizeof( slot->histogram ) );
+      unlockSlot( slot );
+   }
+
+   /* names are kept: readers may still hold them */
+   pthread_mutex_lock( &methodsLock );
+   for ( i = 0 ; i < LUASTATS_METHODS ; i++ )
+      methods[ i ].count = 0;
+   pthread_mutex_unlock( &methodsLock );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_first
+*  ****/
+
+LuaStatsSlot * luastats_first( void )
+{
+   return slots;
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_read
+*  ****/
+
+void luastats_read( LuaStatsSlot * slot , LuaStatsSlot * copy )
+{
+   lockSlot( slot );
+   *copy = *slot;
+   unlockSlot( slot );
+   copy->lock = 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_methods
+*  ****/
+
+int luastats_methods( const char ** names , unsigned long * counts , int max )
+{
+   int i;
+   int n = 0;
+
+   pthread_mutex_lock( &methodsLock );
+   for ( i = 0 ; i < LUASTATS_METHODS && n < max ; i++ )
+   {
+      if ( methods[ i ].count != 0 )
+      {
+         names[ n ] = methods[ i ].name;
+         counts[ n ] = methods[ i ].count;
+         n++;
+      }
+   }
+   pthread_mutex_unlock( &methodsLock );
+
+   return n;
+}
+
+
+/* Calls timed: those ended by errors are only counted */
+static unsigned long timedCalls( LuaStatsSlot * s )
+{
+   unsigned long timed = 0;
+   int i;
+
+   for ( i = 0 ; i < LUASTATS_BUCKETS ; i++ )
+      timed += s->histogram[ i ];
+
+   return timed;
+}
+
+
+static double meanNanos( LuaStatsSlot * s )
+{
+   unsigned long timed = timedCalls( s );
+
+   return timed != 0 ? ( double ) s->nanos / timed : 0;
+}
+
+
+/* Upper bound, in ns, of the bucket holding the p-th percentile call */
+static double percentile( LuaStatsSlot * s , double p )
+{
+   double rank = timedCalls( s ) * p / 100;
+   unsigned long seen = 0;
+   int i;
+
+   for ( i = 0 ; i < LUASTATS_BUCKETS ; i++ )
+   {
+      seen += s->histogram[ i ];
+      if ( seen > 0 && seen >= rank )
+         return ( double ) ( ( uint64_t ) 1 << ( i + 1 ) );
+   }
+   return ( double ) s->maxNanos;
+}
+
+
+static int compareNames( const void * a , const void * b )
+{
+   return strcmp( *( const char ** ) a , *( const char ** ) b );
+}
+
+
+/***************************************************************************
+*
+*  Function: luastats_report
+*  ****/
+
+char * luastats_report( void )
+{
+   LuaStatsSlot * slot;
+   const char * names[ LUASTATS_METHODS ];
+   unsigned long counts[ LUASTATS_METHODS ];
+   int nmethods;
+   int nslots = 0;
+   size_t size;
+   size_t len;
+   char * out;
+   int i;
+
+   for ( slot = slots ; slot != NULL ; slot = slot->next )
+      nslots++;
+   nmethods = luastats_methods( names , counts , LUASTATS_METHODS );
+
+   size = 160 + ( nslots + nmethods + 2 ) * 120;
+   out = malloc( size );
+   if ( out == NULL )
+      return NULL;
+
+   len = snprintf( out , size , "%-40s %10s %12s %10s %10s %10s\n" ,
+                   "entry point" , "calls" , "total ms" , "mean us" , "p99 us" , "max us" );
+
+   for ( slot = slots ; slot != NULL ; slot = slot->next )
+   {
+      LuaStatsSlot s;
+
+      luastats_read( slot , &s );
+      if ( s.count == 0 )
+         continue;
+      len += snprintf( out + len , size - len , "%-40.40s %10lu %12.3f %10.3f %10.3f %10.3f\n" ,
+                       s.name , s.count , s.nanos / 1e6 , meanNanos( &s ) / 1e3 ,
+                       percentile( &s , 99 ) / 1e3 , s.maxNanos / 1e3 );
+      if ( len >= size )
+         len = size - 1;
+   }
+
+   if ( nmethods > 0 && len < size - 1 )
+   {
+      /* sorts name and count pairs through the names */
+      const char * sorted[ LUASTATS_METHODS ];
+
+      memcpy( sorted , names , nmethods * sizeof( *names ) );
+      qsort( sorted , nmethods , sizeof( *sorted ) , compareNames );
+
+      len += snprintf( out + len , size - len , "\n%-40s %10s\n" , "java method" , "calls" );
+      for ( i = 0 ; i < nmethods && len < size - 1 ; i++ )
+      {
+         int j;
+
+         for ( j = 0 ; names[ j ] != sorted[ i ] ; j++ )
+            ;
+         len += snprintf( out + len , size - len , "%-40.40s %10lu\n" , sorted[ i ] , counts[ j ] );
+      }
+   }
+
+   return out;
+}
+
+
+/***************************************************************************
+*
+*  Lua interface
+*
+*****************************************************************************/
+
+static void pushSlot( lua_State * L , LuaStatsSlot * s )
+{
+   int i;
+   int last = -1;
+
+   lua_createtable( L , 0 , 6 );
+
+   lua_pushnumber( L , ( lua_Number ) s->count );
+   lua_setfield( L , -2 , "count" );
+
+   lua_pushnumber( L , ( lua_Number ) s->nanos );
+   lua_setfield( L , -2 , "nanos" );
+
+   lua_pushnumber( L , ( lua_Number ) s->maxNanos );
+   lua_setfield( L , -2 , "max" );
+
+   lua_pushnumber( L , meanNanos( s ) );
+   lua_setfield( L , -2 , "mean" );
+
+   lua_pushnumber( L , percentile( s , 50 ) );
+   lua_setfield( L , -2 , "p50" );
+
+   lua_pushnumber( L , percentile( s , 99 ) );
+   lua_setfield( L , -2 , "p99" );
+
+   /* histogram[i] counts calls of 2^(i-1) to 2^i ns, up to the last used */
+   for ( i = 0 ; i < LUASTATS_BUCKETS ; i++ )
+   {
+      if ( s->histogram[ i ] != 0 )
+         last = i;
+   }
+   lua_createtable( L , last + 1 , 0 );
+   for ( i = 0 ; i <= last ; i++ )
+   {
+      lua_pushnumber( L , ( lua_Number ) s->histogram[ i ] );
+      lua_rawseti( L , -2 , i + 1 );
+   }
+   lua_setfield( L , -2 , "histogram" );
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.stats
+*  ****/
+
+static int luastats( lua_State * L )
+{
+   static const char * const options[] = { "get" , "on" , "off" , "reset" , "report" , NULL };
+   LuaStatsSlot * slot;
+   const char * names[ LUASTATS_METHODS ];
+   unsigned long counts[ LUASTATS_METHODS ];
+   int n;
+   int i;
+
+   switch ( luaL_checkoption( L , 1 , "get" , options ) )
+   {
+      case 1:
+         lua_pushboolean( L , luastats_enable( 1 ) );
+         return 1;
+
+      case 2:
+         lua_pushboolean( L , luastats_enable( 0 ) );
+         return 1;
+
+      case 3:
+         luastats_reset();
+         return 0;
+
+      case 4:
+      {
+         char * report = luastats_report();
+
+         if ( report == NULL )
+            return luaL_error( L , "not enough memory" );
+         lua_pushstring( L , report );
+         free( report );
+         return 1;
+      }
+   }
+
+   lua_createtable( L , 0 , 3 );
+
+   lua_pushboolean( L , luastats_enabled );
+   lua_setfield( L , -2 , "enabled" );
+
+   lua_newtable( L );
+   for ( slot = slots ; slot != NULL ; slot = slot->next )
+   {
+      LuaStatsSlot s;
+
+      luastats_read( slot , &s );
+      pushSlot( L , &s );
+      lua_setfield( L , -2 , s.name );
+   }
+   lua_setfield( L , -2 , "calls" );
+
+   n = luastats_methods( names , counts , LUASTATS_METHODS );
+   lua_createtable( L , 0 , n );
+   for ( i = 0 ; i < n ; i++ )
+   {
+      lua_pushnumber( L , ( lua_Number ) counts[ i ] );
+      lua_setfield( L , -2 , names[ i ] );
+   }
+   lua_setfield( L , -2 , "methods" );
+
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_openstats
+*  ****/
+
+void luajava_openstats( lua_State * L )
+{
+   lua_pushstring( L , "stats" );
+   lua_pushcfunction( L , &luastats );
+   lua_settable( L , -3 );
+}
@@ -0,0 +1,258 @@
+/***************************************************************************
+*
+* $ED
+*    Counters and latency histograms of the crossings between Lua and
+*    Java, see luastats.c.
+*
+*****************************************************************************/
+
+#ifndef LUASTATS_H
+#define LUASTATS_H
+
+#include <stdint.h>
+
+#include "lua.h"
+
+/* Latency buckets: bucket i counts calls of 2^i to 2^(i+1) ns, the last
+   one everything slower */
+#define LUASTATS_BUCKETS      32
+/* Distinct Java method names counted; further names share one entry */
+#define LUASTATS_METHODS      256
+
+typedef struct LuaStatsSlot
+{
+   const char * name;
+   volatile int lock;
+   volatile int registered;
+   unsigned long count;
+   uint64_t nanos;
+   uint64_t maxNanos;
+   unsigned long histogram[ LUASTATS_BUCKETS ];
+   struct LuaStatsSlot * next;
+} LuaStatsSlot;
+
+typedef struct
+{
+   LuaStatsSlot * slot;
+   int64_t start;
+} LuaStatsScope;
+
+extern volatile int luastats_enabled;
+
+
+/***************************************************************************
+*
+* $FC LUASTATS_ENTER
+*
+* $ED Description
+*    declares the scope of a bridge entry point, to be placed with the
+*    declarations at the start of its body. While stats are enabled the
+*    call is counted and, with GCC and clang, timed until the function
+*    returns; calls leaving by lua_error are counted but not timed.
+*    Costs a test of luastats_enabled otherwise.
+*
+* $EP Function Parameters
+*    $P name - name of the entry point, a string literal
+*
+*$. **********************************************************************/
+
+#if defined( __GNUC__ )
+#define LUASTATS_CLEANUP      __attribute__(( cleanup( luastats_leave ) ))
+#else
+#define LUASTATS_CLEANUP
+#endif
+
+#define LUASTATS_ENTER( name ) \
+   static LuaStatsSlot luastats_slot = { name }; \
+   LuaStatsScope luastats_scope LUASTATS_CLEANUP = \
+      { &luastats_slot , luastats_enabled ? luastats_begin( &luastats_slot ) : 0 }
+
+
+/***************************************************************************
+*
+* $FC luastats_begin
+*
+* $ED Description
+*    counts a call of an entry point, used by LUASTATS_ENTER
+*
+* $EP Function Parameters
+*    $P slot - the entry point
+*
+* $FV Returned Value
+*    int64_t - start time of the call in nanoseconds, never 0
+*
+*$. **********************************************************************/
+
+int64_t luastats_begin( LuaStatsSlot * slot );
+
+
+/***************************************************************************
+*
+* $FC luastats_end
+*
+* $ED Description
+*    records the time of a call begun with luastats_begin
+*
+* $EP Function Parameters
+*    $P scope - the call
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastats_end( LuaStatsScope * scope );
+
+#if defined( __GNUC__ )
+static __inline__ void luastats_leave( LuaStatsScope * scope )
+{
+   if ( scope->start != 0 )
+   {
+      luastats_end( scope );
+   }
+}
+#endif
+
+
+/***************************************************************************
+*
+* $FC luastats_method
+*
+* $ED Description
+*    counts a call of the Java method name, if stats are enabled
+*
+* $EP Function Parameters
+*    $P name - name of the method
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastats_method( const char * name );
+
+
+/***************************************************************************
+*
+* $FC luastats_enable
+*
+* $ED Description
+*    turns the collection of stats on or off; collected stats are kept
+*
+* $EP Function Parameters
+*    $P on - non zero to collect stats
+*
+* $FV Returned Value
+*    int - whether stats were collected before
+*
+*$. **********************************************************************/
+
+int luastats_enable( int on );
+
+
+/***************************************************************************
+*
+* $FC luastats_reset
+*
+* $ED Description
+*    clears the stats collected so far
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastats_reset( void );
+
+
+/***************************************************************************
+*
+* $FC luastats_first
+*
+* $ED Description
+*    gives the entry points called since stats were first enabled, as a
+*    list linked by their next field. Read their counters through
+*    luastats_read.
+*
+* $FV Returned Value
+*    LuaStatsSlot * - the first entry point, or NULL
+*
+*$. **********************************************************************/
+
+LuaStatsSlot * luastats_first( void );
+
+
+/***************************************************************************
+*
+* $FC luastats_read
+*
+* $ED Description
+*    copies the counters of an entry point consistently
+*
+* $EP Function Parameters
+*    $P slot - the entry point
+*    $P copy - where to copy them
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luastats_read( LuaStatsSlot * slot , LuaStatsSlot * copy );
+
+
+/***************************************************************************
+*
+* $FC luastats_methods
+*
+* $ED Description
+*    copies the call counts of Java methods
+*
+* $EP Function Parameters
+*    $P names - receives the names, valid until the next reset
+*    $P counts - receives the counts
+*    $P max - room in names and counts
+*
+* $FV Returned Value
+*    int - the number of methods copied
+*
+*$. **********************************************************************/
+
+int luastats_methods( const char ** names , unsigned long * counts , int max );
+
+
+/***************************************************************************
+*
+* $FC luastats_report
+*
+* $ED Description
+*    formats the stats as a table for people to read
+*
+* $FV Returned Value
+*    char * - the report, to be released with free, or NULL if out of
+*             memory
+*
+*$. **********************************************************************/
+
+char * luastats_report( void );
+
+
+/***************************************************************************
+*
+* $FC luajava_openstats
+*
+* $ED Description
+*    registers stats in the table on top of the stack (the luajava
+*    table)
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_openstats( lua_State * L );
+
+#endif
@@ -0,0 +1,587 @@
+/***************************************************************************
+*
+* $ED
+*    This module records a timeline of spans: calls of lua_pcall from Java,
+*    modules loaded by require, steps and full cycles of the collector,
+*    lookups and calls of Java methods from Lua, and spans of the scripts.
+*    Spans begin and end with events stamped by the monotonic clock, kept
+*    in a buffer of the thread recording them. A buffer is only written by
+*    its thread and read without locks, so that threads never wait for
+*    each other; it is a ring keeping the newest events of the thread.
+*    Ends whose beginning was overwritten are dropped with it, and spans
+*    still open when the timeline is output end at the last event of
+*    their thread. Steps of the incremental collector, which would soon
+*    fill the buffers, are only traced when asked for. The timeline is
+*    output in the Chrome trace event format, to be opened by
+*    chrome://tracing or ui.perfetto.dev. From Lua:
+*
+*    luajava.trace.start()                    -- or start(true) for gc steps
+*    luajava.trace.begin 'frame'
+*    ...
+*    luajava.trace['end'] 'frame'
+*    local json = luajava.trace.json()
+*
+*    and from Java through the LuaTrace class. Tracing is global to the
+*    process, and shared by its lua States.
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined( __linux__ )
+#include <sys/syscall.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "luatrace.h"
+
+
+volatile int luatrace_enabled = 0;
+
+/* Whether the steps of the incremental collector are traced */
+static volatile int gcSteps = 0;
+
+typedef struct
+{
+   int64_t ts;
+   const char * cat;
+   char phase;
+   char name[ LUATRACE_NAME ];
+} TraceEvent;
+
+typedef struct TraceBuffer
+{
+   struct TraceBuffer * next;
+   volatile int owned;
+   long tid;
+   /* written belongs to this start of tracing; event i is kept at
+      i % LUATRACE_EVENTS until overwritten */
+   volatile int generation;
+   volatile unsigned long written;
+   TraceEvent events[ LUATRACE_EVENTS ];
+} TraceBuffer;
+
+/* Buffers of all the threads that recorded events; those of ended threads
+   are reused by new threads once their events are outdated */
+static TraceBuffer * volatile buffers = NULL;
+static volatile int generation = 0;
+
+static pthread_key_t bufferKey;
+static pthread_once_t bufferKeyOnce = PTHREAD_ONCE_INIT;
+
+
+static int64_t nowNanos( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC , &ts );
+
+   return ( int64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static long threadId( void )
+{
+#if defined( __linux__ )
+   return ( long ) syscall( SYS_gettid );
+#else
+   return ( long ) ( intptr_t ) pthread_self();
+#endif
+}
+
+
+static void releaseBuffer( void * buffer )
+{
+   __sync_lock_release( &( ( TraceBuffer * ) buffer )->owned );
+}
+
+
+static void createBufferKey( void )
+{
+   pthread_key_create( &bufferKey , releaseBuffer );
+}
+
+
+/* The buffer of the calling thread, or NULL if out of memory */
+static TraceBuffer * threadBuffer( void )
+{
+   TraceBuffer * buffer;
+   TraceBuffer * head;
+
+   pthread_once( &bufferKeyOnce , createBufferKey );
+
+   buffer = pthread_getspecific( bufferKey );
+   if ( buffer != NULL )
+      return buffer;
+
+   for ( buffer = buffers ; buffer != NULL ; buffer = buffer->next )
+   {
+      if ( buffer->generation != generation && !buffer->owned &&
+           !__sync_lock_test_and_set( &buffer->owned , 1 ) )
+         break;
+   }
+
+   if ( buffer == NULL )
+   {
+      buffer = malloc( sizeof( TraceBuffer ) );
+      if ( buffer == NULL )
+         return NULL;
+      buffer->owned = 1;
+      buffer->generation = generation - 1;
+      buffer->written = 0;
+
+      do
+      {
+         head = buffers;
+         buffer->next = head;
+      }
+      while ( !__sync_bool_compare_and_swap( &buffers , head , buffer ) );
+   }
+
+   buffer->tid = threadId();
+   pthread_setspecific( bufferKey , buffer );
+
+   return buffer;
+}
+
+
+static void record( char phase , const char * cat , const char * name )
+{
+   TraceBuffer * buffer = threadBuffer();
+   TraceEvent * e;
+   size_t len;
+   unsigned long n;
+
+   if ( buffer == NULL )
+      return;
+
+   /* a new start outdates the events */
+   if ( buffer->generation != generation )
+   {
+      buffer->written = 0;
+      __sync_synchronize();
+      buffer->generation = generation;
+   }
+
+   n = buffer->written;
+   e = &buffer->events[ n % LUATRACE_EVENTS ];
+   e->ts = nowNanos();
+   e->cat = cat;
+   e->phase = phase;
+
+   /* cuts long names between characters */
+   len = name != NULL ? strlen( name ) : 0;
+   if ( len >= LUATRACE_NAME )
+   {
+      len = LUATRACE_NAME - 1;
+      while ( len > 0 && ( name[ len ] & 0xc0 ) == 0x80 )
+         len--;
+   }
+   if ( len > 0 )
+      memcpy( e->name , name , len );
+   e->name[ len ] = '\0';
+
+   /* publishes the event to readers */
+   __sync_synchronize();
+   buffer->written = n + 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luatrace_begin
+*  ****/
+
+void luatrace_begin( const char * cat , const char * name )
+{
+   if ( luatrace_enabled )
+      record( 'B' , cat , name );
+}
+
+
+/***************************************************************************
+*
+*  Function: luatrace_end
+*  ****/
+
+void luatrace_end( const char * cat , const char * name )
+{
+   if ( luatrace_enabled )
+      record( 'E' , cat , name );
+}
+
+
+/***************************************************************************
+*
+*  Function: luatrace_start
+*  ****/
+
+int luatrace_start( int gcsteps )
+{
+   int was = luatrace_enabled;
+
+   gcSteps = gcsteps;
+   __sync_fetch_and_add( &generation , 1 );
+   luatrace_enabled = 1;
+
+   return was;
+}
+
+
+/***************************************************************************
+*
+*  Function: luatrace_stop
+*  ****/
+
+int luatrace_stop( void )
+{
+   int was = luatrace_enabled;
+
+   luatrace_enabled = 0;
+
+   return was;
+}
+
+
+/* A growing output string */
+typedef struct
+{
+   char * s;
+   size_t len;
+   size_t size;
+   int failed;
+} Output;
+
+
+/* Room for n characters and a terminating zero */
+static char * reserve( Output * out , size_t n )
+{
+   if ( out->failed )
+      return NULL;
+
+   if ( out->len + n >= out->size )
+   {
+      size_t size = out->size * 2 + n + 1;
+      char * s = realloc( out->s , size );
+
+      if ( s == NULL )
+      {
+         out->failed = 1;
+         return NULL;
+      }
+      out->s = s;
+      out->size = size;
+   }
+
+   return out->s + out->len;
+}
+
+
+static void putString( Output * out , const char * s )
+{
+   size_t n = strlen( s );
+   char * p = reserve( out , n );
+
+   if ( p != NULL )
+   {
+      memcpy( p , s , n + 1 );
+      out->len += n;
+   }
+}
+
+
+/* Puts s as a JSON string */
+static void putQuoted( Output * out , const char * s )
+{
+   /* a name expands at most six times */
+   char * p = reserve( out , strlen( s ) * 6 + 3 );
+   char * q = p;
+
+   if ( p == NULL )
+      return;
+
+   *q++ = '"';
+   for ( ; *s ; s++ )
+   {
+      unsigned char c = ( unsigned char ) *s;
+
+      if ( c == '"' || c == '\\' )
+      {
+         *q++ = '\\';
+         *q++ = c;
+      }
+      else if ( c < 0x20 )
+      {
+         sprintf( q , "\\u%04x" , c );
+         q += 6;
+      }
+      else
+      {
+         *q++ = c;
+      }
+   }
+   *q++ = '"';
+   *q = '\0';
+
+   out->len += q - p;
+}
+
+
+static void putEvent( Output * out , const TraceEvent * e , char phase , int64_t ts , long tid ,
+                      int pid , int * first )
+{
+   char head[ 96 ];
+
+   snprintf( head , sizeof( head ) , "%s{\"ph\":\"%c\",\"ts\":%lld.%03d,\"pid\":%d,\"tid\":%ld,\"cat\":" ,
+             *first ? "\n" : ",\n" , phase , ( long long ) ( ts / 1000 ) , ( int ) ( ts % 1000 ) ,
+             pid , tid );
+   putString( out , head );
+   putQuoted( out , e->cat );
+   putString( out , ",\"name\":" );
+   putQuoted( out , e->name );
+   putString( out , "}" );
+   *first = 0;
+}
+
+
+/* Whether end event e ends the span begun by b */
+static int ends( const TraceEvent * e , const TraceEvent * b )
+{
+   return strcmp( e->cat , b->cat ) == 0 &&
+          ( e->name[ 0 ] == '\0' || strcmp( e->name , b->name ) == 0 );
+}
+
+
+/***************************************************************************
+*
+*  Function: luatrace_json
+*  ****/
+
+char * luatrace_json( void )
+{
+   Output out = { NULL , 0 , 0 , 0 };
+   TraceBuffer * buffer;
+   TraceEvent * events = NULL;
+   int * open = NULL;
+   unsigned long dropped = 0;
+   int pid = ( int ) getpid();
+   int first = 1;
+   char tail[ 64 ];
+
+   putString( &out , "{\"traceEvents\":[" );
+
+   for ( buffer = buffers ; buffer != NULL && !out.failed ; buffer = buffer->next )
+   {
+      int current = generation;
+      int depth = 0;
+      unsigned long written , oldest , last;
+      int n;
+      int i;
+
+      if ( buffer->generation != current )
+         continue;
+      __sync_synchronize();
+      written = buffer->written;
+
+      /* copies the events, in case a new start outdates them meanwhile */
+      if ( events == NULL )
+      {
+         events = malloc( LUATRACE_EVENTS * sizeof( TraceEvent ) );
+         open = malloc( LUATRACE_EVENTS * sizeof( int ) );
+         if ( events == NULL || open == NULL )
+         {
+            out.failed = 1;
+            break;
+         }
+      }
+      oldest = ( written > LUATRACE_EVENTS ) ? written - LUATRACE_EVENTS : 0;
+      for ( last = oldest ; last < written ; )
+      {
+         unsigned long at = last % LUATRACE_EVENTS;
+         unsigned long k = LUATRACE_EVENTS - at;
+
+         if ( k > written - last )
+            k = written - last;
+         memcpy( &events[ last - oldest ] , &buffer->events[ at ] , k * sizeof( TraceEvent ) );
+         last += k;
+      }
+      __sync_synchronize();
+      if ( buffer->generation != current )
+         continue;
+
+      /* skips the events overwritten while copying, and the one being
+         written */
+      last = buffer->written + 1;
+      i = ( last > oldest + LUATRACE_EVENTS ) ? ( int ) ( last - LUATRACE_EVENTS - oldest ) : 0;
+      if ( i > ( int ) ( written - oldest ) )
+         i = ( int ) ( written - oldest );
+      n = ( int ) ( written - oldest );
+      dropped += oldest + i;
+
+      /* matches end events with the spans they end, ending those left
+         open inside them by errors, and skips ends of spans begun
+         before the start */
+      for ( ; i < n ; i++ )
+      {
+         TraceEvent * e = &events[ i ];
+         int j;
+
+         if ( e->phase == 'B' )
+         {
+            putEvent( &out , e , 'B' , e->ts , buffer->tid , pid , &first );
+            open[ depth++ ] = i;
+            continue;
+         }
+
+         for ( j = depth - 1 ; j >= 0 && !ends( e , &events[ open[ j ] ] ) ; j-- )
+            ;
+         if ( j < 0 )
+            continue;
+         while ( depth > j )
+         {
+            depth--;
+            putEvent( &out , &events[ open[ depth ] ] , 'E' , e->ts , buffer->tid , pid , &first );
+         }
+      }
+
+      /* spans still open end at the last event of the thread */
+      while ( depth > 0 )
+      {
+         depth--;
+         putEvent( &out , &events[ open[ depth ] ] , 'E' , events[ n - 1 ].ts , buffer->tid , pid ,
+                   &first );
+      }
+   }
+
+   free( events );
+   free( open );
+
+   snprintf( tail , sizeof( tail ) , "\n],\"otherData\":{\"dropped\":\"%lu\"}}\n" , dropped );
+   putString( &out , tail );
+
+   if ( out.failed )
+   {
+      free( out.s );
+      return NULL;
+   }
+
+   return out.s;
+}
+
+
+/* Tracer of the collector and require */
+static void traceState( lua_State * L , int event , const char * cat , const char * name , void * ud )
+{
+   if ( !luatrace_enabled )
+      return;
+   if ( !gcSteps && strcmp( cat , "gc" ) == 0 && strcmp( name , "step" ) == 0 )
+      return;
+   if ( event == LUA_TRACEBEGIN )
+      luatrace_begin( cat , name );
+   else
+      luatrace_end( cat , name );
+}
+
+
+/***************************************************************************
+*
+*  Lua interface
+*
+*****************************************************************************/
+
+/***************************************************************************
+*
+*  Function: luajava.trace.start
+*  ****/
+
+static int traceStart( lua_State * L )
+{
+   lua_pushboolean( L , luatrace_start( lua_toboolean( L , 1 ) ) );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.trace.stop
+*  ****/
+
+static int traceStop( lua_State * L )
+{
+   lua_pushboolean( L , luatrace_stop() );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.trace.begin
+*  ****/
+
+static int traceBegin( lua_State * L )
+{
+   luatrace_begin( "lua" , luaL_checkstring( L , 1 ) );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.trace.end
+*  ****/
+
+static int traceEnd( lua_State * L )
+{
+   luatrace_end( "lua" , luaL_optstring( L , 1 , NULL ) );
+   return 0;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava.trace.json
+*  ****/
+
+static int traceJson( lua_State * L )
+{
+   char * json = luatrace_json();
+
+   if ( json == NULL )
+      return luaL_error( L , "not enough memory" );
+   lua_pushstring( L , json );
+   free( json );
+   return 1;
+}
+
+
+/***************************************************************************
+*
+*  Function: luajava_opentrace
+*  ****/
+
+void luajava_opentrace( lua_State * L )
+{
+   static const luaL_Reg functions[] =
+   {
+      { "start" , &traceStart } ,
+      { "stop" , &traceStop } ,
+      { "begin" , &traceBegin } ,
+      { "end" , &traceEnd } ,
+      { "json" , &traceJson } ,
+      { NULL , NULL }
+   };
+
+   lua_pushstring( L , "trace" );
+   lua_newtable( L );
+   luaL_register( L , NULL , functions );
+   lua_settable( L , -3 );
+
+   lua_settracer( L , &traceState , NULL );
+}
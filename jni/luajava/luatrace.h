@@ -0,0 +1,133 @@
+/***************************************************************************
+*
+* $ED
+*    Timeline of script, collector and bridge activity in the Chrome
+*    trace event format, see luatrace.c.
+*
+*****************************************************************************/
+
+#ifndef LUATRACE_H
+#define LUATRACE_H
+
+#include "lua.h"
+
+/* Events kept per thread, the newest ones */
+#define LUATRACE_EVENTS       8192
+/* Room for the name of an event, longer names are cut */
+#define LUATRACE_NAME         44
+
+extern volatile int luatrace_enabled;
+
+
+/***************************************************************************
+*
+* $FC luatrace_begin
+*
+* $ED Description
+*    records the beginning of a span on the calling thread, if tracing is
+*    enabled
+*
+* $EP Function Parameters
+*    $P cat - category of the span, a string literal
+*    $P name - name of the span, copied
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luatrace_begin( const char * cat , const char * name );
+
+
+/***************************************************************************
+*
+* $FC luatrace_end
+*
+* $ED Description
+*    records the end of a span begun on the calling thread, if tracing is
+*    enabled. Spans begun inside it and left open, by lua errors, end
+*    with it.
+*
+* $EP Function Parameters
+*    $P cat - category of the span
+*    $P name - name of the span, or NULL for the innermost span
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luatrace_end( const char * cat , const char * name );
+
+
+/***************************************************************************
+*
+* $FC luatrace_start
+*
+* $ED Description
+*    discards the events recorded so far and starts tracing
+*
+* $EP Function Parameters
+*    $P gcsteps - whether to trace the steps of the incremental collector
+*                 too, not only its full cycles
+*
+* $FV Returned Value
+*    int - whether tracing was enabled before
+*
+*$. **********************************************************************/
+
+int luatrace_start( int gcsteps );
+
+
+/***************************************************************************
+*
+* $FC luatrace_stop
+*
+* $ED Description
+*    stops tracing; the events recorded are kept until the next start
+*
+* $FV Returned Value
+*    int - whether tracing was enabled before
+*
+*$. **********************************************************************/
+
+int luatrace_stop( void );
+
+
+/***************************************************************************
+*
+* $FC luatrace_json
+*
+* $ED Description
+*    formats the events recorded since the last start as a Chrome trace
+*    event JSON object, for chrome://tracing or Perfetto. May be called
+*    while tracing.
+*
+* $FV Returned Value
+*    char * - the trace, to be released with free, or NULL if out of
+*             memory
+*
+*$. **********************************************************************/
+
+char * luatrace_json( void );
+
+
+/***************************************************************************
+*
+* $FC luajava_opentrace
+*
+* $ED Description
+*    registers trace in the table on top of the stack (the luajava table)
+*    and traces the collector and require of the state
+*
+* $EP Function Parameters
+*    $P L - lua State
+*
+* $FV Returned Value
+*    void
+*
+*$. **********************************************************************/
+
+void luajava_opentrace( lua_State * L );
+
+#endif
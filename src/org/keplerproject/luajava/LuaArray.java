@@ -0,0 +1,250 @@
+package org.keplerproject.luajava;
+
+import java.util.AbstractList;
+import java.util.Iterator;
+import java.util.NoSuchElementException;
+
+/**
+ * A <code>java.util.List</code> view of the array part of a Lua table,
+ * obtained with {@link LuaObject#asList()}. Index 0 of the list is index 1
+ * of the table and the size is the table length (<code>#t</code>).
+ * <p>
+ * The view does not copy the table; elements are read and written with raw
+ * access. Iteration and {@link #toArray()} prefetch the elements in chunks,
+ * with one JNI crossing per chunk. Elements are converted as by
+ * {@link LuaState#toJavaObject(int)}. Storing <code>null</code> leaves a
+ * hole in the table, which changes its length.
+ */
+public class LuaArray extends AbstractList<Object>
+{
+	/**
+	 * Number of elements fetched per JNI crossing while iterating.
+	 */
+	private static final int CHUNK_SIZE = 256;
+
+	protected LuaObject table;
+
+	protected LuaState L;
+
+	protected LuaArray(LuaObject table)
+	{
+		this.table = table;
+		this.L = table.getLuaState();
+	}
+
+	/**
+	 * Returns the table backing this view.
+	 */
+	public LuaObject getLuaObject()
+	{
+		return table;
+	}
+
+	public int size()
+	{
+		synchronized (L)
+		{
+			table.push();
+			int n = L.objLen(-1);
+			L.pop(1);
+			return n;
+		}
+	}
+
+	public Object get(int index)
+	{
+		synchronized (L)
+		{
+			checkIndex(index, size());
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				L.rawGetI(-1, index + 1);
+				return L.toJavaObject(-1);
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	public Object set(int index, Object element)
+	{
+		synchronized (L)
+		{
+			Object old = get(index);
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				L.pushObjectValue(element);
+				L.rawSetI(-2, index + 1);
+				return old;
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	/**
+	 * Inserts an element, shifting the following ones up like
+	 * <code>table.insert</code> does.
+	 */
+	public void add(int index, Object element)
+	{
+		synchronized (L)
+		{
+			int n = size();
+			checkIndex(index, n + 1);
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				for (int i = n; i > index; i--)
+				{
+					L.rawGetI(-1, i);
+					L.rawSetI(-2, i + 1);
+				}
+				L.pushObjectValue(element);
+				L.rawSetI(-2, index + 1);
+				modCount++;
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	/**
+	 * Removes an element, shifting the following ones down like
+	 * <code>table.remove</code> does.
+	 */
+	public Object remove(int index)
+	{
+		synchronized (L)
+		{
+			int n = size();
+			Object old = get(index);
+			int top = L.getTop();
+			table.push();
+			for (int i = index + 1; i < n; i++)
+			{
+				L.rawGetI(-1, i + 1);
+				L.rawSetI(-2, i);
+			}
+			L.pushNil();
+			L.rawSetI(-2, n);
+			L.setTop(top);
+			modCount++;
+			return old;
+		}
+	}
+
+	public Object[] toArray()
+	{
+		synchronized (L)
+		{
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				return L.rawGetRange(-1, 1, L.objLen(-1));
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	public Iterator<Object> iterator()
+	{
+		return new Iterator<Object>()
+		{
+			private Object[] chunk = new Object[0];
+
+			private int pos = 0;
+
+			private int next = 0;
+
+			private int last = -1;
+
+			public boolean hasNext()
+			{
+				if (pos < chunk.length)
+					return true;
+				fetch();
+				return pos < chunk.length;
+			}
+
+			public Object next()
+			{
+				if (!hasNext())
+					throw new NoSuchElementException();
+				last = next - chunk.length + pos;
+				return chunk[pos++];
+			}
+
+			public void remove()
+			{
+				if (last < 0)
+					throw new IllegalStateException();
+				LuaArray.this.remove(last);
+				// the remaining prefetched elements moved down by one
+				next--;
+				last = -1;
+			}
+
+			private void fetch()
+			{
+				synchronized (L)
+				{
+					int top = L.getTop();
+					try
+					{
+						table.push();
+						int count = Math.min(CHUNK_SIZE, L.objLen(-1) - next);
+						chunk = L.rawGetRange(-1, next + 1, Math.max(count, 0));
+						pos = 0;
+						next += chunk.length;
+					}
+					catch (LuaException e)
+					{
+						throw new RuntimeException(e);
+					}
+					finally
+					{
+						L.setTop(top);
+					}
+				}
+			}
+		};
+	}
+
+	private static void checkIndex(int index, int size)
+	{
+		if (index < 0 || index >= size)
+			throw new IndexOutOfBoundsException("Index: " + index + ", Size: " + size);
+	}
+}
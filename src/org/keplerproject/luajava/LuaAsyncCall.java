@@ -0,0 +1,194 @@
+package org.keplerproject.luajava;
+
+import java.util.concurrent.CancellationException;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Executor;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ThreadFactory;
+
+/**
+ * Drives a Lua function running as a coroutine for
+ * {@link LuaObject#callAsync(Object[], Executor)}. Each step resumes the
+ * coroutine on the owner executor; when it yields a {@link Future}
+ * (<code>luajava.await</code>) the call is parked until the future
+ * completes, and the state is free for other work meanwhile.
+ */
+class LuaAsyncCall implements Runnable
+{
+	/**
+	 * Runs steps on the thread that schedules them.
+	 */
+	static final Executor DIRECT = new Executor()
+	{
+		public void execute(Runnable command)
+		{
+			command.run();
+		}
+	};
+
+	/**
+	 * Waits on futures that cannot notify their completion. Each one
+	 * costs a thread while pending, so callback based APIs should complete
+	 * a {@link LuaFuture} instead.
+	 */
+	private static ExecutorService waiters;
+
+	private LuaState L;
+	private LuaObject step;
+	private Executor owner;
+	private LuaFuture result = new LuaFuture();
+	private Object[] resumeArgs;
+
+	LuaAsyncCall(LuaObject function, Object[] args, Executor owner) throws LuaException
+	{
+		this.L = function.getLuaState();
+		this.owner = owner;
+		this.resumeArgs = args;
+
+		synchronized (L)
+		{
+			L.getField(LuaState.LUA_REGISTRYINDEX.intValue(), "luajava.async");
+			LuaObject async = L.getLuaObject(-1);
+			L.pop(1);
+			step = (LuaObject) async.call(new Object[] { function });
+		}
+	}
+
+	LuaFuture start()
+	{
+		owner.execute(this);
+		return result;
+	}
+
+	public void run()
+	{
+		Object[] args = resumeArgs;
+		resumeArgs = null;
+
+		while (!result.isCancelled())
+		{
+			Object[] res;
+			try
+			{
+				res = step.call(args, LuaState.LUA_MULTRET.intValue());
+			}
+			catch (LuaException e)
+			{
+				result.fail(e);
+				return;
+			}
+
+			String status = (String) res[0];
+			Object value = res.length > 1 ? res[1] : null;
+
+			if (status.equals("done"))
+			{
+				result.complete(value);
+				return;
+			}
+			if (status.equals("error"))
+			{
+				result.fail(new LuaException(String.valueOf(value)));
+				return;
+			}
+
+			if (!(value instanceof Future))
+			{
+				/* a plain yield gives other work on the owner a turn */
+				args = null;
+				if (owner == DIRECT)
+					continue;
+				owner.execute(this);
+				return;
+			}
+
+			Future<?> future = (Future<?>) value;
+			if (future.isDone())
+			{
+				args = outcome(future);
+				continue;
+			}
+			park(future);
+			return;
+		}
+	}
+
+	private void park(final Future<?> future)
+	{
+		final Runnable resume = new Runnable()
+		{
+			public void run()
+			{
+				resumeArgs = outcome(future);
+				owner.execute(LuaAsyncCall.this);
+			}
+		};
+
+		if (future instanceof LuaFuture)
+		{
+			((LuaFuture) future).addListener(resume);
+			return;
+		}
+
+		getWaiters().execute(new Runnable()
+		{
+			public void run()
+			{
+				try
+				{
+					future.get();
+				}
+				catch (Exception e)
+				{
+					/* reported by outcome() */
+				}
+				resume.run();
+			}
+		});
+	}
+
+	/**
+	 * Values resuming a coroutine awaiting a completed future.
+	 */
+	private static Object[] outcome(Future<?> future)
+	{
+		try
+		{
+			return new Object[] { Boolean.TRUE, future.get() };
+		}
+		catch (ExecutionException e)
+		{
+			Throwable cause = e.getCause() != null ? e.getCause() : e;
+			String message = cause.getMessage() != null ? cause.getMessage() : cause.toString();
+			return new Object[] { Boolean.FALSE, message };
+		}
+		catch (CancellationException e)
+		{
+			return new Object[] { Boolean.FALSE, "cancelled" };
+		}
+		catch (InterruptedException e)
+		{
+			Thread.currentThread().interrupt();
+			return new Object[] { Boolean.FALSE, "interrupted" };
+		}
+	}
+
+	private static synchronized ExecutorService getWaiters()
+	{
+		if (waiters == null)
+		{
+			waiters = Executors.newCachedThreadPool(new ThreadFactory()
+			{
+				public Thread newThread(Runnable r)
+				{
+					Thread t = new Thread(r, "luajava-await");
+					t.setDaemon(true);
+					return t;
+				}
+			});
+		}
+		return waiters;
+	}
+}
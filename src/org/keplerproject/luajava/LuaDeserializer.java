@@ -0,0 +1,208 @@
+package org.keplerproject.luajava;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.UnsupportedEncodingException;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Decodes values written by <code>luajava.serialize</code> or
+ * {@link LuaState#serialize(int)} without a Lua state.
+ * <p>
+ * Values are mapped as by {@link LuaState#tableToJava(int, String)} with the
+ * default rule: <code>nil</code> becomes <code>null</code>, numbers become
+ * <code>Double</code>, strings are decoded as UTF-8, a table with only an
+ * array part becomes an <code>ArrayList</code> and any other table a
+ * <code>HashMap</code> whose array keys are <code>Double</code>s. Unlike
+ * <code>tableToJava</code>, shared tables decode to the same Java object and
+ * cycles are preserved.
+ * <p>
+ * The format is documented in <code>jni/luajava/luaserialize.c</code>.
+ */
+public class LuaDeserializer
+{
+	/**
+	 * Format version understood by this decoder.
+	 */
+	public static final int VERSION = 1;
+
+	private static final int TNIL = 0x00;
+	private static final int TFALSE = 0x01;
+	private static final int TTRUE = 0x02;
+	private static final int TINT = 0x03;
+	private static final int TDOUBLE = 0x04;
+	private static final int TSTRING = 0x05;
+	private static final int TTABLE = 0x06;
+	private static final int TREF = 0x07;
+
+	private static final int MINREF = 3;
+
+	private static final int MAXDEPTH = 200;
+
+	private final byte[] data;
+
+	private int pos;
+
+	private final List<Object> refs = new ArrayList<Object>();
+
+	private LuaDeserializer(byte[] data)
+	{
+		this.data = data;
+	}
+
+	/**
+	 * Decodes a serialized value.
+	 * @param data bytes produced by <code>luajava.serialize</code>
+	 * @return the decoded value, possibly <code>null</code>
+	 * @throws LuaException if the data is corrupt or of another version
+	 */
+	public static Object decode(byte[] data) throws LuaException
+	{
+		if (data.length < 3 || data[0] != 'L' || data[1] != 'S')
+			throw new LuaException("deserialize: not serialized data");
+		if (data[2] != VERSION)
+			throw new LuaException("deserialize: unsupported version " + data[2]);
+
+		LuaDeserializer d = new LuaDeserializer(data);
+		d.pos = 3;
+		Object value = d.readValue(0);
+		if (d.pos != data.length)
+			throw corrupt();
+		return value;
+	}
+
+	/**
+	 * Reads the whole stream and decodes it.
+	 */
+	public static Object decode(InputStream input) throws IOException, LuaException
+	{
+		ByteArrayOutputStream output = new ByteArrayOutputStream(4096);
+		byte[] buffer = new byte[4096];
+		int n;
+		while ((n = input.read(buffer)) != -1)
+			output.write(buffer, 0, n);
+		return decode(output.toByteArray());
+	}
+
+	private static LuaException corrupt()
+	{
+		return new LuaException("deserialize: corrupt or truncated data");
+	}
+
+	private int readByte() throws LuaException
+	{
+		if (pos >= data.length)
+			throw corrupt();
+		return data[pos++] & 0xff;
+	}
+
+	private int readVarint() throws LuaException
+	{
+		int v = 0;
+		for (int shift = 0; shift <= 28; shift += 7)
+		{
+			int b = readByte();
+			v |= (b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return v;
+		}
+		throw corrupt();
+	}
+
+	private int readSize() throws LuaException
+	{
+		int n = readVarint();
+		if (n < 0 || n > data.length - pos)
+			throw corrupt();
+		return n;
+	}
+
+	private Object readValue(int depth) throws LuaException
+	{
+		int tag = readByte();
+		switch (tag)
+		{
+		case TNIL:
+			return null;
+		case TFALSE:
+			return Boolean.FALSE;
+		case TTRUE:
+			return Boolean.TRUE;
+		case TINT:
+		{
+			int v = readVarint();
+			return new Double((v >>> 1) ^ -(v & 1));
+		}
+		case TDOUBLE:
+		{
+			if (data.length - pos < 8)
+				throw corrupt();
+			long bits = 0;
+			for (int i = 0; i < 8; i++)
+				bits = (bits << 8) | (data[pos++] & 0xff);
+			return new Double(Double.longBitsToDouble(bits));
+		}
+		case TSTRING:
+		{
+			int len = readSize();
+			String s;
+			try
+			{
+				s = new String(data, pos, len, "UTF-8");
+			}
+			catch (UnsupportedEncodingException e)
+			{
+				throw new LuaException(e);
+			}
+			pos += len;
+			if (len >= MINREF)
+				refs.add(s);
+			return s;
+		}
+		case TTABLE:
+			return readTable(depth);
+		case TREF:
+		{
+			int ref = readVarint();
+			if (ref < 0 || ref >= refs.size())
+				throw corrupt();
+			return refs.get(ref);
+		}
+		}
+		throw corrupt();
+	}
+
+	private Object readTable(int depth) throws LuaException
+	{
+		int narr = readSize();
+		int nhash = readSize();
+		if (depth >= MAXDEPTH)
+			throw corrupt();
+
+		if (nhash == 0)
+		{
+			List<Object> list = new ArrayList<Object>(narr);
+			refs.add(list);
+			for (int i = 0; i < narr; i++)
+				list.add(readValue(depth + 1));
+			return list;
+		}
+
+		Map<Object, Object> map = new HashMap<Object, Object>(2 * (narr + nhash));
+		refs.add(map);
+		for (int i = 1; i <= narr; i++)
+			map.put(new Double(i), readValue(depth + 1));
+		for (int i = 0; i < nhash; i++)
+		{
+			Object key = readValue(depth + 1);
+			if (key == null)
+				throw corrupt();
+			map.put(key, readValue(depth + 1));
+		}
+		return map;
+	}
+}
@@ -0,0 +1,95 @@
+package org.keplerproject.luajava;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.FutureTask;
+
+/**
+ * A future completed explicitly, with listeners run on completion. It is
+ * returned by {@link LuaObject#callAsync(Object[])}, and is the cheapest
+ * future to hand to <code>luajava.await</code>: a coroutine awaiting it is
+ * resumed from its listener instead of a thread blocked in
+ * <code>get()</code>.
+ * <p>
+ * Callback based Java APIs are bridged by completing a LuaFuture from the
+ * callback:
+ * <pre>
+ * final LuaFuture f = new LuaFuture();
+ * client.fetch(url, new Callback() {
+ *     public void onResult(String body) { f.complete(body); }
+ *     public void onError(Exception e) { f.fail(e); }
+ * });
+ * return f;
+ * </pre>
+ */
+public class LuaFuture extends FutureTask<Object>
+{
+	private static final Callable<Object> NONE = new Callable<Object>()
+	{
+		public Object call()
+		{
+			return null;
+		}
+	};
+
+	private List<Runnable> listeners = new ArrayList<Runnable>();
+
+	public LuaFuture()
+	{
+		super(NONE);
+	}
+
+	/**
+	 * Does nothing: a LuaFuture only completes through {@link #complete} or
+	 * {@link #fail}.
+	 */
+	public void run()
+	{
+	}
+
+	/**
+	 * Completes the future with <code>value</code>. Ignored if it is done.
+	 */
+	public void complete(Object value)
+	{
+		set(value);
+	}
+
+	/**
+	 * Completes the future with an error. Ignored if it is done.
+	 */
+	public void fail(Throwable error)
+	{
+		setException(error);
+	}
+
+	/**
+	 * Runs <code>listener</code> once the future is done, on the thread
+	 * completing it, or right away if it is done already.
+	 */
+	public void addListener(Runnable listener)
+	{
+		synchronized (listeners)
+		{
+			if (!isDone())
+			{
+				listeners.add(listener);
+				return;
+			}
+		}
+		listener.run();
+	}
+
+	protected void done()
+	{
+		Runnable[] pending;
+		synchronized (listeners)
+		{
+			pending = listeners.toArray(new Runnable[listeners.size()]);
+			listeners.clear();
+		}
+		for (int i = 0; i < pending.length; i++)
+			pending[i].run();
+	}
+}
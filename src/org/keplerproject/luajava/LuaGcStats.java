@@ -0,0 +1,120 @@
+package org.keplerproject.luajava;
+
+/**
+ * Statistics of the garbage collector of a Lua state since it opened or
+ * since <code>gc(LUA_GCRESETSTATS, 0)</code>, as returned by
+ * {@link LuaState#getGcStats}: collections, incremental steps by phase,
+ * bytes allocated and freed, <code>__gc</code> metamethods called and how
+ * far the collector ran behind allocation.
+ * <p>
+ * Times are only measured while timing is on, with
+ * <code>gc(LUA_GCTIMING, 1)</code>, which reads the clock a few times per
+ * step. The atomic phase runs in one step and cannot be interrupted, so
+ * its length is the pause it causes; {@link #pauses} counts them by
+ * length. From Lua the same statistics are
+ * <code>collectgarbage("stats")</code>.
+ * <pre>
+ * L.gc(LuaState.LUA_GCTIMING, 1);
+ * ...
+ * Log.i(TAG, L.getGcStats().toString());
+ * </pre>
+ */
+public final class LuaGcStats
+{
+	/** Phases, indices of {@link #phaseSteps} and {@link #phaseMillis} */
+	public static final int PROPAGATE = 0;
+	public static final int ATOMIC = 1;
+	public static final int SWEEPSTRING = 2;
+	public static final int SWEEP = 3;
+	public static final int FINALIZE = 4;
+	public static final int PHASES = 5;
+
+	/** Number of bins of {@link #pauses} */
+	public static final int PAUSE_BINS = 10;
+
+	private static final String[] PHASE_NAMES =
+		{ "propagate", "atomic", "sweepstring", "sweep", "finalize" };
+
+	public final long cycles;
+	/** Incremental steps and full collections */
+	public final long steps;
+	public final long finalized;
+	public final double allocatedBytes;
+	public final double freedBytes;
+	/** Most bytes the collector was behind schedule */
+	public final double maxDebtBytes;
+	public final double stepMillis;
+	public final double maxStepMillis;
+	public final double maxAtomicMillis;
+	/** Single steps run in each phase, marking the roots counting as propagate */
+	public final long[] phaseSteps;
+	public final double[] phaseMillis;
+	/**
+	 * pauses[i] counts the atomic phases shorter than 0.125 * 2^i ms, and
+	 * longer than the previous bin; the last bin counts the longer ones.
+	 */
+	public final long[] pauses;
+
+	/** From the values of _getGcStats, in the order of luajava.c */
+	LuaGcStats(double[] values)
+	{
+		int i = 0;
+
+		cycles = (long) values[i++];
+		steps = (long) values[i++];
+		finalized = (long) values[i++];
+		allocatedBytes = values[i++];
+		freedBytes = values[i++];
+		maxDebtBytes = values[i++];
+		stepMillis = values[i++];
+		maxStepMillis = values[i++];
+		maxAtomicMillis = values[i++];
+		phaseSteps = new long[PHASES];
+		for (int p = 0; p < PHASES; p++)
+			phaseSteps[p] = (long) values[i++];
+		phaseMillis = new double[PHASES];
+		for (int p = 0; p < PHASES; p++)
+			phaseMillis[p] = values[i++];
+		pauses = new long[PAUSE_BINS];
+		for (int b = 0; b < PAUSE_BINS; b++)
+			pauses[b] = (long) values[i++];
+	}
+
+	/**
+	 * Upper bound, in ms, of the bin <code>b</code> of {@link #pauses};
+	 * infinite for the last one.
+	 */
+	public static double getPauseLimit(int b)
+	{
+		return b < PAUSE_BINS - 1 ? 0.125 * (1 << b) : Double.POSITIVE_INFINITY;
+	}
+
+	/**
+	 * The statistics formatted for people to read.
+	 */
+	public String toString()
+	{
+		StringBuilder s = new StringBuilder();
+
+		s.append(String.format("%d cycles, %d steps, %d finalized\n", cycles, steps, finalized));
+		s.append(String.format("%.0f KB allocated, %.0f KB freed, %.0f KB most behind\n",
+				allocatedBytes / 1024, freedBytes / 1024, maxDebtBytes / 1024));
+		s.append(String.format("%.3f ms in steps, longest %.3f ms, longest atomic %.3f ms\n",
+				stepMillis, maxStepMillis, maxAtomicMillis));
+		s.append(String.format("%-12s %12s %12s\n", "phase", "steps", "ms"));
+		for (int p = 0; p < PHASES; p++)
+			s.append(String.format("%-12s %12d %12.3f\n", PHASE_NAMES[p], phaseSteps[p], phaseMillis[p]));
+		s.append("atomic pauses:");
+		for (int b = 0; b < PAUSE_BINS; b++)
+		{
+			if (pauses[b] == 0)
+				continue;
+			if (b < PAUSE_BINS - 1)
+				s.append(String.format(" <%sms:%d", getPauseLimit(b), pauses[b]));
+			else
+				s.append(String.format(" >=%sms:%d", getPauseLimit(b - 1), pauses[b]));
+		}
+		s.append('\n');
+		return s.toString();
+	}
+}
@@ -0,0 +1,117 @@
+package org.keplerproject.luajava;
+
+import java.util.Iterator;
+import java.util.NoSuchElementException;
+
+/**
+ * A <code>java.util.Iterator</code> over the values produced by a Lua
+ * iterator function, coroutine or table, obtained with
+ * {@link LuaObject#asIterator()}.
+ * <p>
+ * The Lua iterator is advanced natively and its results are buffered, so the
+ * Java side crosses JNI once per chunk instead of running a <code>pcall</code>
+ * for every element. A coroutine produces the first value of each yield, then
+ * the first value returned by its body. A <code>nil</code> value, or a yield
+ * or return of no values, ends the iteration. Values are converted as by
+ * {@link LuaState#toJavaObject(int)}.
+ */
+public class LuaIterator implements Iterator<Object>
+{
+	/**
+	 * Default number of values fetched per JNI crossing.
+	 */
+	public static final int DEFAULT_CHUNK_SIZE = 64;
+
+	protected LuaObject cursor;
+
+	protected LuaState L;
+
+	private final Object[] buffer;
+
+	private int count = 0;
+
+	private int pos = 0;
+
+	private boolean finished = false;
+
+	private long estimate;
+
+	protected LuaIterator(LuaObject cursor, long estimate)
+	{
+		this(cursor, estimate, DEFAULT_CHUNK_SIZE);
+	}
+
+	protected LuaIterator(LuaObject cursor, long estimate, int chunkSize)
+	{
+		this.cursor = cursor;
+		this.L = cursor.getLuaState();
+		this.estimate = estimate;
+		this.buffer = new Object[chunkSize];
+	}
+
+	/**
+	 * Returns an estimate of the number of remaining values, in the manner of
+	 * <code>Spliterator.estimateSize()</code>. The estimate is exact for tables
+	 * without holes, and <code>Long.MAX_VALUE</code> (unknown) for functions and
+	 * coroutines until their last chunk has been fetched.
+	 */
+	public long estimateSize()
+	{
+		return estimate;
+	}
+
+	public boolean hasNext()
+	{
+		if (pos < count)
+			return true;
+		if (finished)
+			return false;
+		fetch();
+		return pos < count;
+	}
+
+	public Object next()
+	{
+		if (!hasNext())
+			throw new NoSuchElementException();
+		Object value = buffer[pos];
+		buffer[pos++] = null;
+		if (estimate > 0 && estimate != Long.MAX_VALUE)
+			estimate--;
+		return value;
+	}
+
+	public void remove()
+	{
+		throw new UnsupportedOperationException();
+	}
+
+	private void fetch()
+	{
+		synchronized (L)
+		{
+			int top = L.getTop();
+			try
+			{
+				cursor.push();
+				count = L.iterChunk(-1, buffer);
+				pos = 0;
+				if (count < buffer.length)
+				{
+					finished = true;
+					estimate = count;
+				}
+			}
+			catch (LuaException e)
+			{
+				finished = true;
+				count = 0;
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+}
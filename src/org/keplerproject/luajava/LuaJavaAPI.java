@@ -24,10 +24,13 @@
 
 package org.keplerproject.luajava;
 
+import java.lang.reflect.Array;
 import java.lang.reflect.Constructor;
 import java.lang.reflect.Field;
 import java.lang.reflect.Method;
 import java.lang.reflect.Modifier;
+import java.util.Enumeration;
+import java.util.Iterator;
 
 /**
  * Class that contains functions accessed by lua.
@@ -485,6 +488,68 @@ public final class LuaJavaAPI
     }
   }
 
+  /**
+   * Returns the object walked by <code>luajava.iter</code>: the iterator of
+   * an <code>Iterable</code>, or the object itself if it is already an
+   * <code>Iterator</code>, an <code>Enumeration</code> or an array.
+   * 
+   * @param obj object to be iterated
+   * @return Iterator, Enumeration or array
+   * @throws LuaException if the object cannot be iterated
+   */
+  public static Object iterSource(Object obj) throws LuaException
+  {
+    if (obj instanceof Iterable)
+    {
+      return ((Iterable) obj).iterator();
+    }
+    if (obj instanceof Iterator || obj instanceof Enumeration
+        || obj.getClass().isArray())
+    {
+      return obj;
+    }
+    throw new LuaException("Object is not an Iterable, Iterator, Enumeration or array.");
+  }
+
+  /**
+   * Fills <code>buffer</code> with the next elements of an iterator source,
+   * so that <code>luajava.iter</code> crosses JNI once per buffer instead of
+   * twice per element.
+   * 
+   * @param source object returned by {@link #iterSource(Object)}
+   * @param offset number of elements fetched so far
+   * @param buffer array receiving the elements
+   * @return number of elements stored, less than the buffer length at the end
+   */
+  public static int iterFill(Object source, int offset, Object[] buffer)
+  {
+    int n = 0;
+
+    if (source instanceof Iterator)
+    {
+      Iterator it = (Iterator) source;
+      while (n < buffer.length && it.hasNext())
+        buffer[n++] = it.next();
+    }
+    else if (source instanceof Enumeration)
+    {
+      Enumeration e = (Enumeration) source;
+      while (n < buffer.length && e.hasMoreElements())
+        buffer[n++] = e.nextElement();
+    }
+    else
+    {
+      int len = Array.getLength(source);
+      while (n < buffer.length && offset + n < len)
+      {
+        buffer[n] = Array.get(source, offset + n);
+        n++;
+      }
+    }
+
+    return n;
+  }
+
   private static Object compareTypes(LuaState L, Class parameter, int idx)
     throws LuaException
   {
@@ -27,6 +27,7 @@ package org.keplerproject.luajava;
 import java.lang.reflect.InvocationHandler;
 import java.lang.reflect.Proxy;
 import java.util.StringTokenizer;
+import java.util.concurrent.Executor;
 
 /**
  * This class represents a Lua object of any type. A LuaObject is constructed by a {@link LuaState} object using one of
@@ -387,6 +388,100 @@ public class LuaObject
 		return L.getLuaObject(this, field);
 	}
 
+	/**
+	 * Returns a live <code>java.util.Map</code> view of the table represented by
+	 * <code>this</code>. Reads go to the table on demand, nothing is copied.
+	 * 
+	 * @throws LuaException
+	 *             When <code>this</code> is not a table
+	 */
+	public LuaTable asMap() throws LuaException
+	{
+		if (!isTable())
+			throw new LuaException("Invalid Object. Must be Table.");
+		return new LuaTable(this);
+	}
+
+	/**
+	 * Returns a live <code>java.util.List</code> view of the array part of the table
+	 * represented by <code>this</code>. Index 0 of the list is index 1 of the table.
+	 * 
+	 * @throws LuaException
+	 *             When <code>this</code> is not a table
+	 */
+	public LuaArray asList() throws LuaException
+	{
+		if (!isTable())
+			throw new LuaException("Invalid Object. Must be Table.");
+		return new LuaArray(this);
+	}
+
+	/**
+	 * Returns a <code>java.util.Iterator</code> over the values produced by
+	 * <code>this</code>, which can be an iterator function (called with no state
+	 * and a <code>nil</code> initial control value), a coroutine (each yield
+	 * produces a value, then the first value returned by its body) or a table
+	 * (its array part is walked like <code>ipairs</code> does). A
+	 * <code>nil</code> value ends the iteration. Values are fetched in chunks,
+	 * one JNI crossing per chunk.
+	 * 
+	 * @throws LuaException
+	 *             When <code>this</code> is not a function, coroutine or table
+	 */
+	public LuaIterator asIterator() throws LuaException
+	{
+		return asIterator(null, null);
+	}
+
+	/**
+	 * Returns a <code>java.util.Iterator</code> over the generic-for iterator
+	 * <code>this, state, control</code>, as returned for example by
+	 * <code>pairs</code> or <code>string.gmatch</code>. Each element is the
+	 * first value returned by the iterator function.
+	 * 
+	 * @param state
+	 *            invariant state passed to the iterator function
+	 * @param control
+	 *            initial value of the control variable
+	 * @throws LuaException
+	 *             When <code>this</code> is not a function, coroutine or table
+	 */
+	public LuaIterator asIterator(Object state, Object control) throws LuaException
+	{
+		synchronized (L)
+		{
+			int type = type();
+			long estimate = Long.MAX_VALUE;
+
+			if (type != LuaState.LUA_TFUNCTION.intValue() && type != LuaState.LUA_TTABLE.intValue()
+					&& type != LuaState.LUA_TTHREAD.intValue())
+				throw new LuaException("Invalid object. Not a function, coroutine or table.");
+
+			L.createTable(3, 0);
+			push();
+			L.rawSetI(-2, 1);
+			if (type == LuaState.LUA_TTABLE.intValue())
+			{
+				push();
+				estimate = L.objLen(-1);
+				L.pop(1);
+				L.pushNumber(0);
+				L.rawSetI(-2, 3);
+			}
+			else if (type == LuaState.LUA_TFUNCTION.intValue())
+			{
+				L.pushObjectValue(state);
+				L.rawSetI(-2, 2);
+				L.pushObjectValue(control);
+				L.rawSetI(-2, 3);
+			}
+			LuaObject cursor = L.getLuaObject(-1);
+			L.pop(1);
+
+			return new LuaIterator(cursor, estimate);
+		}
+	}
+
 	/**
 	 * Calls the object represented by <code>this</code> using Lua function pcall.
 	 * 
@@ -444,6 +539,10 @@ public class LuaObject
 				{
 					str = "Error while running the error handler function. " + str;
 				}
+				else if (err == LuaState.LUA_ERRQUOTA.intValue())
+				{
+					str = "Quota exceeded. " + str;
+				}
 				else
 				{
 					str = "Lua Error code " + err + ". " + str;
@@ -483,6 +582,44 @@ public class LuaObject
 		return call(args, 1)[0];
 	}
 
+	/**
+	 * Calls the object represented by <code>this</code> as a coroutine, which can suspend on Java futures with
+	 * <code>luajava.await</code> without blocking the state. The coroutine runs on the calling thread until it first
+	 * suspends, and is resumed on the thread completing the awaited future.
+	 * 
+	 * @param args -
+	 *            Call arguments
+	 * @return LuaFuture - Completed with the first returned object, or failed with a LuaException
+	 * @throws LuaException
+	 */
+	public LuaFuture callAsync(Object[] args) throws LuaException
+	{
+		return callAsync(args, LuaAsyncCall.DIRECT);
+	}
+
+	/**
+	 * Calls the object represented by <code>this</code> as a coroutine, which can suspend on Java futures with
+	 * <code>luajava.await</code> without blocking the state. Every resume of the coroutine runs on
+	 * <code>owner</code>, for example a single thread owning the state. Cancelling the returned future abandons the
+	 * coroutine at its next resume.
+	 * 
+	 * @param args -
+	 *            Call arguments
+	 * @param owner -
+	 *            Executor running the coroutine
+	 * @return LuaFuture - Completed with the first returned object, or failed with a LuaException
+	 * @throws LuaException
+	 */
+	public LuaFuture callAsync(Object[] args, Executor owner) throws LuaException
+	{
+		synchronized (L)
+		{
+			if (!isFunction() && !isTable() && !isUserdata())
+				throw new LuaException("Invalid object. Not a function, table or userdata .");
+		}
+		return new LuaAsyncCall(this, args, owner).start();
+	}
+
 	public String toString()
 	{
 		synchronized (L)
@@ -84,6 +84,12 @@ public class LuaState
    */
   final public static Integer LUA_ERRERR    = new Integer(5);
 
+  /**
+   * a quota set with {@link #setQuota} was exceeded, or the state was
+   * interrupted.
+   */
+  final public static Integer LUA_ERRQUOTA  = new Integer(6);
+
   /**
    * Opens the library containing the luajava API
    */
@@ -224,7 +230,40 @@ public class LuaState
   final public static Integer LUA_GCSTEP       = new Integer(5);
   final public static Integer LUA_GCSETPAUSE   = new Integer(6);
   final public static Integer LUA_GCSETSTEPMUL = new Integer(7);
+  final public static Integer LUA_GCALLOC      = new Integer(8);
+  final public static Integer LUA_GCALLOCB     = new Integer(9);
+  final public static Integer LUA_GCCYCLES     = new Integer(10);
+  final public static Integer LUA_GCTIMING     = new Integer(11);
+  final public static Integer LUA_GCRESETSTATS = new Integer(12);
   private synchronized native int  _gc(CPtr ptr, int what, int data);
+  private synchronized native double[] _getGcStats(CPtr ptr);
+
+  // Quotas
+  final public static Integer LUA_QUOTAERROR   = new Integer(0);
+  final public static Integer LUA_QUOTAYIELD   = new Integer(1);
+  private synchronized native void _setQuota(CPtr ptr, long instructions, long millis, int mode);
+  private synchronized native long _getQuotaUsed(CPtr ptr);
+  // not synchronized: called while another thread runs the state
+  private native void _interrupt(CPtr ptr);
+
+  // Profiler
+  final public static Integer LUA_PROFILETIME  = new Integer(0);
+  final public static Integer LUA_PROFILECOUNT = new Integer(1);
+  private synchronized native int _startProfiler(CPtr ptr, int mode, int interval, int size);
+  private synchronized native void _stopProfiler(CPtr ptr);
+  private synchronized native String _getProfile(CPtr ptr);
+
+  // Heap profiler
+  private synchronized native void _startHeapProfiler(CPtr ptr, int interval);
+  private synchronized native void _stopHeapProfiler(CPtr ptr);
+  private synchronized native String _getHeapReport(CPtr ptr, int top);
+  private synchronized native String _getRefStats(CPtr ptr);
+
+  // Startup profiler
+  private synchronized native void _startStartupProfiler(CPtr ptr);
+  private synchronized native void _stopStartupProfiler(CPtr ptr);
+  private synchronized native String _getStartupReport(CPtr ptr);
+  private synchronized native void _traceSpan(CPtr ptr, int event, String cat, String name);
 
   // Miscellaneous Functions
   private synchronized native int    _error(CPtr ptr);
@@ -617,6 +656,184 @@ public class LuaState
   {
     return _getGcCount(luaState);
   }
+
+  /**
+   * Returns the statistics of the collector, see {@link LuaGcStats}.
+   */
+  public LuaGcStats getGcStats()
+  {
+    return new LuaGcStats(_getGcStats(luaState));
+  }
+
+  /**
+   * Limits the work done by the state from now on. Scripts exceeding
+   * <code>instructions</code> or running longer than <code>millis</code>
+   * (0 for no limit) get a LUA_ERRQUOTA error, which pcall catches but is
+   * raised again until the next call to setQuota. With
+   * <code>LUA_QUOTAYIELD</code> coroutines are instead forced to yield,
+   * and get a fresh quota each time. Quotas are checked every thousand
+   * instructions or so, not inside C or Java functions.
+   * <p>
+   * Calling <code>setQuota(0, 0, LUA_QUOTAERROR)</code> before running a
+   * script clears a previous {@link #interrupt} and makes the next one
+   * reliable.
+   */
+  public void setQuota(long instructions, long millis, int mode)
+  {
+    _setQuota(luaState, instructions, millis, mode);
+  }
+
+  /**
+   * Returns about how many instructions ran since the last call to
+   * {@link #setQuota}, or the last forced yield.
+   */
+  public long getQuotaUsed()
+  {
+    return _getQuotaUsed(luaState);
+  }
+
+  /**
+   * Stops the script the state is running with a LUA_ERRQUOTA error,
+   * "interrupted". Unlike the other methods, it may be called from any
+   * thread while the state is in use, but not concurrently with
+   * {@link #close}.
+   * <p>
+   * Interrupting is best effort: the script stops at its next quota check,
+   * which may come a check later than asked, and not before it is back in
+   * Lua code. Without a previous {@link #setQuota} only the main thread of
+   * the state and the coroutines resumed afterwards are checked.
+   */
+  public void interrupt()
+  {
+    CPtr ptr = luaState;
+    if (ptr != null)
+      _interrupt(ptr);
+  }
+
+  /**
+   * Starts sampling the Lua code run by the state, as
+   * <code>luajava.profile.start</code> does. With
+   * <code>LUA_PROFILETIME</code> a sample is taken every
+   * <code>interval</code> microseconds the state runs, time spent in calls
+   * into Java being sampled under <code>[java]</code> frames; with
+   * <code>LUA_PROFILECOUNT</code> every <code>interval</code> instructions.
+   * The last <code>size</code> samples are kept. 0 selects the defaults,
+   * one millisecond or ten thousand instructions, and 4096 samples.
+   */
+  public void startProfiler(int mode, int interval, int size) throws LuaException
+  {
+    if (_startProfiler(luaState, mode, interval, size) != 0)
+      throw new LuaException("Cannot start the profiler");
+  }
+
+  /**
+   * Stops the profiler, keeping its samples until it is started again.
+   */
+  public void stopProfiler()
+  {
+    _stopProfiler(luaState);
+  }
+
+  /**
+   * Returns the samples taken by the profiler as folded stacks: a line per
+   * distinct stack, with its frames from the outermost separated by
+   * <code>;</code> and its number of samples, as read by flame graph tools.
+   */
+  public String getProfile()
+  {
+    return _getProfile(luaState);
+  }
+
+  /**
+   * Starts sampling the objects created by the state with their allocation
+   * site, as <code>luajava.heap.start</code> does: about one object every
+   * <code>interval</code> bytes allocated, 0 for 32 KB. Samples of a
+   * previous run are discarded.
+   */
+  public void startHeapProfiler(int interval)
+  {
+    _startHeapProfiler(luaState, interval);
+  }
+
+  /**
+   * Stops sampling new objects. Those sampled are still counted while they
+   * are alive.
+   */
+  public void stopHeapProfiler()
+  {
+    _stopHeapProfiler(luaState);
+  }
+
+  /**
+   * Collects garbage and returns the live objects of the state by type,
+   * then the <code>top</code> allocation sites holding the most sampled
+   * objects, as <code>luajava.heap.report</code> does.
+   */
+  public String getHeapReport(int top)
+  {
+    return _getHeapReport(luaState, top);
+  }
+
+  /**
+   * Returns the JNI global references held by the state and by the process
+   * for Java objects, classes and functions pushed to Lua: live counts,
+   * high-water marks and live references by class, as
+   * <code>luajava.refstats 'report'</code> does. The Lua tracebacks creating
+   * the most references are listed once enabled with
+   * <code>luajava.refstats('traceback', n)</code>.
+   */
+  public String getRefStats()
+  {
+    return _getRefStats(luaState);
+  }
+
+  /**
+   * Starts timing the modules loaded by the state, as
+   * <code>luajava.startup.start</code> does: <code>require</code> calls
+   * with the search, parsing and execution of each module, nested as they
+   * are loaded. Spans of a previous run are discarded.
+   */
+  public void startStartupProfiler()
+  {
+    _startStartupProfiler(luaState);
+  }
+
+  /**
+   * Stops timing module loading; the spans recorded are kept.
+   */
+  public void stopStartupProfiler()
+  {
+    _stopStartupProfiler(luaState);
+  }
+
+  /**
+   * Returns the spans recorded by the startup profiler as an indented tree
+   * with total and self times in milliseconds, as
+   * <code>luajava.startup.report</code> does.
+   */
+  public String getStartupReport()
+  {
+    return _getStartupReport(luaState);
+  }
+
+  /**
+   * Opens a span of the given category, such as <code>"read"</code>, for
+   * the startup profiler and the tracers of the state. Does nothing when
+   * no tracer is installed.
+   */
+  public void traceBegin(String cat, String name)
+  {
+    _traceSpan(luaState, 0, cat, name);
+  }
+
+  /**
+   * Closes the span opened by <code>traceBegin</code> with the same
+   * category and name.
+   */
+  public void traceEnd(String cat, String name)
+  {
+    _traceSpan(luaState, 1, cat, name);
+  }
   
   public int next(int idx)
   {
@@ -880,6 +1097,57 @@ public class LuaState
    */
   private synchronized native boolean _isJavaFunction(CPtr L, int idx);
 
+  /**
+   * Counts the entries of the table at <code>idx</code> with a single
+   * native traversal.
+   */
+  private synchronized native int _tableSize(CPtr L, int idx);
+
+  /**
+   * Converts <code>count</code> consecutive array entries of the table at
+   * <code>idx</code>, starting at <code>first</code>, in one native call.
+   */
+  private synchronized native Object[] _rawGetRange(CPtr L, int idx, int first, int count)
+  	throws LuaException;
+
+  /**
+   * Chunked version of <code>lua_next</code>.
+   */
+  private synchronized native int _nextChunk(CPtr L, int idx, Object[] buffer)
+  	throws LuaException;
+
+  /**
+   * Advances the iterator cursor at <code>idx</code>, see {@link #iterChunk(int, Object[])}.
+   */
+  private synchronized native int _iterChunk(CPtr L, int idx, Object[] buffer)
+  	throws LuaException;
+
+  /**
+   * Converts the table at <code>idx</code> natively, see {@link #tableToJava(int, String)}.
+   */
+  private synchronized native Object _tableToJava(CPtr L, int idx, String type)
+  	throws LuaException;
+
+  /**
+   * Pushes a table built natively from a collection, map or array.
+   */
+  private synchronized native void _pushTable(CPtr L, Object obj) throws LuaException;
+
+  /**
+   * Serializes the value at <code>idx</code>, see {@link #serialize(int)}.
+   */
+  private synchronized native byte[] _serialize(CPtr L, int idx) throws LuaException;
+
+  /**
+   * Decodes serialized bytes and pushes the value.
+   */
+  private synchronized native void _deserialize(CPtr L, byte[] bytes) throws LuaException;
+
+  /**
+   * Spawns the function below <code>nargs</code> arguments on the scheduler.
+   */
+  private synchronized native CPtr _spawn(CPtr L, int nargs) throws LuaException;
+
   /**
    * Gets a Object from Lua
    * @param idx index of the lua stack
@@ -931,6 +1199,148 @@ public class LuaState
     return _isJavaFunction(luaState, idx);
   }
 
+  /**
+   * Returns the number of entries in the table at <code>idx</code>,
+   * including the ones outside of its array part.
+   * @param idx index of the lua stack
+   * @return int
+   */
+  public int tableSize(int idx)
+  {
+    return _tableSize(luaState, idx);
+  }
+
+  /**
+   * Returns the raw values <code>t[first] .. t[first + count - 1]</code> of
+   * the table <code>t</code> at <code>idx</code>, converted as by
+   * {@link #toJavaObject(int)}, using a single JNI crossing.
+   * @param idx index of the lua stack
+   * @param first first array index to fetch
+   * @param count number of elements to fetch
+   * @return Object[]
+   */
+  public Object[] rawGetRange(int idx, int first, int count) throws LuaException
+  {
+    return _rawGetRange(luaState, idx, first, count);
+  }
+
+  /**
+   * Fetches up to <code>buffer.length / 2</code> key/value pairs of the
+   * table at <code>idx</code>, starting after the key on the top of the
+   * stack, like <code>lua_next</code> does for a single pair. Keys are
+   * stored at even positions of the buffer, values at odd positions.<br>
+   * If the buffer was filled, the last key is left on the top of the stack
+   * so the traversal can be continued; otherwise the traversal is finished
+   * and the key has been popped.
+   * @param idx index of the table in the lua stack
+   * @param buffer array receiving the pairs
+   * @return number of pairs fetched
+   * @throws LuaException if the key is no longer in the table, as when it
+   *         was removed and the table rehashed since it was fetched
+   */
+  public int nextChunk(int idx, Object[] buffer) throws LuaException
+  {
+    return _nextChunk(luaState, idx, buffer);
+  }
+
+  /**
+   * Runs the Lua iterator described by the cursor table at <code>idx</code>
+   * until <code>buffer</code> is full or the iteration ends, converting each
+   * value as by {@link #toJavaObject(int)}. The cursor is
+   * <code>{f, s, control}</code> for a generic-for iterator (the first value
+   * returned by each call is stored), <code>{co}</code> for a coroutine (the
+   * first value of each yield is stored) or <code>{t, nil, i}</code> for the
+   * array part of a table. The cursor is updated in place.
+   * @param idx index of the cursor table in the lua stack
+   * @param buffer array receiving the values
+   * @return number of values stored, less than the buffer length at the end
+   * @throws LuaException if the iterator raises an error
+   */
+  public int iterChunk(int idx, Object[] buffer) throws LuaException
+  {
+    return _iterChunk(luaState, idx, buffer);
+  }
+
+  /**
+   * Converts the table at <code>idx</code> into a Java object with a single
+   * JNI crossing. This is the Java counterpart of <code>luajava.tojava</code>.
+   * <p>
+   * <code>type</code> is one of <code>"list"</code> (an <code>ArrayList</code>),
+   * <code>"map"</code> (a <code>HashMap</code>), <code>"object[]"</code>,
+   * <code>"double[]"</code>, <code>"int[]"</code> and <code>"string[]"</code>.
+   * The lists and arrays are built from the array part of the table. With
+   * <code>null</code> or <code>"default"</code> a sequence becomes a list and
+   * any other table a map. Nested tables are converted with the default rule;
+   * tables containing cycles cannot be converted.
+   * @param idx index of the table in the lua stack
+   * @param type conversion type, or <code>null</code>
+   * @return Object
+   * @throws LuaException if the table cannot be converted to <code>type</code>
+   */
+  public Object tableToJava(int idx, String type) throws LuaException
+  {
+    return _tableToJava(luaState, idx, type);
+  }
+
+  /**
+   * Pushes a new table with the contents of a <code>java.util.Collection</code>,
+   * a <code>java.util.Map</code> or an array, built with a single JNI crossing
+   * and preallocated to the right size. Nested collections, maps and arrays are
+   * converted to tables too; other values are pushed as by
+   * {@link #pushObjectValue(Object)}. Object graphs with cycles cannot be
+   * converted.
+   * @param obj collection, map or array to be pushed
+   * @throws LuaException if <code>obj</code> is not a collection, map or array
+   */
+  public void pushTable(Object obj) throws LuaException
+  {
+    _pushTable(luaState, obj);
+  }
+
+  /**
+   * Encodes the value at <code>idx</code> in the format of
+   * <code>luajava.serialize</code>. Nil, booleans, numbers, strings and
+   * graphs of tables (including shared references and cycles) are supported.
+   * The result can be pushed into any state with {@link #deserialize(byte[])}
+   * or decoded in Java with {@link LuaDeserializer}.
+   * @param idx index of the value in the lua stack
+   * @return byte[]
+   * @throws LuaException if the value contains functions, userdata or threads
+   */
+  public byte[] serialize(int idx) throws LuaException
+  {
+    return _serialize(luaState, idx);
+  }
+
+  /**
+   * Decodes a value produced by {@link #serialize(int)} or
+   * <code>luajava.serialize</code> and pushes it onto the stack.
+   * @param bytes serialized value
+   * @throws LuaException if the data is corrupt or of another format version
+   */
+  public void deserialize(byte[] bytes) throws LuaException
+  {
+    _deserialize(luaState, bytes);
+  }
+
+  /**
+   * Runs a function on the native work-stealing scheduler, in the manner of
+   * <code>luajava.spawn</code>. The function and its <code>nargs</code>
+   * arguments are popped from the stack, as with {@link #pcall(int, int, int)}.
+   * <p>
+   * The function must be a Lua function without upvalues, or a string with
+   * Lua source, and the arguments must be serializable (see
+   * {@link #serialize(int)}). It runs on a worker thread in a separate state
+   * that has the standard libraries but not the Java bridge.
+   * @param nargs number of arguments
+   * @return the task
+   * @throws LuaException if the function or arguments cannot be transferred
+   */
+  public LuaTask spawn(int nargs) throws LuaException
+  {
+    return new LuaTask(_spawn(luaState, nargs));
+  }
+
   /**
    * Pushes into the stack any object value.<br>
    * This function checks if the object could be pushed as a lua type, if not
@@ -63,6 +63,28 @@ public final class LuaStateFactory
 		return L;
 	}
 	
+	/**
+	 * Option of newLuaState(int): starts the startup profiler as soon as
+	 * the state is created, so that opening the libraries and loading the
+	 * first modules are timed. See LuaState.getStartupReport().
+	 */
+	public static final int PROFILE_STARTUP = 1;
+	
+	/**
+	 * Method that creates a new instance of LuaState with options
+	 * @param options PROFILE_STARTUP or 0
+	 * @return LuaState
+	 */
+	public synchronized static LuaState newLuaState(int options)
+	{
+		LuaState L = newLuaState();
+		
+		if ((options & PROFILE_STARTUP) != 0)
+			L.startStartupProfiler();
+		
+		return L;
+	}
+	
 	/**
 	 * Returns a existing instance of LuaState
 	 * @param index
@@ -0,0 +1,369 @@
+package org.keplerproject.luajava;
+
+import java.util.ArrayList;
+import java.util.IdentityHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * A fixed-size pool of pre-initialised LuaStates.
+ * <p>
+ * Each state is created with {@link LuaStateFactory#newLuaState()}, has its
+ * standard libraries opened, is passed to an optional {@link Initializer}
+ * (to register <code>print</code>, package loaders and so on) and then
+ * <code>require</code>s the configured modules. The global table and
+ * <code>package.loaded</code> are snapshotted at that point.
+ * <p>
+ * Worker threads {@link #acquire()} a state, use it exclusively and
+ * {@link #release(LuaState)} it. On release the stack is cleared, globals
+ * and loaded modules are restored to the snapshot (keys added during the
+ * lease are removed, replaced ones are put back) and an incremental garbage
+ * collection step is run. Changes made inside preloaded tables, e.g.
+ * <code>string.foo = 1</code>, are not undone.
+ * <p>
+ * Since every state is leased to one thread at a time, work spread over the
+ * pool runs concurrently instead of being serialised on a single state.
+ */
+public class LuaStatePool
+{
+	/**
+	 * Prepares a freshly created state before the snapshot is taken.
+	 */
+	public interface Initializer
+	{
+		public void initialize(LuaState L) throws LuaException;
+	}
+
+	/**
+	 * Kilobytes of incremental collection done when a state is released.
+	 */
+	public static final int DEFAULT_GC_STEP = 64;
+
+	/*
+	 * Milliseconds between checks of closed by threads waiting for a state,
+	 * so that close() wakes them up.
+	 */
+	private static final long CLOSE_CHECK = 100;
+
+	private static final String RESET_SOURCE =
+		"local G, loaded = _G, package.loaded\n" +
+		"local pairs, rawget, rawset = pairs, rawget, rawset\n" +
+		"local getmetatable, setmetatable = getmetatable, setmetatable\n" +
+		"local function snapshot(t)\n" +
+		"  local s = {}\n" +
+		"  for k, v in pairs(t) do s[k] = v end\n" +
+		"  return s\n" +
+		"end\n" +
+		"local function restore(t, s)\n" +
+		"  for k in pairs(t) do\n" +
+		"    if rawget(s, k) == nil then rawset(t, k, nil) end\n" +
+		"  end\n" +
+		"  for k, v in pairs(s) do\n" +
+		"    if rawget(t, k) ~= v then rawset(t, k, v) end\n" +
+		"  end\n" +
+		"end\n" +
+		"local sg, sl, mt = snapshot(G), snapshot(loaded), getmetatable(G)\n" +
+		"return function()\n" +
+		"  setmetatable(G, mt)\n" +
+		"  restore(G, sg)\n" +
+		"  restore(loaded, sl)\n" +
+		"end\n";
+
+	private final LinkedBlockingQueue<LuaState> idle;
+
+	private final Map<LuaState, Integer> resetRefs = new IdentityHashMap<LuaState, Integer>();
+
+	/* States on lease, as a set */
+	private final Map<LuaState, Boolean> leases = new IdentityHashMap<LuaState, Boolean>();
+
+	private final List<LuaState> states = new ArrayList<LuaState>();
+
+	private final Initializer init;
+
+	private final String[] modules;
+
+	private int gcStep = DEFAULT_GC_STEP;
+
+	private boolean closed = false;
+
+	/**
+	 * Creates a pool with one state per available processor.
+	 */
+	public LuaStatePool(Initializer init, String[] modules) throws LuaException
+	{
+		this(Runtime.getRuntime().availableProcessors(), init, modules);
+	}
+
+	/**
+	 * Creates and warms up <code>size</code> states.
+	 * @param size number of states in the pool
+	 * @param init called on every new state after <code>openLibs()</code>, may be null
+	 * @param modules names passed to <code>require</code> on every state, may be null
+	 */
+	public LuaStatePool(int size, Initializer init, String[] modules) throws LuaException
+	{
+		if (size < 1)
+			throw new IllegalArgumentException("Pool size must be positive");
+
+		this.init = init;
+		this.modules = modules;
+		idle = new LinkedBlockingQueue<LuaState>(size);
+		try
+		{
+			for (int i = 0; i < size; i++)
+			{
+				LuaState L = warmUp(init, modules);
+				idle.add(L);
+			}
+		}
+		catch (LuaException e)
+		{
+			close();
+			throw e;
+		}
+	}
+
+	private LuaState warmUp(Initializer init, String[] modules) throws LuaException
+	{
+		LuaState L = LuaStateFactory.newLuaState();
+		synchronized (this)
+		{
+			states.add(L);
+		}
+		try
+		{
+			prepare(L, init, modules);
+		}
+		catch (LuaException e)
+		{
+			discard(L);
+			throw e;
+		}
+		return L;
+	}
+
+	private void prepare(LuaState L, Initializer init, String[] modules) throws LuaException
+	{
+		L.openLibs();
+		if (init != null)
+			init.initialize(L);
+
+		if (modules != null)
+		{
+			for (int i = 0; i < modules.length; i++)
+			{
+				L.getGlobal("require");
+				L.pushString(modules[i]);
+				check(L, L.pcall(1, 0, 0), "Cannot load module " + modules[i]);
+			}
+		}
+
+		check(L, L.LloadString(RESET_SOURCE), "Cannot compile pool reset");
+		check(L, L.pcall(0, 1, 0), "Cannot snapshot state");
+		synchronized (this)
+		{
+			resetRefs.put(L, new Integer(L.Lref(LuaState.LUA_REGISTRYINDEX.intValue())));
+		}
+		L.setTop(0);
+		L.gc(LuaState.LUA_GCCOLLECT.intValue(), 0);
+	}
+
+	private static void check(LuaState L, int err, String what) throws LuaException
+	{
+		if (err != 0)
+		{
+			String msg = L.toString(-1);
+			L.setTop(0);
+			throw new LuaException(what + ": " + msg);
+		}
+	}
+
+	/**
+	 * Sets how many kilobytes are collected when a state is released.
+	 * Zero disables the collection step.
+	 */
+	public synchronized void setGcStep(int kbytes)
+	{
+		gcStep = kbytes;
+	}
+
+	/**
+	 * Returns the total number of states owned by the pool.
+	 */
+	public synchronized int size()
+	{
+		return states.size();
+	}
+
+	/**
+	 * Returns the number of states currently available for lease.
+	 */
+	public int available()
+	{
+		return idle.size();
+	}
+
+	/**
+	 * Leases a state, waiting until one is available.
+	 * @throws IllegalStateException when the pool is or gets closed
+	 */
+	public LuaState acquire() throws InterruptedException
+	{
+		LuaState L;
+		do
+		{
+			checkOpen();
+			L = idle.poll(CLOSE_CHECK, TimeUnit.MILLISECONDS);
+		}
+		while (L == null);
+		return leased(L);
+	}
+
+	/**
+	 * Leases a state, waiting at most the given time.
+	 * @return the state, or null if none became available
+	 * @throws IllegalStateException when the pool is or gets closed
+	 */
+	public LuaState tryAcquire(long timeout, TimeUnit unit) throws InterruptedException
+	{
+		long deadline = System.nanoTime() + unit.toNanos(timeout);
+		LuaState L;
+		do
+		{
+			checkOpen();
+			long left = deadline - System.nanoTime();
+			if (left <= 0)
+				return null;
+			L = idle.poll(Math.min(left, TimeUnit.MILLISECONDS.toNanos(CLOSE_CHECK)),
+					TimeUnit.NANOSECONDS);
+		}
+		while (L == null);
+		return leased(L);
+	}
+
+	/*
+	 * Hands out a state taken from the idle queue, unless close() ran
+	 * meanwhile.
+	 */
+	private LuaState leased(LuaState L)
+	{
+		boolean isClosed;
+		synchronized (this)
+		{
+			isClosed = closed;
+			if (!isClosed)
+				leases.put(L, Boolean.TRUE);
+		}
+		if (isClosed)
+		{
+			discard(L);
+			throw new IllegalStateException("Pool is closed");
+		}
+		return L;
+	}
+
+	/**
+	 * Returns a leased state to the pool, resetting it first. A state that
+	 * cannot be reset is closed and replaced with a new one, prepared as
+	 * the pool prepares its states; the pool only shrinks if that fails.
+	 * @throws IllegalArgumentException if the state does not belong to the pool
+	 * @throws IllegalStateException if the state is not on lease, as when it
+	 *         is released twice
+	 */
+	public void release(LuaState L)
+	{
+		Integer ref;
+		int step;
+		boolean isClosed;
+		synchronized (this)
+		{
+			ref = resetRefs.get(L);
+			if (ref == null)
+				throw new IllegalArgumentException("State does not belong to this pool");
+			if (leases.remove(L) == null)
+				throw new IllegalStateException("State is not on lease");
+			step = gcStep;
+			isClosed = closed;
+		}
+
+		if (isClosed)
+		{
+			discard(L);
+			return;
+		}
+		if (!reset(L, ref.intValue(), step))
+		{
+			discard(L);
+			try
+			{
+				L = warmUp(init, modules);
+			}
+			catch (LuaException e)
+			{
+				return;
+			}
+		}
+		idle.offer(L);
+		synchronized (this)
+		{
+			isClosed = closed;
+		}
+		if (isClosed)
+			close(); // closed after the check above: drain again
+	}
+
+	private boolean reset(LuaState L, int ref, int step)
+	{
+		synchronized (L)
+		{
+			if (L.isClosed())
+				return false;
+			L.setTop(0);
+			L.rawGetI(LuaState.LUA_REGISTRYINDEX.intValue(), ref);
+			if (L.pcall(0, 0, 0) != 0)
+			{
+				L.setTop(0);
+				return false;
+			}
+			if (step > 0)
+				L.gc(LuaState.LUA_GCSTEP.intValue(), step);
+			return true;
+		}
+	}
+
+	private void discard(LuaState L)
+	{
+		synchronized (this)
+		{
+			states.remove(L);
+			resetRefs.remove(L);
+			leases.remove(L);
+		}
+		if (!L.isClosed())
+			L.close();
+	}
+
+	private synchronized void checkOpen()
+	{
+		if (closed)
+			throw new IllegalStateException("Pool is closed");
+	}
+
+	/**
+	 * Closes the idle states. States still on lease are closed when they
+	 * are released; threads waiting in acquire() get an
+	 * IllegalStateException.
+	 */
+	public void close()
+	{
+		synchronized (this)
+		{
+			closed = true;
+		}
+		LuaState L;
+		while ((L = idle.poll()) != null)
+			discard(L);
+	}
+}
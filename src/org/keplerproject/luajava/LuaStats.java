@@ -0,0 +1,176 @@
+package org.keplerproject.luajava;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Counters and latency histograms of the crossings between Lua and Java:
+ * every native method of LuaState and LuaObject, and every call from Lua
+ * into Java (method lookups and calls, field access, <code>newInstance</code>,
+ * <code>bindClass</code>, proxies...). Calls of Java methods from Lua are
+ * also counted by method name.
+ * <p>
+ * Stats are off by default and then cost one test per crossing. They are
+ * global to the process, shared by all Lua states, and are also available
+ * from Lua as <code>luajava.stats()</code>.
+ * <pre>
+ * LuaStats.setEnabled(true);
+ * ...
+ * Log.i(TAG, LuaStats.report());
+ * </pre>
+ */
+public final class LuaStats
+{
+	/** Number of latency buckets of a histogram */
+	public static final int BUCKETS = 32;
+	/** Number of distinct Java method names counted, see luastats.h */
+	private static final int METHODS = 256;
+
+	static
+	{
+		System.loadLibrary("luajava");
+	}
+
+	/**
+	 * The counters of one entry point. Calls leaving by a Lua error are
+	 * counted in <code>count</code> but not timed, so the histogram may sum
+	 * to less than <code>count</code>.
+	 */
+	public static final class Entry
+	{
+		public final String name;
+		public final long count;
+		public final long totalNanos;
+		public final long maxNanos;
+		/** histogram[i] counts calls of 2^i to 2^(i+1) ns */
+		public final long[] histogram;
+
+		Entry(String name, long[] values)
+		{
+			this.name = name;
+			this.count = values[0];
+			this.totalNanos = values[1];
+			this.maxNanos = values[2];
+			this.histogram = new long[BUCKETS];
+			System.arraycopy(values, 3, histogram, 0, BUCKETS);
+		}
+
+		/**
+		 * Number of timed calls, the sum of the histogram
+		 */
+		public long getTimedCount()
+		{
+			long n = 0;
+			for (int i = 0; i < BUCKETS; i++)
+				n += histogram[i];
+			return n;
+		}
+
+		public double getMeanNanos()
+		{
+			long timed = getTimedCount();
+			return timed != 0 ? (double) totalNanos / timed : 0;
+		}
+
+		/**
+		 * Upper bound, in ns, of the bucket holding the <code>p</code>-th
+		 * percentile call.
+		 */
+		public long getPercentileNanos(double p)
+		{
+			double rank = getTimedCount() * p / 100;
+			long seen = 0;
+			for (int i = 0; i < BUCKETS; i++)
+			{
+				seen += histogram[i];
+				if (seen > 0 && seen >= rank)
+					return 1L << (i + 1);
+			}
+			return maxNanos;
+		}
+
+		public String toString()
+		{
+			return name + ": " + count + " calls, mean " + (long) getMeanNanos()
+				+ " ns, p99 " + getPercentileNanos(99) + " ns, max " + maxNanos + " ns";
+		}
+	}
+
+	private LuaStats()
+	{
+	}
+
+	private static native boolean _setEnabled(boolean on);
+	private static native boolean _isEnabled();
+	private static native void _reset();
+	private static native String _report();
+	private static native Object[] _calls();
+	private static native String[] _methods(long[] counts);
+
+	/**
+	 * Turns the collection of stats on or off. Stats already collected are
+	 * kept.
+	 *
+	 * @return whether stats were collected before
+	 */
+	public static boolean setEnabled(boolean on)
+	{
+		return _setEnabled(on);
+	}
+
+	public static boolean isEnabled()
+	{
+		return _isEnabled();
+	}
+
+	/**
+	 * Clears the stats collected so far.
+	 */
+	public static void reset()
+	{
+		_reset();
+	}
+
+	/**
+	 * The stats as a table for people to read.
+	 */
+	public static String report()
+	{
+		return _report();
+	}
+
+	/**
+	 * The counters of the entry points called since stats were first
+	 * enabled.
+	 */
+	public static List<Entry> getCalls()
+	{
+		Object[] calls = _calls();
+		if (calls == null)
+			return Collections.emptyList();
+
+		List<Entry> entries = new ArrayList<Entry>(calls.length / 2);
+		for (int i = 0; i + 1 < calls.length; i += 2)
+			entries.add(new Entry((String) calls[i], (long[]) calls[i + 1]));
+		return entries;
+	}
+
+	/**
+	 * The number of calls from Lua of each Java method, by method name.
+	 */
+	public static Map<String, Long> getMethodCounts()
+	{
+		long[] counts = new long[METHODS];
+		String[] names = _methods(counts);
+		Map<String, Long> methods = new LinkedHashMap<String, Long>();
+		if (names == null)
+			return methods;
+
+		for (int i = 0; i < names.length; i++)
+			methods.put(names[i], Long.valueOf(counts[i]));
+		return methods;
+	}
+}
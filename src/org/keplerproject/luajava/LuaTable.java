@@ -0,0 +1,342 @@
+package org.keplerproject.luajava;
+
+import java.util.AbstractMap;
+import java.util.AbstractSet;
+import java.util.ConcurrentModificationException;
+import java.util.Iterator;
+import java.util.Map;
+import java.util.NoSuchElementException;
+import java.util.Set;
+
+/**
+ * A <code>java.util.Map</code> view of a Lua table, obtained with
+ * {@link LuaObject#asMap()}.
+ * <p>
+ * The view does not copy the table. Every operation reads or writes the table
+ * through the registry reference held by the {@link LuaObject}, using raw
+ * access (metamethods are not called). Iteration fetches the entries in
+ * chunks, so walking a large table costs one JNI crossing per chunk instead of
+ * several per entry.
+ * <p>
+ * Keys and values are converted as by {@link LuaState#toJavaObject(int)}, so
+ * numbers are returned as <code>Double</code> and tables, functions and
+ * userdata as {@link LuaObject}. Lua tables cannot hold <code>nil</code>, so
+ * storing <code>null</code> removes the key.
+ */
+public class LuaTable extends AbstractMap<Object, Object>
+{
+	/**
+	 * Number of key/value pairs fetched per JNI crossing while iterating.
+	 */
+	private static final int CHUNK_SIZE = 128;
+
+	protected LuaObject table;
+
+	protected LuaState L;
+
+	protected LuaTable(LuaObject table)
+	{
+		this.table = table;
+		this.L = table.getLuaState();
+	}
+
+	/**
+	 * Returns the table backing this view.
+	 */
+	public LuaObject getLuaObject()
+	{
+		return table;
+	}
+
+	public int size()
+	{
+		synchronized (L)
+		{
+			table.push();
+			int n = L.tableSize(-1);
+			L.pop(1);
+			return n;
+		}
+	}
+
+	public boolean isEmpty()
+	{
+		synchronized (L)
+		{
+			int top = L.getTop();
+			table.push();
+			L.pushNil();
+			boolean empty = L.next(-2) == 0;
+			L.setTop(top);
+			return empty;
+		}
+	}
+
+	public boolean containsKey(Object key)
+	{
+		return get(key) != null;
+	}
+
+	public Object get(Object key)
+	{
+		if (key == null)
+			return null;
+
+		synchronized (L)
+		{
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				L.pushObjectValue(key);
+				L.rawGet(-2);
+				return L.toJavaObject(-1);
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	public Object put(Object key, Object value)
+	{
+		if (key == null)
+			throw new IllegalArgumentException("nil is not a valid table key.");
+
+		synchronized (L)
+		{
+			int top = L.getTop();
+			try
+			{
+				table.push();
+				L.pushObjectValue(key);
+				L.rawGet(-2);
+				Object old = L.toJavaObject(-1);
+				L.pop(1);
+
+				L.pushObjectValue(key);
+				L.pushObjectValue(value);
+				L.rawSet(-3);
+				return old;
+			}
+			catch (LuaException e)
+			{
+				throw new RuntimeException(e);
+			}
+			finally
+			{
+				L.setTop(top);
+			}
+		}
+	}
+
+	public Object remove(Object key)
+	{
+		if (key == null)
+			return null;
+		return put(key, null);
+	}
+
+	public void clear()
+	{
+		synchronized (L)
+		{
+			int top = L.getTop();
+			table.push();
+			L.pushNil();
+			// assigning nil to an existing field during a traversal is allowed
+			while (L.next(-2) != 0)
+			{
+				L.pop(1);
+				L.pushValue(-1);
+				L.pushNil();
+				L.rawSet(-4);
+			}
+			L.setTop(top);
+		}
+	}
+
+	public Set<Map.Entry<Object, Object>> entrySet()
+	{
+		return new AbstractSet<Map.Entry<Object, Object>>()
+		{
+			public Iterator<Map.Entry<Object, Object>> iterator()
+			{
+				return new EntryIterator();
+			}
+
+			public int size()
+			{
+				return LuaTable.this.size();
+			}
+
+			public void clear()
+			{
+				LuaTable.this.clear();
+			}
+		};
+	}
+
+	private class Entry implements Map.Entry<Object, Object>
+	{
+		private final Object key;
+
+		private Object value;
+
+		Entry(Object key, Object value)
+		{
+			this.key = key;
+			this.value = value;
+		}
+
+		public Object getKey()
+		{
+			return key;
+		}
+
+		public Object getValue()
+		{
+			return value;
+		}
+
+		public Object setValue(Object value)
+		{
+			Object old = put(key, value);
+			this.value = value;
+			return old;
+		}
+
+		public boolean equals(Object o)
+		{
+			if (!(o instanceof Map.Entry))
+				return false;
+			Map.Entry e = (Map.Entry) o;
+			return key.equals(e.getKey())
+					&& (value == null ? e.getValue() == null : value.equals(e.getValue()));
+		}
+
+		public int hashCode()
+		{
+			return key.hashCode() ^ (value == null ? 0 : value.hashCode());
+		}
+
+		public String toString()
+		{
+			return key + "=" + value;
+		}
+	}
+
+	/**
+	 * Iterates the table with a native cursor. The key to continue the
+	 * traversal from is kept in the registry between chunks; if the table
+	 * no longer holds it when the next chunk is fetched, the iterator throws
+	 * a <code>ConcurrentModificationException</code>.
+	 */
+	private class EntryIterator implements Iterator<Map.Entry<Object, Object>>
+	{
+		private final Object[] buffer = new Object[2 * CHUNK_SIZE];
+
+		private int count = 0;
+
+		private int pos = 0;
+
+		private Integer keyRef = null;
+
+		private boolean finished = false;
+
+		private Object lastKey = null;
+
+		public boolean hasNext()
+		{
+			if (pos < count)
+				return true;
+			if (finished)
+				return false;
+			fetch();
+			return pos < count;
+		}
+
+		public Map.Entry<Object, Object> next()
+		{
+			if (!hasNext())
+				throw new NoSuchElementException();
+			lastKey = buffer[2 * pos];
+			Entry e = new Entry(lastKey, buffer[2 * pos + 1]);
+			buffer[2 * pos] = null;
+			buffer[2 * pos + 1] = null;
+			pos++;
+			return e;
+		}
+
+		public void remove()
+		{
+			if (lastKey == null)
+				throw new IllegalStateException();
+			LuaTable.this.remove(lastKey);
+			lastKey = null;
+		}
+
+		private void fetch()
+		{
+			synchronized (L)
+			{
+				int top = L.getTop();
+				try
+				{
+					table.push();
+					if (keyRef == null)
+					{
+						L.pushNil();
+					}
+					else
+					{
+						L.rawGetI(LuaState.LUA_REGISTRYINDEX.intValue(), keyRef.intValue());
+						L.LunRef(LuaState.LUA_REGISTRYINDEX.intValue(), keyRef.intValue());
+						keyRef = null;
+					}
+
+					count = L.nextChunk(-2, buffer);
+					pos = 0;
+
+					if (2 * count == buffer.length)
+						keyRef = new Integer(L.Lref(LuaState.LUA_REGISTRYINDEX.intValue()));
+					else
+						finished = true;
+				}
+				catch (LuaException e)
+				{
+					finished = true;
+					ConcurrentModificationException cme =
+							new ConcurrentModificationException(e.getMessage());
+					cme.initCause(e);
+					throw cme;
+				}
+				finally
+				{
+					L.setTop(top);
+				}
+			}
+		}
+
+		protected void finalize()
+		{
+			try
+			{
+				synchronized (L)
+				{
+					if (keyRef != null && L.getCPtrPeer() != 0)
+						L.LunRef(LuaState.LUA_REGISTRYINDEX.intValue(), keyRef.intValue());
+				}
+			}
+			catch (Exception e)
+			{
+				System.err.println("Unable to release iterator key " + keyRef);
+			}
+		}
+	}
+}
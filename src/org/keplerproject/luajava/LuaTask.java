@@ -0,0 +1,140 @@
+package org.keplerproject.luajava;
+
+import java.util.Map;
+
+/**
+ * A task running on the native work-stealing scheduler, obtained with
+ * {@link LuaState#spawn(int)}. This is the Java side of the task objects
+ * returned by <code>luajava.spawn</code>.
+ * <p>
+ * Results are decoded with {@link LuaDeserializer}, so numbers come back as
+ * <code>Double</code> and tables as lists or maps.
+ */
+public class LuaTask
+{
+	/**
+	 * Values of {@link #await(long)}.
+	 */
+	public static final int PENDING = 0;
+	public static final int DONE = 1;
+	public static final int ERROR = 2;
+
+	private CPtr task;
+
+	protected LuaTask(CPtr task)
+	{
+		this.task = task;
+	}
+
+	// not synchronized: the wait would block the other methods; await()
+	// holds a reference of its own instead
+	private native int _await(CPtr task, long millis);
+	private synchronized native byte[] _result(CPtr task) throws LuaException;
+	private native void _retain(CPtr task);
+	private synchronized native void _release(CPtr task);
+
+	/**
+	 * Waits at most <code>millis</code> milliseconds for the task to finish.
+	 * Zero only polls; a negative value waits without limit.
+	 * @return {@link #PENDING}, {@link #DONE} or {@link #ERROR}
+	 */
+	public int await(long millis)
+	{
+		CPtr t = retain();
+		try
+		{
+			return _await(t, millis);
+		}
+		finally
+		{
+			_release(t);
+		}
+	}
+
+	/**
+	 * Tells whether the task has finished, successfully or not.
+	 */
+	public boolean isDone()
+	{
+		return await(0) != PENDING;
+	}
+
+	/**
+	 * Waits for the task and returns its results.
+	 * @return the values returned by the task function
+	 * @throws LuaException with the error message if the task failed
+	 * @throws InterruptedException if the calling thread is interrupted
+	 */
+	public Object[] join() throws LuaException, InterruptedException
+	{
+		while (await(100) == PENDING)
+		{
+			if (Thread.interrupted())
+				throw new InterruptedException();
+		}
+		return results();
+	}
+
+	/**
+	 * Returns the results of a finished task.
+	 * @throws LuaException with the error message if the task failed
+	 * @throws IllegalStateException if the task is still running
+	 */
+	public Object[] results() throws LuaException
+	{
+		CPtr t = retain();
+		byte[] data;
+		try
+		{
+			data = _result(t);
+		}
+		finally
+		{
+			_release(t);
+		}
+		if (data == null)
+			throw new IllegalStateException("Task has not finished");
+
+		/* results are packed as {r1, ..., rn, n = n} */
+		Map<?, ?> map = (Map<?, ?>) LuaDeserializer.decode(data);
+		int n = ((Number) map.get("n")).intValue();
+		Object[] values = new Object[n];
+		for (int i = 0; i < n; i++)
+			values[i] = map.get(new Double(i + 1));
+		return values;
+	}
+
+	/**
+	 * Releases the native task. Called automatically on finalization.
+	 */
+	public synchronized void release()
+	{
+		if (task != null)
+		{
+			_release(task);
+			task = null;
+		}
+	}
+
+	/*
+	 * Takes a reference to the native task, so that a release() while
+	 * waiting for it or reading its results does not free it.
+	 */
+	private synchronized CPtr retain()
+	{
+		checkReleased();
+		_retain(task);
+		return task;
+	}
+
+	private synchronized void checkReleased()
+	{
+		if (task == null)
+			throw new IllegalStateException("Task has been released");
+	}
+
+	protected void finalize()
+	{
+		release();
+	}
+}
@@ -0,0 +1,128 @@
+package org.keplerproject.luajava;
+
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+
+/**
+ * Timeline of script execution, garbage collection and crossings between
+ * Lua and Java, in the Chrome trace event format: calls of
+ * <code>pcall</code> and <code>doString</code> from Java, modules loaded by
+ * <code>require</code>, full collections and, if asked for, collector
+ * steps, lookups and calls of Java methods from Lua, and spans marked by
+ * scripts with <code>luajava.trace.begin/end</code> or by Java with
+ * {@link #begin} and {@link #end}. The trace opens in chrome://tracing or ui.perfetto.dev.
+ * <p>
+ * Tracing is off by default and then costs one test per traced point. It
+ * is global to the process, shared by all Lua states, and each thread
+ * keeps its newest 8192 events. Spans still open when the trace is output
+ * end at the last event of their thread.
+ * <pre>
+ * LuaTrace.start();
+ * ...
+ * LuaTrace.stop();
+ * LuaTrace.save("/sdcard/lua.json");
+ * </pre>
+ */
+public final class LuaTrace
+{
+	static
+	{
+		System.loadLibrary("luajava");
+	}
+
+	private LuaTrace()
+	{
+	}
+
+	private static native boolean _start(boolean gcSteps);
+	private static native boolean _stop();
+	private static native boolean _isEnabled();
+	private static native void _begin(String name);
+	private static native void _end(String name);
+	private static native String _json();
+
+	/**
+	 * Discards the events recorded so far and starts tracing, without the
+	 * collector steps.
+	 *
+	 * @return whether tracing was on before
+	 */
+	public static boolean start()
+	{
+		return _start(false);
+	}
+
+	/**
+	 * Discards the events recorded so far and starts tracing.
+	 *
+	 * @param gcSteps whether to trace each step of the incremental collector
+	 *                too, not only its full collections
+	 * @return whether tracing was on before
+	 */
+	public static boolean start(boolean gcSteps)
+	{
+		return _start(gcSteps);
+	}
+
+	/**
+	 * Stops tracing. The events recorded are kept until the next start.
+	 *
+	 * @return whether tracing was on before
+	 */
+	public static boolean stop()
+	{
+		return _stop();
+	}
+
+	public static boolean isEnabled()
+	{
+		return _isEnabled();
+	}
+
+	/**
+	 * Begins a span on the current thread.
+	 */
+	public static void begin(String name)
+	{
+		_begin(name);
+	}
+
+	/**
+	 * Ends the span of the current thread begun with that name, or the
+	 * innermost one if <code>name</code> is null.
+	 */
+	public static void end(String name)
+	{
+		_end(name);
+	}
+
+	/**
+	 * The events recorded since the last start, as Chrome trace event
+	 * JSON, or null if out of memory.
+	 */
+	public static String toJson()
+	{
+		return _json();
+	}
+
+	/**
+	 * Writes the events recorded since the last start to a file.
+	 */
+	public static void save(String path) throws IOException
+	{
+		String json = toJson();
+		if (json == null)
+			throw new IOException("not enough memory");
+
+		OutputStream out = new FileOutputStream(path);
+		try
+		{
+			out.write(json.getBytes("UTF-8"));
+		}
+		finally
+		{
+			out.close();
+		}
+	}
+}
@@ -0,0 +1,129 @@
+package sk.kottman.androlua;
+
+import java.util.concurrent.Callable;
+import java.util.concurrent.CancellationException;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Executor;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.FutureTask;
+import java.util.concurrent.ThreadFactory;
+
+import android.os.Handler;
+import android.os.Looper;
+
+/**
+ * A single thread owning a Lua state. Work is queued and run in order on
+ * that thread, so scripts never block the UI; only results (and calls
+ * explicitly requested with {@link #runOnUi}) go back through the Handler.
+ */
+public class LuaExecutor implements Executor {
+
+	/** Receives the outcome of a request on the Handler's thread. */
+	public interface Callback<T> {
+		void onResult(T result);
+
+		/** Called with a CancellationException for cancelled requests. */
+		void onError(Throwable error);
+	}
+
+	/**
+	 * A queued or running request. Cancelling a queued request drops it;
+	 * cancelling the running one interrupts the Lua thread, which scripts
+	 * observe at their next call into Java.
+	 */
+	public class Request<T> extends FutureTask<T> {
+		private final Callback<T> callback;
+
+		Request(Callable<T> task, Callback<T> callback) {
+			super(task);
+			this.callback = callback;
+		}
+
+		@Override
+		protected void done() {
+			if (callback == null)
+				return;
+			handler.post(new Runnable() {
+				public void run() {
+					try {
+						callback.onResult(get());
+					} catch (ExecutionException e) {
+						callback.onError(e.getCause() != null ? e.getCause() : e);
+					} catch (CancellationException e) {
+						callback.onError(e);
+					} catch (InterruptedException e) {
+						callback.onError(e);
+					}
+				}
+			});
+		}
+	}
+
+	private final Handler handler;
+	private final ExecutorService queue;
+	private volatile Thread thread;
+
+	public LuaExecutor(Handler handler) {
+		this.handler = handler;
+		this.queue = Executors.newSingleThreadExecutor(new ThreadFactory() {
+			public Thread newThread(Runnable r) {
+				thread = new Thread(r, "lua");
+				return thread;
+			}
+		});
+	}
+
+	/** Queues a task to run on the Lua thread. */
+	public void execute(Runnable command) {
+		queue.execute(command);
+	}
+
+	/**
+	 * Queues a task to run on the Lua thread; callback, if not null, gets
+	 * its outcome on the Handler's thread.
+	 */
+	public <T> Request<T> submit(Callable<T> task, Callback<T> callback) {
+		Request<T> request = new Request<T>(task, callback);
+		queue.execute(request);
+		return request;
+	}
+
+	/** Tells whether the caller is the Lua thread. */
+	public boolean isLuaThread() {
+		return Thread.currentThread() == thread;
+	}
+
+	/**
+	 * Runs a call on the UI thread and waits for its result. Meant for the
+	 * Lua thread, which keeps the state locked meanwhile: the call must not
+	 * use the Lua state.
+	 */
+	public <T> T runOnUi(Callable<T> call) throws Exception {
+		if (Looper.myLooper() == handler.getLooper())
+			return call.call();
+		Future<T> future = new FutureTask<T>(call);
+		handler.post((Runnable) future);
+		try {
+			return future.get();
+		} catch (ExecutionException e) {
+			Throwable cause = e.getCause();
+			if (cause instanceof Exception)
+				throw (Exception) cause;
+			throw e;
+		} finally {
+			future.cancel(false);
+		}
+	}
+
+	/**
+	 * Stops the Lua thread once the queued work is done, running
+	 * <code>last</code> (for example closing the state) on it first.
+	 */
+	public void shutdown(Runnable last) {
+		if (last != null)
+			queue.execute(last);
+		queue.shutdown();
+	}
+}
@@ -1,8 +1,12 @@
 package sk.kottman.androlua;
 
 import java.io.*;
+import java.lang.reflect.Method;
+import java.lang.reflect.Modifier;
 import java.net.ServerSocket;
 import java.net.Socket;
+import java.util.concurrent.Callable;
+import java.util.concurrent.CancellationException;
 
 import org.keplerproject.luajava.JavaFunction;
 import org.keplerproject.luajava.LuaException;
@@ -26,18 +30,25 @@ import android.widget.Toast;
 public class Main extends Activity implements OnClickListener,
 		OnLongClickListener {
 	private final static int LISTEN_PORT = 3333;
+	// time a remote chunk may run before it is stopped
+	private final static long REMOTE_TIMEOUT = 10000;
 
 	Button execute;
 	
 	// public so we can play with these from Lua
 	public EditText source;
 	public TextView status;
-	public LuaState L;
+	// set on the Lua thread, read by the UI thread to interrupt scripts
+	public volatile LuaState L;
 	
 	final StringBuilder output = new StringBuilder();
 
 	Handler handler;
 	ServerThread serverThread;
+
+	// owns L: everything touching the state runs on its thread
+	LuaExecutor executor;
+	LuaExecutor.Request<String> running;
 	
 	private static byte[] readAll(InputStream input) throws Exception {
 		ByteArrayOutputStream output = new ByteArrayOutputStream(4096);
@@ -66,8 +77,34 @@ public class Main extends Activity implements OnClickListener,
 		status.setMovementMethod(ScrollingMovementMethod.getInstance());
 
 		handler = new Handler();
+		executor = new LuaExecutor(handler);
+		executor.execute(new Runnable() {
+			public void run() {
+				initLua();
+			}
+		});
+	}
+
+	@Override
+	protected void onDestroy() {
+		super.onDestroy();
+		// a running script would otherwise keep the state open until it ends
+		if (running != null)
+			running.cancel(true);
+		LuaState state = L;
+		if (state != null)
+			state.interrupt();
+		executor.shutdown(new Runnable() {
+			public void run() {
+				// L is only set on this thread
+				if (L != null)
+					L.close();
+			}
+		});
+	}
 
-		L = LuaStateFactory.newLuaState();
+	private void initLua() {
+		L = LuaStateFactory.newLuaState(LuaStateFactory.PROFILE_STARTUP);
 		L.openLibs();
 
 		try {
@@ -77,6 +114,7 @@ public class Main extends Activity implements OnClickListener,
 			JavaFunction print = new JavaFunction(L) {
 				@Override
 				public int execute() throws LuaException {
+					checkCancelled();
 					for (int i = 2; i <= L.getTop(); i++) {
 						int type = L.type(i);
 						String stype = L.typeName(type);
@@ -101,6 +139,38 @@ public class Main extends Activity implements OnClickListener,
 			};
 			print.register("print");
 
+			// ui(object, method, ...) calls a Java method on the UI thread
+			JavaFunction ui = new JavaFunction(L) {
+				@Override
+				public int execute() throws LuaException {
+					checkCancelled();
+					final Object target = L.toJavaObject(2);
+					String name = L.toString(3);
+					if (target == null || name == null)
+						throw new LuaException("ui: expected an object and a method name");
+					final Object[] args = new Object[L.getTop() - 3];
+					final Method method = findMethod(target, name, args);
+					Object res;
+					try {
+						res = executor.runOnUi(new Callable<Object>() {
+							public Object call() throws Exception {
+								return method.invoke(
+									Modifier.isStatic(method.getModifiers()) ? null : target, args);
+							}
+						});
+					} catch (InterruptedException e) {
+						throw new LuaException("cancelled");
+					} catch (Exception e) {
+						throw new LuaException(e);
+					}
+					if (res == null)
+						return 0;
+					L.pushObjectValue(res);
+					return 1;
+				}
+			};
+			ui.register("ui");
+
 			JavaFunction assetLoader = new JavaFunction(L) {
 				@Override
 				public int execute() throws LuaException {
@@ -108,8 +178,14 @@ public class Main extends Activity implements OnClickListener,
 
 					AssetManager am = getAssets();
 					try {
-						InputStream is = am.open(name + ".lua");
-						byte[] bytes = readAll(is);
+						InputStream is = am.open(name.replace('.', '/') + ".lua");
+						L.traceBegin("read", name);
+						byte[] bytes;
+						try {
+							bytes = readAll(is);
+						} finally {
+							L.traceEnd("read", name);
+						}
 						L.LloadBuffer(bytes, name);
 						return 1;
 					} catch (Exception e) {
@@ -136,8 +212,64 @@ public class Main extends Activity implements OnClickListener,
 			L.setField(-2, "path");            // package
 			L.pop(1);
 		} catch (Exception e) {
-			status.setText("Cannot override print");
+			handler.post(new Runnable() {
+				public void run() {
+					status.setText("Cannot override print");
+				}
+			});
+		}
+	}
+
+	/** Ends the running script if its request was cancelled. */
+	private static void checkCancelled() throws LuaException {
+		if (Thread.interrupted())
+			throw new LuaException("cancelled");
+	}
+
+	/**
+	 * Finds the method of target (or of the class target) called name that
+	 * accepts the arguments of ui() and converts them into args.
+	 */
+	private Method findMethod(Object target, String name, Object[] args) throws LuaException {
+		Class<?> clazz = target instanceof Class ? (Class<?>) target : target.getClass();
+		for (Method m : clazz.getMethods()) {
+			Class<?>[] params = m.getParameterTypes();
+			if (!m.getName().equals(name) || params.length != args.length)
+				continue;
+			boolean ok = true;
+			for (int i = 0; ok && i < params.length; i++) {
+				args[i] = convert(L.toJavaObject(i + 4), params[i]);
+				ok = args[i] != NO_MATCH;
+			}
+			if (ok)
+				return m;
 		}
+		throw new LuaException("ui: no method " + name + " for the given arguments");
+	}
+
+	private static final Object NO_MATCH = new Object();
+
+	private static Object convert(Object value, Class<?> type) {
+		if (value == null)
+			return type.isPrimitive() ? NO_MATCH : null;
+		if (value instanceof Number) {
+			Number n = (Number) value;
+			if (type == Integer.TYPE || type == Integer.class)
+				return new Integer(n.intValue());
+			if (type == Long.TYPE || type == Long.class)
+				return new Long(n.longValue());
+			if (type == Float.TYPE || type == Float.class)
+				return new Float(n.floatValue());
+			if (type == Double.TYPE || type == Double.class)
+				return new Double(n.doubleValue());
+			if (type == Short.TYPE || type == Short.class)
+				return new Short(n.shortValue());
+			if (type == Byte.TYPE || type == Byte.class)
+				return new Byte(n.byteValue());
+		}
+		if (value instanceof Boolean && type == Boolean.TYPE)
+			return value;
+		return type.isInstance(value) ? value : NO_MATCH;
 	}
 
 	@Override
@@ -177,22 +309,47 @@ public class Main extends Activity implements OnClickListener,
 							FileWriter fw = new FileWriter(file);
 							fw.write(s);
 							fw.close();	
-							// package.loaded[mod] = nil
-							L.getGlobal("package");
-							L.getField(-1, "loaded");
-							L.pushNil();
-							L.setField(-2, mod);
+							final String loaded = mod;
+							executor.submit(new Callable<Void>() {
+								public Void call() {
+									// package.loaded[mod] = nil
+									L.getGlobal("package");
+									L.getField(-1, "loaded");
+									L.pushNil();
+									L.setField(-2, loaded);
+									L.pop(2);
+									return null;
+								}
+							}, null).get();
 							out.println("wrote " + file + "\n");
 							out.flush();
+						} else if (s.startsWith("--startup:")) {
+							String res = executor.submit(new Callable<String>() {
+								public String call() {
+									return L.getStartupReport();
+								}
+							}, null).get();
+							out.println(res.replace('\n', '\001'));
+							out.flush();
+						} else if (s.startsWith("--profile:")) {
+							final String command = s.substring(s.indexOf(':') + 1).trim();
+							String res = executor.submit(new Callable<String>() {
+								public String call() {
+									return profile(command);
+								}
+							}, null).get();
+							out.println(res.replace('\n', '\001'));
+							out.flush();
 						} else {
-							handler.post(new Runnable() {
-								public void run() {
-									String res = safeEvalLua(s);
-									res = res.replace('\n', '\001');
-									out.println(res);
-									out.flush();
+							// runs on the Lua thread; only this connection waits
+							String res = executor.submit(new Callable<String>() {
+								public String call() {
+									return safeEvalLua(s, REMOTE_TIMEOUT);
 								}
-							});
+							}, null).get();
+							res = res.replace('\n', '\001');
+							out.println(res);
+							out.flush();
 						}
 					}
 				}
@@ -211,18 +368,50 @@ public class Main extends Activity implements OnClickListener,
 		}
 	}	
 
-	String safeEvalLua(String src) {
+	/**
+	 * Handles the --profile: commands of the remote console:
+	 * "start [time|count] [interval]" starts the profiler, "stop" stops it
+	 * and returns the samples as folded stacks.
+	 */
+	String profile(String command) {
+		String[] args = command.split("\\s+");
+		if (args[0].equals("start")) {
+			int mode = LuaState.LUA_PROFILETIME.intValue();
+			int interval = 0;
+			if (args.length > 1 && args[1].equals("count"))
+				mode = LuaState.LUA_PROFILECOUNT.intValue();
+			try {
+				if (args.length > 2)
+					interval = Integer.parseInt(args[2]);
+				L.startProfiler(mode, interval, 0);
+			} catch (Exception e) {
+				return e.getMessage() + "\n";
+			}
+			return "profiling\n";
+		} else if (args[0].equals("stop")) {
+			L.stopProfiler();
+			return L.getProfile();
+		}
+		return "usage: --profile:start [time|count] [interval] | --profile:stop\n";
+	}
+
+	String safeEvalLua(String src, long timeout) {
 		String res = null;	
 		try {
-			res = evalLua(src);
+			res = evalLua(src, timeout);
 		} catch(LuaException e) {
 			res = e.getMessage()+"\n";
 		}
 		return res;		
 	}
 	
-	String evalLua(String src) throws LuaException {
+	/**
+	 * Runs a chunk, stopping it after timeout milliseconds (0 for none)
+	 * or when the state is interrupted.
+	 */
+	String evalLua(String src, long timeout) throws LuaException {
 		L.setTop(0);
+		L.setQuota(0, timeout, LuaState.LUA_QUOTAERROR.intValue());
 		int ok = L.LloadString(src);
 		if (ok == 0) {
 			L.getGlobal("debug");
@@ -242,16 +431,41 @@ public class Main extends Activity implements OnClickListener,
 	}
 
 	public void onClick(View view) {
-		String src = source.getText().toString();
-		status.setText("");
-		try {
-			String res = evalLua(src);
-			status.append(res);
-			status.append("Finished succesfully");
-		} catch(LuaException e) {			
-			Toast.makeText(this, e.getMessage(), Toast.LENGTH_LONG).show();			
+		if (running != null) {
+			running.cancel(true);
+			// stops scripts that never call into Java
+			LuaState state = L;
+			if (state != null)
+				state.interrupt();
+			return;
 		}
+		final String src = source.getText().toString();
+		status.setText("");
+		execute.setText("Cancel");
+		running = executor.submit(new Callable<String>() {
+			public String call() throws LuaException {
+				return evalLua(src, 0);
+			}
+		}, new LuaExecutor.Callback<String>() {
+			public void onResult(String res) {
+				finished();
+				status.append(res);
+				status.append("Finished succesfully");
+			}
+
+			public void onError(Throwable e) {
+				finished();
+				if (e instanceof CancellationException)
+					status.append("Cancelled");
+				else
+					Toast.makeText(Main.this, e.getMessage(), Toast.LENGTH_LONG).show();
+			}
+		});
+	}
 
+	private void finished() {
+		running = null;
+		execute.setText("Execute!");
 	}
 
 	private String errorReason(int error) {
@@ -264,6 +478,8 @@ public class Main extends Activity implements OnClickListener,
 			return "Runtime error";
 		case 1:
 			return "Yield error";
+		case 6:
+			return "Quota exceeded";
 		}
 		return "Unknown error " + error;
 	}
@@ -0,0 +1,173 @@
+package org.keplerproject.luajava.test;
+
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+
+/**
+ * Checks of <code>luajava.channel</code>, run on a desktop JVM against the
+ * host build of libluajava with <code>make test</code>. Blocking is checked
+ * between states on separate Java threads, which share named channels.
+ * Exits with status 1 when a check fails.
+ */
+public class LuaChannelTest
+{
+	private LuaState L;
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaChannelTest test = new LuaChannelTest();
+		test.L = newState();
+
+		test.capacity();
+		test.roundedCapacity();
+		test.invalidCapacity();
+		test.values();
+		test.blockingRecv();
+		test.blockingSend();
+
+		test.L.close();
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	/**
+	 * try_send fails once the channel holds as many messages as asked for,
+	 * and messages come out in the order they were sent.
+	 */
+	void capacity() throws Exception
+	{
+		run("ch = luajava.channel(4) "
+				+ "sent = {} for i = 1, 5 do sent[i] = ch:try_send(i) end");
+		check("sends within capacity", eval("return sent[1] and sent[2] and sent[3] and sent[4]"), Boolean.TRUE);
+		check("send beyond capacity", eval("return sent[5]"), Boolean.FALSE);
+		check("first out", eval("return select(2, ch:try_recv())"), new Double(1));
+		check("send after recv", eval("return ch:try_send(5)"), Boolean.TRUE);
+		check("order", eval("return ch:recv() .. ch:recv() .. ch:recv() .. ch:recv()"), "2345");
+		check("empty", eval("return ch:try_recv()"), Boolean.FALSE);
+	}
+
+	/**
+	 * The capacity is a minimum: it is rounded up to a power of two.
+	 */
+	void roundedCapacity() throws Exception
+	{
+		check("capacity 3 holds", eval("local ch, n = luajava.channel(3), 0 "
+				+ "while ch:try_send(n) do n = n + 1 end return n"), new Double(4));
+	}
+
+	void invalidCapacity() throws Exception
+	{
+		check("capacity 0 refused", L.LdoString("luajava.channel(0)") != 0, true);
+		L.setTop(0);
+	}
+
+	void values() throws Exception
+	{
+		run("ch = luajava.channel(2) ch:send({1, 'two', k = true}) "
+				+ "t = ch:recv()");
+		check("table sent", eval("return t[1] .. t[2] .. tostring(t.k)"), "1twotrue");
+		check("nested table refused", L.LdoString("ch:send({{}})") != 0, true);
+		L.setTop(0);
+	}
+
+	/**
+	 * recv on an empty channel waits until another state sends.
+	 */
+	void blockingRecv() throws Exception
+	{
+		Worker worker = new Worker("received = luajava.channel(2, 'test.recv'):recv()");
+		worker.start();
+		Thread.sleep(100);
+		check("recv blocked", worker.isAlive(), true);
+		run("luajava.channel(2, 'test.recv'):send(7)");
+		worker.join(2000);
+		check("recv woken", worker.isAlive(), false);
+		check("received", worker.global("received"), new Double(7));
+	}
+
+	/**
+	 * send on a full channel waits until another state receives.
+	 */
+	void blockingSend() throws Exception
+	{
+		Worker worker = new Worker("local ch = luajava.channel(2, 'test.send') "
+				+ "ch:send(1) ch:send(2) ch:send(3) sent = true");
+		worker.start();
+		Thread.sleep(100);
+		check("send blocked", worker.isAlive(), true);
+		check("first received", eval("return luajava.channel(2, 'test.send'):recv()"), new Double(1));
+		worker.join(2000);
+		check("send woken", worker.isAlive(), false);
+		check("sent", worker.global("sent"), Boolean.TRUE);
+		check("rest received", eval("local ch = luajava.channel(2, 'test.send') "
+				+ "return ch:recv() + ch:recv()"), new Double(5));
+	}
+
+	/**
+	 * Runs a chunk in a state of its own on another thread.
+	 */
+	private static class Worker extends Thread
+	{
+		private final LuaState L;
+		private final String chunk;
+
+		Worker(String chunk)
+		{
+			this.L = newState();
+			this.chunk = chunk;
+		}
+
+		public void run()
+		{
+			if (L.LdoString(chunk) != 0)
+				System.out.println("worker: " + L.toString(-1));
+		}
+
+		/**
+		 * Reads a global once the thread has ended, and closes the state.
+		 */
+		Object global(String name) throws LuaException
+		{
+			L.getGlobal(name);
+			Object value = L.toJavaObject(-1);
+			L.close();
+			return value;
+		}
+	}
+
+	private static LuaState newState()
+	{
+		LuaState L = LuaStateFactory.newLuaState();
+		L.openLibs();
+		return L;
+	}
+
+	private void run(String chunk) throws LuaException
+	{
+		if (L.LdoString(chunk) != 0)
+			throw new LuaException(L.toString(-1));
+	}
+
+	private Object eval(String chunk) throws LuaException
+	{
+		run(chunk);
+		Object value = L.toJavaObject(-1);
+		L.setTop(0);
+		return value;
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (expected == null ? actual != null : !expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}
@@ -0,0 +1,143 @@
+package org.keplerproject.luajava.test;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaIterator;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+
+/**
+ * Checks of {@link LuaIterator}, run on a desktop JVM against the host
+ * build of libluajava with <code>make test</code>. Exits with status 1
+ * when a check fails.
+ */
+public class LuaIteratorTest
+{
+	private LuaState L;
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaIteratorTest test = new LuaIteratorTest();
+
+		test.unknownSize();
+		test.tableSize();
+		test.coroutineYieldingNil();
+		test.coroutineYieldingNothing();
+		test.coroutineReturnValue();
+		test.coroutineReturningNothing();
+		test.coroutineAcrossChunks();
+
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	/**
+	 * Functions and coroutines have an unknown size, Long.MAX_VALUE as for
+	 * Spliterator.
+	 */
+	void unknownSize() throws Exception
+	{
+		check("unknown size of a function", iterator("string.gmatch('a b', '%a')").estimateSize(),
+				Long.MAX_VALUE);
+		LuaIterator it = iterator("coroutine.create(function() coroutine.yield(1) end)");
+		check("unknown size of a coroutine", it.estimateSize(), Long.MAX_VALUE);
+		it.next();
+		check("unknown size after next", it.estimateSize() > 0, true);
+	}
+
+	void tableSize() throws Exception
+	{
+		LuaIterator it = iterator("{ 'a', 'b', 'c' }");
+		check("size of a table", it.estimateSize(), 3L);
+		it.next();
+		check("size after next", it.estimateSize(), 2L);
+	}
+
+	/**
+	 * A nil yielded ends the iteration, as it does for iterator functions.
+	 */
+	void coroutineYieldingNil() throws Exception
+	{
+		check("yield nil", values("coroutine.create(function() "
+				+ "coroutine.yield(1) coroutine.yield(nil) coroutine.yield(3) end)"), list(1));
+	}
+
+	void coroutineYieldingNothing() throws Exception
+	{
+		check("yield nothing", values("coroutine.create(function() "
+				+ "coroutine.yield(1) coroutine.yield() coroutine.yield(3) end)"), list(1));
+	}
+
+	/**
+	 * The first value returned by the body is the last element.
+	 */
+	void coroutineReturnValue() throws Exception
+	{
+		check("return value", values("coroutine.create(function() "
+				+ "coroutine.yield(1) coroutine.yield(2) return 3, 4 end)"), list(1, 2, 3));
+	}
+
+	void coroutineReturningNothing() throws Exception
+	{
+		check("return nothing", values("coroutine.create(function() "
+				+ "coroutine.yield(1) end)"), list(1));
+	}
+
+	/**
+	 * The return value is kept when the yields fill whole chunks.
+	 */
+	void coroutineAcrossChunks() throws Exception
+	{
+		int n = 2 * LuaIterator.DEFAULT_CHUNK_SIZE;
+		List<Object> expected = new ArrayList<Object>();
+		for (int i = 1; i <= n + 1; i++)
+			expected.add(new Double(i));
+		check("across chunks", values("coroutine.create(function() "
+				+ "for i = 1, " + n + " do coroutine.yield(i) end return " + (n + 1) + " end)"),
+				expected);
+	}
+
+	private LuaIterator iterator(String expression) throws LuaException
+	{
+		if (L != null)
+			L.close();
+		L = LuaStateFactory.newLuaState();
+		L.openLibs();
+		if (L.LdoString("subject = " + expression) != 0)
+			throw new LuaException(L.toString(-1));
+		return L.getLuaObject("subject").asIterator();
+	}
+
+	private List<Object> values(String expression) throws LuaException
+	{
+		List<Object> values = new ArrayList<Object>();
+		LuaIterator it = iterator(expression);
+		while (it.hasNext())
+			values.add(it.next());
+		return values;
+	}
+
+	private static List<Object> list(int... values)
+	{
+		List<Object> list = new ArrayList<Object>();
+		for (int i = 0; i < values.length; i++)
+			list.add(new Double(values[i]));
+		return list;
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (!expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}
@@ -0,0 +1,164 @@
+package org.keplerproject.luajava.test;
+
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+import org.keplerproject.luajava.LuaTask;
+
+/**
+ * Checks of {@link LuaState#spawn(int)} and the tasks of the native
+ * scheduler, run on a desktop JVM against the host build of libluajava
+ * with <code>make test</code>. Exits with status 1 when a check fails.
+ */
+public class LuaSchedulerTest
+{
+	private LuaState L;
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaSchedulerTest test = new LuaSchedulerTest();
+		test.L = LuaStateFactory.newLuaState();
+		test.L.openLibs();
+
+		test.results();
+		test.nestedJoin();
+		test.nestedFanOut();
+		test.errorPropagation();
+		test.nestedErrorPropagation();
+		test.nestedErrorCaught();
+		test.released();
+
+		test.L.close();
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	void results() throws Exception
+	{
+		L.pushString("return ..., nil, 'x'");
+		L.pushNumber(1);
+		Object[] values = L.spawn(1).join();
+		check("number of results", values.length, 3);
+		check("number result", values[0], new Double(1));
+		check("nil result", values[1], null);
+		check("string result", values[2], "x");
+	}
+
+	/**
+	 * A task joining a task of its own runs other tasks while it waits,
+	 * rather than holding its worker.
+	 */
+	void nestedJoin() throws Exception
+	{
+		Object[] values = run("local t = luajava.spawn(function(x) return x * 2 end, 21) "
+				+ "return t:join()");
+		check("nested join", values[0], new Double(42));
+	}
+
+	void nestedFanOut() throws Exception
+	{
+		Object[] values = run("local ts = {} "
+				+ "for i = 1, 16 do "
+				+ "  ts[i] = luajava.spawn(function(i) "
+				+ "    return luajava.spawn(function(i) return i * i end, i):join() "
+				+ "  end, i) "
+				+ "end "
+				+ "local sum = 0 "
+				+ "for i = 1, 16 do sum = sum + ts[i]:join() end "
+				+ "return sum");
+		check("sum of nested joins", values[0], new Double(1496));
+	}
+
+	void errorPropagation() throws Exception
+	{
+		check("error message", error("error('boom')"), "task:1: boom");
+	}
+
+	/**
+	 * An error in a subtask is raised again by its join, and so fails the
+	 * outer task with the same message.
+	 */
+	void nestedErrorPropagation() throws Exception
+	{
+		check("nested error message",
+				error("return luajava.spawn(\"error('inner')\"):join()"), "task:1: inner");
+	}
+
+	void nestedErrorCaught() throws Exception
+	{
+		Object[] values = run("local ok, e = pcall(function() "
+				+ "  return luajava.spawn(\"error('inner')\"):join() "
+				+ "end) "
+				+ "return ok, e");
+		check("nested error caught", values[0], Boolean.FALSE);
+		check("caught message", values[1], "task:1: inner");
+	}
+
+	void released() throws Exception
+	{
+		L.pushString("return 1");
+		LuaTask task = L.spawn(0);
+		task.join();
+		task.release();
+		boolean thrown = false;
+		try
+		{
+			task.results();
+		}
+		catch (IllegalStateException e)
+		{
+			thrown = true;
+		}
+		check("results after release refused", thrown, true);
+	}
+
+	private Object[] run(String source) throws Exception
+	{
+		L.pushString(source);
+		LuaTask task = L.spawn(0);
+		try
+		{
+			return task.join();
+		}
+		finally
+		{
+			task.release();
+		}
+	}
+
+	/**
+	 * The message the task fails with, or null if it succeeds.
+	 */
+	private String error(String source) throws Exception
+	{
+		L.pushString(source);
+		LuaTask task = L.spawn(0);
+		try
+		{
+			task.join();
+			return null;
+		}
+		catch (LuaException e)
+		{
+			return e.getMessage();
+		}
+		finally
+		{
+			task.release();
+		}
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (expected == null ? actual != null : !expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}
@@ -0,0 +1,176 @@
+package org.keplerproject.luajava.test;
+
+import java.util.List;
+import java.util.Map;
+
+import org.keplerproject.luajava.LuaDeserializer;
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+
+/**
+ * Checks of {@link LuaState#serialize(int)}, {@link LuaState#deserialize(byte[])}
+ * and {@link LuaDeserializer}, run on a desktop JVM against the host build
+ * of libluajava with <code>make test</code>. Exits with status 1 when a
+ * check fails.
+ */
+public class LuaSerializerTest
+{
+	private LuaState L;
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaSerializerTest test = new LuaSerializerTest();
+		test.L = LuaStateFactory.newLuaState();
+		test.L.openLibs();
+
+		test.cycles();
+		test.numbers();
+		test.largeStrings();
+		test.refused();
+		test.truncated();
+
+		test.L.close();
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	/**
+	 * A table reaching itself, directly or through others, decodes to a
+	 * copy with the same shape, in Lua and in Java.
+	 */
+	void cycles() throws Exception
+	{
+		byte[] data = serialize("local t = {} t.self = t t[1] = t t.list = {t, {t}} return t");
+		L.deserialize(data);
+		L.setGlobal("u");
+		check("self reference", eval("return u.self == u and u[1] == u"), Boolean.TRUE);
+		check("cycle through tables", eval("return u.list[1] == u and u.list[2][1] == u"), Boolean.TRUE);
+
+		Map<?, ?> map = (Map<?, ?>) LuaDeserializer.decode(data);
+		List<?> list = (List<?>) map.get("list");
+		check("decoded self reference", map.get("self") == map, true);
+		check("decoded array reference", map.get(new Double(1)) == map, true);
+		check("decoded cycle through lists", list.get(0) == map && ((List<?>) list.get(1)).get(0) == map, true);
+	}
+
+	void numbers() throws Exception
+	{
+		byte[] data = serialize("return {0/0, 1/0, -1/0, 2^53, 0.1, -7}");
+		L.deserialize(data);
+		L.setGlobal("n");
+		check("NaN", eval("return n[1] ~= n[1]"), Boolean.TRUE);
+		check("infinities", eval("return n[2] == 1/0 and n[3] == -1/0"), Boolean.TRUE);
+		check("other numbers", eval("return n[4] == 2^53 and n[5] == 0.1 and n[6] == -7"), Boolean.TRUE);
+
+		List<?> list = (List<?>) LuaDeserializer.decode(data);
+		check("decoded NaN", ((Double) list.get(0)).isNaN(), true);
+		check("decoded infinity", list.get(1), new Double(Double.POSITIVE_INFINITY));
+		check("decoded negative infinity", list.get(2), new Double(Double.NEGATIVE_INFINITY));
+		check("decoded 2^53", list.get(3), new Double(9007199254740992.0));
+		check("decoded fraction", list.get(4), new Double(0.1));
+		check("decoded negative", list.get(5), new Double(-7));
+	}
+
+	/**
+	 * Strings of any bytes and length survive, and a repeated one is
+	 * stored once.
+	 */
+	void largeStrings() throws Exception
+	{
+		run("s = string.rep('\\0\\255abc', 300000)");
+		byte[] data = serialize("return {s, s, k = s}");
+		check("repeated string stored once", data.length < 1600000, true);
+		L.deserialize(data);
+		L.setGlobal("big");
+		check("binary string", eval("return #big[1] == #s and big[1] == s"), Boolean.TRUE);
+		check("repeated string", eval("return big[2] == s and big.k == s"), Boolean.TRUE);
+
+		run("s = string.rep('abc', 1000000)");
+		Object text = LuaDeserializer.decode(serialize("return s"));
+		check("decoded length", ((String) text).length(), 3000000);
+		check("decoded text", ((String) text).startsWith("abcabc") && ((String) text).endsWith("abc"), true);
+	}
+
+	void refused() throws Exception
+	{
+		run("return {print}");
+		boolean thrown = false;
+		try
+		{
+			L.serialize(-1);
+		}
+		catch (LuaException e)
+		{
+			thrown = true;
+		}
+		L.setTop(0);
+		check("function refused", thrown, true);
+	}
+
+	void truncated() throws Exception
+	{
+		byte[] data = serialize("return {1, 'two', {3}}");
+		byte[] shorter = new byte[data.length - 1];
+		System.arraycopy(data, 0, shorter, 0, shorter.length);
+
+		boolean thrown = false;
+		try
+		{
+			L.deserialize(shorter);
+		}
+		catch (LuaException e)
+		{
+			thrown = true;
+		}
+		L.setTop(0);
+		check("truncated data refused", thrown, true);
+
+		thrown = false;
+		try
+		{
+			LuaDeserializer.decode(shorter);
+		}
+		catch (LuaException e)
+		{
+			thrown = true;
+		}
+		check("truncated data refused in Java", thrown, true);
+	}
+
+	private void run(String chunk) throws LuaException
+	{
+		if (L.LdoString(chunk) != 0)
+			throw new LuaException(L.toString(-1));
+	}
+
+	private Object eval(String chunk) throws LuaException
+	{
+		run(chunk);
+		Object value = L.toJavaObject(-1);
+		L.setTop(0);
+		return value;
+	}
+
+	private byte[] serialize(String chunk) throws LuaException
+	{
+		run(chunk);
+		byte[] data = L.serialize(-1);
+		L.setTop(0);
+		return data;
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (expected == null ? actual != null : !expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}
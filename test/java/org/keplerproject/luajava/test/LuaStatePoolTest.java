@@ -0,0 +1,176 @@
+package org.keplerproject.luajava.test;
+
+import java.util.concurrent.TimeUnit;
+
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+import org.keplerproject.luajava.LuaStatePool;
+
+/**
+ * Checks of {@link LuaStatePool}, run on a desktop JVM against the host
+ * build of libluajava with <code>make test</code>. Exits with status 1
+ * when a check fails.
+ */
+public class LuaStatePoolTest
+{
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaStatePoolTest test = new LuaStatePoolTest();
+
+		test.leaseAndRelease();
+		test.resetOnRelease();
+		test.initializer();
+		test.doubleRelease();
+		test.foreignState();
+		test.closeWakesAcquirers();
+
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	void leaseAndRelease() throws Exception
+	{
+		LuaStatePool pool = new LuaStatePool(2, null, null);
+		LuaState a = pool.acquire();
+		LuaState b = pool.acquire();
+		check("distinct states", a != b, true);
+		check("none available", pool.available(), 0);
+		check("timed out", pool.tryAcquire(50, TimeUnit.MILLISECONDS), null);
+		pool.release(a);
+		check("one available", pool.available(), 1);
+		check("same state leased again", pool.acquire() == a, true);
+		pool.close();
+	}
+
+	/**
+	 * Globals added or replaced during a lease are restored to the
+	 * snapshot, and the stack is cleared.
+	 */
+	void resetOnRelease() throws Exception
+	{
+		LuaStatePool pool = new LuaStatePool(1, null, null);
+		LuaState L = pool.acquire();
+		L.LdoString("added = 1 print = nil");
+		L.pushNumber(3);
+		pool.release(L);
+
+		L = pool.acquire();
+		check("stack cleared", L.getTop(), 0);
+		L.getGlobal("added");
+		check("added global removed", L.isNil(-1), true);
+		L.pop(1);
+		L.getGlobal("print");
+		check("replaced global restored", L.isNil(-1), false);
+		L.pop(1);
+		pool.release(L);
+		pool.close();
+	}
+
+	void initializer() throws Exception
+	{
+		LuaStatePool pool = new LuaStatePool(1, new LuaStatePool.Initializer()
+		{
+			public void initialize(LuaState L) throws LuaException
+			{
+				L.LdoString("answer = 42");
+			}
+		}, null);
+		LuaState L = pool.acquire();
+		L.getGlobal("answer");
+		check("initialized", L.toInteger(-1), 42);
+		L.pop(1);
+		pool.release(L);
+		pool.close();
+	}
+
+	/**
+	 * A state released twice would be handed to two threads at once.
+	 */
+	void doubleRelease() throws Exception
+	{
+		LuaStatePool pool = new LuaStatePool(2, null, null);
+		LuaState L = pool.acquire();
+		pool.release(L);
+		boolean thrown = false;
+		try
+		{
+			pool.release(L);
+		}
+		catch (IllegalStateException e)
+		{
+			thrown = true;
+		}
+		check("double release refused", thrown, true);
+		check("available after double release", pool.available(), 2);
+
+		LuaState a = pool.acquire();
+		LuaState b = pool.acquire();
+		check("distinct states after double release", a != b, true);
+		pool.close();
+	}
+
+	void foreignState() throws Exception
+	{
+		LuaStatePool pool = new LuaStatePool(1, null, null);
+		LuaState other = LuaStateFactory.newLuaState();
+		boolean thrown = false;
+		try
+		{
+			pool.release(other);
+		}
+		catch (IllegalArgumentException e)
+		{
+			thrown = true;
+		}
+		check("foreign state refused", thrown, true);
+		other.close();
+		pool.close();
+	}
+
+	void closeWakesAcquirers() throws Exception
+	{
+		final LuaStatePool pool = new LuaStatePool(1, null, null);
+		final boolean[] woken = new boolean[1];
+		LuaState L = pool.acquire();
+		Thread waiter = new Thread()
+		{
+			public void run()
+			{
+				try
+				{
+					pool.acquire();
+				}
+				catch (IllegalStateException e)
+				{
+					woken[0] = true;
+				}
+				catch (InterruptedException e)
+				{
+				}
+			}
+		};
+		waiter.start();
+		Thread.sleep(50);
+		pool.close();
+		waiter.join(2000);
+		check("acquirer woken by close", woken[0], true);
+		pool.release(L);
+		check("leased state closed on release", L.isClosed(), true);
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (expected == null ? actual != null : !expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}
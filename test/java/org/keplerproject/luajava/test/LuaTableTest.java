@@ -0,0 +1,102 @@
+package org.keplerproject.luajava.test;
+
+import java.util.ConcurrentModificationException;
+import java.util.Iterator;
+import java.util.Map;
+
+import org.keplerproject.luajava.LuaException;
+import org.keplerproject.luajava.LuaState;
+import org.keplerproject.luajava.LuaStateFactory;
+import org.keplerproject.luajava.LuaTable;
+
+/**
+ * Checks of {@link LuaTable}, run on a desktop JVM against the host build
+ * of libluajava with <code>make test</code>. Exits with status 1 when a
+ * check fails.
+ */
+public class LuaTableTest
+{
+	private LuaState L;
+	private int failures = 0;
+
+	public static void main(String[] args) throws Exception
+	{
+		LuaTableTest test = new LuaTableTest();
+
+		test.iterateAcrossChunks();
+		test.rehashedDuringIteration();
+
+		if (test.failures > 0)
+		{
+			System.out.println(test.failures + " failed");
+			System.exit(1);
+		}
+		System.out.println("ok");
+	}
+
+	void iterateAcrossChunks() throws Exception
+	{
+		LuaTable t = table(1000);
+		int n = 0;
+		double sum = 0;
+		for (Map.Entry<Object, Object> e : t.entrySet())
+		{
+			n++;
+			sum += ((Double) e.getValue()).doubleValue();
+		}
+		check("entries", n, 1000);
+		check("sum of values", sum, 500500.0);
+	}
+
+	/**
+	 * Removing the key a chunk ends at and then growing the table drops the
+	 * key from it, which fails the next chunk without ending the process.
+	 */
+	void rehashedDuringIteration() throws Exception
+	{
+		LuaTable t = table(200);
+		Iterator<Map.Entry<Object, Object>> it = t.entrySet().iterator();
+		int n = 0;
+		while (n < 128 && it.hasNext())
+		{
+			it.next();
+			n++;
+		}
+		it.remove();
+		for (int i = 0; i < 1000; i++)
+			t.put("new" + i, new Double(i));
+
+		boolean thrown = false;
+		try
+		{
+			while (it.hasNext())
+				it.next();
+		}
+		catch (ConcurrentModificationException e)
+		{
+			thrown = true;
+		}
+		check("concurrent modification", thrown, true);
+		check("state usable afterwards", t.size(), 1199);
+	}
+
+	private LuaTable table(int n) throws LuaException
+	{
+		if (L != null)
+			L.close();
+		L = LuaStateFactory.newLuaState();
+		L.openLibs();
+		if (L.LdoString("subject = {} for i = 1, " + n + " do subject['k' .. i] = i end") != 0)
+			throw new LuaException(L.toString(-1));
+		return L.getLuaObject("subject").asMap();
+	}
+
+	private void check(String name, Object actual, Object expected)
+	{
+		if (!expected.equals(actual))
+		{
+			System.out.println("FAIL " + name + ": expected " + expected + ", got " + actual);
+			failures++;
+		}
+	}
+}